@@ -0,0 +1,463 @@
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "WindowContext.h"
+#include "DemoScene.h"
+#include "exameScene.h"
+#include "StressScene.h"
+#include "RecordingRenderer.h"
+#include "FramePipeline.h"
+#include "EntityComponentSysetm.h"
+#include "ForwardPlusRenderer.h"
+#include "CameraPath.h"
+
+// RenderingProjectBenchmark: renders a scene along a camera path with a fixed simulated clock, so two
+// runs draw the same frames, and writes the frame time statistics to JSON.
+//
+//   --scene exame|demo|stress   scene to load (exame)
+//   --stress SPEC               StressScene of the given size, e.g. entities=2000,groups=8,points=16 (implies --scene stress)
+//   --stress-config FILE        the same spec, one key=value per line
+//   --forward-plus / --deferred renderer (deferred)
+//   --recording                 no GL at all: RecordingRenderer, CPU time of the stress scene only
+//   --hash                      with --recording, hash of the recorded frames to compare two runs
+//   --pipelined N               scene on a simulation thread, N frames in flight (0: serial)
+//   --headless                  surfaceless context, needs the HEADLESS build
+//   --resolution WxH            size of the frame (1600x1000)
+//   --warmup N / --frames N     frames not measured, then measured (100 / 1000)
+//   --time-step S               simulated seconds per frame (1/60)
+//   --camera-path FILE          recorded path (see --record-camera of RenderingProject), otherwise an orbit
+//   --orbit R,H,T               radius, height and period in seconds of the scripted orbit (30,10,20)
+//   --gpu-profile FILE          GPU time of every pass over the measured frames (.json, otherwise csv)
+//   --cpu-profile FILE          Chrome trace of the CPU zones of the measured frames
+//   --output FILE               results (benchmark.json)
+
+namespace
+{
+    struct Summary
+    {
+        double mean{ 0.0 };
+        double p50{ 0.0 };
+        double p95{ 0.0 };
+        double p99{ 0.0 };
+        double min{ 0.0 };
+        double max{ 0.0 };
+    };
+
+    Summary Summarize(std::vector<double> samples)
+    {
+        Summary summary;
+        if (samples.empty())
+            return summary;
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double sample : samples)
+            sum += sample;
+        auto percentile = [&samples](double p) {
+            return samples[static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5)];
+        };
+        summary.mean = sum / static_cast<double>(samples.size());
+        summary.p50 = percentile(0.50);
+        summary.p95 = percentile(0.95);
+        summary.p99 = percentile(0.99);
+        summary.min = samples.front();
+        summary.max = samples.back();
+        return summary;
+    }
+
+    void WriteSummary(std::ostream& out, const char* name, const Summary& summary, bool last = false)
+    {
+        out << "    \"" << name << "\": { \"mean\": " << summary.mean << ", \"p50\": " << summary.p50
+            << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99
+            << ", \"min\": " << summary.min << ", \"max\": " << summary.max << " }" << (last ? "\n" : ",\n");
+    }
+
+    // GPU time and primitives of a frame, read back FRAMES_IN_FLIGHT frames later
+    class FrameQueries
+    {
+    public:
+        static constexpr size_t FRAMES_IN_FLIGHT = 4;
+
+        FrameQueries()
+        {
+            for (Slot& slot : m_Slots)
+                glGenQueries(3, slot.queries.data());
+        }
+        ~FrameQueries()
+        {
+            for (Slot& slot : m_Slots)
+                glDeleteQueries(3, slot.queries.data());
+        }
+        FrameQueries(const FrameQueries&) = delete;
+        FrameQueries& operator=(const FrameQueries&) = delete;
+
+        // sample < 0 for the frames that are not measured
+        void Begin(long sample)
+        {
+            Slot& slot = m_Slots[m_Next];
+            if (slot.sample >= 0)
+                read(slot);
+            slot.sample = sample;
+            glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+            glBeginQuery(GL_PRIMITIVES_GENERATED, slot.queries[2]);
+        }
+
+        void End()
+        {
+            Slot& slot = m_Slots[m_Next];
+            glEndQuery(GL_PRIMITIVES_GENERATED);
+            glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+            m_Next = (m_Next + 1) % FRAMES_IN_FLIGHT;
+        }
+
+        void Flush()
+        {
+            for (Slot& slot : m_Slots)
+            {
+                if (slot.sample >= 0)
+                    read(slot);
+            }
+        }
+
+        std::vector<double> gpuMs;
+        std::vector<double> triangles;
+
+    private:
+        struct Slot
+        {
+            std::array<GLuint, 3> queries{};
+            long sample{ -1 };
+        };
+
+        void read(Slot& slot)
+        {
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            GLuint64 primitives = 0;
+            glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+            glGetQueryObjectui64v(slot.queries[2], GL_QUERY_RESULT, &primitives);
+            const size_t index = static_cast<size_t>(slot.sample);
+            if (gpuMs.size() <= index)
+            {
+                gpuMs.resize(index + 1, 0.0);
+                triangles.resize(index + 1, 0.0);
+            }
+            gpuMs[index] = static_cast<double>(end - begin) / 1.0e6;
+            triangles[index] = static_cast<double>(primitives);
+            slot.sample = -1;
+        }
+
+        std::array<Slot, FRAMES_IN_FLIGHT> m_Slots;
+        size_t m_Next{ 0 };
+    };
+}
+
+int main(int argc, char** argv)
+{
+    int width{ 1600 };
+    int height{ 1000 };
+    std::string sceneName{ "exame" };
+    bool forwardPlus{ false };
+    ContextMode mode{ ContextMode::Window };
+    long warmupFrames{ 100 };
+    long measuredFrames{ 1000 };
+    double timeStep{ 1.0 / 60.0 };
+    std::string cameraPathFile;
+    float orbitRadius{ 30.0f };
+    float orbitHeight{ 10.0f };
+    float orbitPeriod{ 20.0f };
+    std::string outputPath{ "benchmark.json" };
+    StressSceneSpec stressSpec;
+    std::string gpuProfilePath;
+    std::string cpuProfilePath;
+    bool recording{ false };
+    bool hashing{ false };
+    int framesInFlight{ 0 };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--scene") == 0 && hasValue)
+            sceneName = argv[++i];
+        else if (std::strcmp(argv[i], "--forward-plus") == 0)
+            forwardPlus = true;
+        else if (std::strcmp(argv[i], "--deferred") == 0)
+            forwardPlus = false;
+        else if (std::strcmp(argv[i], "--recording") == 0)
+            recording = true;
+        else if (std::strcmp(argv[i], "--hash") == 0)
+            hashing = true;
+        else if (std::strcmp(argv[i], "--pipelined") == 0 && hasValue)
+            framesInFlight = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            mode = ContextMode::Headless;
+        else if (std::strcmp(argv[i], "--resolution") == 0 && hasValue)
+            std::sscanf(argv[++i], "%dx%d", &width, &height);
+        else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue)
+            warmupFrames = std::max(0L, std::strtol(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--frames") == 0 && hasValue)
+            measuredFrames = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--time-step") == 0 && hasValue)
+            timeStep = std::strtod(argv[++i], nullptr);
+        else if (std::strcmp(argv[i], "--camera-path") == 0 && hasValue)
+            cameraPathFile = argv[++i];
+        else if (std::strcmp(argv[i], "--orbit") == 0 && hasValue)
+            std::sscanf(argv[++i], "%f,%f,%f", &orbitRadius, &orbitHeight, &orbitPeriod);
+        else if (std::strcmp(argv[i], "--stress") == 0 && hasValue)
+        {
+            sceneName = "stress";
+            if (!stressSpec.Parse(argv[++i]))
+                return 1;
+        }
+        else if (std::strcmp(argv[i], "--stress-config") == 0 && hasValue)
+        {
+            sceneName = "stress";
+            if (!stressSpec.Load(argv[++i]))
+            {
+                std::cout << "Can not read the stress spec " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--gpu-profile") == 0 && hasValue)
+            gpuProfilePath = argv[++i];
+        else if (std::strcmp(argv[i], "--cpu-profile") == 0 && hasValue)
+            cpuProfilePath = argv[++i];
+        else if (std::strcmp(argv[i], "--output") == 0 && hasValue)
+            outputPath = argv[++i];
+        else
+        {
+            std::cout << "Unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (sceneName != "exame" && sceneName != "demo" && sceneName != "stress")
+    {
+        std::cout << "Unknown scene " << sceneName << ", use exame, demo or stress" << std::endl;
+        return 1;
+    }
+    // the other scenes load their meshes and textures on the GPU
+    if (recording && sceneName != "stress")
+    {
+        std::cout << "--recording needs --scene stress" << std::endl;
+        return 1;
+    }
+
+    CameraPath path;
+    if (!cameraPathFile.empty())
+    {
+        if (!path.Load(cameraPathFile))
+        {
+            std::cout << "Can not read the camera path " << cameraPathFile << std::endl;
+            return 1;
+        }
+    }
+    else
+        path = CameraPath::Orbit(glm::vec3(0.0f), orbitRadius, orbitHeight, orbitPeriod);
+
+    std::vector<double> cpuMs;
+    std::vector<double> frameMs;
+    std::vector<double> drawCalls;
+    cpuMs.reserve(measuredFrames);
+    frameMs.reserve(measuredFrames);
+    drawCalls.reserve(measuredFrames);
+    std::vector<double> gpuMs;
+    std::vector<double> triangles;
+    std::string glRenderer{ "none" };
+    uint64_t runHash{ 0 };
+    FramePipeline::Stats pipelineStats;
+
+    if (recording)
+    {
+        // no context: RecordingRenderer records the scene, only the CPU side of the frame is measured
+        auto renderer = std::make_unique<RecordingRenderer>(static_cast<float>(timeStep));
+        RecordingRenderer& recorder = *renderer;
+        recorder.setHashing(hashing);
+        StressScene scene(std::move(renderer), stressSpec);
+        scene.initialize();
+
+        Camera camera;
+        const glm::mat4 projection = Camera::GetProjectionMatrix(static_cast<float>(width) / static_cast<float>(height));
+        using Clock = std::chrono::steady_clock;
+        const long totalFrames = warmupFrames + measuredFrames;
+        runHash = 14695981039346656037ull;
+        for (long frame = 0; frame < totalFrames; ++frame)
+        {
+            const long sample = frame - warmupFrames;
+            if (sample == 0)
+                CpuProfiler::Get().Clear();
+            path.Apply(recorder.getTime(), camera);
+            recorder.setViewProjection(projection * camera.GetViewMatrix());
+
+            const Clock::time_point frameStart = Clock::now();
+            scene.render();
+            const Clock::time_point frameEnd = Clock::now();
+
+            if (sample < 0)
+                continue;
+            const RecordingRenderer::FrameStats& stats = recorder.getFrameStats();
+            // FNV-1a of the hashes of the measured frames
+            for (int byte = 0; byte < 8; ++byte)
+                runHash = (runHash ^ ((stats.hash >> (8 * byte)) & 0xFF)) * 1099511628211ull;
+            const double ms = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+            cpuMs.push_back(ms);
+            frameMs.push_back(ms);
+            drawCalls.push_back(static_cast<double>(stats.visibleCommands + stats.instancedCommands));
+            triangles.push_back(static_cast<double>(stats.triangles));
+        }
+        if (!cpuProfilePath.empty())
+            CpuProfiler::Get().DumpChromeTrace(cpuProfilePath);
+    }
+    else
+    {
+        WindowContext context{ width, height, "RenderingProjectBenchmark", mode };
+        // the animations read the time of the context: with a fixed step every run draws the same frames
+        context.setFixedTimeStep(timeStep);
+        glRenderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+        {
+            std::unique_ptr<IRenderer> renderer;
+            if (forwardPlus)
+                renderer = std::make_unique<ForwardPlusRenderer>(context);
+            else
+                renderer = std::make_unique<DeferredRenderer>(context);
+            std::unique_ptr<FramePipeline> pipeline;
+            if (framesInFlight > 0)
+            {
+                pipeline = std::make_unique<FramePipeline>(std::move(renderer), framesInFlight);
+                renderer = pipeline->createSceneRenderer();
+            }
+
+            std::unique_ptr<Scene> scene;
+            if (sceneName == "demo")
+                scene = std::make_unique<MyDemoScene>(std::move(renderer));
+            else if (sceneName == "stress")
+                scene = std::make_unique<StressScene>(std::move(renderer), stressSpec);
+            else
+                scene = std::make_unique<ExameScene>(std::move(renderer));
+            scene->initialize();
+            if (pipeline)
+                pipeline->start(*scene);
+
+            FrameQueries queries;
+            using Clock = std::chrono::steady_clock;
+            const long totalFrames = warmupFrames + measuredFrames;
+            for (long frame = 0; frame < totalFrames && !context.shouldClose(); ++frame)
+            {
+                const long sample = frame - warmupFrames;
+                // the profiles only keep the measured frames
+                if (sample == 0)
+                {
+                    GpuProfiler::Get().Reset();
+                    CpuProfiler::Get().Clear();
+                }
+                path.Apply(context.getTotalTime(), context.getCamera());
+
+                const Clock::time_point frameStart = Clock::now();
+                queries.Begin(sample);
+
+                glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                GLState::Enable(GL_DEPTH_TEST);
+                if (pipeline)
+                    pipeline->renderFrame();
+                else
+                    scene->render();
+
+                queries.End();
+                const Clock::time_point cpuEnd = Clock::now();
+                context.swapBuffersAndPollEvents();
+                const Clock::time_point frameEnd = Clock::now();
+
+                if (sample < 0)
+                    continue;
+                cpuMs.push_back(std::chrono::duration<double, std::milli>(cpuEnd - frameStart).count());
+                frameMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+                drawCalls.push_back(static_cast<double>(GLState::GetFrameStats().drawCalls));
+            }
+            queries.Flush();
+            if (pipeline)
+            {
+                pipeline->stop();
+                pipelineStats = pipeline->getStats();
+            }
+            if (!gpuProfilePath.empty())
+            {
+                if (gpuProfilePath.ends_with(".json"))
+                    GpuProfiler::Get().ExportJSON(gpuProfilePath);
+                else
+                    GpuProfiler::Get().ExportCSV(gpuProfilePath);
+            }
+            if (!cpuProfilePath.empty())
+                CpuProfiler::Get().DumpChromeTrace(cpuProfilePath);
+            gpuMs = queries.gpuMs;
+            triangles = queries.triangles;
+        }
+        GeometryArena::Get().clean();
+        GpuProfiler::Get().clean();
+    }
+
+    const Summary cpu = Summarize(cpuMs);
+    const Summary frame = Summarize(frameMs);
+    const Summary gpu = Summarize(gpuMs);
+    const Summary draws = Summarize(drawCalls);
+    const Summary tris = Summarize(triangles);
+
+    std::ofstream out(outputPath);
+    if (!out)
+    {
+        std::cout << "Can not write " << outputPath << std::endl;
+        return 1;
+    }
+    out << "{\n"
+        << "  \"scene\": \"" << sceneName << "\",\n";
+    if (sceneName == "stress")
+    {
+        out << "  \"stress\": ";
+        stressSpec.Write(out);
+        out << ",\n";
+    }
+    const char* rendererName = recording ? "recording" : (forwardPlus ? "forward_plus" : "deferred");
+    if (recording && hashing)
+        out << "  \"hash\": \"" << std::hex << runHash << std::dec << "\",\n";
+    out << "  \"renderer\": \"" << rendererName << "\",\n"
+        << "  \"gl_renderer\": \"" << glRenderer << "\",\n"
+        << "  \"headless\": " << (mode == ContextMode::Headless ? "true" : "false") << ",\n"
+        << "  \"resolution\": [" << width << ", " << height << "],\n"
+        << "  \"time_step\": " << timeStep << ",\n"
+        << "  \"camera_path\": \"" << (cameraPathFile.empty() ? "orbit" : cameraPathFile) << "\",\n"
+        << "  \"warmup_frames\": " << warmupFrames << ",\n"
+        << "  \"frames_in_flight\": " << framesInFlight << ",\n"
+        << "  \"max_latency_frames\": " << (framesInFlight > 0 ? pipelineStats.maxLatencyFrames : 1) << ",\n"
+        << "  \"frames\": " << cpuMs.size() << ",\n"
+        << "  \"results\": {\n";
+    WriteSummary(out, "cpu_ms", cpu);
+    WriteSummary(out, "frame_ms", frame);
+    WriteSummary(out, "gpu_ms", gpu);
+    WriteSummary(out, "draw_calls", draws);
+    WriteSummary(out, "triangles", tris, true);
+    out << "  }\n}\n";
+
+    std::printf("%s %s %dx%d, %zu frames\n", sceneName.c_str(), rendererName, width, height, cpuMs.size());
+    std::printf("  cpu   mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f ms\n", cpu.mean, cpu.p50, cpu.p95, cpu.p99);
+    std::printf("  frame mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f ms\n", frame.mean, frame.p50, frame.p95, frame.p99);
+    std::printf("  gpu   mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f ms\n", gpu.mean, gpu.p50, gpu.p95, gpu.p99);
+    std::printf("  draw calls %.0f, triangles %.0f per frame\n", draws.mean, tris.mean);
+    if (recording && hashing)
+        std::printf("  hash %016llx\n", static_cast<unsigned long long>(runHash));
+    std::cout << "Results written to " << outputPath << std::endl;
+    return 0;
+}
@@ -21,6 +21,10 @@ const float PITCH = 0.0f;
 const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+// projection shared by every renderer (the field of view does not follow Zoom)
+const float FOV = 45.0f;
+const float NEAR_PLANE = 0.01f;
+const float FAR_PLANE = 100.0f;
 
 
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
@@ -77,6 +81,11 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    static glm::mat4 GetProjectionMatrix(float aspect)
+    {
+        return glm::perspective(glm::radians(FOV), aspect, NEAR_PLANE, FAR_PLANE);
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -117,6 +126,15 @@ public:
         updateCameraVectors();
     }
 
+    // place the camera directly, e.g. on a recorded path
+    void SetPose(const glm::vec3& position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
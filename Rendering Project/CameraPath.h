@@ -0,0 +1,132 @@
+#pragma once
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "Camera.h"
+
+/**
+    * @brief Camera keyframes (time, position, yaw, pitch), recorded from the window or scripted.
+    *
+    * @details Apply interpolates linearly between the two keyframes around the time and wraps the time
+    *          on the duration of the path, so a short path loops over a long run.
+    *          The file format is one keyframe per line: "time x y z yaw pitch", '#' starts a comment.
+**/
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        float time{ 0.0f };
+        glm::vec3 position{ 0.0f };
+        float yaw{ 0.0f };
+        float pitch{ 0.0f };
+    };
+
+    // the keyframes must be added in increasing time
+    void Add(float time, const Camera& camera)
+    {
+        m_Keyframes.push_back({ time, camera.Position, camera.Yaw, camera.Pitch });
+    }
+
+    void Add(const Keyframe& keyframe) { m_Keyframes.push_back(keyframe); }
+
+    bool Empty() const { return m_Keyframes.empty(); }
+    size_t Size() const { return m_Keyframes.size(); }
+    float Duration() const { return m_Keyframes.empty() ? 0.0f : m_Keyframes.back().time - m_Keyframes.front().time; }
+
+    void Apply(float time, Camera& camera) const
+    {
+        if (m_Keyframes.empty())
+            return;
+        const float duration = Duration();
+        float t = m_Keyframes.front().time;
+        if (duration > 0.0f)
+            t += std::fmod(std::max(time, 0.0f), duration);
+
+        auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), t,
+            [](float value, const Keyframe& keyframe) { return value < keyframe.time; });
+        if (next == m_Keyframes.begin() || next == m_Keyframes.end())
+        {
+            const Keyframe& keyframe = next == m_Keyframes.end() ? m_Keyframes.back() : m_Keyframes.front();
+            camera.SetPose(keyframe.position, keyframe.yaw, keyframe.pitch);
+            return;
+        }
+        const Keyframe& a = *(next - 1);
+        const Keyframe& b = *next;
+        const float f = b.time > a.time ? (t - a.time) / (b.time - a.time) : 0.0f;
+        camera.SetPose(glm::mix(a.position, b.position, f), a.yaw + (b.yaw - a.yaw) * f, a.pitch + (b.pitch - a.pitch) * f);
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        m_Keyframes.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream values(line);
+            Keyframe keyframe;
+            if (values >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.yaw >> keyframe.pitch)
+                m_Keyframes.push_back(keyframe);
+        }
+        return !m_Keyframes.empty();
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+        file << "# time x y z yaw pitch\n";
+        for (const Keyframe& keyframe : m_Keyframes)
+        {
+            file << keyframe.time << ' ' << keyframe.position.x << ' ' << keyframe.position.y << ' ' << keyframe.position.z
+                << ' ' << keyframe.yaw << ' ' << keyframe.pitch << '\n';
+        }
+        return true;
+    }
+
+    // scripted path: a circle around center at the given height, always looking at the center
+    static CameraPath Orbit(const glm::vec3& center, float radius, float height, float duration, int steps = 64)
+    {
+        CameraPath path;
+        float previousYaw = 0.0f;
+        for (int i = 0; i <= steps; ++i)
+        {
+            const float angle = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(steps);
+            Keyframe keyframe;
+            keyframe.time = duration * static_cast<float>(i) / static_cast<float>(steps);
+            keyframe.position = center + glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle));
+            const glm::vec3 front = glm::normalize(center - keyframe.position);
+            keyframe.yaw = glm::degrees(std::atan2(front.z, front.x));
+            // unwrap the yaw so the interpolation never turns the long way
+            while (i > 0 && keyframe.yaw < previousYaw - 180.0f)
+                keyframe.yaw += 360.0f;
+            while (i > 0 && keyframe.yaw > previousYaw + 180.0f)
+                keyframe.yaw -= 360.0f;
+            previousYaw = keyframe.yaw;
+            keyframe.pitch = glm::degrees(std::asin(front.y));
+            path.Add(keyframe);
+        }
+        return path;
+    }
+
+private:
+    std::vector<Keyframe> m_Keyframes;
+};
+
+#endif // !CAMERA_PATH_H
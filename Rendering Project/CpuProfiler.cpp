@@ -0,0 +1,107 @@
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+    int64_t steadyNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+CpuProfiler& CpuProfiler::Get()
+{
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+CpuProfiler::CpuProfiler()
+    : m_StartTicks(Now()),
+    m_StartNanoseconds(steadyNanoseconds())
+{
+}
+
+CpuProfiler::ThreadBuffer* CpuProfiler::registerThread()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->id = static_cast<uint32_t>(m_Buffers.size());
+    buffer->name = buffer->id == 0 ? "Main" : "Thread " + std::to_string(buffer->id);
+    m_Buffers.push_back(std::move(buffer));
+    return m_Buffers.back().get();
+}
+
+void CpuProfiler::SetThreadName(const std::string& name)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    buffer.name = name;
+}
+
+void CpuProfiler::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto& buffer : m_Buffers)
+        buffer->clearedAt = buffer->head.load(std::memory_order_acquire);
+}
+
+bool CpuProfiler::DumpChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "CpuProfiler: can not write " << path << std::endl;
+        return false;
+    }
+
+    // ticks per microsecond, measured over the whole run
+#if CPU_PROFILER_RDTSC
+    const double elapsedNs = static_cast<double>(steadyNanoseconds() - m_StartNanoseconds);
+    const double ticksPerUs = elapsedNs > 0.0 ? static_cast<double>(Now() - m_StartTicks) / (elapsedNs / 1000.0) : 1.0;
+#else
+    const double ticksPerUs = static_cast<double>(std::chrono::steady_clock::period::den) / (1.0e6 * std::chrono::steady_clock::period::num);
+#endif
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<Event> events;
+    for (const auto& buffer : m_Buffers)
+    {
+        file << (first ? "\n" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+            << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+        first = false;
+
+        // copy the ring, then drop what the thread overwrote during the copy
+        const uint64_t headBefore = buffer->head.load(std::memory_order_acquire);
+        const uint64_t begin = std::max(buffer->clearedAt, headBefore > RING ? headBefore - RING : 0);
+        events.clear();
+        for (uint64_t i = begin; i < headBefore; ++i)
+            events.push_back(buffer->events[i & (RING - 1)].Load());
+        // pairs with the fence in Record: a copied slot written again has a head past its index
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t headAfter = buffer->head.load(std::memory_order_relaxed);
+        // with headAfter = h the thread may be writing index h, the slot of index h - RING
+        const uint64_t valid = headAfter >= RING ? headAfter - RING + 1 : 0;
+
+        for (uint64_t i = begin; i < headBefore; ++i)
+        {
+            if (i < valid)
+                continue;
+            const Event& event = events[i - begin];
+            const double ts = static_cast<double>(static_cast<int64_t>(event.begin - m_StartTicks)) / ticksPerUs;
+            const double dur = static_cast<double>(event.end - event.begin) / ticksPerUs;
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                << ",\"ts\":" << ts << ",\"dur\":" << dur << "}";
+        }
+    }
+    file << "\n]}\n";
+    return true;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_PROFILER_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CPU_PROFILER_RDTSC 1
+#else
+#include <chrono>
+#define CPU_PROFILER_RDTSC 0
+#endif
+
+// CPU_PROFILER, fixed at compile time (CMake option CPU_PROFILER): 0 removes every PROFILE_SCOPE
+#ifndef CPU_PROFILER
+#define CPU_PROFILER 1
+#endif
+
+/**
+    * @brief CPU zones of the frame, dumped as a Chrome trace (about:tracing, ui.perfetto.dev).
+    *
+    * @details Every thread writes its zones in its own ring of RING events, so recording never takes a
+    *          lock: one rdtsc (steady_clock on the other CPUs) when the scope opens, one when it closes
+    *          and a store of the event. The ring keeps the last RING zones of the thread, the older ones
+    *          are overwritten. The zone names must outlive the capture (string literals).
+    *          DumpChromeTrace can run while the other threads record: the slots are relaxed atomics
+    *          and Record fences the head before it overwrites a slot (a seqlock where the head is the
+    *          sequence), so an event overwritten during the copy is always seen as such and dropped.
+    *          The ticks are converted with the ratio between the
+    *          counter and steady_clock measured from the creation of the profiler to the dump.
+**/
+class CpuProfiler
+{
+public:
+    static constexpr size_t RING = 1 << 16;
+
+    // RAII zone, the name must be a string literal
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name) : m_Name(name), m_Begin(CpuProfiler::Now()) {}
+        ~Scope() { CpuProfiler::Get().Record(m_Name, m_Begin, CpuProfiler::Now()); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* m_Name;
+        uint64_t m_Begin;
+    };
+
+    CpuProfiler(const CpuProfiler&) = delete;
+    CpuProfiler& operator=(const CpuProfiler&) = delete;
+
+    static CpuProfiler& Get();
+
+    static uint64_t Now()
+    {
+#if CPU_PROFILER_RDTSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    void SetEnabled(bool enable) { m_Enabled.store(enable, std::memory_order_relaxed); }
+    bool IsEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+    void Record(const char* name, uint64_t begin, uint64_t end)
+    {
+        if (!m_Enabled.load(std::memory_order_relaxed))
+            return;
+        ThreadBuffer& buffer = threadBuffer();
+        const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        // a dump that reads this write also reads a head past the event it overwrites
+        std::atomic_thread_fence(std::memory_order_release);
+        buffer.events[head & (RING - 1)].Store(name, begin, end);
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // the name of the calling thread in the trace
+    void SetThreadName(const std::string& name);
+
+    bool DumpChromeTrace(const std::string& path);
+    // the next dump starts from now
+    void Clear();
+
+private:
+    CpuProfiler();
+    ~CpuProfiler() = default;
+
+    struct Event
+    {
+        const char* name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // read by the dump while the thread writes it, relaxed stores are plain stores on x86
+    struct EventSlot
+    {
+        std::atomic<const char*> name{ nullptr };
+        std::atomic<uint64_t> begin{ 0 };
+        std::atomic<uint64_t> end{ 0 };
+
+        void Store(const char* inName, uint64_t inBegin, uint64_t inEnd)
+        {
+            name.store(inName, std::memory_order_relaxed);
+            begin.store(inBegin, std::memory_order_relaxed);
+            end.store(inEnd, std::memory_order_relaxed);
+        }
+        Event Load() const
+        {
+            return { name.load(std::memory_order_relaxed), begin.load(std::memory_order_relaxed), end.load(std::memory_order_relaxed) };
+        }
+    };
+
+    struct ThreadBuffer
+    {
+        std::array<EventSlot, RING> events{};
+        std::atomic<uint64_t> head{ 0 };
+        uint64_t clearedAt{ 0 };   // written by Clear, under m_Mutex
+        uint32_t id{ 0 };
+        std::string name;
+    };
+
+    std::atomic<bool> m_Enabled{ true };
+    // only the registration of a new thread and the dump take it
+    std::mutex m_Mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_Buffers;
+    uint64_t m_StartTicks{ 0 };
+    int64_t m_StartNanoseconds{ 0 };
+
+    ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+            buffer = registerThread();
+        return *buffer;
+    }
+    ThreadBuffer* registerThread();
+};
+
+#if CPU_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) CpuProfiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
+
+#endif // !CPU_PROFILER_H
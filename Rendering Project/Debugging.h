@@ -10,6 +10,20 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>  
 
+#include "GLState.h"
+
+// GL_DEBUG_LEVEL, fixed at compile time (e.g. -DGL_DEBUG_LEVEL=1):
+// 0 = no check at all: GL_CHECK is empty and the GLAD debug wrappers are uninstalled (default of the release builds)
+// 1 = KHR_debug callback, asynchronous, the report shows the last GL_CHECK passed
+// 2 = synchronous callback with the name of the failing GL call, GL_CHECK also drains glGetError (default of the debug builds)
+#ifndef GL_DEBUG_LEVEL
+#ifdef NDEBUG
+#define GL_DEBUG_LEVEL 0
+#else
+#define GL_DEBUG_LEVEL 2
+#endif
+#endif
+
 // Debug function to check OpenGL errors
 inline void CheckGLError(const char* function, const char* file, int line) {
     GLenum error;
@@ -28,10 +42,131 @@ inline void CheckGLError(const char* function, const char* file, int line) {
 }
 
 
-#define GL_CHECK() CheckGLError(__FUNCTION__, __FILE__, __LINE__)
+// Reporter of the KHR_debug messages. Init() is called once the context is current (see WindowContext)
+class GLDebug
+{
+public:
+    static void Init()
+    {
+#if GL_DEBUG_LEVEL == 0
+        // the debug wrappers call glGetError after every GL call
+        gladUninstallGLDebug();
+#else
+#if GL_DEBUG_LEVEL >= 2
+        gladSetGLPreCallback(preCall);
+        gladSetGLPostCallback(postCall);
+#else
+        gladUninstallGLDebug();
+#endif
+        if (!GLAD_GL_KHR_debug && !GLAD_GL_VERSION_4_3)
+        {
+            std::cerr << "GL debug: KHR_debug is not supported, only GL_CHECK reports the errors" << std::endl;
+            return;
+        }
+        GLState::Enable(GL_DEBUG_OUTPUT);
+#if GL_DEBUG_LEVEL >= 2
+        // the callback runs inside the call that caused the message
+        GLState::Enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+        glDebugMessageCallback(callback, nullptr);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+#endif
+    }
+
+    // the last checkpoint passed by this thread, printed with the messages
+    static void Mark(const char* function, const char* file, int line)
+    {
+        s_Function = function;
+        s_File = file;
+        s_Line = line;
+    }
+
+    // name shown by the messages and by the GL debuggers, GL_PROGRAM, GL_TEXTURE, GL_FRAMEBUFFER, GL_BUFFER...
+    static void Label(GLenum identifier, GLuint name, const std::string& label)
+    {
+#if GL_DEBUG_LEVEL > 0
+        if (name != 0 && (GLAD_GL_KHR_debug || GLAD_GL_VERSION_4_3))
+            glObjectLabel(identifier, name, static_cast<GLsizei>(label.size()), label.c_str());
+#else
+        (void)identifier;
+        (void)name;
+        (void)label;
+#endif
+    }
+
+private:
+    static inline thread_local const char* s_Function = nullptr;
+    static inline thread_local const char* s_File = nullptr;
+    static inline thread_local int s_Line = 0;
+    static inline thread_local const char* s_Call = nullptr;
 
+    static void preCall(const char* name, GLADapiproc, int, ...)
+    {
+        s_Call = name;
+    }
+    // KHR_debug reports the errors, the default GLAD post callback would drain them with glGetError
+    static void postCall(void*, const char*, GLADapiproc, int, ...) {}
+
+    static const char* sourceName(GLenum source)
+    {
+        switch (source)
+        {
+        case GL_DEBUG_SOURCE_API: return "API";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "application";
+        default: return "other";
+        }
+    }
+
+    static const char* typeName(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        case GL_DEBUG_TYPE_MARKER: return "marker";
+        case GL_DEBUG_TYPE_PUSH_GROUP: return "push group";
+        case GL_DEBUG_TYPE_POP_GROUP: return "pop group";
+        default: return "other";
+        }
+    }
+
+    static const char* severityName(GLenum severity)
+    {
+        switch (severity)
+        {
+        case GL_DEBUG_SEVERITY_HIGH: return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW: return "low";
+        default: return "notification";
+        }
+    }
+
+    static void APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei, const GLchar* message, const void*)
+    {
+        std::cerr << "GL " << typeName(type) << " (" << severityName(severity) << ", " << sourceName(source) << ", id " << id << "): " << message << std::endl;
+        if (s_Call != nullptr)
+            std::cerr << "  in " << s_Call << std::endl;
+        if (s_File != nullptr)
+            std::cerr << "  after GL_CHECK at " << s_File << ":" << s_Line << " (" << s_Function << ")" << std::endl;
+    }
+};
 
+#if GL_DEBUG_LEVEL >= 2
+#define GL_CHECK() (GLDebug::Mark(__FUNCTION__, __FILE__, __LINE__), CheckGLError(__FUNCTION__, __FILE__, __LINE__))
 #define GLCheckError() (glGetError() == GL_NO_ERROR)
+#elif GL_DEBUG_LEVEL == 1
+#define GL_CHECK() GLDebug::Mark(__FUNCTION__, __FILE__, __LINE__)
+#define GLCheckError() true
+#else
+#define GL_CHECK() ((void)0)
+#define GLCheckError() true
+#endif
 
 static void printout_opengl_glsl_info() {
     const GLubyte* renderer = glGetString(GL_RENDERER);
@@ -166,5 +301,147 @@ static bool validate_shader_program(GLuint program) {
     return true;
 }
 
+// GPU time of a block of commands measured with GL_TIME_ELAPSED queries.
+// The result is read some frames later, when it is already available, so the CPU never waits the GPU.
+// The tag given to Begin() is returned with the measure (e.g. which technique was measured).
+class GpuTimer
+{
+public:
+    GpuTimer() = default;
+    ~GpuTimer() { clean(); }
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void Begin(int tag = 0)
+    {
+        if (m_Queries[0] == 0)
+            glGenQueries(QUERY_RING, m_Queries);
+        if (m_Pending == QUERY_RING) // every query is still in flight, skip this measure
+            return;
+
+        int index = (m_Oldest + m_Pending) % QUERY_RING;
+        m_Tags[index] = tag;
+        glBeginQuery(GL_TIME_ELAPSED, m_Queries[index]);
+        m_Open = true;
+    }
+
+    void End()
+    {
+        if (!m_Open)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        m_Open = false;
+        ++m_Pending;
+    }
+
+    // milliseconds of the oldest finished measure, false when nothing is ready
+    bool Poll(double& ms, int& tag)
+    {
+        if (m_Pending == 0)
+            return false;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_Queries[m_Oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(m_Queries[m_Oldest], GL_QUERY_RESULT, &elapsed);
+        ms = static_cast<double>(elapsed) / 1.0e6;
+        tag = m_Tags[m_Oldest];
+        m_Oldest = (m_Oldest + 1) % QUERY_RING;
+        --m_Pending;
+        return true;
+    }
+
+    void clean()
+    {
+        if (m_Queries[0] != 0) {
+            glDeleteQueries(QUERY_RING, m_Queries);
+            m_Queries[0] = 0;
+        }
+        m_Oldest = m_Pending = 0;
+        m_Open = false;
+    }
+
+private:
+    static constexpr int QUERY_RING = 4;
+    GLuint m_Queries[QUERY_RING]{};
+    int m_Tags[QUERY_RING]{};
+    int m_Oldest{ 0 };
+    int m_Pending{ 0 };
+    bool m_Open{ false };
+};
+
+// Same as GpuTimer with a pair of GL_TIMESTAMP queries, so the measured block may contain
+// GL_TIME_ELAPSED queries (they cannot be nested), e.g. the whole frame around the pass timers.
+class GpuTimestampTimer
+{
+public:
+    GpuTimestampTimer() = default;
+    ~GpuTimestampTimer() { clean(); }
+    GpuTimestampTimer(const GpuTimestampTimer&) = delete;
+    GpuTimestampTimer& operator=(const GpuTimestampTimer&) = delete;
+
+    void Begin()
+    {
+        if (m_Queries[0] == 0)
+            glGenQueries(2 * QUERY_RING, m_Queries);
+        if (m_Pending == QUERY_RING)
+            return;
+
+        int index = (m_Oldest + m_Pending) % QUERY_RING;
+        glQueryCounter(m_Queries[2 * index], GL_TIMESTAMP);
+        m_Open = true;
+    }
+
+    void End()
+    {
+        if (!m_Open)
+            return;
+        int index = (m_Oldest + m_Pending) % QUERY_RING;
+        glQueryCounter(m_Queries[2 * index + 1], GL_TIMESTAMP);
+        m_Open = false;
+        ++m_Pending;
+    }
+
+    bool Poll(double& ms)
+    {
+        if (m_Pending == 0)
+            return false;
+
+        // the end is written after the start, when it is available both are
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_Queries[2 * m_Oldest + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(m_Queries[2 * m_Oldest], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(m_Queries[2 * m_Oldest + 1], GL_QUERY_RESULT, &end);
+        ms = static_cast<double>(end - start) / 1.0e6;
+        m_Oldest = (m_Oldest + 1) % QUERY_RING;
+        --m_Pending;
+        return true;
+    }
+
+    void clean()
+    {
+        if (m_Queries[0] != 0) {
+            glDeleteQueries(2 * QUERY_RING, m_Queries);
+            m_Queries[0] = 0;
+        }
+        m_Oldest = m_Pending = 0;
+        m_Open = false;
+    }
+
+private:
+    static constexpr int QUERY_RING = 4;
+    GLuint m_Queries[2 * QUERY_RING]{};
+    int m_Oldest{ 0 };
+    int m_Pending{ 0 };
+    bool m_Open{ false };
+};
+
 #define SAFE_DELETE(p) if (p) { delete p; p = NULL; }
 #endif
\ No newline at end of file
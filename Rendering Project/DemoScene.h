@@ -281,7 +281,7 @@ private:
             cubeMesh->SetupInstancedArrays(instanceMatrices);
             InstancedMeshRenderer instancedCubeRenderer; 
             instancedCubeRenderer.mesh = cubeMesh;
-            instancedCubeRenderer.instanceMatrices = instanceMatrices;
+            instancedCubeRenderer.instances = std::make_shared<InstanceSet>(instanceMatrices);
          //   addComponent(instanceCubes, std::move(instancedCubeRenderer));
         }
     }
@@ -21,17 +21,26 @@
 #include <functional>   
 #include <numeric>
 #include <concepts>
+#include <algorithm>
 
 #include "Utilities.h"
 #include "Shader.h"
 #include "Mesh.h"
+#include "IndirectDraw.h"
+#include "InstanceBuffer.h"
 #include "frameBufferObject.h"
+#include "ShadowAtlas.h"
+#include "ShadowCascades.h"
+#include "ShadowMoments.h"
 #include "LightStruct.h"
 #include "Camera.h"
 #include "Skybox.h"
 #include "Animation.h"
 #include "Component.h"
 #include "PathConfig.h"
+#include "RenderGraph.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
 
 
 
@@ -217,11 +226,15 @@ struct MeshRenderer : public Component {
     std::shared_ptr<BasicMesh> mesh;
     bool castShadows = true;
     bool receiveShadows = true;
+    // the static casters are kept in the shadow cache, an entity with a playing Animation is always dynamic
+    bool isStatic = true;
 };
 
 struct InstancedMeshRenderer : public Component {
     std::shared_ptr<BasicMesh> mesh;
-    std::vector<glm::mat4> instanceMatrices;
+    // kept on the GPU between the frames, use InstanceSet::SetMatrix to move an instance
+    std::shared_ptr<InstanceSet> instances;
+    bool castShadows = true;
 };
 
 
@@ -231,12 +244,14 @@ struct RenderCommand
     std::shared_ptr<BasicMesh> mesh;
     bool castShadows{ true };
     bool receiveShadows{ true };
+    bool isStatic{ true };
 };
 
 struct InstancedRenderCommand
 {
     std::shared_ptr<BasicMesh> mesh;
-    std::vector<glm::mat4> instances;
+    std::shared_ptr<InstanceSet> instances;
+    bool castShadows{ true };
 };
 
 struct LightData
@@ -260,6 +275,10 @@ public:
     virtual void endFrame() = 0;
     virtual void resize() = 0;
     virtual WindowContext& getContext() = 0;
+    // seconds read by the animations, the clock of the WindowContext for the GL renderers
+    virtual float getTime() = 0;
+    // the renderers that never call GL (RecordingRenderer) need CPU-only meshes, see Scene::createMesh
+    virtual bool isCpuOnly() const { return false; }
 protected:
     // Prevent creating an IRenderer directly. Only derived classes can.
     IRenderer() = default;
@@ -274,11 +293,149 @@ private:
     // Frame Buffer Objects
     std::unique_ptr<FXAA> fxaa;
     std::unique_ptr<GBufferFBO> gbuffer;
-    std::unique_ptr<ShadowMapFBO> shadowDirMap;
-    std::unique_ptr<ShadowMapArrayFBO> shadowSpotMap;
-    std::unique_ptr<ShadowMapCubeFBO> shadowPointMap;
-    bool m_spotShadowsInitialized = false;
-    bool m_pointShadowsInitialized = false;
+    bool m_reportGBufferLayout = false;
+    // Sunlight: cascades fitted to the camera frustum, one layer of the array per cascade
+    std::unique_ptr<ShadowMapArrayFBO> shadowDirMap;
+    ShadowCascades cascades;
+    static constexpr unsigned int CASCADE_SIZE = 1024;
+    float m_shadowDistance = 60.f;
+    // the point light depth is in the atlas, 6 tiles per cube map (see PointShadowMode)
+    std::shared_ptr<Shader> shadowPointShader;
+    PointShadowMode m_pointShadowMode{ PointShadowMode::PerFace };
+    // Shadow atlas: every spot and point light gets tiles sized from its screen coverage, the small
+    // (far) lights are redrawn every few frames and at most m_shadowUpdateBudget texels are drawn per frame
+    static constexpr unsigned int SHADOW_ATLAS_SIZE = 4096;
+    static constexpr unsigned int MAX_SHADOW_TILE_SIZE = 1024;
+    static constexpr unsigned int MAX_SHADOW_UPDATE_INTERVAL = 8;
+    struct ShadowSlot
+    {
+        ShadowAtlas::Tile tile;
+        unsigned int wantedSize{ 0 };       // before the atlas shrinks it to fit
+        glm::mat4 key{ 0.f };               // what the tiles depend on, a moved light is redrawn at once
+        unsigned long long lastUpdate{ 0 };
+        unsigned int interval{ 1 };         // frames between two updates
+        bool update{ false };               // drawn in this frame
+        std::array<bool, 6> cached{};       // shadow cache: the views of the tiles holding the static casters
+        bool liveIsCache{ false };          // shadow cache: no dynamic caster was drawn on the live tiles
+        float coverage{ 0.f };              // importance of the light, see screenCoverage
+        int maskChannel{ -1 };              // masked light in the shadow mask, -1 = shadow computed in the lighting pass
+    };
+    std::unique_ptr<ShadowAtlas> shadowAtlas;
+    std::vector<ShadowSlot> spotSlots;
+    std::vector<ShadowSlot> pointSlots;
+    std::vector<size_t> spotUpdates;  // the lights drawn in this frame
+    std::vector<size_t> pointUpdates;
+    size_t m_shadowUpdateBudget = SHADOW_ATLAS_SIZE * SHADOW_ATLAS_SIZE / 2;
+    // Multi draw indirect for the opaque G-buffer pass and the shadow casters
+    std::unique_ptr<IndirectDrawBuilder> indirectGeometry;
+    std::unique_ptr<IndirectDrawBuilder> indirectShadows;
+    std::shared_ptr<Shader> shadowIndirectShader;
+    std::shared_ptr<Shader> shadowPointIndirectShader;
+    std::unique_ptr<DepthPyramid> depthPyramid;
+    bool m_useIndirectDraw = true;
+    bool m_useGpuCulling = true;
+    bool m_useOcclusionCulling = false;
+    // Automatic instancing of the per mesh path: the commands that share a mesh become one instanced draw
+    struct InstanceBatch
+    {
+        BasicMesh* mesh;
+        GLuint buffer;
+        GLuint firstInstance;
+        GLuint instanceCount;
+        GLuint shadowCount; // the shadow casters are the first shadowCount instances of the batch
+        GLuint dynamicShadowCount; // the dynamic casters come before the static ones
+        const glm::mat4* matrices; // CPU copy of the instances, used by the per face culling
+    };
+    std::unique_ptr<FrameInstanceBuffer> frameInstances;
+    std::vector<InstanceBatch> instanceBatches;
+    std::shared_ptr<Shader> shadowInstancedShader;
+    std::shared_ptr<Shader> shadowPointInstancedShader;
+    // all the spot light layers in one instanced draw per caster batch (gl_Layer from the instance id)
+    std::shared_ptr<Shader> shadowSpotLayeredShader;
+    bool m_useLayeredSpotShadows = true;
+    static constexpr size_t MAX_LAYERED_SPOT_LIGHTS = 16; // keep in sync with shadowMapSpot_layered.vert/.geom
+    bool m_useAutoInstancing = true;
+    // point light shadows without geometry shader: every cube face is drawn alone with its visible casters
+    struct FaceBatch
+    {
+        BasicMesh* mesh;
+        GLuint firstInstance;
+        GLuint instanceCount;
+        int light;
+        int face;   // or the cascade of the sun
+    };
+    std::shared_ptr<Shader> shadowPointFaceShader;
+    std::shared_ptr<Shader> shadowPointFaceIndirectShader;
+    // point lights with PointShadowType::DualParaboloid
+    std::shared_ptr<Shader> shadowParaboloidShader;
+    std::shared_ptr<Shader> shadowParaboloidInstancedShader;
+    std::shared_ptr<Shader> shadowParaboloidIndirectShader;
+    std::unique_ptr<FrameInstanceBuffer> pointFaceInstances;
+    std::vector<FaceBatch> faceBatches;
+    std::unique_ptr<FrameInstanceBuffer> cascadeInstances;
+    std::vector<FaceBatch> cascadeBatches;
+    std::vector<glm::vec4> casterSpheres;
+    // alternate the two point shadow modes and compare their GPU time
+    GpuTimer pointShadowTimer;
+    bool m_benchmarkPointShadows = false;
+    unsigned int m_benchmarkFrame = 0;
+    double m_benchmarkTime[2]{};
+    unsigned int m_benchmarkSamples[2]{};
+    size_t m_pointFacesDrawn = 0;
+    size_t m_pointFacesTotal = 0;
+    static constexpr unsigned int POINT_BENCHMARK_FRAMES = 120;
+    unsigned long long m_frameIndex = 0;
+    // Shadow cache: the static casters are drawn in a copy of the shadow maps only when the light or a
+    // static caster moves, every frame the maps are restored from the copy and only the dynamic casters are drawn
+    std::unique_ptr<ShadowMapArrayFBO> shadowDirCache;
+    std::unique_ptr<ShadowAtlas> shadowAtlasCache;
+    std::unique_ptr<IndirectDrawBuilder> indirectStaticShadows;
+    std::array<glm::mat4, ShadowCascades::MAX_CASCADES> m_dirCacheKey{};
+    std::array<bool, ShadowCascades::MAX_CASCADES> m_dirCached{};
+    bool m_dirLiveIsCache = false; // the live sun map still holds the cache, no dynamic caster was drawn on it
+    size_t m_staticCasterHash = 0;
+    bool m_useShadowCache = true;
+    // Prefiltered shadows: with ShadowFilter::EVSM the depth of a light type is converted in blurred and
+    // mipmapped moments after the shadow pass and the lighting pass takes one tap per light
+    std::unique_ptr<ShadowMomentMap> cascadeMoments;
+    std::unique_ptr<ShadowMomentMap> atlasMoments;
+    ShadowFilter m_dirShadowFilter = ShadowFilter::PCF;
+    ShadowFilter m_spotShadowFilter = ShadowFilter::PCF;
+    ShadowFilter m_pointShadowFilter = ShadowFilter::PCF;
+    bool m_atlasMomentsValid = false; // false: every tile is converted, not only the ones drawn in this frame
+    // alternate PCF and EVSM for every light type and compare the GPU time of the lighting pass
+    GpuTimer lightingTimer;
+    bool m_benchmarkLighting = false;
+    unsigned int m_lightingBenchmarkFrame = 0;
+    double m_lightingTime[2]{};
+    unsigned int m_lightingSamples[2]{};
+    static constexpr unsigned int LIGHTING_BENCHMARK_FRAMES = 120;
+    // Shadow mask: the visibility of the sun and of the most important shadowed lights is computed at half
+    // resolution before the lighting pass, which upsamples it instead of filtering their shadow maps
+    std::unique_ptr<ShadowMaskFBO> shadowMask;
+    bool m_useShadowMask = true;
+    int m_shadowMaskLights = 3;
+    std::vector<std::pair<int, int>> maskedLights; // (0 = point / 1 = spot, light index)
+    // Dynamic resolution: the targets keep the window size and the passes up to the lighting render in the
+    // bottom left m_renderScale part of them (viewports only, nothing is reallocated), FXAA upscales it to
+    // the window. With m_dynamicResolution the scale follows the GPU frame time against m_frameBudgetMs
+    static constexpr unsigned int RENDER_SCALE_SETTLE_FRAMES = 8; // the queries in flight still measure the old scale
+    GpuTimestampTimer frameTimer;
+    bool m_dynamicResolution = false;
+    float m_renderScale = 1.0f;
+    float m_minRenderScale = 0.5f;
+    double m_frameBudgetMs = 1000.0 / 60.0;
+    double m_frameTimeMs = 0.0;     // smoothed GPU time of the frames at the current scale
+    unsigned int m_frameTimeSamples = 0;
+    unsigned int m_scaleSettleFrames = 0;
+    int m_renderWidth = 0;
+    int m_renderHeight = 0;
+    // Render graph: the passes are declared every frame with the textures they use, the unused ones are
+    // culled and the transient targets (the shadow mask, the EVSM blur scratch) come from a pool where the
+    // targets with disjoint lifetimes alias. With m_reportRenderGraph the statistics are printed when they change
+    RenderGraph frameGraph;
+    RenderGraph::Stats m_lastGraphStats;
+    bool m_reportRenderGraph = false;
     // Render commands for this frame
     std::vector<RenderCommand> renderCommands;
     std::vector<InstancedRenderCommand> instancedCommands;
@@ -311,25 +468,66 @@ public:
     {
         // Instance FBOs
         gbuffer = std::make_unique<GBufferFBO>();
-        shadowDirMap = std::make_unique<ShadowMapFBO>(3000, 3000);
-        shadowSpotMap = std::make_unique<ShadowMapArrayFBO>(1024, 1024);
-        shadowPointMap = std::make_unique<ShadowMapCubeFBO>(1024);
+        shadowDirMap = std::make_unique<ShadowMapArrayFBO>(CASCADE_SIZE, CASCADE_SIZE);
+        shadowAtlas = std::make_unique<ShadowAtlas>(SHADOW_ATLAS_SIZE);
         fxaa = std::make_unique<FXAA>();
+        indirectGeometry = std::make_unique<IndirectDrawBuilder>();
+        indirectShadows = std::make_unique<IndirectDrawBuilder>();
+        depthPyramid = std::make_unique<DepthPyramid>();
+        shadowIndirectShader = std::make_shared<Shader>();
+        shadowPointIndirectShader = std::make_shared<Shader>();
+        frameInstances = std::make_unique<FrameInstanceBuffer>();
+        shadowInstancedShader = std::make_shared<Shader>();
+        shadowPointInstancedShader = std::make_shared<Shader>();
+        shadowSpotLayeredShader = std::make_shared<Shader>();
+        shadowPointFaceShader = std::make_shared<Shader>();
+        shadowPointFaceIndirectShader = std::make_shared<Shader>();
+        shadowParaboloidShader = std::make_shared<Shader>();
+        shadowParaboloidInstancedShader = std::make_shared<Shader>();
+        shadowParaboloidIndirectShader = std::make_shared<Shader>();
+        pointFaceInstances = std::make_unique<FrameInstanceBuffer>();
+        cascadeInstances = std::make_unique<FrameInstanceBuffer>();
+        shadowDirCache = std::make_unique<ShadowMapArrayFBO>(CASCADE_SIZE, CASCADE_SIZE);
+        shadowAtlasCache = std::make_unique<ShadowAtlas>(SHADOW_ATLAS_SIZE);
+        indirectStaticShadows = std::make_unique<IndirectDrawBuilder>();
+        cascadeMoments = std::make_unique<ShadowMomentMap>(CASCADE_SIZE, CASCADE_SIZE, static_cast<unsigned int>(ShadowCascades::MAX_CASCADES));
+        atlasMoments = std::make_unique<ShadowMomentMap>(SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 1);
+        shadowMask = std::make_unique<ShadowMaskFBO>();
 
         // Inizialize shader for shadow casting
         auto shader = std::make_shared<Shader>();
-        auto shaderBox = std::make_shared<Shader>();
+        shadowPointShader = std::make_shared<Shader>();
 
         shader->load(getShaderFullPath("shadowMap.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str());
 
-        shaderBox->load(getShaderFullPath("shadowMapPoint.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str() , getShaderFullPath("shadowMapPoint.geom").c_str() );
+        shadowPointShader->load(getShaderFullPath("shadowMapPoint.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str() , getShaderFullPath("shadowMapPoint.geom").c_str() );
+        shadowIndirectShader->load(getShaderFullPath("shadowMap_indirect.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str());
+        shadowPointIndirectShader->load(getShaderFullPath("shadowMapPoint_indirect.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str(), getShaderFullPath("shadowMapPoint.geom").c_str());
+        shadowInstancedShader->load(getShaderFullPath("shadowMap_instanced.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str());
+        shadowPointInstancedShader->load(getShaderFullPath("shadowMapPoint_instanced.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str(), getShaderFullPath("shadowMapPoint.geom").c_str());
+        shadowPointFaceShader->load(getShaderFullPath("shadowMapPoint_face_instanced.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str());
+        shadowPointFaceIndirectShader->load(getShaderFullPath("shadowMapPoint_face_indirect.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str());
+        shadowParaboloidShader->load(getShaderFullPath("shadowMapParaboloid.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str());
+        shadowParaboloidInstancedShader->load(getShaderFullPath("shadowMapParaboloid_instanced.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str());
+        shadowParaboloidIndirectShader->load(getShaderFullPath("shadowMapParaboloid_indirect.vert").c_str(), getShaderFullPath("shadowMapPoint.frag").c_str());
+        // without the extension the layer is selected by a pass through geometry shader
+        if (GLAD_GL_ARB_shader_viewport_layer_array)
+            shadowSpotLayeredShader->load(getShaderFullPath("shadowMapSpot_layered.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str());
+        else
+            shadowSpotLayeredShader->load(getShaderFullPath("shadowMapSpot_layered_gs.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str(), getShaderFullPath("shadowMapSpot_layered.geom").c_str());
 
         // Inizialize FBOs
         gbuffer->Init(m_context.getWidth(),m_context.getHeight());
         fxaa->init(m_context.getWidth(), m_context.getHeight());
-        shadowDirMap->Init( shader );
-        shadowSpotMap->SetupShader( shader );
-        shadowPointMap->SetupShader( shaderBox );
+        shadowMask->Init(m_context.getWidth(), m_context.getHeight());
+        shadowDirMap->Init( ShadowCascades::MAX_CASCADES, shader );
+        shadowDirCache->Init( ShadowCascades::MAX_CASCADES, shader );
+        shadowAtlas->Init();
+        shadowAtlasCache->Init();
+        indirectGeometry->Init();
+        indirectShadows->Init(false);
+        indirectStaticShadows->Init(false);
+        depthPyramid->Init(m_context.getWidth(), m_context.getHeight());
     }
 
     void beginFrame() override 
@@ -342,7 +540,7 @@ public:
         // Update camera matrices
         viewMatrix = m_context.getCamera().GetViewMatrix();
 
-        projectionMatrix = glm::perspective(glm::radians(45.0f), (float)m_context.getWidth() / (float)m_context.getHeight(), 0.01f, 100.0f);
+        projectionMatrix = Camera::GetProjectionMatrix((float)m_context.getWidth() / (float)m_context.getHeight());
 
         modelMatrix = glm::mat4(1.0f);
     }
@@ -357,36 +555,30 @@ public:
 
     void setLightData(const LightData& lights) override 
     {
-        if (!m_spotShadowsInitialized && !lights.spotLights.empty()) 
-        {
-            shadowSpotMap->Init(lights.spotLights.size());
-            m_spotShadowsInitialized = true;
-        }
-        if (!m_pointShadowsInitialized && !lights.pointLights.empty())
-        {
-            shadowPointMap->Init(lights.pointLights.size());
-            m_pointShadowsInitialized = true;
-        }
-
+        // the atlas tiles follow the light count every frame (see updateShadowAtlas)
         lightData = lights;
     }
 
     void endFrame() override 
     {
-        // Geometry pass
-        renderGeometryPass();
+        PROFILE_SCOPE("DeferredRenderer::endFrame");
+        ++m_frameIndex;
+        applyRenderScale();
+        frameTimer.Begin();
+        GpuProfiler::Get().BeginFrame();
 
-        // Shadow pass
-        renderShadowMaps();
+        // both paths read the sets from their GPU buffer, the indirect one copies them in its model SSBO
+        syncInstanceSets();
 
-        // Lighting pass
-        renderLightingPass();
+        // the multi draw indirect path already merges every draw, the per mesh path merges the draws of the same mesh
+        if (!m_useIndirectDraw && m_useAutoInstancing)
+            buildInstanceBatches();
 
-        // Forward pass (transparent objects, skybox)
-        renderForwardPass();
+        renderFrameGraph();
 
-        // Post-processing
-        renderPostProcessing();
+        GpuProfiler::Get().EndFrame();
+        frameTimer.End();
+        updateRenderScale();
     }
 
     // resize the frame buffer object to match the window size
@@ -395,6 +587,8 @@ public:
 
         gbuffer->Resize(m_context.getWidth(), m_context.getHeight()); 
         fxaa->resize(m_context.getWidth(), m_context.getHeight());
+        shadowMask->Resize(m_context.getWidth(), m_context.getHeight());
+        depthPyramid->Resize(m_context.getWidth(), m_context.getHeight());
     }
 
     void setSkybox(const std::string& path, const std::vector<std::string>& faces) override 
@@ -408,88 +602,1188 @@ public:
         return m_context;
     }
 
+    float getTime() override
+    {
+        return m_context.getTotalTime();
+    }
+
+    // switch between the multi draw indirect passes and the one draw per mesh path
+    void setIndirectDraw(bool enable) { m_useIndirectDraw = enable; }
+    // visibility of the indirect draws computed on the GPU (frustum, and optionally the depth of the previous frame)
+    void setGpuCulling(bool enable) { m_useGpuCulling = enable; }
+    void setOcclusionCulling(bool enable) 
+    { 
+        m_useOcclusionCulling = enable;
+        depthPyramid->Invalidate();
+    }
+    // print the culled passes and the estimated memory and bandwidth of the render graph when they change
+    void setRenderGraphReport(bool enable) { m_reportRenderGraph = enable; }
+    const RenderGraph::Stats& getRenderGraphStats() const { return frameGraph.GetStats(); }
+    // merge the commands that share a mesh in a single instanced draw (only for the per mesh path)
+    void setAutoInstancing(bool enable) { m_useAutoInstancing = enable; }
+    // render every spot light layer in the same draw (auto instancing path only)
+    void setLayeredSpotShadows(bool enable) { m_useLayeredSpotShadows = enable; }
+    // geometry shader or one pass per cube face (the one draw per mesh path always use the geometry shader)
+    void setPointShadowMode(PointShadowMode mode) { m_pointShadowMode = mode; }
+    // switch the point shadow mode every POINT_BENCHMARK_FRAMES frames and print the average GPU time of both
+    void setPointShadowBenchmark(bool enable)
+    {
+        m_benchmarkPointShadows = enable;
+        m_benchmarkFrame = 0;
+        m_benchmarkTime[0] = m_benchmarkTime[1] = 0.0;
+        m_benchmarkSamples[0] = m_benchmarkSamples[1] = 0;
+        m_pointFacesDrawn = m_pointFacesTotal = 0;
+    }
+    // keep the static casters in a cached copy of the shadow maps
+    void setShadowCache(bool enable)
+    {
+        m_useShadowCache = enable;
+        invalidateShadowCache();
+    }
+    // the moved lights and static casters are detected every frame, these are for the changes the renderer
+    // cannot see (e.g. a mesh edited in place)
+    void invalidateShadowCache()
+    {
+        m_dirCached.fill(false);
+        m_dirLiveIsCache = false;
+        for (auto& slot : spotSlots)
+            slot.cached.fill(false);
+        for (auto& slot : pointSlots)
+            slot.cached.fill(false);
+    }
+    void invalidateDirShadow() { m_dirCached.fill(false); }
+    void invalidateSpotShadow(size_t lightIndex)
+    {
+        if (lightIndex < spotSlots.size())
+            spotSlots[lightIndex].cached.fill(false);
+    }
+    void invalidatePointShadow(size_t lightIndex)
+    {
+        if (lightIndex < pointSlots.size())
+            pointSlots[lightIndex].cached.fill(false);
+    }
+    // face in the cube map order (+X, -X, +Y, -Y, +Z, -Z), or the hemisphere for a dual paraboloid light
+    void invalidatePointShadowFace(size_t lightIndex, int face)
+    {
+        if (lightIndex < pointSlots.size() && face >= 0 && face < 6)
+            pointSlots[lightIndex].cached[face] = false;
+    }
+    // texels of the atlas redrawn per frame by the lights that are not forced (moved, new tile)
+    void setShadowUpdateBudget(size_t texels) { m_shadowUpdateBudget = texels; }
+    // sun cascades: count (up to ShadowCascades::MAX_CASCADES), view distance they cover and the
+    // split scheme (0 = linear, 1 = logarithmic)
+    void setShadowCascades(size_t count)
+    {
+        cascades.SetCount(count);
+        invalidateDirShadow();
+    }
+    void setShadowDistance(float distance) { m_shadowDistance = distance; }
+    void setCascadeSplitLambda(float lambda) { cascades.SetSplitLambda(lambda); }
+    // PCF or prefiltered EVSM, per light type (the moment maps are allocated at the first use)
+    void setDirShadowFilter(ShadowFilter filter) { m_dirShadowFilter = filter; }
+    void setSpotShadowFilter(ShadowFilter filter)
+    {
+        m_spotShadowFilter = filter;
+        m_atlasMomentsValid = false;
+    }
+    void setPointShadowFilter(ShadowFilter filter)
+    {
+        m_pointShadowFilter = filter;
+        m_atlasMomentsValid = false;
+    }
+    // blur taps on each side of the moments, 0 keeps only the 2x2 box of the downsample
+    void setShadowBlurRadius(int radius)
+    {
+        cascadeMoments->SetBlurRadius(radius);
+        atlasMoments->SetBlurRadius(radius);
+        m_atlasMomentsValid = false;
+    }
+    // switch every light type between PCF and EVSM every LIGHTING_BENCHMARK_FRAMES frames and print the
+    // average GPU time of the lighting pass of both with the current light count
+    void setLightingBenchmark(bool enable)
+    {
+        m_benchmarkLighting = enable;
+        m_lightingBenchmarkFrame = 0;
+        m_lightingTime[0] = m_lightingTime[1] = 0.0;
+        m_lightingSamples[0] = m_lightingSamples[1] = 0;
+    }
+    // half resolution shadow mask for the sun and the count most important shadowed lights (up to
+    // ShadowMaskFBO::MAX_MASKED_LIGHTS), the other lights keep their shadow in the lighting pass
+    void setShadowMask(bool enable) { m_useShadowMask = enable; }
+    void setShadowMaskLights(int count) { m_shadowMaskLights = std::clamp(count, 0, ShadowMaskFBO::MAX_MASKED_LIGHTS); }
+    // resolution of the passes up to the lighting as a fraction of the window, from the minimum scale to 1
+    void setRenderScale(float scale) { m_renderScale = std::clamp(scale, m_minRenderScale, 1.0f); }
+    float getRenderScale() const { return m_renderScale; }
+    // let the GPU frame time choose the render scale, budgetMs is the target frame time
+    void setDynamicResolution(bool enable, double budgetMs = 1000.0 / 60.0)
+    {
+        m_dynamicResolution = enable;
+        m_frameBudgetMs = budgetMs;
+        m_frameTimeMs = 0.0;
+        m_frameTimeSamples = 0;
+    }
+    void setMinRenderScale(float scale)
+    {
+        m_minRenderScale = std::clamp(scale, 0.5f, 1.0f);
+        m_renderScale = std::max(m_renderScale, m_minRenderScale);
+    }
+    // print the traffic of both G-buffer layouts at the window size and at 4K when the layout is set
+    void setGBufferLayoutReport(bool enable) { m_reportGBufferLayout = enable; }
+    // G-buffer layout, with setGBufferLayoutReport prints what it costs
+    void setGBufferLayout(GBufferLayout layout)
+    {
+        gbuffer->SetLayout(layout);
+        if (!m_reportGBufferLayout)
+            return;
+
+        auto frameMB = [](GBufferLayout l, int width, int height) {
+            // written once by the geometry pass and read once by the lighting pass
+            return 2.0 * static_cast<double>(GBufferFBO::BytesPerPixel(l)) * width * height / (1024.0 * 1024.0);
+        };
+        auto report = [&](int width, int height) {
+            double standard = frameMB(GBufferLayout::Standard, width, height);
+            double compact = frameMB(GBufferLayout::Compact, width, height);
+            std::cout << "G-buffer " << width << "x" << height << ": standard " << standard << " MB/frame, compact "
+                << compact << " MB/frame, saved " << standard - compact << " MB/frame" << std::endl;
+        };
+        std::cout << "G-buffer layout: " << (layout == GBufferLayout::Compact ? "compact" : "standard") << std::endl;
+        report(m_context.getWidth(), m_context.getHeight());
+        report(3840, 2160);
+    }
+
 private:
-    void renderShadowMaps()
+    // sort the commands by mesh (the material is owned by the mesh, so a mesh is also a material state)
+    // and write the model matrices of every group in the instance buffer of the frame
+    void buildInstanceBatches()
     {
+        PROFILE_SCOPE("BuildInstanceBatches");
+        instanceBatches.clear();
+        frameInstances->Begin();
+
+        std::stable_sort(renderCommands.begin(), renderCommands.end(),
+            [](const RenderCommand& a, const RenderCommand& b) {
+                if (a.mesh.get() != b.mesh.get())
+                    return std::less<const BasicMesh*>()(a.mesh.get(), b.mesh.get());
+                // dynamic casters, static casters, then the rest
+                auto rank = [](const RenderCommand& c) { return !c.castShadows ? 2 : (c.isStatic ? 1 : 0); };
+                return rank(a) < rank(b);
+            });
+
+        for (const auto& cmd : renderCommands)
+        {
+            if (instanceBatches.empty() || instanceBatches.back().mesh != cmd.mesh.get())
+                instanceBatches.push_back({ cmd.mesh.get(), 0, frameInstances->Append(cmd.modelMatrix), 0, 0, 0, nullptr });
+            else
+                frameInstances->Append(cmd.modelMatrix);
+
+            InstanceBatch& batch = instanceBatches.back();
+            batch.instanceCount++;
+            if (cmd.castShadows)
+                batch.shadowCount++;
+            if (cmd.castShadows && !cmd.isStatic)
+                batch.dynamicShadowCount++;
+        }
 
-        // decrease peter panning 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
+        frameInstances->Upload();
+        for (auto& batch : instanceBatches)
+        {
+            batch.buffer = frameInstances->GetBuffer();
+            batch.matrices = frameInstances->GetMatrices().data() + batch.firstInstance;
+        }
 
-        // Sunlight shadow casting 
-        shadowDirMap->BindForWriting();
-        glClear(GL_DEPTH_BUFFER_BIT);
+        // the InstancedMeshRenderer are already on the GPU
+        for (const auto& insCmd : instancedCommands)
+        {
+            const InstanceSet& set = *insCmd.instances;
+            GLuint count = static_cast<GLuint>(set.GetCount());
+            GLuint shadowCount = insCmd.castShadows ? count : 0;
+            instanceBatches.push_back({ insCmd.mesh.get(), set.GetBuffer(), set.GetFirstInstance(), count, shadowCount, set.IsStatic() ? 0 : shadowCount, set.GetMatrices().data() });
+        }
+    }
+
+    // write the dirty matrices of the instance sets in the region of this frame
+    void syncInstanceSets()
+    {
+        PROFILE_SCOPE("SyncInstanceSets");
+        for (const auto& insCmd : instancedCommands)
+            insCmd.instances->Sync(m_frameIndex);
+    }
+
+    void fenceInstanceSets()
+    {
+        for (const auto& insCmd : instancedCommands)
+            insCmd.instances->Fence();
+    }
+
+    // with the cache the static casters are already in the restored maps, only the dynamic ones are drawn
+    bool drawCaster(bool castShadows, bool isStatic) const { return castShadows && !(m_useShadowCache && isStatic); }
+    GLuint shadowInstances(const InstanceBatch& batch) const { return m_useShadowCache ? batch.dynamicShadowCount : batch.shadowCount; }
+    // the sun map bound with the cache was just restored from it and must be kept
+    void clearShadowTarget()
+    {
+        if (!m_useShadowCache)
+            glClear(GL_DEPTH_BUFFER_BIT);
+    }
 
-        shadowDirMap->shader->use();
-        glm::mat4 lightSpaceMatrix = lightData.sunLight.Projection * lightData.sunLight.View;
-        shadowDirMap->shader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+    // one instanced draw per batch with the shadow casters of the batch
+    void drawShadowBatches(const Shader& shader)
+    {
+        for (const auto& batch : instanceBatches)
+            batch.mesh->RenderInstanced(shader, batch.buffer, batch.firstInstance, shadowInstances(batch));
+    }
+
+    // every caster instance is tested against the frustum of every face, the survivors of a face
+    // are written in a per face range of pointFaceInstances and drawn in the atlas tile of the face
+    void renderPointShadowFaces()
+    {
+        faceBatches.clear();
+        pointFaceInstances->Begin();
+        for (size_t i : pointUpdates)
+        {
+            if (isParaboloid(lightData.pointLights[i])) continue;
+            std::array<glm::mat4, 6> faceMatrices = PointShadowFaceMatrices(lightData.pointLights[i]);
+            for (int face = 0; face < 6; ++face)
+            {
+                ++m_pointFacesTotal;
+                cullShadowBatches(FrustumPlanes(faceMatrices[face]), *pointFaceInstances, faceBatches, static_cast<int>(i), face);
+            }
+        }
+        pointFaceInstances->Upload();
+
+        shadowPointFaceShader->use();
+        int boundLayer = -1;
+        // the batches are sorted by light, one scope per light
+        int profiledLight = -1;
+        for (const auto& faceBatch : faceBatches)
+        {
+            int layer = faceBatch.light * 6 + faceBatch.face;
+            if (faceBatch.light != profiledLight)
+            {
+                if (profiledLight >= 0)
+                    GpuProfiler::Get().Pop();
+                GpuProfiler::Get().Push("Point", faceBatch.light);
+                profiledLight = faceBatch.light;
+            }
+            if (layer != boundLayer)
+            {
+                shadowAtlas->SetViewport(pointSlots[faceBatch.light].tile, faceBatch.face);
+                SetupPointShadowFaceUniforms(lightData.pointLights[faceBatch.light], faceBatch.face, *shadowPointFaceShader);
+                boundLayer = layer;
+                ++m_pointFacesDrawn;
+            }
+            faceBatch.mesh->RenderInstanced(*shadowPointFaceShader, pointFaceInstances->GetBuffer(), faceBatch.firstInstance, faceBatch.instanceCount);
+        }
+        if (profiledLight >= 0)
+            GpuProfiler::Get().Pop();
+    }
 
-        for (auto [modelMatrix, mesh, castShadows, receiveShadows] : renderCommands)
+    // append to instances the casters of every batch inside planes, one FaceBatch per batch with survivors
+    void cullShadowBatches(const CullPlanes& planes, FrameInstanceBuffer& instances, std::vector<FaceBatch>& batches, int light, int face)
+    {
+        for (const auto& batch : instanceBatches)
         {
-            if (!castShadows) continue;
+            const glm::vec4& sphere = batch.mesh->GetBoundingSphere();
+            GLuint first = static_cast<GLuint>(instances.GetCount());
+            GLuint count = 0;
+            for (GLuint k = 0; k < shadowInstances(batch); k++)
+            {
+                if (!SphereInsidePlanes(planes, TransformBoundingSphere(sphere, batch.matrices[k]))) continue;
+                instances.Append(batch.matrices[k]);
+                count++;
+            }
+            if (count != 0)
+                batches.push_back({ batch.mesh, first, count, light, face });
+        }
+    }
 
-            shadowDirMap->shader->setMat4("model", modelMatrix);
-            mesh->Render(shadowDirMap->shader);
+    // the sun cascades of the auto instancing path, every cascade draws only the casters inside its own box
+    void renderCascadeShadows()
+    {
+        cascadeBatches.clear();
+        cascadeInstances->Begin();
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+            cullShadowBatches(FrustumPlanes(cascades.GetMatrix(c)), *cascadeInstances, cascadeBatches, 0, static_cast<int>(c));
+        cascadeInstances->Upload();
+
+        shadowInstancedShader->use();
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+        {
+            GPU_PROFILE_SCOPE("Cascade", static_cast<int>(c));
+            shadowDirMap->BindLayerForWriting(static_cast<int>(c));
+            clearShadowTarget();
+            shadowInstancedShader->setMat4("lightSpaceMatrix", cascades.GetMatrix(c));
+            for (const auto& cascadeBatch : cascadeBatches)
+                if (cascadeBatch.face == static_cast<int>(c))
+                    cascadeBatch.mesh->RenderInstanced(*shadowInstancedShader, cascadeInstances->GetBuffer(), cascadeBatch.firstInstance, cascadeBatch.instanceCount);
         }
+    }
+
+    static bool isParaboloid(const PointLight& light) { return light.shadowType == PointShadowType::DualParaboloid; }
+
+    // half of the box around the light covered by a paraboloid hemisphere (0 = +Z, 1 = -Z)
+    static CullPlanes HemispherePlanes(const PointLight& light, int hemisphere)
+    {
+        glm::vec3 minCorner = light.Pos - glm::vec3(light.far_plane);
+        glm::vec3 maxCorner = light.Pos + glm::vec3(light.far_plane);
+        if (hemisphere == 0)
+            minCorner.z = light.Pos.z;
+        else
+            maxCorner.z = light.Pos.z;
+        return BoxPlanes(minCorner, maxCorner);
+    }
+
+    // call drawHemisphere with the viewport on the atlas tile of each hemisphere of the updated lights,
+    // drawHemisphere select the program and draws the casters
+    void renderParaboloidShadows(const std::function<void(const PointLight&, size_t, int)>& drawHemisphere)
+    {
+        bool any = std::any_of(pointUpdates.begin(), pointUpdates.end(),
+            [this](size_t i) { return isParaboloid(lightData.pointLights[i]); });
+        if (!any)
+            return;
 
-        // SpotLight shadow casting  
-        shadowSpotMap->shader->use();
-        for (size_t i{ 0 }; i < lightData.spotLights.size(); i++)
+        GLState::Enable(GL_CLIP_DISTANCE0);
+        for (size_t i : pointUpdates)
         {
-            shadowSpotMap->BindLayerForWriting(static_cast<int>(i));
+            const auto& light = lightData.pointLights[i];
+            if (!isParaboloid(light)) continue;
+            GPU_PROFILE_SCOPE("Point", static_cast<int>(i));
+            for (int hemisphere = 0; hemisphere < 2; ++hemisphere)
+            {
+                shadowAtlas->SetViewport(pointSlots[i].tile, hemisphere);
+                drawHemisphere(light, i, hemisphere);
+            }
+        }
+        GLState::Disable(GL_CLIP_DISTANCE0);
+    }
 
+    // world bounding spheres of the shadow casters, used to skip the empty cube faces of the indirect path
+    void collectCasterSpheres()
+    {
+        casterSpheres.clear();
+        for (const auto& cmd : renderCommands)
+            if (drawCaster(cmd.castShadows, cmd.isStatic))
+                casterSpheres.push_back(TransformBoundingSphere(cmd.mesh->GetBoundingSphere(), cmd.modelMatrix));
+        for (const auto& insCmd : instancedCommands)
+        {
+            if (!drawCaster(insCmd.castShadows, insCmd.instances->IsStatic())) continue;
+            for (const auto& model : insCmd.instances->GetMatrices())
+                casterSpheres.push_back(TransformBoundingSphere(insCmd.mesh->GetBoundingSphere(), model));
+        }
+    }
+
+    bool anyCasterInside(const CullPlanes& planes) const
+    {
+        for (const auto& sphere : casterSpheres)
+            if (SphereInsidePlanes(planes, sphere))
+                return true;
+        return false;
+    }
+
+    void beginPointShadowTiming()
+    {
+        if (m_benchmarkPointShadows)
+            pointShadowTimer.Begin(static_cast<int>(m_pointShadowMode));
+    }
+
+    void endPointShadowTiming()
+    {
+        if (m_benchmarkPointShadows)
+            pointShadowTimer.End();
+    }
+
+    // collect the finished measures, switch mode and print the comparison once both modes have a full window
+    void updatePointShadowBenchmark()
+    {
+        double ms;
+        int tag;
+        while (pointShadowTimer.Poll(ms, tag))
+        {
+            m_benchmarkTime[tag] += ms;
+            m_benchmarkSamples[tag]++;
+        }
+
+        if (++m_benchmarkFrame % POINT_BENCHMARK_FRAMES != 0)
+            return;
+
+        bool perFace = m_pointShadowMode == PointShadowMode::PerFace;
+        m_pointShadowMode = perFace ? PointShadowMode::GeometryShader : PointShadowMode::PerFace;
+
+        if (m_benchmarkSamples[0] == 0 || m_benchmarkSamples[1] == 0)
+            return;
+
+        std::cout << "Point shadows (" << lightData.pointLights.size() << " lights): geometry shader "
+            << m_benchmarkTime[0] / m_benchmarkSamples[0] << " ms, per face "
+            << m_benchmarkTime[1] / m_benchmarkSamples[1] << " ms, faces drawn "
+            << m_pointFacesDrawn << "/" << m_pointFacesTotal << std::endl;
+
+        m_benchmarkTime[0] = m_benchmarkTime[1] = 0.0;
+        m_benchmarkSamples[0] = m_benchmarkSamples[1] = 0;
+        m_pointFacesDrawn = m_pointFacesTotal = 0;
+    }
+
+    // the InstancedMeshRenderer casters of the one draw per mesh path
+    void drawInstancedCasters(const Shader& shader)
+    {
+        for (const auto& insCmd : instancedCommands)
+        {
+            if (!drawCaster(insCmd.castShadows, insCmd.instances->IsStatic())) continue;
+            const InstanceSet& set = *insCmd.instances;
+            insCmd.mesh->RenderInstanced(shader, set.GetBuffer(), set.GetFirstInstance(), static_cast<unsigned int>(set.GetCount()));
+        }
+    }
+
+    // every caster batch is drawn once for all the updated spot lights: instance i is the caster
+    // i / viewportCount in the viewport (the atlas tile of a light) i % viewportCount,
+    // the lights beyond MAX_LAYERED_SPOT_LIGHTS take another draw per batch
+    void renderLayeredSpotShadows()
+    {
+        std::vector<glm::mat4> lightSpaceMatrices;
+        shadowSpotLayeredShader->use();
+        for (size_t first = 0; first < spotUpdates.size(); first += MAX_LAYERED_SPOT_LIGHTS)
+        {
+            const size_t viewportCount = std::min(MAX_LAYERED_SPOT_LIGHTS, spotUpdates.size() - first);
+            // the lights of a group are drawn together, the group is the smallest scope to measure
+            GPU_PROFILE_SCOPE("Spot group", static_cast<int>(first / MAX_LAYERED_SPOT_LIGHTS));
+            lightSpaceMatrices.clear();
+            for (size_t k = 0; k < viewportCount; k++)
+            {
+                const size_t i = spotUpdates[first + k];
+                const auto& light = lightData.spotLights[i];
+                lightSpaceMatrices.push_back(light.Projection * light.View);
+                shadowAtlas->SetViewport(static_cast<GLuint>(k), spotSlots[i].tile, 0);
+            }
+            shadowSpotLayeredShader->setMat4Array("lightSpaceMatrices", lightSpaceMatrices.data(), static_cast<int>(viewportCount));
+            shadowSpotLayeredShader->setInt("viewportCount", static_cast<int>(viewportCount));
+
+            for (const auto& batch : instanceBatches)
+            {
+                if (shadowInstances(batch) == 0) continue;
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_MATRIX_SSBO_BINDING, batch.buffer);
+                shadowSpotLayeredShader->setInt("firstInstance", static_cast<int>(batch.firstInstance));
+                batch.mesh->RenderInstancedDepth(shadowInstances(batch) * static_cast<GLuint>(viewportCount));
+            }
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_MATRIX_SSBO_BINDING, 0);
+    }
+
+    bool hasDynamicCasters() const
+    {
+        for (const auto& cmd : renderCommands)
+            if (cmd.castShadows && !cmd.isStatic)
+                return true;
+        for (const auto& insCmd : instancedCommands)
+            if (insCmd.castShadows && !insCmd.instances->IsStatic())
+                return true;
+        return false;
+    }
+
+    static void hashCombine(size_t& seed, size_t value)
+    {
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    // identity of the static caster set: meshes, model matrices and versions of the static instance sets
+    size_t hashStaticCasters() const
+    {
+        size_t seed = 0;
+        for (const auto& cmd : renderCommands)
+        {
+            if (!cmd.castShadows || !cmd.isStatic) continue;
+            hashCombine(seed, std::hash<const BasicMesh*>()(cmd.mesh.get()));
+            const float* values = &cmd.modelMatrix[0][0];
+            for (int k = 0; k < 16; k++)
+                hashCombine(seed, std::hash<float>()(values[k]));
+        }
+        for (const auto& insCmd : instancedCommands)
+        {
+            if (!insCmd.castShadows || !insCmd.instances->IsStatic()) continue;
+            hashCombine(seed, std::hash<const BasicMesh*>()(insCmd.mesh.get()));
+            hashCombine(seed, std::hash<const InstanceSet*>()(insCmd.instances.get()));
+            hashCombine(seed, insCmd.instances->GetVersion());
+        }
+        return seed;
+    }
+
+    static glm::mat4 pointShadowKey(const PointLight& light)
+    {
+        glm::mat4 key(0.f);
+        key[0] = glm::vec4(light.Pos, light.far_plane);
+        key[1] = glm::vec4(light.near_plane, static_cast<float>(light.shadowType), 0.f, 0.f);
+        return key;
+    }
+
+    // projected radius of a sphere over half the screen height, 1 when the camera is inside it
+    float screenCoverage(const glm::vec3& center, float radius) const
+    {
+        float distance = glm::length(m_context.getCamera().Position - center);
+        if (distance <= radius)
+            return 1.0f;
+        return std::min(1.0f, radius * projectionMatrix[1][1] / distance);
+    }
+
+    // power of two tile side for a coverage, the current size is kept until the coverage is clearly out of its range
+    static unsigned int shadowTileSize(float coverage, unsigned int current)
+    {
+        float texels = coverage * static_cast<float>(MAX_SHADOW_TILE_SIZE);
+        unsigned int size = ShadowAtlas::MIN_TILE_SIZE;
+        while (size < MAX_SHADOW_TILE_SIZE && static_cast<float>(size * 2) <= texels)
+            size *= 2;
+        if (current != 0 && size > current && texels < current * 2.4f)
+            return current;
+        if (current != 0 && size < current && texels > current * 0.8f)
+            return current;
+        return size;
+    }
+
+    static size_t tileTexels(const ShadowAtlas::Tile& tile)
+    {
+        return static_cast<size_t>(tile.size) * tile.size * tile.tileCount;
+    }
+
+    // place the tiles of the lights in the atlas and choose the lights drawn in this frame: the forced ones
+    // (new or moved tile, moved light) always, then the most overdue ones until the texel budget is spent
+    void updateShadowAtlas()
+    {
+        spotSlots.resize(lightData.spotLights.size());
+        pointSlots.resize(lightData.pointLights.size());
+
+        std::vector<ShadowAtlas::Request> requests;
+        std::vector<glm::mat4> keys;
+        for (size_t i = 0; i < spotSlots.size(); i++)
+        {
+            const auto& light = lightData.spotLights[i];
+            // the cone is approximated by the sphere around its first half
+            float radius = light.far_plane * 0.5f;
+            float coverage = screenCoverage(light.Pos + glm::normalize(light.Dir) * radius, radius);
+            spotSlots[i].coverage = coverage;
+            spotSlots[i].wantedSize = shadowTileSize(coverage, spotSlots[i].wantedSize);
+            requests.push_back({ 1, spotSlots[i].wantedSize, coverage });
+            keys.push_back(light.Projection * light.View);
+        }
+        for (size_t i = 0; i < pointSlots.size(); i++)
+        {
+            const auto& light = lightData.pointLights[i];
+            float coverage = screenCoverage(light.Pos, light.far_plane);
+            pointSlots[i].coverage = coverage;
+            pointSlots[i].wantedSize = shadowTileSize(coverage, pointSlots[i].wantedSize);
+            requests.push_back({ isParaboloid(light) ? 2u : 6u, pointSlots[i].wantedSize, coverage });
+            keys.push_back(pointShadowKey(light));
+        }
+        shadowAtlas->Allocate(requests);
+
+        const auto& tiles = shadowAtlas->GetTiles();
+        size_t budget = m_shadowUpdateBudget;
+        std::vector<std::pair<float, ShadowSlot*>> candidates;
+        for (size_t k = 0; k < requests.size(); k++)
+        {
+            ShadowSlot& slot = k < spotSlots.size() ? spotSlots[k] : pointSlots[k - spotSlots.size()];
+            bool forced = slot.lastUpdate == 0;
+            if (slot.tile != tiles[k] || slot.key != keys[k])
+            {
+                slot.tile = tiles[k];
+                slot.key = keys[k];
+                slot.cached.fill(false);
+                slot.liveIsCache = false;
+                forced = true;
+            }
+
+            slot.update = false;
+            if (slot.tile.size == 0) continue;
+            // full size tiles every frame, a quarter of the side every 4 frames
+            slot.interval = std::clamp(MAX_SHADOW_TILE_SIZE / slot.tile.size, 1u, MAX_SHADOW_UPDATE_INTERVAL);
+            if (forced)
+            {
+                slot.update = true;
+                budget -= std::min(budget, tileTexels(slot.tile));
+            }
+            else if (m_frameIndex - slot.lastUpdate >= slot.interval)
+                candidates.push_back({ static_cast<float>(m_frameIndex - slot.lastUpdate) / static_cast<float>(slot.interval), &slot });
+        }
+
+        // the most overdue first, it is drawn even if it alone exceeds the budget so no light starves
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            ShadowSlot& slot = *candidates[c].second;
+            const size_t texels = tileTexels(slot.tile);
+            if (texels > budget && c != 0) continue;
+            slot.update = true;
+            budget -= std::min(budget, texels);
+        }
+
+        for (auto* slots : { &spotSlots, &pointSlots })
+            for (auto& slot : *slots)
+                if (slot.update)
+                    slot.lastUpdate = m_frameIndex;
+    }
+
+    void collectShadowUpdates()
+    {
+        spotUpdates.clear();
+        pointUpdates.clear();
+        for (size_t i = 0; i < spotSlots.size(); i++)
+            if (spotSlots[i].update)
+                spotUpdates.push_back(i);
+        for (size_t i = 0; i < pointSlots.size(); i++)
+            if (pointSlots[i].update)
+                pointUpdates.push_back(i);
+    }
+
+    // the tiles drawn in this frame start from the cached static casters, or empty without the cache
+    void prepareShadowTiles()
+    {
+        shadowAtlas->BindForWriting();
+        auto prepare = [this](const ShadowSlot& slot) {
+            for (unsigned int offset = 0; offset < slot.tile.tileCount; ++offset)
+            {
+                if (m_useShadowCache)
+                    shadowAtlas->CopyTileFrom(*shadowAtlasCache, slot.tile, offset);
+                else
+                    shadowAtlas->ClearTile(slot.tile, offset);
+            }
+        };
+        for (size_t i : spotUpdates)
+            prepare(spotSlots[i]);
+        for (size_t i : pointUpdates)
+            prepare(pointSlots[i]);
+        GL_CHECK();
+    }
+
+    void cullStaticCasters(const CullPlanes& planes)
+    {
+        if (m_useGpuCulling)
+            indirectStaticShadows->Cull(planes);
+        else
+            indirectStaticShadows->ResetCulling();
+    }
+
+    // the live tiles of a light with a redrawn cached view are restored in this frame
+    void markCacheRedrawn(ShadowSlot& slot)
+    {
+        slot.update = true;
+        slot.liveIsCache = false;
+        slot.lastUpdate = m_frameIndex;
+    }
+
+    // draw the static casters in the invalid views of the caches, one view at a time with the indirect
+    // shaders whatever path renders the dynamic casters, return true if the sun cache was redrawn
+    bool updateShadowCache()
+    {
+        size_t staticHash = hashStaticCasters();
+        if (staticHash != m_staticCasterHash)
+        {
+            // a static caster moved, was added or removed: every view can be affected
+            m_staticCasterHash = staticHash;
+            indirectStaticShadows->Begin();
+            for (const auto& cmd : renderCommands)
+                if (cmd.castShadows && cmd.isStatic)
+                    indirectStaticShadows->AddMesh(*cmd.mesh, cmd.modelMatrix);
+            for (const auto& insCmd : instancedCommands)
+                if (insCmd.castShadows && insCmd.instances->IsStatic())
+                    indirectStaticShadows->AddInstances(*insCmd.mesh, *insCmd.instances);
+            indirectStaticShadows->Upload();
+            invalidateShadowCache();
+        }
+
+        GLState::Enable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+
+        // Sunlight, a cascade is redrawn when its snapped box moves
+        bool dirUpdated = false;
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+        {
+            const glm::mat4& lightSpaceMatrix = cascades.GetMatrix(c);
+            if (m_dirCached[c] && m_dirCacheKey[c] == lightSpaceMatrix) continue;
+            shadowDirCache->BindLayerForWriting(static_cast<int>(c));
             glClear(GL_DEPTH_BUFFER_BIT);
+            cullStaticCasters(FrustumPlanes(lightSpaceMatrix));
+            shadowIndirectShader->use();
+            shadowIndirectShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+            indirectStaticShadows->Draw(*shadowIndirectShader);
+            m_dirCacheKey[c] = lightSpaceMatrix;
+            m_dirCached[c] = true;
+            dirUpdated = true;
+        }
 
-            const auto light = lightData.spotLights[i];
+        // SpotLight, the tiles of the cache atlas are placed as the ones of the live atlas
+        shadowAtlasCache->BindForWriting();
+        for (size_t i = 0; i < spotSlots.size(); i++)
+        {
+            ShadowSlot& slot = spotSlots[i];
+            if (slot.tile.size == 0 || slot.cached[0]) continue;
+
+            const auto& light = lightData.spotLights[i];
+            glm::mat4 lightSpaceMatrix = light.Projection * light.View;
+            shadowAtlasCache->SetViewport(slot.tile, 0);
+            shadowAtlasCache->ClearTile(slot.tile, 0);
+            cullStaticCasters(FrustumPlanes(lightSpaceMatrix));
+            shadowIndirectShader->use();
+            shadowIndirectShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+            indirectStaticShadows->Draw(*shadowIndirectShader);
+            slot.cached[0] = true;
+            markCacheRedrawn(slot);
+        }
+
+        // Pointlight, every cube face or paraboloid hemisphere is a view of its own
+        for (size_t i = 0; i < pointSlots.size(); i++)
+        {
+            ShadowSlot& slot = pointSlots[i];
+            if (slot.tile.size == 0) continue;
+            const auto& light = lightData.pointLights[i];
+
+            if (isParaboloid(light))
+            {
+                GLState::Enable(GL_CLIP_DISTANCE0);
+                for (int hemisphere = 0; hemisphere < 2; ++hemisphere)
+                {
+                    if (slot.cached[hemisphere]) continue;
+                    shadowAtlasCache->SetViewport(slot.tile, hemisphere);
+                    shadowAtlasCache->ClearTile(slot.tile, hemisphere);
+                    cullStaticCasters(HemispherePlanes(light, hemisphere));
+                    shadowParaboloidIndirectShader->use();
+                    SetupParaboloidShadowUniforms(light, hemisphere, *shadowParaboloidIndirectShader);
+                    indirectStaticShadows->Draw(*shadowParaboloidIndirectShader);
+                    slot.cached[hemisphere] = true;
+                    markCacheRedrawn(slot);
+                }
+                GLState::Disable(GL_CLIP_DISTANCE0);
+                continue;
+            }
+
+            std::array<glm::mat4, 6> faceMatrices = PointShadowFaceMatrices(light);
+            for (int face = 0; face < 6; ++face)
+            {
+                if (slot.cached[face]) continue;
+                shadowAtlasCache->SetViewport(slot.tile, face);
+                shadowAtlasCache->ClearTile(slot.tile, face);
+                cullStaticCasters(FrustumPlanes(faceMatrices[face]));
+                shadowPointFaceIndirectShader->use();
+                SetupPointShadowFaceUniforms(light, face, *shadowPointFaceIndirectShader);
+                indirectStaticShadows->Draw(*shadowPointFaceIndirectShader);
+                slot.cached[face] = true;
+                markCacheRedrawn(slot);
+            }
+        }
+
+        glCullFace(GL_BACK);
+        return dirUpdated;
+    }
+
+    // copy the cached static depth of the sun cascades over the live ones (same size and format, so a plain image copy)
+    void restoreDirShadowCache()
+    {
+        glCopyImageSubData(shadowDirCache->GetTexture(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+            shadowDirMap->GetTexture(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+            shadowDirMap->s_Width, shadowDirMap->s_Height, static_cast<GLsizei>(cascades.GetCount()));
+        GL_CHECK();
+    }
+
+    void renderShadowMaps()
+    {
+        PROFILE_SCOPE("Shadows");
+        renderShadowDepth();
+    }
+
+    // convert the depth drawn in this frame in moments for the light types filtered with EVSM, the graph
+    // culls these passes when no light type reads them
+    bool atlasUsesMoments() const { return m_spotShadowFilter == ShadowFilter::EVSM || m_pointShadowFilter == ShadowFilter::EVSM; }
+
+    void updateCascadeMoments(GLuint scratch)
+    {
+        if (!cascadeMoments->IsInitialized())
+            cascadeMoments->Init();
+        std::vector<ShadowMomentMap::Region> regions;
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+            regions.push_back({ static_cast<int>(c), glm::ivec4(0, 0, CASCADE_SIZE, CASCADE_SIZE) });
+        cascadeMoments->Update(shadowDirMap->GetTexture(), GL_TEXTURE_2D_ARRAY, regions, scratch);
+    }
+
+    void updateAtlasMoments(GLuint scratch)
+    {
+        const bool spotMoments = m_spotShadowFilter == ShadowFilter::EVSM;
+        const bool pointMoments = m_pointShadowFilter == ShadowFilter::EVSM;
+        if (!atlasMoments->IsInitialized())
+            atlasMoments->Init();
+
+        std::vector<ShadowMomentMap::Region> regions;
+        auto addTiles = [&](const ShadowSlot& slot) {
+            for (unsigned int offset = 0; offset < slot.tile.tileCount; ++offset)
+                regions.push_back({ 0, shadowAtlas->GetTileRect(slot.tile, offset) });
+        };
+        for (size_t i = 0; i < spotSlots.size(); i++)
+            if (spotMoments && spotSlots[i].tile.size != 0 && (spotSlots[i].update || !m_atlasMomentsValid))
+                addTiles(spotSlots[i]);
+        for (size_t i = 0; i < pointSlots.size(); i++)
+            if (pointMoments && pointSlots[i].tile.size != 0 && (pointSlots[i].update || !m_atlasMomentsValid))
+                addTiles(pointSlots[i]);
+        atlasMoments->Update(shadowAtlas->GetTexture(), GL_TEXTURE_2D, regions, scratch);
+        m_atlasMomentsValid = true;
+    }
+
+    void renderShadowDepth()
+    {
+        if (m_benchmarkPointShadows)
+            updatePointShadowBenchmark();
+
+        cascades.Update(viewMatrix, projectionMatrix, lightData.sunLight.Direction, m_shadowDistance, lightData.sunLight.far_plane, CASCADE_SIZE);
+        updateShadowAtlas();
+        if (m_useShadowCache)
+        {
+            bool dirUpdated = updateShadowCache();
+            bool dynamicCasters = hasDynamicCasters();
+            if (dirUpdated || !m_dirLiveIsCache)
+                restoreDirShadowCache();
+            m_dirLiveIsCache = !dynamicCasters;
+
+            for (auto* slots : { &spotSlots, &pointSlots })
+            {
+                for (auto& slot : *slots)
+                {
+                    // without dynamic casters a tile that already holds the cache has nothing to redraw
+                    if (!dynamicCasters && slot.liveIsCache)
+                        slot.update = false;
+                    if (slot.update)
+                        slot.liveIsCache = !dynamicCasters;
+                }
+            }
+            collectShadowUpdates();
+            prepareShadowTiles();
+
+            // nothing to draw on top of the restored maps
+            if (!dynamicCasters)
+                return;
+        }
+        else
+        {
+            collectShadowUpdates();
+            prepareShadowTiles();
+        }
+
+        if (m_useIndirectDraw)
+            renderIndirectShadowMaps();
+        else if (m_useAutoInstancing)
+            renderInstancedShadowMaps();
+        else
+            renderDirectShadowMaps();
+    }
+
+    // the casters are uploaded once, then every light cull them with its own volume and draw the survivors
+    void renderIndirectShadowMaps()
+    {
+        indirectShadows->Begin();
+        for (const auto& cmd : renderCommands)
+            if (drawCaster(cmd.castShadows, cmd.isStatic))
+                indirectShadows->AddMesh(*cmd.mesh, cmd.modelMatrix);
+        for (const auto& insCmd : instancedCommands)
+            if (drawCaster(insCmd.castShadows, insCmd.instances->IsStatic()))
+                indirectShadows->AddInstances(*insCmd.mesh, *insCmd.instances);
+        indirectShadows->Upload();
+
+        auto cullShadowCasters = [this](const CullPlanes& planes) {
+            if (m_useGpuCulling)
+                indirectShadows->Cull(planes);
+            else
+                indirectShadows->ResetCulling();
+        };
+
+        GLState::Enable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+
+        // Sunlight shadow casting, every cascade culls the casters with its own box
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+        {
+            GPU_PROFILE_SCOPE("Cascade", static_cast<int>(c));
+            shadowDirMap->BindLayerForWriting(static_cast<int>(c));
+            clearShadowTarget();
+            cullShadowCasters(FrustumPlanes(cascades.GetMatrix(c)));
+            shadowIndirectShader->use();
+            shadowIndirectShader->setMat4("lightSpaceMatrix", cascades.GetMatrix(c));
+            indirectShadows->Draw(*shadowIndirectShader);
+        }
+
+        // SpotLight shadow casting, in the atlas tile of the lights updated in this frame
+        shadowAtlas->BindForWriting();
+        for (size_t i : spotUpdates)
+        {
+            GPU_PROFILE_SCOPE("Spot", static_cast<int>(i));
+            shadowAtlas->SetViewport(spotSlots[i].tile, 0);
+
+            const auto& light = lightData.spotLights[i];
             glm::mat4 lightSpaceMatrix = light.Projection * light.View;
+            cullShadowCasters(FrustumPlanes(lightSpaceMatrix));
+            shadowIndirectShader->use();
+            shadowIndirectShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+            indirectShadows->Draw(*shadowIndirectShader);
+        }
+
+        // Pointlight shadow casting, the cube map covers the box of side 2 * far_plane around the light
+        if (!pointUpdates.empty())
+        {
+            beginPointShadowTiming();
+            if (m_pointShadowMode == PointShadowMode::PerFace)
+            {
+                // the faces without casters keep the cleared (or cached) depth and are not drawn at all
+                collectCasterSpheres();
+                for (size_t i : pointUpdates)
+                {
+                    const auto& light = lightData.pointLights[i];
+                    if (isParaboloid(light)) continue;
+                    GPU_PROFILE_SCOPE("Point", static_cast<int>(i));
+                    std::array<glm::mat4, 6> faceMatrices = PointShadowFaceMatrices(light);
+                    for (int face = 0; face < 6; ++face)
+                    {
+                        CullPlanes planes = FrustumPlanes(faceMatrices[face]);
+                        ++m_pointFacesTotal;
+                        if (!anyCasterInside(planes)) continue;
+                        ++m_pointFacesDrawn;
+
+                        shadowAtlas->SetViewport(pointSlots[i].tile, face);
+                        cullShadowCasters(planes);
+                        shadowPointFaceIndirectShader->use();
+                        SetupPointShadowFaceUniforms(light, face, *shadowPointFaceIndirectShader);
+                        indirectShadows->Draw(*shadowPointFaceIndirectShader);
+                    }
+                }
+            }
+            else
+            {
+                // the geometry shader sends every face to its own viewport, one per tile
+                for (size_t i : pointUpdates)
+                {
+                    const auto& light = lightData.pointLights[i];
+                    if (isParaboloid(light)) continue;
+                    GPU_PROFILE_SCOPE("Point", static_cast<int>(i));
+                    cullShadowCasters(BoxPlanes(light.Pos - glm::vec3(light.far_plane), light.Pos + glm::vec3(light.far_plane)));
+
+                    shadowAtlas->SetViewports(pointSlots[i].tile);
+                    shadowPointIndirectShader->use();
+                    SetupPointShadowUniforms(light, *shadowPointIndirectShader);
+                    indirectShadows->Draw(*shadowPointIndirectShader);
+                }
+            }
+
+            renderParaboloidShadows([&](const PointLight& light, size_t, int hemisphere) {
+                cullShadowCasters(HemispherePlanes(light, hemisphere));
+                shadowParaboloidIndirectShader->use();
+                SetupParaboloidShadowUniforms(light, hemisphere, *shadowParaboloidIndirectShader);
+                indirectShadows->Draw(*shadowParaboloidIndirectShader);
+            });
+            endPointShadowTiming();
+        }
+        glCullFace(GL_BACK);
+    }
+
+    void renderInstancedShadowMaps()
+    {
+        GLState::Enable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
 
-            shadowSpotMap->shader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        // Sunlight shadow casting
+        renderCascadeShadows();
 
-            for (auto [modelMatrix, mesh, castShadows, receiveShadows] : renderCommands)
+        // SpotLight shadow casting
+        shadowAtlas->BindForWriting();
+        if (m_useLayeredSpotShadows && !spotUpdates.empty())
+            renderLayeredSpotShadows();
+        else
+        {
+            // the cascades leave their own shader bound
+            shadowInstancedShader->use();
+            for (size_t i : spotUpdates)
             {
-                if (!castShadows) continue;
+                GPU_PROFILE_SCOPE("Spot", static_cast<int>(i));
+                shadowAtlas->SetViewport(spotSlots[i].tile, 0);
 
-                shadowSpotMap->shader->setMat4("model", modelMatrix);
-                mesh->Render(shadowSpotMap->shader);
+                const auto& light = lightData.spotLights[i];
+                shadowInstancedShader->setMat4("lightSpaceMatrix", light.Projection * light.View);
+                drawShadowBatches(*shadowInstancedShader);
             }
         }
 
         // Pointlight shadow casting
-        if (m_pointShadowsInitialized && !lightData.pointLights.empty())
+        if (!pointUpdates.empty())
         {
-            shadowPointMap->BindForWriting(0);
-            glClear(GL_DEPTH_BUFFER_BIT);
+            beginPointShadowTiming();
+            if (m_pointShadowMode == PointShadowMode::PerFace)
+                renderPointShadowFaces();
+            else
+            {
+                shadowPointInstancedShader->use();
+                for (size_t i : pointUpdates)
+                {
+                    if (isParaboloid(lightData.pointLights[i])) continue;
+                    GPU_PROFILE_SCOPE("Point", static_cast<int>(i));
+                    shadowAtlas->SetViewports(pointSlots[i].tile);
+                    SetupPointShadowUniforms(lightData.pointLights[i], *shadowPointInstancedShader);
+                    drawShadowBatches(*shadowPointInstancedShader);
+                }
+            }
+
+            renderParaboloidShadows([&](const PointLight& light, size_t, int hemisphere) {
+                shadowParaboloidInstancedShader->use();
+                SetupParaboloidShadowUniforms(light, hemisphere, *shadowParaboloidInstancedShader);
+                drawShadowBatches(*shadowParaboloidInstancedShader);
+            });
+            endPointShadowTiming();
+        }
+        glCullFace(GL_BACK);
+    }
+
+    void renderDirectShadowMaps()
+    {
+
+        // decrease peter panning
+        GLState::Enable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+
+        // Sunlight shadow casting, the commands outside the box of a cascade are skipped
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+        {
+            GPU_PROFILE_SCOPE("Cascade", static_cast<int>(c));
+            shadowDirMap->BindLayerForWriting(static_cast<int>(c));
+            clearShadowTarget();
+
+            const glm::mat4& lightSpaceMatrix = cascades.GetMatrix(c);
+            CullPlanes planes = FrustumPlanes(lightSpaceMatrix);
+            shadowDirMap->shader->use();
+            shadowDirMap->shader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+
+            for (auto [modelMatrix, mesh, castShadows, receiveShadows, isStatic] : renderCommands)
+            {
+                if (!drawCaster(castShadows, isStatic)) continue;
+                if (!SphereInsidePlanes(planes, TransformBoundingSphere(mesh->GetBoundingSphere(), modelMatrix))) continue;
+
+                shadowDirMap->shader->setMat4("model", modelMatrix);
+                mesh->Render(shadowDirMap->shader);
+            }
+            shadowInstancedShader->use();
+            shadowInstancedShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+            drawInstancedCasters(*shadowInstancedShader);
+        }
+
+        // SpotLight shadow casting, same program of the sun
+        shadowAtlas->BindForWriting();
+        for (size_t i : spotUpdates)
+        {
+            GPU_PROFILE_SCOPE("Spot", static_cast<int>(i));
+            shadowAtlas->SetViewport(spotSlots[i].tile, 0);
+
+            const auto light = lightData.spotLights[i];
+            glm::mat4 lightSpaceMatrix = light.Projection * light.View;
 
-            shadowPointMap->shader->use();
-            for (size_t i = 0; i < lightData.pointLights.size(); ++i)
+            shadowDirMap->shader->use();
+            shadowDirMap->shader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+
+            for (auto [modelMatrix, mesh, castShadows, receiveShadows, isStatic] : renderCommands)
             {
-                // Set current light index
-                shadowPointMap->shader->setInt("lightIndex", static_cast<int>(i));
+                if (!drawCaster(castShadows, isStatic)) continue;
 
-                // Your existing setupUniformShader call
-                shadowPointMap->setupUniformShader(&lightData.pointLights[i]);
+                shadowDirMap->shader->setMat4("model", modelMatrix);
+                mesh->Render(shadowDirMap->shader);
+            }
+            shadowInstancedShader->use();
+            shadowInstancedShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+            drawInstancedCasters(*shadowInstancedShader);
+        }
 
-                for (auto [modelMatrix, mesh, castShadows, receiveShadows] : renderCommands)
+        // Pointlight shadow casting
+        if (!pointUpdates.empty())
+        {
+            for (size_t i : pointUpdates)
+            {
+                if (isParaboloid(lightData.pointLights[i])) continue;
+                GPU_PROFILE_SCOPE("Point", static_cast<int>(i));
+                shadowAtlas->SetViewports(pointSlots[i].tile);
+                shadowPointShader->use();
+                SetupPointShadowUniforms(lightData.pointLights[i], *shadowPointShader);
+
+                for (auto [modelMatrix, mesh, castShadows, receiveShadows, isStatic] : renderCommands)
                 {
-                    if (!castShadows) continue;
+                    if (!drawCaster(castShadows, isStatic)) continue;
 
-                    shadowPointMap->shader->setMat4("model", modelMatrix);
-                    mesh->Render(shadowPointMap->shader);
+                    shadowPointShader->setMat4("model", modelMatrix);
+                    mesh->Render(shadowPointShader);
                 }
+
+                shadowPointInstancedShader->use();
+                SetupPointShadowUniforms(lightData.pointLights[i], *shadowPointInstancedShader);
+                drawInstancedCasters(*shadowPointInstancedShader);
             }
+
+            renderParaboloidShadows([&](const PointLight& light, size_t, int hemisphere) {
+                shadowParaboloidShader->use();
+                SetupParaboloidShadowUniforms(light, hemisphere, *shadowParaboloidShader);
+                for (auto [modelMatrix, mesh, castShadows, receiveShadows, isStatic] : renderCommands)
+                {
+                    if (!drawCaster(castShadows, isStatic)) continue;
+
+                    shadowParaboloidShader->setMat4("model", modelMatrix);
+                    mesh->Render(*shadowParaboloidShader);
+                }
+
+                shadowParaboloidInstancedShader->use();
+                SetupParaboloidShadowUniforms(light, hemisphere, *shadowParaboloidInstancedShader);
+                drawInstancedCasters(*shadowParaboloidInstancedShader);
+            });
         }
         glCullFace(GL_BACK);
     }
 
     void renderGeometryPass() {
+        PROFILE_SCOPE("Geometry");
         gbuffer->BindForWriting();
+        if (m_useIndirectDraw)
+        {
+            renderIndirectGeometry();
+
+            // the depth of this frame is the occluder of the next one
+            if (m_useGpuCulling && m_useOcclusionCulling)
+                depthPyramid->Build(gbuffer->depthBuffer, projectionMatrix * viewMatrix, glm::ivec2(m_renderWidth, m_renderHeight));
+        }
+        else if (m_useAutoInstancing)
+            renderInstancedGeometry();
+        else
+            renderDirectGeometry();
+        gbuffer->UnBind();        
+    }
+
+    // every sub mesh of every command (and every single instance) in a multi draw, one per material
+    void renderIndirectGeometry()
+    {
+        indirectGeometry->Begin();
+        for (const auto& cmd : renderCommands)
+            indirectGeometry->AddMesh(*cmd.mesh, cmd.modelMatrix);
+        for (const auto& insCmd : instancedCommands)
+            indirectGeometry->AddInstances(*insCmd.mesh, *insCmd.instances);
+        indirectGeometry->Upload();
+
+        if (m_useGpuCulling)
+            indirectGeometry->Cull(FrustumPlanes(projectionMatrix * viewMatrix), m_useOcclusionCulling ? depthPyramid.get() : nullptr);
+
+        gbuffer->shaderIndirect->use();
+        gbuffer->shaderIndirect->setMat4("projection", this->projectionMatrix);
+        gbuffer->shaderIndirect->setMat4("view", this->viewMatrix);
+        indirectGeometry->Draw(*gbuffer->shaderIndirect);
+    }
+
+    // one instanced draw per mesh, InstancedMeshRenderer included
+    void renderInstancedGeometry()
+    {
+        gbuffer->shaderInstanced->use();
+        gbuffer->shaderInstanced->setMat4("projection", this->projectionMatrix);
+        gbuffer->shaderInstanced->setMat4("view", this->viewMatrix);
+        for (const auto& batch : instanceBatches)
+            batch.mesh->RenderInstanced(*gbuffer->shaderInstanced, batch.buffer, batch.firstInstance, batch.instanceCount);
+    }
+
+    void renderDirectGeometry()
+    {
         gbuffer->shaderGeom->use();
+        gbuffer->shaderGeom->setMat4("projection", this->projectionMatrix);
+        gbuffer->shaderGeom->setMat4("view", this->viewMatrix);
         // Render normal objects
         for (const auto& cmd : renderCommands) {
-            // Set matrices for the mesh's shader
-
-            gbuffer->shaderGeom->setMat4("projection", this->projectionMatrix);
-            gbuffer->shaderGeom->setMat4("view", this->viewMatrix);
             gbuffer->shaderGeom->setMat4("model", cmd.modelMatrix);
             // BasicMesh handles its own material and texture binding
             cmd.mesh->Render(gbuffer->shaderGeom);
@@ -499,20 +1793,169 @@ private:
         gbuffer->shaderInstanced->setMat4("projection", this->projectionMatrix);
         gbuffer->shaderInstanced->setMat4("view", this->viewMatrix);
         // Render instanced objects
-        for (const auto& insCmd : instancedCommands) { //// wip 
-            // Set instance matrices
-            insCmd.mesh->SetupInstancedArrays(insCmd.instances);
-            insCmd.mesh->RenderInstanced(gbuffer->shaderInstanced, insCmd.instances.size());
+        for (const auto& insCmd : instancedCommands) {
+            const InstanceSet& set = *insCmd.instances;
+            insCmd.mesh->RenderInstanced(*gbuffer->shaderInstanced, set.GetBuffer(), set.GetFirstInstance(), static_cast<unsigned int>(set.GetCount()));
         }
-        gbuffer->UnBind();        
+    }
+
+    // collect the finished measures, switch the filters and print the comparison once both have a full window
+    void updateLightingBenchmark()
+    {
+        double ms;
+        int tag;
+        while (lightingTimer.Poll(ms, tag))
+        {
+            m_lightingTime[tag] += ms;
+            m_lightingSamples[tag]++;
+        }
+
+        if (++m_lightingBenchmarkFrame % LIGHTING_BENCHMARK_FRAMES != 0)
+            return;
+
+        ShadowFilter next = m_dirShadowFilter == ShadowFilter::PCF ? ShadowFilter::EVSM : ShadowFilter::PCF;
+        setDirShadowFilter(next);
+        setSpotShadowFilter(next);
+        setPointShadowFilter(next);
+
+        if (m_lightingSamples[0] == 0 || m_lightingSamples[1] == 0)
+            return;
+
+        std::cout << "Lighting pass (" << lightData.pointLights.size() << " point, " << lightData.spotLights.size()
+            << " spot lights): PCF " << m_lightingTime[0] / m_lightingSamples[0] << " ms, EVSM "
+            << m_lightingTime[1] / m_lightingSamples[1] << " ms" << std::endl;
+
+        m_lightingTime[0] = m_lightingTime[1] = 0.0;
+        m_lightingSamples[0] = m_lightingSamples[1] = 0;
+    }
+
+    void applyRenderScale()
+    {
+        m_renderWidth = std::max(1, static_cast<int>(std::lround(m_context.getWidth() * m_renderScale)));
+        m_renderHeight = std::max(1, static_cast<int>(std::lround(m_context.getHeight() * m_renderScale)));
+        gbuffer->SetRenderSize(m_renderWidth, m_renderHeight);
+        shadowMask->SetRenderSize(m_renderWidth, m_renderHeight);
+        fxaa->setRenderSize(m_renderWidth, m_renderHeight);
+    }
+
+    // the cost of the frame is taken as proportional to the pixels, the square of the scale, the scale moves
+    // toward the one that fits the budget with a margin, by small steps and only out of a dead band
+    void updateRenderScale()
+    {
+        double ms = 0.0;
+        while (frameTimer.Poll(ms))
+        {
+            if (m_scaleSettleFrames > 0)
+                continue;
+            m_frameTimeMs = m_frameTimeSamples == 0 ? ms : m_frameTimeMs * 0.8 + ms * 0.2;
+            ++m_frameTimeSamples;
+        }
+        if (m_scaleSettleFrames > 0)
+            --m_scaleSettleFrames;
+        if (!m_dynamicResolution || m_frameTimeSamples < RENDER_SCALE_SETTLE_FRAMES)
+            return;
+
+        // over the budget, or clearly under it while the scale can still grow
+        bool over = m_frameTimeMs > m_frameBudgetMs;
+        bool under = m_frameTimeMs < m_frameBudgetMs * 0.8 && m_renderScale < 1.0f;
+        if (!over && !under)
+            return;
+
+        float target = m_renderScale * static_cast<float>(std::sqrt(m_frameBudgetMs * 0.9 / m_frameTimeMs));
+        // drop fast, grow slowly
+        float scale = std::clamp(target, m_renderScale - 0.1f, m_renderScale + 0.05f);
+        scale = std::clamp(scale, m_minRenderScale, 1.0f);
+        if (std::abs(scale - m_renderScale) < 1.0f / 64.0f)
+            return;
+
+        m_renderScale = scale;
+        m_frameTimeSamples = 0;
+        m_scaleSettleFrames = RENDER_SCALE_SETTLE_FRAMES;
+    }
+
+    // the shadowed lights with the largest screen coverage get a channel of the shadow mask
+    void selectMaskedLights()
+    {
+        std::vector<std::pair<float, ShadowSlot*>> candidates;
+        maskedLights.clear();
+        for (auto& slot : spotSlots)
+        {
+            slot.maskChannel = -1;
+            if (slot.tile.size != 0)
+                candidates.push_back({ slot.coverage, &slot });
+        }
+        for (auto& slot : pointSlots)
+        {
+            slot.maskChannel = -1;
+            if (slot.tile.size != 0)
+                candidates.push_back({ slot.coverage, &slot });
+        }
+        size_t count = std::min(candidates.size(), static_cast<size_t>(m_shadowMaskLights));
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            ShadowSlot* slot = candidates[k].second;
+            slot->maskChannel = static_cast<int>(k);
+            bool spot = slot >= spotSlots.data() && slot < spotSlots.data() + spotSlots.size();
+            int index = static_cast<int>(spot ? slot - spotSlots.data() : slot - pointSlots.data());
+            maskedLights.push_back({ spot ? 1 : 0, index });
+        }
+    }
+
+    // visibility of the sun and of the masked lights at half resolution, same shader source of the lighting pass
+    void renderShadowMaskPass()
+    {
+        PROFILE_SCOPE("ShadowMask");
+        selectMaskedLights();
+
+        shadowMask->BindForWriting();
+        const auto shader = gbuffer->shaderShadowMask;
+        shader->use();
+        setLightingUniforms(shader);
+        shader->setInt("numMaskedLights", static_cast<int>(maskedLights.size()));
+        for (size_t k = 0; k < maskedLights.size(); ++k)
+        {
+            shader->setInt("maskedLightType[" + std::to_string(k) + "]", maskedLights[k].first);
+            shader->setInt("maskedLightIndex[" + std::to_string(k) + "]", maskedLights[k].second);
+        }
+        gbuffer->Render();
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
     void renderLightingPass()
     {
+        PROFILE_SCOPE("Lighting");
+        if (m_benchmarkLighting)
+        {
+            updateLightingBenchmark();
+            lightingTimer.Begin(m_dirShadowFilter == ShadowFilter::EVSM ? 1 : 0);
+        }
+
         fxaa->bind();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         const auto shader = gbuffer->shaderLighting;
         shader->use();
+        setLightingUniforms(shader);
+
+        // without the mask the graph culled its pass and its targets may be gone from the pool
+        if (m_useShadowMask)
+            shadowMask->BindForReading(SHADOW_MASK_UNIT);
+        shader->setInt("shadowMask0", SHADOW_MASK_UNIT);
+        shader->setInt("shadowMask1", SHADOW_MASK_UNIT + 1);
+        shader->setBool("useShadowMask", m_useShadowMask);
+
+        gbuffer->Render();
+        fxaa->unbind();
+
+        if (m_benchmarkLighting)
+            lightingTimer.End();
+    }
+
+    // G-buffer, shadow maps and lights, shared by the lighting pass and the shadow mask pass
+    void setLightingUniforms(const std::shared_ptr<Shader>& shader)
+    {
         // bind GBuffer for reading and uniform 
         gbuffer->BindForReading(0);
         // wip realy bad magic number
@@ -520,23 +1963,35 @@ private:
         shader->setInt("gNormalShininess", GbufferBind::NormalShininess);
         shader->setInt("gColorSpec", GbufferBind::ColorSpec);
         shader->setInt("gDepth", GbufferBind::Depth);
+        // compact layout: the shininess takes the unit of the position, which is rebuilt from the depth
+        shader->setInt("gShininess", GbufferBind::Position);
+        shader->setMat4("invViewProjection", glm::inverse(projectionMatrix * viewMatrix));
+        shader->setIVec2("renderSize", glm::ivec2(m_renderWidth, m_renderHeight));
 
-        // bind shadow map for point light and uniform
-        if (m_pointShadowsInitialized) {
-            shadowPointMap->BindForReading(SHADOW_MAP_CUBE_UNIT);
-            shader->setInt("shadowCubeArray", SHADOW_MAP_CUBE_UNIT);
-        }
-        
+        // bind the shadow atlas of the point and spot lights and uniform
+        shadowAtlas->BindForReading(SHADOW_ATLAS_UNIT);
+        shader->setInt("shadowAtlas", SHADOW_ATLAS_UNIT);
 
-        // bind shadow map for directional light and uniform
+        // bind the cascades of the directional light and uniform
         shadowDirMap->BindForReading(SHADOW_MAP_DIR_UNIT);
-        shader->setInt("shadowDir", SHADOW_MAP_DIR_UNIT);
-        glm::mat4 lightSpaceMatrix = lightData.sunLight.Projection * lightData.sunLight.View;
-        shader->setMat4("dirLightSpaceMatrice", lightSpaceMatrix);
-
-        // bind shadow map for spotlight and uniform
-        shadowSpotMap->BindForReading(SHADOW_MAP_SPOT_UNIT);
-        shader->setInt("shadowSpotArray", SHADOW_MAP_SPOT_UNIT);
+        shader->setInt("shadowCascades", SHADOW_MAP_DIR_UNIT);
+        shader->setInt("cascadeCount", static_cast<int>(cascades.GetCount()));
+        shader->setMat4Array("cascadeMatrices", cascades.GetMatrices().data(), static_cast<int>(cascades.GetCount()));
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+            shader->setFloat("cascadeSplits[" + std::to_string(c) + "]", cascades.GetSplit(c));
+        shader->setVec3("cameraForward", m_context.getCamera().Front);
+
+        // prefiltered moments, on their own units even when unused (a sampler of another type would share the unit)
+        if (cascadeMoments->IsInitialized())
+            cascadeMoments->BindForReading(SHADOW_MOMENTS_DIR_UNIT);
+        if (atlasMoments->IsInitialized())
+            atlasMoments->BindForReading(SHADOW_MOMENTS_ATLAS_UNIT);
+        shader->setInt("cascadeMoments", SHADOW_MOMENTS_DIR_UNIT);
+        shader->setInt("atlasMoments", SHADOW_MOMENTS_ATLAS_UNIT);
+        shader->setInt("dirShadowFilter", static_cast<int>(m_dirShadowFilter));
+        shader->setInt("spotShadowFilter", static_cast<int>(m_spotShadowFilter));
+        shader->setInt("pointShadowFilter", static_cast<int>(m_pointShadowFilter));
+        shader->setVec2("evsmExponents", ShadowMomentMap::GetExponents());
 
         // setup view position in the scene 
         shader->setVec3("viewPos", m_context.getCamera().Position);
@@ -558,7 +2013,9 @@ private:
             shader->setFloat(idx + ".quadratic", light.quadratic);
 
             shader->setFloat(idx + ".far_plane", light.far_plane);
-            shader->setInt(idx + ".shadowID", static_cast<int>(i));
+            shader->setVec4(idx + ".shadowTile", shadowAtlas->GetTileUniform(pointSlots[i].tile));
+            shader->setInt(idx + ".shadowType", static_cast<int>(light.shadowType));
+            shader->setInt(idx + ".maskChannel", m_useShadowMask ? pointSlots[i].maskChannel : -1);
         }
         //      Set uniform spot lights     //
         shader->setInt("numSpotLights", static_cast<int>(lightData.spotLights.size()));
@@ -590,7 +2047,8 @@ private:
 
             // Shadow mapping
             shader->setFloat(idx + ".far_plane", light.far_plane);
-            shader->setInt(idx + ".shadowID", static_cast<int>(i));
+            shader->setVec4(idx + ".shadowTile", shadowAtlas->GetTileUniform(spotSlots[i].tile));
+            shader->setInt(idx + ".maskChannel", m_useShadowMask ? spotSlots[i].maskChannel : -1);
         }
 
         //      Set unifrom point lights    //
@@ -604,36 +2062,176 @@ private:
             shader->setVec3(idx + ".light.specular", lightData.sunLight.Specular); 
 
         }
-        gbuffer->Render();
-        fxaa->unbind();
-
     }
 
     void renderForwardPass() {
-        // switch form deferred randering to forward rendering 
-        glViewport(0, 0, m_context.getWidth(), m_context.getHeight());
+        PROFILE_SCOPE("Forward");
+        // switch form deferred randering to forward rendering, the G-buffer depth is attached to the
+        // lighting target for the depth test instead of being copied in a depth buffer of its own
+        fxaa->setDepthAttachment(gbuffer->depthBuffer);
+        GLState::Viewport(0, 0, m_renderWidth, m_renderHeight);
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer->fbo);
-
-        // Write to the FXAA FBO (you'll need a getter for this)
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fxaa->framebuffer);
-
-        // Blit the depth buffer contents
-        glBlitFramebuffer(0, 0, m_context.getWidth(), m_context.getHeight(), 0, 0, m_context.getWidth(), m_context.getHeight(), GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, fxaa->framebuffer);
-
-        glEnable(GL_DEPTH_TEST);
+        GLState::Enable(GL_DEPTH_TEST);
         // render skybox
         if (skybox) {
             skybox->Render(projectionMatrix, viewMatrix);
         }
+        // the lighting pass of the next frame samples the depth, it must not be attached there
+        fxaa->setDepthAttachment(0);
     }
 
     void renderPostProcessing() {
+        PROFILE_SCOPE("PostProcessing");
         fxaa->render();
     }
 
+    // the passes of the frame and the textures they use, the textures of the FBO classes are imported
+    void renderFrameGraph()
+    {
+        using Handle = RenderGraph::Handle;
+        // the passes up to the lighting only touch the render scale part of their targets, FXAA writes the window
+        const size_t pixels = static_cast<size_t>(m_renderWidth) * static_cast<size_t>(m_renderHeight);
+        const size_t windowPixels = static_cast<size_t>(m_context.getWidth()) * static_cast<size_t>(m_context.getHeight());
+        const size_t shadowBytes = 4 * (static_cast<size_t>(CASCADE_SIZE) * CASCADE_SIZE * cascades.GetCount()
+            + static_cast<size_t>(SHADOW_ATLAS_SIZE) * SHADOW_ATLAS_SIZE);
+
+        frameGraph.Reset();
+        const Handle gbufferTargets = frameGraph.Import("GBuffer", 0, pixels * (GBufferFBO::BytesPerPixel(gbuffer->GetLayout()) - 4));
+        const Handle depth = frameGraph.Import("Depth", gbuffer->depthBuffer, pixels * 4);
+        const Handle shadowMaps = frameGraph.Import("ShadowMaps", 0, shadowBytes);
+        const Handle sceneColor = frameGraph.Import("SceneColor", fxaa->getColorTexture(), pixels * 3);
+        const Handle backbuffer = frameGraph.Import("Backbuffer", 0, windowPixels * 4);
+        const Handle dirMoments = frameGraph.Import("CascadeMoments", cascadeMoments->GetTexture(), cascadeMoments->GetBytes());
+        const Handle tileMoments = frameGraph.Import("AtlasMoments", atlasMoments->GetTexture(), atlasMoments->GetBytes());
+        frameGraph.MarkOutput(backbuffer);
+        Handle mask0 = RenderGraph::INVALID;
+        Handle mask1 = RenderGraph::INVALID;
+        Handle dirScratch = RenderGraph::INVALID;
+        Handle tileScratch = RenderGraph::INVALID;
+
+        // the two moment passes blur through a scratch of the same description, their lifetimes do not
+        // overlap so they share one pool texture
+        glm::ivec2 scratchSize(0);
+        if (m_dirShadowFilter == ShadowFilter::EVSM)
+            scratchSize = glm::max(scratchSize, cascadeMoments->GetScratchSize());
+        if (atlasUsesMoments())
+            scratchSize = glm::max(scratchSize, atlasMoments->GetScratchSize());
+        const RenderGraph::TextureDesc scratchDesc{ scratchSize.x, scratchSize.y, GL_RGBA16F };
+        auto scratchTexture = [](const RenderGraph& graph, Handle scratch) {
+            return scratch == RenderGraph::INVALID ? 0u : graph.GetTexture(scratch);
+        };
+
+        frameGraph.AddPass("Geometry",
+            [&](RenderGraph::Builder& builder) {
+                builder.Write(gbufferTargets);
+                builder.Write(depth);
+            },
+            [this](const RenderGraph&) { renderGeometryPass(); });
+
+        frameGraph.AddPass("Shadows",
+            [&](RenderGraph::Builder& builder) { builder.Write(shadowMaps); },
+            [this](const RenderGraph&) {
+                renderShadowMaps();
+                // the last pass that reads the instance sets (drawn, or copied by the indirect builders)
+                fenceInstanceSets();
+            });
+
+        frameGraph.AddPass("CascadeMoments",
+            [&](RenderGraph::Builder& builder) {
+                builder.Read(shadowMaps);
+                builder.Write(dirMoments);
+                if (cascadeMoments->GetBlurRadius() > 0)
+                    dirScratch = builder.Create("CascadeMomentScratch", scratchDesc);
+            },
+            [&](const RenderGraph& graph) { updateCascadeMoments(scratchTexture(graph, dirScratch)); });
+
+        frameGraph.AddPass("AtlasMoments",
+            [&](RenderGraph::Builder& builder) {
+                builder.Read(shadowMaps);
+                builder.Write(tileMoments);
+                if (atlasMoments->GetBlurRadius() > 0)
+                    tileScratch = builder.Create("AtlasMomentScratch", scratchDesc);
+            },
+            [&](const RenderGraph& graph) { updateAtlasMoments(scratchTexture(graph, tileScratch)); });
+
+        // read by the lighting only with m_useShadowMask, otherwise culled and its targets never allocated
+        frameGraph.AddPass("ShadowMask",
+            [&](RenderGraph::Builder& builder) {
+                const RenderGraph::TextureDesc desc{ shadowMask->GetWidth(), shadowMask->GetHeight(), GL_RGBA8 };
+                builder.Read(gbufferTargets);
+                builder.Read(depth);
+                builder.Read(shadowMaps);
+                mask0 = builder.Create("ShadowMask0", desc);
+                mask1 = builder.Create("ShadowMask1", desc);
+            },
+            [&](const RenderGraph& graph) {
+                shadowMask->SetTargets(graph.GetTexture(mask0), graph.GetTexture(mask1));
+                renderShadowMaskPass();
+            });
+
+        frameGraph.AddPass("Lighting",
+            [&](RenderGraph::Builder& builder) {
+                builder.Read(gbufferTargets);
+                builder.Read(depth);
+                builder.Read(shadowMaps);
+                if (m_useShadowMask)
+                {
+                    builder.Read(mask0);
+                    builder.Read(mask1);
+                }
+                if (m_dirShadowFilter == ShadowFilter::EVSM)
+                    builder.Read(dirMoments);
+                if (atlasUsesMoments())
+                    builder.Read(tileMoments);
+                builder.Write(sceneColor);
+            },
+            [this](const RenderGraph&) { renderLightingPass(); });
+
+        // Forward pass (transparent objects, skybox)
+        frameGraph.AddPass("Forward",
+            [&](RenderGraph::Builder& builder) {
+                builder.Read(depth);
+                builder.Read(sceneColor);
+                builder.Write(sceneColor);
+            },
+            [this](const RenderGraph&) { renderForwardPass(); });
+
+        frameGraph.AddPass("PostProcessing",
+            [&](RenderGraph::Builder& builder) {
+                builder.Read(sceneColor);
+                builder.Write(backbuffer);
+            },
+            [this](const RenderGraph&) { renderPostProcessing(); });
+
+        {
+            PROFILE_SCOPE("RenderGraph::Compile");
+            frameGraph.Compile();
+        }
+        frameGraph.Execute();
+        reportFrameGraph(pixels);
+    }
+
+    void reportFrameGraph(size_t pixels)
+    {
+        const RenderGraph::Stats& stats = frameGraph.GetStats();
+        if (!m_reportRenderGraph || stats == m_lastGraphStats)
+            return;
+        m_lastGraphStats = stats;
+
+        auto mb = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+        std::cout << "Render graph: " << stats.passCount - stats.culledPasses << "/" << stats.passCount << " passes";
+        for (const auto& name : frameGraph.GetCulledPasses())
+            std::cout << ", culled " << name;
+        std::cout << std::endl;
+        std::cout << "  transient targets " << mb(stats.transientBytes) << " MB, allocated " << mb(stats.allocatedBytes)
+            << " MB (aliasing saves " << mb(stats.transientBytes - stats.allocatedBytes) << " MB), culled "
+            << mb(stats.culledBytes) << " MB" << std::endl;
+        // the forward pass used a depth buffer of its own, filled by a blit (one read and one write)
+        std::cout << "  bandwidth " << mb(stats.bandwidthBytes) << " MB/frame, culled passes save "
+            << mb(stats.culledBandwidthBytes) << " MB/frame, shared depth saves " << mb(pixels * 4) << " MB and "
+            << mb(pixels * 8) << " MB/frame of blit" << std::endl;
+    }
+
 };
 
 // ============================================================================
@@ -684,6 +2282,7 @@ public:
     }
     // Scene lifecycle
     void render() {
+        PROFILE_SCOPE("Scene::render");
         renderer->beginFrame();
 
         // Collect render commands from entities
@@ -704,10 +2303,18 @@ protected:
 
     ComponentStorage& getComponents() { return components; }
 
+    // an empty mesh the renderer can use: CPU-only when the renderer has no GL context
+    std::shared_ptr<BasicMesh> createMesh() const {
+        if (renderer->isCpuOnly())
+            return std::make_shared<BasicMesh>(BasicMesh::CpuOnly{});
+        return std::make_shared<BasicMesh>();
+    }
+
 private:
 
     void collectRenderCommands() 
     {
+        PROFILE_SCOPE("collectRenderCommands");
         // Get the component arrays you will need.
         ComponentArray<MeshRenderer>* meshRendererArray = static_cast<ComponentArray<MeshRenderer>*>(components.getComponentArray<MeshRenderer>());
         ComponentArray<Transform>* transformArray = static_cast<ComponentArray<Transform>*>(components.getComponentArray<Transform>());
@@ -739,12 +2346,14 @@ private:
                 cmd.mesh = meshRenderer.mesh;         // Data from MeshRenderer component 
                 cmd.castShadows = meshRenderer.castShadows; 
                 cmd.receiveShadows = meshRenderer.receiveShadows;
+                cmd.isStatic = meshRenderer.isStatic;
 
                 // get the AnimationComponent using the EntityID
                 Animation* animComponent = animationArray->getComponent(entityID);
                 if (animComponent && animComponent->isPlaying && animComponent->animation)
                 {
-                    animComponent->animation->updateTime(renderer->getContext().getTotalTime());
+                    cmd.isStatic = false;
+                    animComponent->animation->updateTime(renderer->getTime());
                     glm::vec3 animPosition = animComponent->animation->getPosition(); 
                     glm::quat animRotation = animComponent->animation->getRotation(); 
                     glm::vec3 animScale = animComponent->animation->getScale(); 
@@ -775,10 +2384,12 @@ private:
         if (instancedArray) {
             // We can iterate directly over all instanced components
             for (auto& instancedRenderer : instancedArray->getComponentVector()) {
-                if (instancedRenderer.mesh && !instancedRenderer.instanceMatrices.empty()) {
+                if (instancedRenderer.mesh && instancedRenderer.instances && instancedRenderer.instances->GetCount() != 0) {
+                    // only the pointer is copied, the matrices stay in the component
                     InstancedRenderCommand cmd;
                     cmd.mesh = instancedRenderer.mesh;
-                    cmd.instances = instancedRenderer.instanceMatrices;
+                    cmd.instances = instancedRenderer.instances;
+                    cmd.castShadows = instancedRenderer.castShadows;
                     renderer->submitInstancedRenderCommand(cmd);
                 }
             }
@@ -787,6 +2398,7 @@ private:
 
     // setup all the light in the scene 
     void collectLightData() {
+        PROFILE_SCOPE("collectLightData");
         LightData lights;
 
         // --- Collect Point Lights ---
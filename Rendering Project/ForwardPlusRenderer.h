@@ -0,0 +1,446 @@
+#pragma once
+
+#ifndef FORWARD_PLUS_RENDERER_H
+#define FORWARD_PLUS_RENDERER_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "EntityComponentSysetm.h"
+#include "ShadowAtlas.h"
+#include "ShadowCascades.h"
+
+/**
+    * @brief Tiled forward (Forward+) implementation of IRenderer.
+    *
+    * @details Three passes over the same RenderCommand, InstancedRenderCommand and LightData of the
+    *          DeferredRenderer: a depth pre-pass in the MultisampleFramebuffer, a compute pass that splits
+    *          the screen in TILE_SIZE tiles and keeps, for every tile, the point and spot lights whose
+    *          bounding sphere touches the tile between its min and max depth, and a single forward pass
+    *          that shades every fragment with the lights of its tile only (depth test LEQUAL, no depth
+    *          write, so every pixel is shaded once). There is no G-buffer to write and read back, and
+    *          the MSAA resolve is a blit: this is the renderer for the bandwidth limited GPUs and for
+    *          the multisampled output.
+    *          The shadows come before the pre-pass, with the same ShadowCascades, ShadowAtlas and shadow
+    *          shaders of the DeferredRenderer: the sun cascades and one atlas tile per spot light, drawn
+    *          every frame and filtered with PCF (no cache, no EVSM). The point lights are unshadowed.
+**/
+class ForwardPlusRenderer : public IRenderer
+{
+public:
+    static constexpr int TILE_SIZE = 16;
+    // keep in sync with forward_plus_cull.comp and forward_plus.frag
+    static constexpr unsigned int MAX_LIGHTS_PER_TILE = 255;
+
+    ForwardPlusRenderer(WindowContext& context, int samples = 4) :
+        m_context(context),
+        m_samples(std::max(samples, 1))
+    {}
+
+    ~ForwardPlusRenderer() override
+    {
+        glDeleteBuffers(1, &m_lightBuffer);
+        glDeleteBuffers(1, &m_tileBuffer);
+    }
+
+    void initialize() override
+    {
+        depthShader = std::make_shared<Shader>();
+        depthInstancedShader = std::make_shared<Shader>();
+        forwardShader = std::make_shared<Shader>();
+        forwardInstancedShader = std::make_shared<Shader>();
+        cullShader = std::make_shared<Shader>();
+        shadowShader = std::make_shared<Shader>();
+        shadowInstancedShader = std::make_shared<Shader>();
+
+        depthShader->load(getShaderFullPath("Geometry_pass.vert").c_str(), getShaderFullPath("forward_plus_depth.frag").c_str());
+        depthInstancedShader->load(getShaderFullPath("Geometry_pass_instanced.vert").c_str(), getShaderFullPath("forward_plus_depth.frag").c_str());
+        forwardShader->load(getShaderFullPath("Geometry_pass.vert").c_str(), getShaderFullPath("forward_plus.frag").c_str());
+        forwardInstancedShader->load(getShaderFullPath("Geometry_pass_instanced.vert").c_str(), getShaderFullPath("forward_plus.frag").c_str());
+        cullShader->loadCompute(getShaderFullPath("forward_plus_cull.comp").c_str());
+        shadowShader->load(getShaderFullPath("shadowMap.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str());
+        shadowInstancedShader->load(getShaderFullPath("shadowMap_instanced.vert").c_str(), getShaderFullPath("shadowMap.frag").c_str());
+
+        shadowDirMap = std::make_unique<ShadowMapArrayFBO>(CASCADE_SIZE, CASCADE_SIZE);
+        shadowDirMap->Init(ShadowCascades::MAX_CASCADES, shadowShader);
+        shadowAtlas = std::make_unique<ShadowAtlas>(SHADOW_ATLAS_SIZE);
+        shadowAtlas->Init();
+
+        msaa = std::make_unique<MultisampleFramebuffer>(m_context.getWidth(), m_context.getHeight(), m_samples);
+        msaa->init();
+
+        glGenBuffers(1, &m_lightBuffer);
+        glGenBuffers(1, &m_tileBuffer);
+        resizeTileBuffer();
+    }
+
+    void beginFrame() override
+    {
+        renderCommands.clear();
+        instancedCommands.clear();
+        lightData = {};
+
+        viewMatrix = m_context.getCamera().GetViewMatrix();
+        projectionMatrix = Camera::GetProjectionMatrix((float)m_context.getWidth() / (float)m_context.getHeight());
+    }
+
+    void submitRenderCommand(const RenderCommand& command) override
+    {
+        renderCommands.push_back(command);
+    }
+
+    void submitInstancedRenderCommand(const InstancedRenderCommand& command) override
+    {
+        instancedCommands.push_back(command);
+    }
+
+    void setLightData(const LightData& lights) override
+    {
+        lightData = lights;
+    }
+
+    void setSkybox(const std::string& path, const std::vector<std::string>& faces) override
+    {
+        skybox = std::make_unique<Skybox>();
+        skybox->load(path.c_str(), faces);
+    }
+
+    void endFrame() override
+    {
+        ++m_frameIndex;
+        for (const auto& insCmd : instancedCommands)
+            insCmd.instances->Sync(m_frameIndex);
+
+        renderShadows();
+        uploadLights();
+
+        renderDepthPrepass();
+        cullLights();
+        renderForwardPass();
+
+        for (const auto& insCmd : instancedCommands)
+            insCmd.instances->Fence();
+
+        // resolve the samples on the window
+        msaa->blit();
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void resize() override
+    {
+        msaa->resize(m_context.getWidth(), m_context.getHeight());
+        resizeTileBuffer();
+    }
+
+    WindowContext& getContext() override
+    {
+        return m_context;
+    }
+
+    float getTime() override
+    {
+        return m_context.getTotalTime();
+    }
+
+    // recreate the multisampled target, 1 = no MSAA
+    void setSampleCount(int samples)
+    {
+        m_samples = std::max(samples, 1);
+        if (!msaa)
+            return;
+        msaa = std::make_unique<MultisampleFramebuffer>(m_context.getWidth(), m_context.getHeight(), m_samples);
+        msaa->init();
+    }
+    int getSampleCount() const { return m_samples; }
+
+private:
+    // std430 mirror of ForwardLight in the shaders
+    struct GpuLight
+    {
+        glm::vec4 positionType;
+        glm::vec4 directionCutOff;
+        glm::vec4 ambientOuterCutOff;
+        glm::vec4 diffuse;
+        glm::vec4 specular;
+        glm::vec4 attenuation;
+        glm::vec4 boundingSphere;
+        glm::mat4 shadowMatrix;
+        glm::vec4 shadowTile;   // ShadowAtlas::GetTileUniform, y = 0 without shadow
+    };
+
+    WindowContext& m_context;
+    int m_samples;
+    unsigned long long m_frameIndex = 0;
+
+    std::unique_ptr<MultisampleFramebuffer> msaa;
+    std::unique_ptr<Skybox> skybox;
+    std::shared_ptr<Shader> depthShader;
+    std::shared_ptr<Shader> depthInstancedShader;
+    std::shared_ptr<Shader> forwardShader;
+    std::shared_ptr<Shader> forwardInstancedShader;
+    std::shared_ptr<Shader> cullShader;
+    std::shared_ptr<Shader> shadowShader;
+    std::shared_ptr<Shader> shadowInstancedShader;
+
+    // same sizes of the DeferredRenderer
+    static constexpr unsigned int CASCADE_SIZE = 1024;
+    static constexpr unsigned int SHADOW_ATLAS_SIZE = 4096;
+    static constexpr unsigned int SPOT_SHADOW_SIZE = 512;
+    ShadowCascades cascades;
+    std::unique_ptr<ShadowMapArrayFBO> shadowDirMap;
+    std::unique_ptr<ShadowAtlas> shadowAtlas;
+    std::vector<ShadowAtlas::Request> shadowRequests;
+    float m_shadowDistance = 60.f;
+
+    GLuint m_lightBuffer{ 0 };
+    GLuint m_tileBuffer{ 0 };
+    size_t m_lightCapacity{ 0 };
+    int m_tilesX{ 0 };
+    int m_tilesY{ 0 };
+    int m_lightCount{ 0 };
+
+    std::vector<RenderCommand> renderCommands;
+    std::vector<InstancedRenderCommand> instancedCommands;
+    LightData lightData;
+    std::vector<GpuLight> gpuLights;
+
+    glm::mat4 viewMatrix{ 1.0f };
+    glm::mat4 projectionMatrix{ 1.0f };
+
+    // per tile the light count and MAX_LIGHTS_PER_TILE indices
+    void resizeTileBuffer()
+    {
+        m_tilesX = (m_context.getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+        m_tilesY = (m_context.getHeight() + TILE_SIZE - 1) / TILE_SIZE;
+        const size_t size = static_cast<size_t>(m_tilesX) * m_tilesY * (MAX_LIGHTS_PER_TILE + 1) * sizeof(GLuint);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_tileBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, sizeof(GLuint)), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // distance where the attenuation brings the brightest channel under 1/256, the deferred lighting
+    // does not cut the spot lights, so this is the nearest range that does not change the image
+    static float attenuationRange(float constant, float linear, float quadratic, const glm::vec3& color, float fallback)
+    {
+        const float target = 256.0f * std::max({ color.r, color.g, color.b });
+        if (target <= constant)
+            return 0.0f;
+        if (quadratic > 0.0f)
+            return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * (target - constant))) / (2.0f * quadratic);
+        if (linear > 0.0f)
+            return (target - constant) / linear;
+        return fallback;
+    }
+
+    void uploadLights()
+    {
+        gpuLights.clear();
+        // the deferred lighting skips the point lights past their far plane
+        for (const auto& light : lightData.pointLights)
+        {
+            GpuLight gpu{};
+            gpu.positionType = glm::vec4(light.Pos, 0.0f);
+            gpu.ambientOuterCutOff = glm::vec4(light.Ambient, 0.0f);
+            gpu.diffuse = glm::vec4(light.Diffuse, 0.0f);
+            gpu.specular = glm::vec4(light.Specular, 0.0f);
+            gpu.attenuation = glm::vec4(light.constant, light.linear, light.quadratic, light.far_plane);
+            gpu.boundingSphere = glm::vec4(light.Pos, light.far_plane);
+            gpuLights.push_back(gpu);
+        }
+        for (size_t i = 0; i < lightData.spotLights.size(); ++i)
+        {
+            const auto& light = lightData.spotLights[i];
+            const glm::vec3 brightest = glm::max(light.Ambient, glm::max(light.Diffuse, light.Specular));
+            const float range = attenuationRange(light.constant, light.linear, light.quadratic, brightest, light.far_plane);
+            GpuLight gpu{};
+            gpu.positionType = glm::vec4(light.Pos, 1.0f);
+            gpu.directionCutOff = glm::vec4(light.Dir, light.cutOff);
+            gpu.ambientOuterCutOff = glm::vec4(light.Ambient, light.outerCutOff);
+            gpu.diffuse = glm::vec4(light.Diffuse, 0.0f);
+            gpu.specular = glm::vec4(light.Specular, 0.0f);
+            gpu.attenuation = glm::vec4(light.constant, light.linear, light.quadratic, range);
+            gpu.shadowMatrix = light.Projection * light.View;
+            gpu.shadowTile = shadowAtlas->GetTileUniform(shadowAtlas->GetTiles()[i]);
+            // smallest sphere around the cone: on the axis for the narrow cones, around the cap for the wide ones
+            const glm::vec3 dir = glm::normalize(light.Dir);
+            const float cosAngle = std::clamp(light.outerCutOff, 0.0f, 1.0f);
+            if (cosAngle >= 0.70710678f)
+            {
+                const float radius = range / (2.0f * cosAngle * cosAngle);
+                gpu.boundingSphere = glm::vec4(light.Pos + dir * radius, radius);
+            }
+            else
+                gpu.boundingSphere = glm::vec4(light.Pos + dir * range * cosAngle, range * std::sqrt(1.0f - cosAngle * cosAngle));
+            gpuLights.push_back(gpu);
+        }
+        m_lightCount = static_cast<int>(gpuLights.size());
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightBuffer);
+        if (gpuLights.size() > m_lightCapacity || m_lightCapacity == 0)
+        {
+            m_lightCapacity = std::max(gpuLights.size(), size_t(16));
+            glBufferData(GL_SHADER_STORAGE_BUFFER, m_lightCapacity * sizeof(GpuLight), nullptr, GL_DYNAMIC_DRAW);
+        }
+        if (!gpuLights.empty())
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuLights.size() * sizeof(GpuLight), gpuLights.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void drawScene(const std::shared_ptr<Shader>& shader, const std::shared_ptr<Shader>& instancedShader)
+    {
+        shader->use();
+        shader->setMat4("projection", projectionMatrix);
+        shader->setMat4("view", viewMatrix);
+        for (const auto& cmd : renderCommands)
+        {
+            shader->setMat4("model", cmd.modelMatrix);
+            cmd.mesh->Render(shader);
+        }
+
+        if (instancedCommands.empty())
+            return;
+        instancedShader->use();
+        instancedShader->setMat4("projection", projectionMatrix);
+        instancedShader->setMat4("view", viewMatrix);
+        for (const auto& insCmd : instancedCommands)
+        {
+            const InstanceSet& set = *insCmd.instances;
+            insCmd.mesh->RenderInstanced(*instancedShader, set.GetBuffer(), set.GetFirstInstance(), static_cast<unsigned int>(set.GetCount()));
+        }
+    }
+
+    // the casters with the shadow shaders of the DeferredRenderer, the target is already bound
+    void drawCasters(const glm::mat4& lightSpaceMatrix)
+    {
+        shadowShader->use();
+        shadowShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        for (const auto& cmd : renderCommands)
+        {
+            if (!cmd.castShadows) continue;
+            shadowShader->setMat4("model", cmd.modelMatrix);
+            cmd.mesh->Render(shadowShader);
+        }
+
+        shadowInstancedShader->use();
+        shadowInstancedShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        for (const auto& insCmd : instancedCommands)
+        {
+            if (!insCmd.castShadows) continue;
+            const InstanceSet& set = *insCmd.instances;
+            insCmd.mesh->RenderInstanced(*shadowInstancedShader, set.GetBuffer(), set.GetFirstInstance(), static_cast<unsigned int>(set.GetCount()));
+        }
+    }
+
+    // sun cascades, then one atlas tile per spot light
+    void renderShadows()
+    {
+        GLState::Enable(GL_DEPTH_TEST);
+        GLState::DepthFunc(GL_LESS);
+        GLState::DepthMask(GL_TRUE);
+        GLState::Enable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+
+        cascades.Update(viewMatrix, projectionMatrix, lightData.sunLight.Direction, m_shadowDistance, lightData.sunLight.far_plane, CASCADE_SIZE);
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+        {
+            shadowDirMap->BindLayerForWriting(static_cast<int>(c));
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawCasters(cascades.GetMatrix(c));
+        }
+
+        // every spot light asks for the same tile, the atlas halves them when they do not fit
+        shadowRequests.assign(lightData.spotLights.size(), ShadowAtlas::Request{ 1, SPOT_SHADOW_SIZE, 1.0f });
+        shadowAtlas->Allocate(shadowRequests);
+        shadowAtlas->BindForWriting();
+        for (size_t i = 0; i < lightData.spotLights.size(); ++i)
+        {
+            const ShadowAtlas::Tile& tile = shadowAtlas->GetTiles()[i];
+            if (tile.size == 0) continue;
+            shadowAtlas->SetViewport(tile, 0);
+            shadowAtlas->ClearTile(tile, 0);
+            const auto& light = lightData.spotLights[i];
+            drawCasters(light.Projection * light.View);
+        }
+
+        glCullFace(GL_BACK);
+        GLState::Disable(GL_CULL_FACE);
+    }
+
+    void renderDepthPrepass()
+    {
+        msaa->bind();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        GLState::Enable(GL_DEPTH_TEST);
+        GLState::DepthFunc(GL_LESS);
+        GLState::DepthMask(GL_TRUE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        drawScene(depthShader, depthInstancedShader);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    // one work group per tile
+    void cullLights()
+    {
+        cullShader->use();
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaa->getDepthTexture());
+        cullShader->setInt("depthTexture", 0);
+        cullShader->setInt("sampleCount", msaa->getSamples());
+        cullShader->setIVec2("screenSize", glm::ivec2(m_context.getWidth(), m_context.getHeight()));
+        cullShader->setInt("lightCount", m_lightCount);
+        cullShader->setMat4("view", viewMatrix);
+        cullShader->setMat4("invProjection", glm::inverse(projectionMatrix));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_tileBuffer);
+
+        glDispatchCompute(static_cast<GLuint>(m_tilesX), static_cast<GLuint>(m_tilesY), 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+    }
+
+    void setLightingUniforms(Shader& shader)
+    {
+        shader.setVec3("viewPos", m_context.getCamera().Position);
+        shader.setVec3("cameraForward", m_context.getCamera().Front);
+        shader.setInt("shadowCascades", SHADOW_MAP_DIR_UNIT);
+        shader.setInt("shadowAtlas", SHADOW_ATLAS_UNIT);
+        shader.setInt("cascadeCount", static_cast<int>(cascades.GetCount()));
+        shader.setMat4Array("cascadeMatrices", cascades.GetMatrices().data(), static_cast<int>(cascades.GetCount()));
+        for (size_t c = 0; c < cascades.GetCount(); ++c)
+            shader.setFloat("cascadeSplits[" + std::to_string(c) + "]", cascades.GetSplit(c));
+        shader.setInt("tilesX", m_tilesX);
+        shader.setVec3("dirLight.position", lightData.sunLight.Position);
+        shader.setVec3("dirLight.direction", lightData.sunLight.Direction);
+        shader.setVec3("dirLight.light.ambient", lightData.sunLight.Ambient);
+        shader.setVec3("dirLight.light.diffuse", lightData.sunLight.Diffuse);
+        shader.setVec3("dirLight.light.specular", lightData.sunLight.Specular);
+    }
+
+    // the depth is already there: every covered sample is shaded once, then the skybox fills the rest
+    void renderForwardPass()
+    {
+        GLState::DepthFunc(GL_LEQUAL);
+        GLState::DepthMask(GL_FALSE);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_tileBuffer);
+
+        shadowDirMap->BindForReading(SHADOW_MAP_DIR_UNIT);
+        shadowAtlas->BindForReading(SHADOW_ATLAS_UNIT);
+
+        forwardShader->use();
+        setLightingUniforms(*forwardShader);
+        forwardInstancedShader->use();
+        setLightingUniforms(*forwardInstancedShader);
+        drawScene(forwardShader, forwardInstancedShader);
+
+        GLState::DepthFunc(GL_LESS);
+        GLState::DepthMask(GL_TRUE);
+
+        if (skybox)
+            skybox->Render(projectionMatrix, viewMatrix);
+    }
+};
+
+#endif // !FORWARD_PLUS_RENDERER_H
@@ -0,0 +1,206 @@
+#include "FramePipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "WindowContext.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+}
+
+// the IRenderer seen by the scene, on the simulation thread once the pipeline runs
+class FramePipeline::SceneRenderer : public IRenderer
+{
+public:
+    explicit SceneRenderer(FramePipeline& pipeline) : m_Pipeline(pipeline) {}
+
+    // before start, on the GL thread
+    void initialize() override { m_Pipeline.m_Renderer->initialize(); }
+    void setSkybox(const std::string& path, const std::vector<std::string>& faces) override { m_Pipeline.m_Renderer->setSkybox(path, faces); }
+    void resize() override { m_Pipeline.m_Renderer->resize(); }
+    WindowContext& getContext() override { return m_Pipeline.m_Renderer->getContext(); }
+    bool isCpuOnly() const override { return m_Pipeline.m_Renderer->isCpuOnly(); }
+
+    void beginFrame() override
+    {
+        m_Packet = m_Pipeline.acquireFree();
+        if (!m_Packet)
+            return;
+        m_Time = m_Packet->time;
+        m_Packet->commands.clear();
+        m_Packet->instancedCommands.clear();
+    }
+
+    void submitRenderCommand(const RenderCommand& command) override
+    {
+        if (m_Packet)
+            m_Packet->commands.push_back(command);
+    }
+
+    void submitInstancedRenderCommand(const InstancedRenderCommand& command) override
+    {
+        if (m_Packet)
+            m_Packet->instancedCommands.push_back(command);
+    }
+
+    void setLightData(const LightData& lights) override
+    {
+        if (!m_Packet)
+            return;
+        m_Packet->lights.pointLights.assign(lights.pointLights.begin(), lights.pointLights.end());
+        m_Packet->lights.spotLights.assign(lights.spotLights.begin(), lights.spotLights.end());
+        m_Packet->lights.sunLight = lights.sunLight;
+    }
+
+    void endFrame() override
+    {
+        if (m_Packet)
+            m_Pipeline.publish(m_Packet);
+        m_Packet = nullptr;
+    }
+
+    // the time stamped in the packet being built
+    float getTime() override { return m_Time; }
+
+private:
+    FramePipeline& m_Pipeline;
+    FramePacket* m_Packet{ nullptr };
+    float m_Time{ 0.0f };
+};
+
+FramePipeline::FramePipeline(std::unique_ptr<IRenderer> renderer, int framesInFlight) :
+    m_Renderer(std::move(renderer))
+{
+    const size_t count = static_cast<size_t>(std::clamp(framesInFlight, 1, static_cast<int>(MAX_FRAMES_IN_FLIGHT))) + 1;
+    for (size_t i = 0; i < count; ++i)
+        m_Packets.push_back(std::make_unique<FramePacket>());
+}
+
+FramePipeline::~FramePipeline()
+{
+    stop();
+}
+
+std::unique_ptr<IRenderer> FramePipeline::createSceneRenderer()
+{
+    return std::make_unique<SceneRenderer>(*this);
+}
+
+void FramePipeline::start(Scene& scene)
+{
+    if (m_Running.load(std::memory_order_acquire))
+        return;
+
+    // every packet starts free, with the input of now
+    FramePacket* packet = nullptr;
+    while (m_Ready.Pop(packet))
+        ;
+    while (m_Free.Pop(packet))
+        ;
+    while (m_ReadyCount.try_acquire())
+        ;
+    while (m_FreeCount.try_acquire())
+        ;
+    for (auto& free : m_Packets)
+    {
+        stamp(*free);
+        m_Free.Push(free.get());
+        m_FreeCount.release();
+    }
+
+    m_Running.store(true, std::memory_order_release);
+    m_Simulation = std::thread([this, &scene]() {
+        CpuProfiler::Get().SetThreadName("Simulation");
+        while (m_Running.load(std::memory_order_acquire))
+            scene.render();
+    });
+}
+
+void FramePipeline::stop()
+{
+    m_Running.store(false, std::memory_order_release);
+    if (m_Simulation.joinable())
+    {
+        // the simulation may sleep in acquireFree
+        m_FreeCount.release();
+        m_Simulation.join();
+    }
+}
+
+void FramePipeline::renderFrame()
+{
+    PROFILE_SCOPE("FramePipeline::renderFrame");
+    // the simulation runs until stop, which is called by this thread: it always publishes a packet
+    if (!m_Running.load(std::memory_order_acquire))
+        return;
+    FramePacket* packet = nullptr;
+    {
+        PROFILE_SCOPE("Wait simulation");
+        const Clock::time_point waitStart = Clock::now();
+        m_ReadyCount.acquire();
+        m_Ready.Pop(packet);
+        m_Stats.renderWaitMs += elapsedMs(waitStart);
+    }
+    m_Stats.maxLatencyFrames = std::max(m_Stats.maxLatencyFrames, m_Stats.frames + 1 - packet->inputFrame);
+
+    // the frame is drawn from the camera it was built for, the input keeps the camera of the context
+    Camera& camera = m_Renderer->getContext().getCamera();
+    const glm::vec3 position = camera.Position;
+    const float yaw = camera.Yaw;
+    const float pitch = camera.Pitch;
+    camera.SetPose(packet->cameraPosition, packet->cameraYaw, packet->cameraPitch);
+
+    m_Renderer->beginFrame();
+    for (const RenderCommand& command : packet->commands)
+        m_Renderer->submitRenderCommand(command);
+    for (const InstancedRenderCommand& command : packet->instancedCommands)
+        m_Renderer->submitInstancedRenderCommand(command);
+    m_Renderer->setLightData(packet->lights);
+    m_Renderer->endFrame();
+
+    camera.SetPose(position, yaw, pitch);
+    ++m_Stats.frames;
+
+    stamp(*packet);
+    m_Free.Push(packet);
+    m_FreeCount.release();
+}
+
+void FramePipeline::stamp(FramePacket& packet)
+{
+    WindowContext& context = m_Renderer->getContext();
+    const Camera& camera = context.getCamera();
+    packet.cameraPosition = camera.Position;
+    packet.cameraYaw = camera.Yaw;
+    packet.cameraPitch = camera.Pitch;
+    packet.time = context.getTotalTime();
+    packet.inputFrame = m_Stats.frames;
+}
+
+FramePacket* FramePipeline::acquireFree()
+{
+    PROFILE_SCOPE("Wait render");
+    const Clock::time_point waitStart = Clock::now();
+    m_FreeCount.acquire();
+    // woken by stop: the packet, if any, stays in the queue for the next start
+    if (!m_Running.load(std::memory_order_acquire))
+        return nullptr;
+    FramePacket* packet = nullptr;
+    m_Free.Pop(packet);
+    m_SimulationWaitNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - waitStart).count(), std::memory_order_relaxed);
+    return packet;
+}
+
+void FramePipeline::publish(FramePacket* packet)
+{
+    // never full: the queue holds every packet
+    m_Ready.Push(packet);
+    m_ReadyCount.release();
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EntityComponentSysetm.h"
+
+/**
+    * @brief Bounded lock-free queue with one producer thread and one consumer thread.
+    *
+    * @details Head and tail only grow, the slot is the position modulo CAPACITY (a power of 2). Each side
+    *          writes its own index with release and reads the other one with acquire, nothing else is shared.
+**/
+template<typename T, size_t CAPACITY>
+class SpscQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "the capacity must be a power of 2");
+
+public:
+    // producer only, false when the queue is full
+    bool Push(const T& value)
+    {
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail - m_Head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        m_Slots[tail & (CAPACITY - 1)] = value;
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only, false when the queue is empty
+    bool Pop(T& value)
+    {
+        const size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_Tail.load(std::memory_order_acquire))
+            return false;
+        value = m_Slots[head & (CAPACITY - 1)];
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, CAPACITY> m_Slots{};
+    // on their own cache lines, the two threads write one each
+    alignas(64) std::atomic<size_t> m_Head{ 0 };
+    alignas(64) std::atomic<size_t> m_Tail{ 0 };
+};
+
+/**
+    * @brief Everything the render thread needs to draw a frame, written by the simulation thread.
+    *
+    * @details The input part (camera, time, inputFrame) is stamped by the render thread when it gives the
+    *          packet back, the simulation builds the frame for that input. The vectors keep their capacity
+    *          from a use to the next.
+**/
+struct FramePacket
+{
+    // input
+    glm::vec3 cameraPosition{ 0.0f };
+    float cameraYaw{ 0.0f };
+    float cameraPitch{ 0.0f };
+    float time{ 0.0f };
+    uint64_t inputFrame{ 0 };       // rendered frames when the input was sampled
+
+    // output of Scene::render
+    std::vector<RenderCommand> commands;
+    std::vector<InstancedRenderCommand> instancedCommands;
+    LightData lights;
+};
+
+/**
+    * @brief Runs Scene::render (animation, command and light collection) on a simulation thread while the
+    *        calling thread submits the previous frames to the GL renderer.
+    *
+    * @details The pipeline owns the GL renderer and gives the scene a proxy IRenderer (createSceneRenderer)
+    *          that writes into FramePackets instead. There are framesInFlight + 1 packets (framesInFlight 1 is
+    *          double buffered, 2 triple buffered) handed between the two threads through two SpscQueue: the
+    *          free packets go to the simulation, the built ones come back to the render thread. The packets
+    *          move without a lock, every queue has a counting semaphore of its packets so that a side without
+    *          packet sleeps until the other one gives one back instead of spinning on a core.
+    *
+    *          renderFrame takes the oldest built packet, draws it with the camera stamped in it (the camera of
+    *          the context is restored after, so the input keeps moving it), then stamps the packet with the
+    *          current camera and time and gives it back. An input reaches the screen at most
+    *          framesInFlight + 1 frames later (getStats().maxLatencyFrames), against 1 frame for the serial loop.
+    *
+    *          The scene must be initialized on the GL thread before start (the meshes are created there),
+    *          after start only the simulation thread touches it. The InstanceSet of the commands are shared
+    *          with the render thread: a scene that changes them while it runs needs its own double buffer.
+**/
+class FramePipeline
+{
+public:
+    static constexpr size_t MAX_FRAMES_IN_FLIGHT = 3;
+
+    struct Stats
+    {
+        uint64_t frames{ 0 };
+        double renderWaitMs{ 0.0 };      // render thread waiting for a built packet
+        double simulationWaitMs{ 0.0 };  // simulation thread waiting for a free packet
+        uint64_t maxLatencyFrames{ 0 };  // between the input sampling and the draw of its frame
+    };
+
+    FramePipeline(std::unique_ptr<IRenderer> renderer, int framesInFlight = 1);
+    ~FramePipeline();
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // the IRenderer of the scene: initialize, setSkybox and resize go to the GL renderer, the frames to the packets
+    std::unique_ptr<IRenderer> createSceneRenderer();
+
+    // starts the simulation thread, scene must be initialized and outlive stop
+    void start(Scene& scene);
+    void stop();
+    // render thread: draws the oldest built packet with the GL renderer
+    void renderFrame();
+
+    IRenderer& getRenderer() { return *m_Renderer; }
+    int getFramesInFlight() const { return static_cast<int>(m_Packets.size()) - 1; }
+    Stats getStats() const
+    {
+        Stats stats = m_Stats;
+        stats.simulationWaitMs = static_cast<double>(m_SimulationWaitNs.load(std::memory_order_relaxed)) / 1.0e6;
+        return stats;
+    }
+
+private:
+    class SceneRenderer;
+
+    // capacity of the queues, enough for every packet
+    static constexpr size_t QUEUE_CAPACITY = 4;
+    static_assert(MAX_FRAMES_IN_FLIGHT + 1 <= QUEUE_CAPACITY);
+
+    std::unique_ptr<IRenderer> m_Renderer;
+    std::vector<std::unique_ptr<FramePacket>> m_Packets;
+    SpscQueue<FramePacket*, QUEUE_CAPACITY> m_Free;
+    SpscQueue<FramePacket*, QUEUE_CAPACITY> m_Ready;
+    // released after every Push, acquired before every Pop; stop releases m_FreeCount once more to wake the simulation
+    std::counting_semaphore<> m_FreeCount{ 0 };
+    std::counting_semaphore<> m_ReadyCount{ 0 };
+    std::thread m_Simulation;
+    std::atomic<bool> m_Running{ false };
+    // written by the simulation thread
+    std::atomic<int64_t> m_SimulationWaitNs{ 0 };
+    // render thread only
+    Stats m_Stats;
+
+    void stamp(FramePacket& packet);
+    // simulation thread, nullptr when the pipeline stops while it waits
+    FramePacket* acquireFree();
+    void publish(FramePacket* packet);
+};
+
+#endif // !FRAME_PIPELINE_H
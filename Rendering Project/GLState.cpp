@@ -0,0 +1,258 @@
+#include "GLState.h"
+
+GLState::State GLState::s_State;
+GLState::Stats GLState::s_Frame;
+GLState::Stats GLState::s_LastFrame;
+GLState::Caps GLState::s_Caps;
+GLuint GLState::s_DefaultFramebuffer = 0;
+
+GLState::State::State()
+{
+    for (auto& unit : textures)
+        unit.fill(UNKNOWN);
+    caps.fill(-1);
+}
+
+bool GLState::change(bool changed)
+{
+    if (changed)
+        ++s_Frame.issued;
+    else
+        ++s_Frame.skipped;
+    return changed;
+}
+
+int GLState::textureSlot(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_2D_ARRAY: return 1;
+    case GL_TEXTURE_CUBE_MAP: return 2;
+    case GL_TEXTURE_2D_MULTISAMPLE: return 3;
+    case GL_TEXTURE_CUBE_MAP_ARRAY: return 4;
+    case GL_TEXTURE_3D: return 5;
+    default: return -1;
+    }
+}
+
+int GLState::capSlot(GLenum cap)
+{
+    switch (cap)
+    {
+    case GL_DEPTH_TEST: return 0;
+    case GL_CULL_FACE: return 1;
+    case GL_BLEND: return 2;
+    case GL_STENCIL_TEST: return 3;
+    case GL_SCISSOR_TEST: return 4;
+    case GL_POLYGON_OFFSET_FILL: return 5;
+    case GL_DEPTH_CLAMP: return 6;
+    case GL_MULTISAMPLE: return 7;
+    default: return -1;
+    }
+}
+
+void GLState::UseProgram(GLuint program)
+{
+    if (change(s_State.program != program))
+    {
+        glUseProgram(program);
+        s_State.program = program;
+    }
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+    if (change(s_State.vertexArray != vao))
+    {
+        glBindVertexArray(vao);
+        s_State.vertexArray = vao;
+    }
+}
+
+void GLState::ActiveTexture(GLenum unit)
+{
+    if (change(s_State.activeUnit != unit))
+    {
+        glActiveTexture(unit);
+        s_State.activeUnit = unit;
+    }
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+    const int slot = textureSlot(target);
+    const GLuint unit = s_State.activeUnit - GL_TEXTURE0;
+    // an unknown active unit or target is always issued
+    if (slot < 0 || s_State.activeUnit == UNKNOWN || unit >= MAX_TEXTURE_UNITS)
+    {
+        change(true);
+        glBindTexture(target, texture);
+        return;
+    }
+    GLuint& bound = s_State.textures[unit][slot];
+    if (change(bound != texture))
+    {
+        glBindTexture(target, texture);
+        bound = texture;
+    }
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    const bool changed = (read && s_State.readFramebuffer != framebuffer) || (draw && s_State.drawFramebuffer != framebuffer);
+    if (change(changed))
+    {
+        glBindFramebuffer(target, framebuffer == 0 ? s_DefaultFramebuffer : framebuffer);
+        if (read)
+            s_State.readFramebuffer = framebuffer;
+        if (draw)
+            s_State.drawFramebuffer = framebuffer;
+    }
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    const std::array<GLint, 4> viewport{ x, y, width, height };
+    if (change(s_State.viewport != viewport))
+    {
+        glViewport(x, y, width, height);
+        s_State.viewport = viewport;
+    }
+}
+
+void GLState::ViewportIndexedf(GLuint index, GLfloat x, GLfloat y, GLfloat width, GLfloat height)
+{
+    if (index != 0)
+    {
+        change(true);
+        glViewportIndexedf(index, x, y, width, height);
+        return;
+    }
+
+    const std::array<GLint, 4> viewport{ static_cast<GLint>(x), static_cast<GLint>(y), static_cast<GLint>(width), static_cast<GLint>(height) };
+    const bool integral = viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height;
+    if (change(!integral || s_State.viewport != viewport))
+    {
+        glViewportIndexedf(index, x, y, width, height);
+        // a fractional viewport is not one that Viewport can ask for
+        s_State.viewport = integral ? viewport : std::array<GLint, 4>{ -1, -1, -1, -1 };
+    }
+}
+
+void GLState::setCap(GLenum cap, bool enable)
+{
+    const int slot = capSlot(cap);
+    if (slot >= 0 && !change(s_State.caps[slot] != static_cast<int>(enable)))
+        return;
+    if (slot < 0)
+        change(true);
+    if (enable)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    if (slot >= 0)
+        s_State.caps[slot] = enable ? 1 : 0;
+}
+
+void GLState::Enable(GLenum cap)
+{
+    setCap(cap, true);
+}
+
+void GLState::Disable(GLenum cap)
+{
+    setCap(cap, false);
+}
+
+void GLState::DepthMask(GLboolean flag)
+{
+    const int mask = flag ? 1 : 0;
+    if (change(s_State.depthMask != mask))
+    {
+        glDepthMask(flag);
+        s_State.depthMask = mask;
+    }
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+    if (change(s_State.depthFunc != func))
+    {
+        glDepthFunc(func);
+        s_State.depthFunc = func;
+    }
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+    glDeleteProgram(program);
+    // a program in use is only flagged for deletion, but its name can not be bound again
+    if (program != 0 && s_State.program == program)
+        s_State.program = UNKNOWN;
+}
+
+void GLState::DeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+    glDeleteVertexArrays(n, arrays);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        if (arrays[i] != 0 && s_State.vertexArray == arrays[i])
+            s_State.vertexArray = 0;
+    }
+}
+
+void GLState::DeleteTextures(GLsizei n, const GLuint* textures)
+{
+    glDeleteTextures(n, textures);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        if (textures[i] == 0)
+            continue;
+        for (auto& unit : s_State.textures)
+        {
+            for (GLuint& bound : unit)
+            {
+                if (bound == textures[i])
+                    bound = 0;
+            }
+        }
+    }
+}
+
+void GLState::DeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+    glDeleteFramebuffers(n, framebuffers);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        if (framebuffers[i] == 0)
+            continue;
+        // GL falls back to the window framebuffer, which is not s_DefaultFramebuffer in headless mode,
+        // so the next bind must always reach GL
+        if (s_State.readFramebuffer == framebuffers[i])
+            s_State.readFramebuffer = UNKNOWN;
+        if (s_State.drawFramebuffer == framebuffers[i])
+            s_State.drawFramebuffer = UNKNOWN;
+    }
+}
+
+void GLState::Invalidate()
+{
+    s_State = State();
+}
+
+void GLState::QueryCaps()
+{
+    glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &s_Caps.maxCombinedTextureImageUnits);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &s_Caps.maxTextureSize);
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &s_Caps.maxArrayTextureLayers);
+    glGetIntegerv(GL_MAX_SAMPLES, &s_Caps.maxSamples);
+}
+
+void GLState::EndFrame()
+{
+    s_LastFrame = s_Frame;
+    s_Frame = {};
+}
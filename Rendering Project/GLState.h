@@ -0,0 +1,110 @@
+#pragma once
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <array>
+#include <cstddef>
+#include <glad/gl.h>
+
+/**
+    * @brief Cache of the GL state that the engine changes the most: program, vertex array, texture
+    * bindings of every unit, framebuffers, viewport, enable bits, depth mask and depth function.
+    *
+    * @details Every call of the engine goes through these functions (same arguments of the gl function
+    *          with the same name) and is dropped when the state is already the requested one. The cache
+    *          starts unknown, so the first call of every state is always issued; Invalidate() forgets
+    *          everything after code that changes the state behind its back. The Delete functions clear
+    *          the bindings of the deleted objects, as GL does, so a name given again by GL is not skipped.
+    *          EndFrame() closes the counters of the frame, GetFrameStats() returns the last closed frame.
+**/
+class GLState
+{
+public:
+    static constexpr size_t MAX_TEXTURE_UNITS = 32;
+
+    struct Stats
+    {
+        size_t issued{ 0 };
+        size_t skipped{ 0 };
+        size_t drawCalls{ 0 };   // a multi draw counts once
+    };
+
+    // limits of the context, they never change: queried once by QueryCaps when the context is created
+    struct Caps
+    {
+        GLint maxCombinedTextureImageUnits{ 0 };
+        GLint maxTextureSize{ 0 };
+        GLint maxArrayTextureLayers{ 0 };
+        GLint maxSamples{ 0 };
+    };
+
+    static void UseProgram(GLuint program);
+    static void BindVertexArray(GLuint vao);
+    static void ActiveTexture(GLenum unit);
+    // binds on the active unit, like glBindTexture
+    static void BindTexture(GLenum target, GLuint texture);
+    static void BindFramebuffer(GLenum target, GLuint framebuffer);
+    static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    // viewport 0 is the one of Viewport and shares its cache, the other indices are never skipped
+    static void ViewportIndexedf(GLuint index, GLfloat x, GLfloat y, GLfloat width, GLfloat height);
+    static void Enable(GLenum cap);
+    static void Disable(GLenum cap);
+    static void DepthMask(GLboolean flag);
+    static void DepthFunc(GLenum func);
+
+    static void DeleteProgram(GLuint program);
+    static void DeleteVertexArrays(GLsizei n, const GLuint* arrays);
+    static void DeleteTextures(GLsizei n, const GLuint* textures);
+    static void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+
+    // called next to every draw of the engine, for the frame statistics
+    static void CountDraw() { ++s_Frame.drawCalls; }
+
+    static void Invalidate();
+    static void EndFrame();
+    static const Stats& GetFrameStats() { return s_LastFrame; }
+
+    static void QueryCaps();
+    static const Caps& GetCaps() { return s_Caps; }
+
+    // the framebuffer bound in place of 0, the offscreen target of a context without a window
+    static void SetDefaultFramebuffer(GLuint framebuffer) { s_DefaultFramebuffer = framebuffer; }
+
+private:
+    // the texture targets with a slot in the cache, the other targets are never skipped
+    static constexpr size_t TEXTURE_TARGETS = 6;
+    static constexpr GLuint UNKNOWN = 0xFFFFFFFFu;
+    // the caps with a bit in the cache, the other caps are never skipped
+    static constexpr size_t CACHED_CAPS = 8;
+
+    struct State
+    {
+        GLuint program{ UNKNOWN };
+        GLuint vertexArray{ UNKNOWN };
+        GLenum activeUnit{ UNKNOWN };
+        std::array<std::array<GLuint, TEXTURE_TARGETS>, MAX_TEXTURE_UNITS> textures;
+        GLuint readFramebuffer{ UNKNOWN };
+        GLuint drawFramebuffer{ UNKNOWN };
+        std::array<GLint, 4> viewport{ -1, -1, -1, -1 };
+        std::array<int, CACHED_CAPS> caps; // -1 unknown, 0 disabled, 1 enabled
+        int depthMask{ -1 };
+        GLenum depthFunc{ UNKNOWN };
+
+        State();
+    };
+
+    static State s_State;
+    static Stats s_Frame;
+    static Stats s_LastFrame;
+    static Caps s_Caps;
+    static GLuint s_DefaultFramebuffer;
+
+    static int textureSlot(GLenum target);
+    static int capSlot(GLenum cap);
+    static void setCap(GLenum cap, bool enable);
+    // true if the call must be issued, and counts it
+    static bool change(bool changed);
+};
+
+#endif // !GL_STATE_H
@@ -0,0 +1,215 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstddef>
+
+#include "Debugging.h"
+#include "GLState.h"
+
+GeometryArena& GeometryArena::Get()
+{
+    static GeometryArena arena;
+    return arena;
+}
+
+GeometryArena::~GeometryArena()
+{
+    // the GL context could already be destroyed here, the owner of the context
+    // should call clean() before closing the window
+}
+
+ArenaAllocation GeometryArena::Allocate(const std::vector<ArenaVertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    ArenaAllocation allocation;
+    if (vertices.empty() || indices.empty())
+        return allocation;
+
+    if (m_VertexBuffer == 0)
+        Grow(std::max(INITIAL_VERTEX_CAPACITY, vertices.size()), std::max(INITIAL_INDEX_CAPACITY, indices.size()));
+
+    size_t vertexOffset = 0;
+    size_t indexOffset = 0;
+    size_t vertexCapacity = m_VertexCapacity;
+    size_t indexCapacity = m_IndexCapacity;
+
+    // when a range does not fit AllocateRange only tells the new capacity needed, the buffers
+    // are grown once for both and then the allocation is retried
+    bool vertexFit = AllocateRange(m_FreeVertices, vertexCapacity, vertices.size(), vertexOffset);
+    bool indexFit = AllocateRange(m_FreeIndices, indexCapacity, indices.size(), indexOffset);
+    if (!vertexFit || !indexFit)
+    {
+        if (vertexFit) ReleaseRange(m_FreeVertices, vertexOffset, vertices.size());
+        if (indexFit) ReleaseRange(m_FreeIndices, indexOffset, indices.size());
+
+        Grow(vertexCapacity, indexCapacity);
+
+        vertexFit = AllocateRange(m_FreeVertices, vertexCapacity, vertices.size(), vertexOffset);
+        indexFit = AllocateRange(m_FreeIndices, indexCapacity, indices.size(), indexOffset);
+        if (!vertexFit || !indexFit)
+        {
+            std::cerr << "GeometryArena: unable to allocate " << vertices.size() << " vertices and "
+                << indices.size() << " indices" << std::endl;
+            return allocation;
+        }
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_VertexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * sizeof(ArenaVertex), vertices.size() * sizeof(ArenaVertex), vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_IndexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    GL_CHECK();
+
+    allocation.BaseVertex = static_cast<GLint>(vertexOffset);
+    allocation.FirstIndex = static_cast<GLuint>(indexOffset);
+    allocation.NumVertices = static_cast<GLuint>(vertices.size());
+    allocation.NumIndices = static_cast<GLuint>(indices.size());
+
+    m_UsedVertices += vertices.size();
+    m_UsedIndices += indices.size();
+    return allocation;
+}
+
+void GeometryArena::Free(const ArenaAllocation& allocation)
+{
+    if (!allocation.IsValid())
+        return;
+
+    ReleaseRange(m_FreeVertices, allocation.BaseVertex, allocation.NumVertices);
+    ReleaseRange(m_FreeIndices, allocation.FirstIndex, allocation.NumIndices);
+    m_UsedVertices -= allocation.NumVertices;
+    m_UsedIndices -= allocation.NumIndices;
+}
+
+void GeometryArena::SetupVertexFormat(GLuint vao) const
+{
+    GLState::BindVertexArray(vao);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, Position));
+    glVertexAttribBinding(0, ARENA_VERTEX_BINDING);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, TexCoord));
+    glVertexAttribBinding(1, ARENA_VERTEX_BINDING);
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, Normal));
+    glVertexAttribBinding(2, ARENA_VERTEX_BINDING);
+
+    glEnableVertexAttribArray(3);
+    glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, Tangent));
+    glVertexAttribBinding(3, ARENA_VERTEX_BINDING);
+
+    glEnableVertexAttribArray(4);
+    glVertexAttribFormat(4, 3, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, Bitangent));
+    glVertexAttribBinding(4, ARENA_VERTEX_BINDING);
+
+    AttachBuffers(vao);
+}
+
+void GeometryArena::AttachBuffers(GLuint vao) const
+{
+    GLState::BindVertexArray(vao);
+    glBindVertexBuffer(ARENA_VERTEX_BINDING, m_VertexBuffer, 0, sizeof(ArenaVertex));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+    GL_CHECK();
+}
+
+void GeometryArena::clean()
+{
+    if (m_VertexBuffer != 0) {
+        glDeleteBuffers(1, &m_VertexBuffer);
+        m_VertexBuffer = 0;
+    }
+    if (m_IndexBuffer != 0) {
+        glDeleteBuffers(1, &m_IndexBuffer);
+        m_IndexBuffer = 0;
+    }
+    m_VertexCapacity = m_IndexCapacity = 0;
+    m_UsedVertices = m_UsedIndices = 0;
+    m_FreeVertices.clear();
+    m_FreeIndices.clear();
+    ++m_Generation;
+}
+
+bool GeometryArena::AllocateRange(std::vector<FreeRange>& freeList, size_t& capacity, size_t size, size_t& outOffset)
+{
+    for (auto it = freeList.begin(); it != freeList.end(); ++it)
+    {
+        if (it->Size < size)
+            continue;
+
+        outOffset = it->Offset;
+        it->Offset += size;
+        it->Size -= size;
+        if (it->Size == 0)
+            freeList.erase(it);
+        return true;
+    }
+
+    // does not fit: report the capacity required, counting the free tail that can be extended
+    size_t tail = 0;
+    if (!freeList.empty() && freeList.back().Offset + freeList.back().Size == capacity)
+        tail = freeList.back().Size;
+    capacity = std::max(capacity * 2, capacity + size - tail);
+    return false;
+}
+
+void GeometryArena::ReleaseRange(std::vector<FreeRange>& freeList, size_t offset, size_t size)
+{
+    // keep the list sorted by offset and merge the adjacent ranges
+    auto it = std::lower_bound(freeList.begin(), freeList.end(), offset,
+        [](const FreeRange& range, size_t value) { return range.Offset < value; });
+    it = freeList.insert(it, FreeRange{ offset, size });
+
+    auto next = it + 1;
+    if (next != freeList.end() && it->Offset + it->Size == next->Offset) {
+        it->Size += next->Size;
+        freeList.erase(next);
+    }
+    if (it != freeList.begin()) {
+        auto prev = it - 1;
+        if (prev->Offset + prev->Size == it->Offset) {
+            prev->Size += it->Size;
+            freeList.erase(it);
+        }
+    }
+}
+
+void GeometryArena::Grow(size_t minVertexCapacity, size_t minIndexCapacity)
+{
+    if (minVertexCapacity > m_VertexCapacity) {
+        GrowBuffer(m_VertexBuffer, m_VertexCapacity * sizeof(ArenaVertex), minVertexCapacity * sizeof(ArenaVertex));
+        ReleaseRange(m_FreeVertices, m_VertexCapacity, minVertexCapacity - m_VertexCapacity);
+        m_VertexCapacity = minVertexCapacity;
+    }
+    if (minIndexCapacity > m_IndexCapacity) {
+        GrowBuffer(m_IndexBuffer, m_IndexCapacity * sizeof(unsigned int), minIndexCapacity * sizeof(unsigned int));
+        ReleaseRange(m_FreeIndices, m_IndexCapacity, minIndexCapacity - m_IndexCapacity);
+        m_IndexCapacity = minIndexCapacity;
+    }
+
+    // every VAO that points to the old buffers must be updated
+    ++m_Generation;
+}
+
+void GeometryArena::GrowBuffer(GLuint& buffer, size_t oldBytes, size_t newBytes)
+{
+    GLuint newBuffer = 0;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+
+    if (buffer != 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    GL_CHECK();
+
+    buffer = newBuffer;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <vector>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// use to keep sync with the shaders and with the attribute locations in Mesh.h
+constexpr GLuint ARENA_VERTEX_BINDING = 0;
+
+// Interleaved vertex used by every mesh stored in the arena.
+struct ArenaVertex
+{
+    glm::vec3 Position;
+    glm::vec2 TexCoord;
+    glm::vec3 Normal;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+// Where a mesh lives inside the shared buffers.
+// BaseVertex and FirstIndex are already expressed in elements (not bytes) so they can be
+// used directly as the baseVertex / firstIndex of a draw call.
+struct ArenaAllocation
+{
+    GLint BaseVertex{ 0 };
+    GLuint FirstIndex{ 0 };
+    GLuint NumVertices{ 0 };
+    GLuint NumIndices{ 0 };
+
+    bool IsValid() const { return NumIndices != 0; }
+};
+
+/**
+    * @brief Global geometry storage: one interleaved vertex buffer and one index buffer
+    * shared by all the BasicMesh objects.
+    *
+    * @details Every mesh sub-allocates a range of vertices and a range of indices.
+    *          Since all the meshes share the same buffers, draws of different meshes can be
+    *          merged into a single glMultiDrawElementsIndirect call.
+    *          When the arena runs out of space the buffers are reallocated (bigger) and the
+    *          generation counter is incremented: the VAOs that reference the arena have to call
+    *          AttachBuffers again (BasicMesh does it lazily before drawing).
+**/
+class GeometryArena
+{
+public:
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    static GeometryArena& Get();
+
+    ArenaAllocation Allocate(const std::vector<ArenaVertex>& vertices, const std::vector<unsigned int>& indices);
+    void Free(const ArenaAllocation& allocation);
+
+    // specify the vertex format of the arena in the VAO (only needed once per VAO)
+    void SetupVertexFormat(GLuint vao) const;
+    // bind the arena buffers to the VAO (needed again every time the generation changes)
+    void AttachBuffers(GLuint vao) const;
+
+    unsigned int GetGeneration() const { return m_Generation; }
+    GLuint GetVertexBuffer() const { return m_VertexBuffer; }
+    GLuint GetIndexBuffer() const { return m_IndexBuffer; }
+    size_t GetUsedVertices() const { return m_UsedVertices; }
+    size_t GetUsedIndices() const { return m_UsedIndices; }
+
+    void clean();
+
+private:
+    GeometryArena() = default;
+    ~GeometryArena();
+
+    // simple first fit free list, ranges are expressed in elements
+    struct FreeRange
+    {
+        size_t Offset;
+        size_t Size;
+    };
+
+    bool AllocateRange(std::vector<FreeRange>& freeList, size_t& capacity, size_t size, size_t& outOffset);
+    void ReleaseRange(std::vector<FreeRange>& freeList, size_t offset, size_t size);
+    void Grow(size_t minVertexCapacity, size_t minIndexCapacity);
+    void GrowBuffer(GLuint& buffer, size_t oldBytes, size_t newBytes);
+
+    GLuint m_VertexBuffer{ 0 };
+    GLuint m_IndexBuffer{ 0 };
+
+    size_t m_VertexCapacity{ 0 };
+    size_t m_IndexCapacity{ 0 };
+    size_t m_UsedVertices{ 0 };
+    size_t m_UsedIndices{ 0 };
+
+    std::vector<FreeRange> m_FreeVertices;
+    std::vector<FreeRange> m_FreeIndices;
+
+    unsigned int m_Generation{ 0 };
+
+    static constexpr size_t INITIAL_VERTEX_CAPACITY = 1 << 20;
+    static constexpr size_t INITIAL_INDEX_CAPACITY = 1 << 21;
+};
+
+#endif // !GEOMETRY_ARENA_H
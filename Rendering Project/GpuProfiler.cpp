@@ -0,0 +1,255 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+GpuProfiler& GpuProfiler::Get()
+{
+    static GpuProfiler profiler;
+    return profiler;
+}
+
+void GpuProfiler::BeginFrame()
+{
+    if (!m_Enabled)
+        return;
+    if (m_Frame == 0)
+        m_DebugGroups = GLAD_GL_KHR_debug || GLAD_GL_VERSION_4_3;
+
+    ++m_Frame;
+    FrameQueries& frame = current();
+    if (frame.recorded)
+        resolve(frame);
+    frame.zones.clear();
+    frame.used = 0;
+    frame.recorded = true;
+
+    m_InFrame = true;
+    m_Stack.clear();
+    Push("Frame");
+}
+
+void GpuProfiler::EndFrame()
+{
+    if (!m_InFrame)
+        return;
+    // a scope left open closes with the frame
+    while (!m_Stack.empty())
+        Pop();
+    m_InFrame = false;
+}
+
+void GpuProfiler::Push(const char* name, int index)
+{
+    if (!m_InFrame)
+    {
+        m_Stack.push_back(SIZE_MAX);
+        return;
+    }
+
+    if (m_DebugGroups)
+    {
+        char label[64];
+        if (index >= 0)
+            std::snprintf(label, sizeof(label), "%s %d", name, index);
+        else
+            std::snprintf(label, sizeof(label), "%s", name);
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, label);
+    }
+
+    FrameQueries& frame = current();
+    frame.zones.push_back(Zone{ name, index, static_cast<int>(m_Stack.size()), timestamp(frame) });
+    m_Stack.push_back(frame.zones.size() - 1);
+}
+
+void GpuProfiler::Pop()
+{
+    if (m_Stack.empty())
+        return;
+    const size_t zone = m_Stack.back();
+    m_Stack.pop_back();
+    if (zone == SIZE_MAX || !m_InFrame)
+        return;
+
+    FrameQueries& frame = current();
+    frame.zones[zone].endQuery = timestamp(frame);
+    if (m_DebugGroups)
+        glPopDebugGroup();
+}
+
+size_t GpuProfiler::timestamp(FrameQueries& frame)
+{
+    if (frame.used == frame.queries.size())
+    {
+        // grow in blocks, a new scene or more lights may add scopes
+        const size_t grow = std::max<size_t>(32, frame.queries.size());
+        frame.queries.resize(frame.queries.size() + grow);
+        glGenQueries(static_cast<GLsizei>(grow), frame.queries.data() + frame.used);
+    }
+    glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+    return frame.used++;
+}
+
+void GpuProfiler::resolve(FrameQueries& frame)
+{
+    if (frame.used == 0)
+        return;
+
+    // the last query is the last one the GPU writes: if it is ready every other one is
+    GLuint available = 0;
+    glGetQueryObjectuiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        ++m_DroppedFrames;
+        return;
+    }
+
+    std::vector<std::string> order;
+    std::vector<std::string> path;
+    order.reserve(frame.zones.size());
+    for (const Zone& zone : frame.zones)
+    {
+        std::string name = zone.index >= 0 ? zone.name + " " + std::to_string(zone.index) : zone.name;
+        path.resize(zone.depth);
+        if (!path.empty())
+            name = path.back() + "/" + name;
+        path.push_back(name);
+        if (zone.endQuery == SIZE_MAX)
+            continue;
+
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(frame.queries[zone.beginQuery], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[zone.endQuery], GL_QUERY_RESULT, &end);
+        const float ms = end > begin ? static_cast<float>(static_cast<double>(end - begin) / 1.0e6) : 0.0f;
+
+        History& history = m_History[name];
+        if (std::find(order.begin(), order.end(), name) == order.end())
+        {
+            history.depth = zone.depth;
+            history.last = ms;
+            order.push_back(name);
+        }
+        else
+        {
+            // the same zone more than once in a frame (a loop without index): one sample with the sum
+            history.last += ms;
+            history.next = (history.next + HISTORY - 1) % HISTORY;
+            history.count = std::max<size_t>(history.count, 1) - 1;
+        }
+        history.samples[history.next] = history.last;
+        history.next = (history.next + 1) % HISTORY;
+        history.count = std::min(history.count + 1, HISTORY);
+    }
+    m_Order = std::move(order);
+    ++m_ResolvedFrames;
+}
+
+GpuProfiler::ZoneStats GpuProfiler::makeStats(const std::string& name, const History& history) const
+{
+    ZoneStats stats;
+    stats.name = name;
+    stats.depth = history.depth;
+    stats.samples = history.count;
+    stats.lastMs = history.last;
+    if (history.count == 0)
+        return stats;
+
+    std::vector<float> sorted(history.samples.begin(), history.samples.begin() + history.count);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (float sample : sorted)
+        sum += sample;
+    auto percentile = [&sorted](double p) {
+        return static_cast<double>(sorted[static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5)]);
+    };
+    stats.averageMs = sum / static_cast<double>(sorted.size());
+    stats.minMs = sorted.front();
+    stats.maxMs = sorted.back();
+    stats.p50Ms = percentile(0.50);
+    stats.p95Ms = percentile(0.95);
+    stats.p99Ms = percentile(0.99);
+    return stats;
+}
+
+std::vector<GpuProfiler::ZoneStats> GpuProfiler::GetStats() const
+{
+    std::vector<ZoneStats> result;
+    result.reserve(m_Order.size());
+    for (const std::string& name : m_Order)
+        result.push_back(makeStats(name, m_History.at(name)));
+    return result;
+}
+
+bool GpuProfiler::GetStats(const std::string& name, ZoneStats& stats) const
+{
+    auto it = m_History.find(name);
+    if (it == m_History.end())
+        return false;
+    stats = makeStats(name, it->second);
+    return true;
+}
+
+bool GpuProfiler::ExportCSV(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "GpuProfiler: can not write " << path << std::endl;
+        return false;
+    }
+    file << "zone,depth,samples,last_ms,average_ms,min_ms,max_ms,p50_ms,p95_ms,p99_ms\n";
+    for (const ZoneStats& zone : GetStats())
+    {
+        file << '"' << zone.name << "\"," << zone.depth << ',' << zone.samples << ',' << zone.lastMs << ','
+            << zone.averageMs << ',' << zone.minMs << ',' << zone.maxMs << ','
+            << zone.p50Ms << ',' << zone.p95Ms << ',' << zone.p99Ms << '\n';
+    }
+    return true;
+}
+
+bool GpuProfiler::ExportJSON(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "GpuProfiler: can not write " << path << std::endl;
+        return false;
+    }
+    file << "{\n  \"frames\": " << m_ResolvedFrames << ",\n  \"dropped_frames\": " << m_DroppedFrames << ",\n  \"zones\": [";
+    const std::vector<ZoneStats> zones = GetStats();
+    for (size_t i = 0; i < zones.size(); ++i)
+    {
+        const ZoneStats& zone = zones[i];
+        // the scope names have no quote to escape
+        file << (i == 0 ? "\n" : ",\n")
+            << "    { \"name\": \"" << zone.name << "\", \"depth\": " << zone.depth << ", \"samples\": " << zone.samples
+            << ", \"last_ms\": " << zone.lastMs << ", \"average_ms\": " << zone.averageMs
+            << ", \"min_ms\": " << zone.minMs << ", \"max_ms\": " << zone.maxMs
+            << ", \"p50_ms\": " << zone.p50Ms << ", \"p95_ms\": " << zone.p95Ms << ", \"p99_ms\": " << zone.p99Ms << " }";
+    }
+    file << "\n  ]\n}\n";
+    return true;
+}
+
+void GpuProfiler::Reset()
+{
+    m_History.clear();
+    m_Order.clear();
+    m_ResolvedFrames = 0;
+    m_DroppedFrames = 0;
+}
+
+void GpuProfiler::clean()
+{
+    for (FrameQueries& frame : m_Frames)
+    {
+        if (!frame.queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        frame = FrameQueries();
+    }
+    m_Stack.clear();
+    m_InFrame = false;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glad/gl.h>
+
+/**
+    * @brief GPU time of the render passes, measured with a pair of GL_TIMESTAMP queries per scope.
+    *
+    * @details The scopes nest (GL_TIME_ELAPSED queries can not, so they would break the timers that are
+    *          already in the renderer) and every scope is also a glPushDebugGroup, so the captures of
+    *          RenderDoc / Nsight show the same tree. The queries of a frame are read back FRAME_LATENCY
+    *          frames later, when the GPU has long finished them: BeginFrame never waits, a frame whose
+    *          results are still not available is dropped (GetDroppedFrames).
+    *          Every zone is identified by its path ("Frame/Shadows/Spot 2") and keeps the last HISTORY
+    *          samples, GetStats returns the rolling average, min, max and percentiles of them.
+**/
+class GpuProfiler
+{
+public:
+    static constexpr size_t FRAME_LATENCY = 4;
+    static constexpr size_t HISTORY = 240;
+
+    struct ZoneStats
+    {
+        std::string name;   // path of the zone, the parents separated by '/'
+        int depth{ 0 };
+        size_t samples{ 0 };
+        double lastMs{ 0.0 };
+        double averageMs{ 0.0 };
+        double minMs{ 0.0 };
+        double maxMs{ 0.0 };
+        double p50Ms{ 0.0 };
+        double p95Ms{ 0.0 };
+        double p99Ms{ 0.0 };
+    };
+
+    // RAII scope, index (if >= 0) is appended to the name, e.g. the light of a shadow map
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name, int index = -1) { GpuProfiler::Get().Push(name, index); }
+        ~Scope() { GpuProfiler::Get().Pop(); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    static GpuProfiler& Get();
+
+    void SetEnabled(bool enable) { m_Enabled = enable; }
+    bool IsEnabled() const { return m_Enabled; }
+
+    // opens the root zone "Frame", reads back the frame recorded FRAME_LATENCY frames ago
+    void BeginFrame();
+    void EndFrame();
+    // the scopes outside BeginFrame / EndFrame are ignored
+    void Push(const char* name, int index = -1);
+    void Pop();
+
+    // every zone seen in the last read frame, in the order of the frame
+    std::vector<ZoneStats> GetStats() const;
+    bool GetStats(const std::string& name, ZoneStats& stats) const;
+    uint64_t GetResolvedFrames() const { return m_ResolvedFrames; }
+    uint64_t GetDroppedFrames() const { return m_DroppedFrames; }
+
+    bool ExportCSV(const std::string& path) const;
+    bool ExportJSON(const std::string& path) const;
+
+    // forget the statistics, the queries are kept
+    void Reset();
+    // delete the queries, call it while the context is still alive
+    void clean();
+
+private:
+    GpuProfiler() = default;
+    ~GpuProfiler() = default;
+
+    // the name is copied: the scopes may name it with a string that does not live FRAME_LATENCY frames
+    struct Zone
+    {
+        std::string name;
+        int index;
+        int depth;
+        size_t beginQuery;
+        size_t endQuery{ SIZE_MAX };
+    };
+
+    struct FrameQueries
+    {
+        std::vector<GLuint> queries;
+        std::vector<Zone> zones;
+        size_t used{ 0 };
+        bool recorded{ false };
+    };
+
+    struct History
+    {
+        int depth{ 0 };
+        std::array<float, HISTORY> samples{};
+        size_t count{ 0 };
+        size_t next{ 0 };
+        float last{ 0.0f };
+    };
+
+    bool m_Enabled{ true };
+    bool m_InFrame{ false };
+    bool m_DebugGroups{ false };
+    uint64_t m_Frame{ 0 };
+    uint64_t m_ResolvedFrames{ 0 };
+    uint64_t m_DroppedFrames{ 0 };
+    std::array<FrameQueries, FRAME_LATENCY> m_Frames;
+    // open zones, SIZE_MAX for the ignored scopes so Pop stays balanced
+    std::vector<size_t> m_Stack;
+
+    std::unordered_map<std::string, History> m_History;
+    std::vector<std::string> m_Order;
+
+    FrameQueries& current() { return m_Frames[m_Frame % FRAME_LATENCY]; }
+    size_t timestamp(FrameQueries& frame);
+    void resolve(FrameQueries& frame);
+    ZoneStats makeStats(const std::string& name, const History& history) const;
+};
+
+#define GPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define GPU_PROFILE_CONCAT(a, b) GPU_PROFILE_CONCAT_INNER(a, b)
+// GPU_PROFILE_SCOPE("Lighting") or GPU_PROFILE_SCOPE("Spot", index) until the end of the block
+#define GPU_PROFILE_SCOPE(...) GpuProfiler::Scope GPU_PROFILE_CONCAT(gpuProfileScope, __LINE__)(__VA_ARGS__)
+
+#endif // !GPU_PROFILER_H
@@ -0,0 +1,555 @@
+#include "IndirectDraw.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "Debugging.h"
+#include "GeometryArena.h"
+#include "PathConfig.h"
+
+// ============================================================================
+// CULLING PLANES
+// ============================================================================
+
+CullPlanes FrustumPlanes(const glm::mat4& viewProjection)
+{
+    // Gribb / Hartmann: the planes are combination of the rows of the matrix
+    const glm::mat4 m = glm::transpose(viewProjection);
+    CullPlanes planes = {
+        m[3] + m[0], // left
+        m[3] - m[0], // right
+        m[3] + m[1], // bottom
+        m[3] - m[1], // top
+        m[3] + m[2], // near
+        m[3] - m[2]  // far
+    };
+    for (auto& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+    return planes;
+}
+
+CullPlanes BoxPlanes(const glm::vec3& minCorner, const glm::vec3& maxCorner)
+{
+    return {
+        glm::vec4(1.0f, 0.0f, 0.0f, -minCorner.x),
+        glm::vec4(-1.0f, 0.0f, 0.0f, maxCorner.x),
+        glm::vec4(0.0f, 1.0f, 0.0f, -minCorner.y),
+        glm::vec4(0.0f, -1.0f, 0.0f, maxCorner.y),
+        glm::vec4(0.0f, 0.0f, 1.0f, -minCorner.z),
+        glm::vec4(0.0f, 0.0f, -1.0f, maxCorner.z)
+    };
+}
+
+glm::vec4 TransformBoundingSphere(const glm::vec4& sphere, const glm::mat4& model)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+    float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+    return glm::vec4(center, sphere.w * scale);
+}
+
+bool SphereInsidePlanes(const CullPlanes& planes, const glm::vec4& sphere)
+{
+    for (const auto& plane : planes)
+        if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w)
+            return false;
+    return true;
+}
+
+// ============================================================================
+// DEPTH PYRAMID
+// ============================================================================
+
+DepthPyramid::~DepthPyramid()
+{
+    clean();
+}
+
+void DepthPyramid::Init(int s_Width, int s_Height)
+{
+    m_Shader = std::make_unique<Shader>();
+    m_Shader->loadCompute(getShaderFullPath("depth_pyramid.comp").c_str());
+    Resize(s_Width, s_Height);
+}
+
+void DepthPyramid::Resize(int s_Width, int s_Height)
+{
+    if (m_Texture != 0) {
+        GLState::DeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+    m_Width = std::max(1, s_Width);
+    m_Height = std::max(1, s_Height);
+    createTexture();
+    m_Valid = false;
+}
+
+void DepthPyramid::createTexture()
+{
+    m_Levels = 1;
+    for (int size = std::max(m_Width, m_Height); size > 1; size /= 2)
+        m_Levels++;
+
+    glGenTextures(1, &m_Texture);
+    GLState::BindTexture(GL_TEXTURE_2D, m_Texture);
+    glTexStorage2D(GL_TEXTURE_2D, m_Levels, GL_R32F, m_Width, m_Height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+    GL_CHECK();
+}
+
+void DepthPyramid::Build(GLuint depthTexture, const glm::mat4& viewProjection, const glm::ivec2& sourceSize)
+{
+    m_Shader->use();
+
+    // level 0 is a copy of the depth buffer
+    GLState::ActiveTexture(GL_TEXTURE0);
+    GLState::BindTexture(GL_TEXTURE_2D, depthTexture);
+    m_Shader->setInt("depthTexture", 0);
+    m_Shader->setIVec2("sourceSize", sourceSize);
+    m_Shader->setBool("firstLevel", true);
+    glBindImageTexture(1, m_Texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((m_Width + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE,
+        (m_Height + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, 1);
+
+    // every other level keep the farthest depth of the texels it covers
+    m_Shader->setBool("firstLevel", false);
+    int width = m_Width, height = m_Height;
+    for (int level = 1; level < m_Levels; level++)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glBindImageTexture(0, m_Texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, m_Texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((width + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE,
+            (height + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, 1);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+    GL_CHECK();
+
+    m_ViewProjection = viewProjection;
+    m_Valid = true;
+}
+
+void DepthPyramid::clean()
+{
+    if (m_Texture != 0) {
+        GLState::DeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+    m_Valid = false;
+}
+
+// ============================================================================
+// INDIRECT DRAW BUILDER
+// ============================================================================
+
+IndirectDrawBuilder::~IndirectDrawBuilder()
+{
+    clean();
+}
+
+bool IndirectDrawBuilder::SupportsIndirectCount()
+{
+    return GLAD_GL_VERSION_4_6 || GLAD_GL_ARB_indirect_parameters;
+}
+
+void IndirectDrawBuilder::Init(bool batchByMaterial)
+{
+    clean();
+    m_BatchByMaterial = batchByMaterial;
+
+    GeometryArena& arena = GeometryArena::Get();
+
+    glGenVertexArrays(1, &m_VAO);
+    arena.SetupVertexFormat(m_VAO);
+    m_ArenaGeneration = arena.GetGeneration();
+
+    // draw id: one uint per instance, the baseInstance of each command select the record
+    glEnableVertexAttribArray(DRAW_ID_LOCATION);
+    glVertexAttribIFormat(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0);
+    glVertexAttribBinding(DRAW_ID_LOCATION, DRAW_ID_BINDING);
+    glVertexBindingDivisor(DRAW_ID_BINDING, 1);
+    EnsureDrawIDCapacity(1024);
+
+    GLState::BindVertexArray(0);
+
+    m_CullShader = std::make_unique<Shader>();
+    m_CullShader->loadCompute(getShaderFullPath("cull_draws.comp").c_str());
+    GL_CHECK();
+}
+
+void IndirectDrawBuilder::Begin()
+{
+    m_Culled = false;
+    m_Pending.clear();
+    m_Commands.clear();
+    m_DrawRecords.clear();
+    m_Models.clear();
+    m_Sets.clear();
+    m_MaterialRecords.clear();
+    m_MaterialIndices.clear();
+    m_Batches.clear();
+}
+
+void IndirectDrawBuilder::AddMesh(const BasicMesh& mesh, const glm::mat4& model)
+{
+    m_Models.push_back(model);
+    AddDraws(mesh, static_cast<GLuint>(m_Models.size() - 1), nullptr);
+}
+
+void IndirectDrawBuilder::AddInstances(const BasicMesh& mesh, const InstanceSet& instances)
+{
+    if (instances.GetCount() == 0)
+        return;
+
+    // a set drawn with more meshes is copied once
+    auto it = std::find_if(m_Sets.begin(), m_Sets.end(), [&](const SetCopy& copy) { return copy.pSet == &instances; });
+    if (it == m_Sets.end())
+    {
+        const GLuint firstModel = m_Sets.empty() ? 0u : m_Sets.back().FirstModel + static_cast<GLuint>(m_Sets.back().pSet->GetCount());
+        m_Sets.push_back({ &instances, firstModel });
+        it = m_Sets.end() - 1;
+    }
+    AddDraws(mesh, it->FirstModel, &instances);
+}
+
+void IndirectDrawBuilder::AddDraws(const BasicMesh& mesh, GLuint firstModel, const InstanceSet* pSet)
+{
+    const ArenaAllocation& allocation = mesh.GetArenaAllocation();
+    if (!allocation.IsValid())
+        return;
+
+    const auto& materials = mesh.GetMaterials();
+    for (const auto& entry : mesh.GetSubMeshes())
+    {
+        if (entry.NumIndices == 0 || entry.MaterialIndex >= materials.size())
+            continue;
+
+        PendingDraw draw;
+        draw.pMaterial = m_BatchByMaterial ? &materials[entry.MaterialIndex] : nullptr;
+        draw.Command.Count = entry.NumIndices;
+        draw.Command.InstanceCount = pSet != nullptr ? static_cast<GLuint>(pSet->GetCount()) : 1u;
+        draw.Command.FirstIndex = allocation.FirstIndex + entry.BaseIndex;
+        draw.Command.BaseVertex = allocation.BaseVertex + static_cast<GLint>(entry.BaseVertex);
+        draw.Command.BaseInstance = 0; // assigned in Upload, after the sort
+        draw.FirstModel = firstModel;
+        draw.pSet = pSet;
+        draw.BoundingSphere = mesh.GetBoundingSphere();
+        m_Pending.push_back(draw);
+    }
+}
+
+void IndirectDrawBuilder::Upload()
+{
+    // group by material so the textures are bound once per batch
+    std::stable_sort(m_Pending.begin(), m_Pending.end(),
+        [](const PendingDraw& a, const PendingDraw& b) { return a.pMaterial < b.pMaterial; });
+
+    m_Commands.reserve(m_Pending.size());
+    m_DrawRecords.reserve(m_Pending.size());
+    m_Culled = false;
+    m_SlotsFilled = false;
+
+    // the models of the sets follow the ones of AddMesh
+    const GLuint setModelsBase = static_cast<GLuint>(m_Models.size());
+    GLuint firstSlot = 0;
+    for (const auto& draw : m_Pending)
+    {
+        if (m_Batches.empty() || m_Batches.back().pMaterial != draw.pMaterial)
+            m_Batches.push_back({ draw.pMaterial, static_cast<GLuint>(m_Commands.size()), 0 });
+        Batch& batch = m_Batches.back();
+        batch.CommandCount++;
+
+        // record index == command index and the slots grow with the command index, the culling relies on both
+        DrawElementsIndirectCommand command = draw.Command;
+        command.BaseInstance = firstSlot;
+        firstSlot += command.InstanceCount;
+        m_Commands.push_back(command);
+
+        GLuint materialIndex = draw.pMaterial != nullptr ? GetMaterialIndex(draw.pMaterial) : 0u;
+        GLuint firstModel = draw.pSet != nullptr ? setModelsBase + draw.FirstModel : draw.FirstModel;
+        m_DrawRecords.push_back({ draw.BoundingSphere,
+            glm::uvec4(materialIndex, static_cast<GLuint>(m_Batches.size() - 1), batch.FirstCommand, firstModel) });
+    }
+    m_InstanceCount = firstSlot;
+
+    if (m_Commands.empty())
+        return;
+
+    const size_t modelCount = m_Sets.empty() ? m_Models.size()
+        : setModelsBase + m_Sets.back().FirstModel + m_Sets.back().pSet->GetCount();
+    EnsureCapacity(m_CommandBuffer, m_CommandCapacity, m_Commands.size(), sizeof(DrawElementsIndirectCommand), GL_DRAW_INDIRECT_BUFFER);
+    EnsureCapacity(m_CountedCommandBuffer, m_CountedCommandCapacity, m_Commands.size(), sizeof(DrawElementsIndirectCommand), GL_DRAW_INDIRECT_BUFFER);
+    EnsureCapacity(m_CulledCommandBuffer, m_CulledCommandCapacity, m_Commands.size(), sizeof(DrawElementsIndirectCommand), GL_DRAW_INDIRECT_BUFFER);
+    EnsureCapacity(m_DrawCountBuffer, m_DrawCountCapacity, m_Batches.size(), sizeof(GLuint), GL_SHADER_STORAGE_BUFFER);
+    EnsureCapacity(m_DrawRecordBuffer, m_DrawRecordCapacity, m_DrawRecords.size(), sizeof(GPUDrawRecord), GL_SHADER_STORAGE_BUFFER);
+    EnsureCapacity(m_DrawInstanceBuffer, m_DrawInstanceCapacity, m_InstanceCount, sizeof(glm::uvec2), GL_SHADER_STORAGE_BUFFER);
+    EnsureCapacity(m_ModelBuffer, m_ModelCapacity, modelCount, sizeof(glm::mat4), GL_SHADER_STORAGE_BUFFER);
+    EnsureDrawIDCapacity(m_InstanceCount);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_Commands.size() * sizeof(DrawElementsIndirectCommand), m_Commands.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_DrawRecordBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_DrawRecords.size() * sizeof(GPUDrawRecord), m_DrawRecords.data());
+    if (!m_Models.empty()) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_ModelBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_Models.size() * sizeof(glm::mat4), m_Models.data());
+    }
+    // the matrices of the sets never leave the GPU: copied from the region of the frame of the set
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_ModelBuffer);
+    for (const SetCopy& copy : m_Sets)
+    {
+        if (copy.pSet->GetBuffer() == 0)
+            continue;
+        glBindBuffer(GL_COPY_READ_BUFFER, copy.pSet->GetBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            static_cast<GLintptr>(copy.pSet->GetFirstInstance()) * sizeof(glm::mat4),
+            static_cast<GLintptr>(setModelsBase + copy.FirstModel) * sizeof(glm::mat4),
+            static_cast<GLsizeiptr>(copy.pSet->GetCount() * sizeof(glm::mat4)));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!m_MaterialRecords.empty()) {
+        EnsureCapacity(m_MaterialBuffer, m_MaterialCapacity, m_MaterialRecords.size(), sizeof(GPUMaterialRecord), GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_MaterialBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_MaterialRecords.size() * sizeof(GPUMaterialRecord), m_MaterialRecords.data());
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    GL_CHECK();
+}
+
+void IndirectDrawBuilder::Cull(const CullPlanes& planes, const DepthPyramid* pyramid)
+{
+    m_Culled = false;
+    m_SlotsFilled = false;
+    if (m_Commands.empty())
+        return;
+
+    Dispatch(planes, pyramid, true);
+    m_Culled = true;
+}
+
+void IndirectDrawBuilder::ResetCulling()
+{
+    // the slots of the last Cull() only hold the visible instances
+    if (m_Culled)
+        m_SlotsFilled = false;
+    m_Culled = false;
+}
+
+void IndirectDrawBuilder::Dispatch(const CullPlanes& planes, const DepthPyramid* pyramid, bool cull)
+{
+    const bool compact = cull && SupportsIndirectCount();
+    if (compact) {
+        // one atomic counter per batch
+        const GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_DrawCountBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORD_SSBO_BINDING, m_DrawRecordBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTED_COMMAND_SSBO_BINDING, m_CountedCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INPUT_COMMAND_SSBO_BINDING, m_CommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OUTPUT_COMMAND_SSBO_BINDING, m_CulledCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COUNT_SSBO_BINDING, m_DrawCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_INSTANCE_SSBO_BINDING, m_DrawInstanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MODEL_SSBO_BINDING, m_ModelBuffer);
+
+    m_CullShader->use();
+    m_CullShader->setInt("drawCount", static_cast<int>(m_Commands.size()));
+    m_CullShader->setInt("instanceCount", static_cast<int>(m_InstanceCount));
+    m_CullShader->setBool("cull", cull);
+    for (size_t i = 0; i < planes.size(); i++)
+        m_CullShader->setVec4("planes[" + std::to_string(i) + "]", planes[i]);
+
+    const bool occlusion = cull && pyramid != nullptr && pyramid->IsValid();
+    m_CullShader->setBool("occlusionCulling", occlusion);
+    if (occlusion) {
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D, pyramid->GetTexture());
+        m_CullShader->setInt("depthPyramid", 0);
+        m_CullShader->setMat4("pyramidViewProjection", pyramid->GetViewProjection());
+        m_CullShader->setVec2("pyramidSize", glm::vec2(pyramid->GetWidth(), pyramid->GetHeight()));
+        m_CullShader->setInt("pyramidLevels", pyramid->GetLevels());
+    }
+
+    const GLuint commandGroups = (static_cast<GLuint>(m_Commands.size()) + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+    const GLuint instanceGroups = (static_cast<GLuint>(m_InstanceCount) + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+
+    // the counted commands start with no instance
+    m_CullShader->setInt("stage", CULL_STAGE_RESET);
+    glDispatchCompute(commandGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    // every instance tests itself and takes the next slot of its command
+    m_CullShader->setInt("stage", CULL_STAGE_INSTANCES);
+    glDispatchCompute(instanceGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    // the commands with a visible instance are packed per batch
+    if (compact) {
+        m_CullShader->setInt("stage", CULL_STAGE_COMPACT);
+        glDispatchCompute(commandGroups, 1, 1);
+    }
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    GL_CHECK();
+
+    m_SlotsFilled = !cull;
+}
+
+void IndirectDrawBuilder::Draw(const Shader& shader)
+{
+    if (m_Commands.empty())
+        return;
+
+    // without a Cull() the slots hold every instance, filled once after the upload
+    if (!m_Culled && !m_SlotsFilled)
+        Dispatch(CullPlanes{}, nullptr, false);
+
+    const GeometryArena& arena = GeometryArena::Get();
+    GLState::BindVertexArray(m_VAO);
+    if (m_ArenaGeneration != arena.GetGeneration()) {
+        arena.AttachBuffers(m_VAO);
+        m_ArenaGeneration = arena.GetGeneration();
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORD_SSBO_BINDING, m_DrawRecordBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_INSTANCE_SSBO_BINDING, m_DrawInstanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MODEL_SSBO_BINDING, m_ModelBuffer);
+    // culled: compacted per batch, or counted in place without the indirect count
+    GLuint commands = m_CommandBuffer;
+    if (m_Culled)
+        commands = SupportsIndirectCount() ? m_CulledCommandBuffer : m_CountedCommandBuffer;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+    if (m_Culled && SupportsIndirectCount())
+        glBindBuffer(GL_PARAMETER_BUFFER, m_DrawCountBuffer);
+
+    if (m_BatchByMaterial) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_RECORD_SSBO_BINDING, m_MaterialBuffer);
+        shader.setInt("diffuseTexture", COLOR_TEXTURE_UNIT);
+        shader.setInt("specularTexture", SPECULAR_EXPONENT_UNIT);
+        shader.setInt("normalTexture", NORMAL_TEXTURE_UNIT);
+        shader.setInt("alphaTexture", ALPHA_TEXTURE_UNIT);
+    }
+
+    for (size_t i = 0; i < m_Batches.size(); i++)
+    {
+        if (m_Batches[i].pMaterial != nullptr)
+            BindMaterialTextures(*m_Batches[i].pMaterial);
+        MultiDraw(m_Batches[i], static_cast<GLuint>(i));
+    }
+
+    glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    GLState::BindVertexArray(0);
+    GL_CHECK();
+}
+
+void IndirectDrawBuilder::MultiDraw(const Batch& batch, GLuint batchIndex) const
+{
+    const void* commandOffset = (void*)(batch.FirstCommand * sizeof(DrawElementsIndirectCommand));
+    GLState::CountDraw();
+
+    if (m_Culled && GLAD_GL_VERSION_4_6)
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset,
+            batchIndex * sizeof(GLuint), batch.CommandCount, 0);
+    else if (m_Culled && GLAD_GL_ARB_indirect_parameters)
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset,
+            batchIndex * sizeof(GLuint), batch.CommandCount, 0);
+    else
+        // fallback: the commands without a visible instance are still there with instanceCount = 0
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset, batch.CommandCount, 0);
+}
+
+void IndirectDrawBuilder::clean()
+{
+    GLuint buffers[] = { m_CommandBuffer, m_CountedCommandBuffer, m_CulledCommandBuffer, m_DrawCountBuffer, m_DrawRecordBuffer,
+        m_MaterialBuffer, m_DrawIDBuffer, m_DrawInstanceBuffer, m_ModelBuffer };
+    for (GLuint buffer : buffers)
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+    m_CommandBuffer = m_CountedCommandBuffer = m_CulledCommandBuffer = m_DrawCountBuffer = m_DrawRecordBuffer = 0;
+    m_MaterialBuffer = m_DrawIDBuffer = m_DrawInstanceBuffer = m_ModelBuffer = 0;
+    m_CommandCapacity = m_CountedCommandCapacity = m_CulledCommandCapacity = m_DrawCountCapacity = m_DrawRecordCapacity = 0;
+    m_MaterialCapacity = m_DrawIDCapacity = m_DrawInstanceCapacity = m_ModelCapacity = 0;
+    m_Culled = m_SlotsFilled = false;
+
+    if (m_VAO != 0) {
+        GLState::DeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+    }
+    m_CullShader.reset();
+}
+
+GLuint IndirectDrawBuilder::GetMaterialIndex(const Material* pMaterial)
+{
+    auto it = m_MaterialIndices.find(pMaterial);
+    if (it != m_MaterialIndices.end())
+        return it->second;
+
+    GPUMaterialRecord record;
+    record.DiffuseColor = pMaterial->DiffuseColor;
+    record.AmbientColor = pMaterial->AmbientColor;
+    record.SpecularColor = glm::vec4(glm::vec3(pMaterial->SpecularColor), pMaterial->Shininess);
+    record.TextureFlags = glm::uvec4(pMaterial->pDiffuse != nullptr, pMaterial->pSpecularExponent != nullptr,
+        pMaterial->pNormal != nullptr, pMaterial->pAlpha != nullptr);
+
+    GLuint index = static_cast<GLuint>(m_MaterialRecords.size());
+    m_MaterialRecords.push_back(record);
+    m_MaterialIndices.emplace(pMaterial, index);
+    return index;
+}
+
+void IndirectDrawBuilder::EnsureCapacity(GLuint& buffer, size_t& capacity, size_t required, size_t elementSize, GLenum target)
+{
+    if (buffer != 0 && required <= capacity)
+        return;
+
+    capacity = std::max<size_t>(required, std::max<size_t>(capacity * 2, 64));
+    if (buffer == 0)
+        glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, capacity * elementSize, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(target, 0);
+}
+
+void IndirectDrawBuilder::EnsureDrawIDCapacity(size_t required)
+{
+    if (m_DrawIDBuffer != 0 && required <= m_DrawIDCapacity)
+        return;
+
+    // the content never changes: 0, 1, 2, ... only grow when there are more records
+    m_DrawIDCapacity = std::max<size_t>(required, m_DrawIDCapacity * 2);
+    std::vector<GLuint> ids(m_DrawIDCapacity);
+    std::iota(ids.begin(), ids.end(), 0u);
+
+    if (m_DrawIDBuffer == 0)
+        glGenBuffers(1, &m_DrawIDBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_DrawIDBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    GLState::BindVertexArray(m_VAO);
+    glBindVertexBuffer(DRAW_ID_BINDING, m_DrawIDBuffer, 0, sizeof(GLuint));
+    GLState::BindVertexArray(0);
+}
+
+void IndirectDrawBuilder::BindMaterialTextures(const Material& material) const
+{
+    // the flags in the material record tell the shader which texture is valid,
+    // so the stale bindings of the previous batch are harmless
+    if (material.pDiffuse != nullptr)
+        material.pDiffuse->Bind();
+    if (material.pSpecularExponent != nullptr)
+        material.pSpecularExponent->Bind();
+    if (material.pNormal != nullptr)
+        material.pNormal->Bind();
+    if (material.pAlpha != nullptr)
+        material.pAlpha->Bind();
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Shader.h"
+#include "InstanceBuffer.h"
+
+// use to keep sync with the shaders (Geometry_pass_indirect.vert/.frag, cull_draws.comp)
+constexpr GLuint DRAW_RECORD_SSBO_BINDING = 0;
+constexpr GLuint MATERIAL_RECORD_SSBO_BINDING = 1;
+constexpr GLuint INPUT_COMMAND_SSBO_BINDING = 2;
+constexpr GLuint OUTPUT_COMMAND_SSBO_BINDING = 3;
+constexpr GLuint DRAW_COUNT_SSBO_BINDING = 4;
+// 5 is INSTANCE_MATRIX_SSBO_BINDING (Mesh.h)
+constexpr GLuint DRAW_INSTANCE_SSBO_BINDING = 6;
+constexpr GLuint MODEL_SSBO_BINDING = 7;
+// cull_draws.comp only, it has no material
+constexpr GLuint COUNTED_COMMAND_SSBO_BINDING = MATERIAL_RECORD_SSBO_BINDING;
+constexpr GLint CULL_STAGE_RESET = 0;
+constexpr GLint CULL_STAGE_INSTANCES = 1;
+constexpr GLint CULL_STAGE_COMPACT = 2;
+constexpr GLuint DRAW_ID_LOCATION = 5;
+constexpr GLuint DRAW_ID_BINDING = 1;
+constexpr GLuint CULL_WORKGROUP_SIZE = 64;
+constexpr GLuint DEPTH_PYRAMID_WORKGROUP_SIZE = 8;
+
+// layout defined by the OpenGL specification for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint Count;
+    GLuint InstanceCount;
+    GLuint FirstIndex;
+    GLint BaseVertex;
+    GLuint BaseInstance;
+};
+
+// per command data, std430 layout
+struct GPUDrawRecord
+{
+    glm::vec4 BoundingSphere; // local space, xyz = center, w = radius
+    glm::uvec4 Info;          // x = material index, y = batch index, z = first command of the batch, w = first model
+};
+
+// per material data, std430 layout
+struct GPUMaterialRecord
+{
+    glm::vec4 DiffuseColor;
+    glm::vec4 AmbientColor;
+    glm::vec4 SpecularColor; // w = shininess
+    glm::uvec4 TextureFlags; // x = diffuse, y = specular, z = normal, w = alpha
+};
+
+using CullPlanes = std::array<glm::vec4, 6>;
+
+// normalized planes of the frustum of a view projection matrix, the normals point inside
+CullPlanes FrustumPlanes(const glm::mat4& viewProjection);
+// planes of an axis aligned box, used for the point lights (the cube map cover the whole box)
+CullPlanes BoxPlanes(const glm::vec3& minCorner, const glm::vec3& maxCorner);
+// bounding sphere (xyz = center, w = radius) of a mesh moved by model, the radius is scaled by the largest axis
+glm::vec4 TransformBoundingSphere(const glm::vec4& sphere, const glm::mat4& model);
+// CPU version of the test done in cull_draws.comp
+bool SphereInsidePlanes(const CullPlanes& planes, const glm::vec4& sphere);
+
+/**
+    * @brief Hierarchical max depth buffer built from the G-buffer depth, used by the GPU culling
+    * to reject the draws hidden behind the geometry of the previous frame.
+**/
+class DepthPyramid
+{
+public:
+    DepthPyramid() = default;
+    ~DepthPyramid();
+    DepthPyramid(const DepthPyramid&) = delete;
+    DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+    void Init(int s_Width, int s_Height);
+    void Resize(int s_Width, int s_Height);
+    // reduce the depth texture, viewProjection is the matrix used to render it; sourceSize is the rendered
+    // part of the texture (dynamic resolution), stretched over the whole pyramid
+    void Build(GLuint depthTexture, const glm::mat4& viewProjection, const glm::ivec2& sourceSize);
+    void Invalidate() { m_Valid = false; }
+    void clean();
+
+    bool IsValid() const { return m_Valid; }
+    GLuint GetTexture() const { return m_Texture; }
+    int GetWidth() const { return m_Width; }
+    int GetHeight() const { return m_Height; }
+    int GetLevels() const { return m_Levels; }
+    const glm::mat4& GetViewProjection() const { return m_ViewProjection; }
+
+private:
+    void createTexture();
+
+    GLuint m_Texture{ 0 };
+    int m_Width{ 0 }, m_Height{ 0 }, m_Levels{ 0 };
+    bool m_Valid{ false };
+    glm::mat4 m_ViewProjection{ 1.0f };
+    std::unique_ptr<Shader> m_Shader;
+};
+
+/**
+    * @brief Build and submit the glMultiDrawElementsIndirect commands for a pass.
+    *
+    * @details Every sub mesh added becomes one DrawElementsIndirectCommand that points inside the
+    *          GeometryArena and one GPUDrawRecord (bounds, material index, first model) stored in a SSBO.
+    *          The model matrices are in a SSBO of their own: the ones of AddMesh are uploaded, the ones of an
+    *          InstanceSet are copied on the GPU from the region of the frame of the set (glCopyBufferSubData),
+    *          so only the dirty range written by InstanceSet::Sync crosses the bus. The command of an
+    *          InstanceSet draws all its instances (instanceCount = count of the set).
+    *          Every instance of a command owns a slot of the draw instance SSBO (a model index and the command),
+    *          the slot is found in the shader through a per instance attribute fed by an identity buffer and
+    *          offset by the baseInstance of the command, this works with GL 4.3 without the need of
+    *          gl_DrawID / gl_BaseInstance. The slots are filled on the GPU, with or without culling.
+    *          The textures are not bindless, so the commands are sorted by material and each
+    *          material issue one multi draw after binding its textures (depth only passes use a single batch).
+    *
+    *          Cull() runs a compute pass that test every instance against a set of planes (and optionally
+    *          against a DepthPyramid), packs the visible ones at the start of the slots of their command and
+    *          counts them in its instanceCount. A second pass writes the commands with a visible instance
+    *          of each batch in a compact range with an atomic counter per batch, the counters are then the
+    *          draw count of glMultiDrawElementsIndirectCount. Without GL 4.6 / ARB_indirect_parameters the
+    *          commands are not compacted, the hidden ones just keep instanceCount = 0.
+**/
+class IndirectDrawBuilder
+{
+public:
+    IndirectDrawBuilder() = default;
+    ~IndirectDrawBuilder();
+    IndirectDrawBuilder(const IndirectDrawBuilder&) = delete;
+    IndirectDrawBuilder& operator=(const IndirectDrawBuilder&) = delete;
+
+    // batchByMaterial = false for the depth only passes, all the draws end in a single multi draw
+    void Init(bool batchByMaterial = true);
+    void Begin();
+    void AddMesh(const BasicMesh& mesh, const glm::mat4& model);
+    // the matrices are read from the GPU buffer of the set, it must be synced for the frame before Upload
+    // and stay alive until the last Draw; every instance is still culled on its own
+    void AddInstances(const BasicMesh& mesh, const InstanceSet& instances);
+    // sort the pending draws by material, upload commands, records and mesh models and copy the set models
+    void Upload();
+    // GPU culling, the next Draw() uses the surviving commands
+    void Cull(const CullPlanes& planes, const DepthPyramid* pyramid = nullptr);
+    // draw every uploaded command, ignoring the last Cull()
+    void ResetCulling();
+    void Draw(const Shader& shader);
+    void clean();
+
+    size_t GetCommandCount() const { return m_Commands.size(); }
+    size_t GetBatchCount() const { return m_Batches.size(); }
+    static bool SupportsIndirectCount();
+
+private:
+    struct PendingDraw
+    {
+        const Material* pMaterial;
+        DrawElementsIndirectCommand Command;
+        GLuint FirstModel;            // index in m_Models, or in m_Sets for an InstanceSet
+        const InstanceSet* pSet;
+        glm::vec4 BoundingSphere;
+    };
+
+    // where the models of an InstanceSet go in the model SSBO, after the models of AddMesh
+    struct SetCopy
+    {
+        const InstanceSet* pSet;
+        GLuint FirstModel;
+    };
+
+    struct Batch
+    {
+        const Material* pMaterial;
+        GLuint FirstCommand;
+        GLuint CommandCount;
+    };
+
+    void AddDraws(const BasicMesh& mesh, GLuint firstModel, const InstanceSet* pSet);
+    // fill the draw instance slots, every instance is visible when cull is false
+    void Dispatch(const CullPlanes& planes, const DepthPyramid* pyramid, bool cull);
+    GLuint GetMaterialIndex(const Material* pMaterial);
+    void EnsureCapacity(GLuint& buffer, size_t& capacity, size_t required, size_t elementSize, GLenum target);
+    void EnsureDrawIDCapacity(size_t required);
+    void BindMaterialTextures(const Material& material) const;
+    void MultiDraw(const Batch& batch, GLuint batchIndex) const;
+
+    bool m_BatchByMaterial{ true };
+    bool m_Culled{ false };
+    bool m_SlotsFilled{ false };  // the slots hold every instance (m_Culled false)
+
+    GLuint m_VAO{ 0 };
+    GLuint m_CommandBuffer{ 0 };
+    GLuint m_CountedCommandBuffer{ 0 };
+    GLuint m_CulledCommandBuffer{ 0 };
+    GLuint m_DrawCountBuffer{ 0 };
+    GLuint m_DrawRecordBuffer{ 0 };
+    GLuint m_MaterialBuffer{ 0 };
+    GLuint m_DrawIDBuffer{ 0 };
+    GLuint m_DrawInstanceBuffer{ 0 };
+    GLuint m_ModelBuffer{ 0 };
+
+    size_t m_CommandCapacity{ 0 };
+    size_t m_CountedCommandCapacity{ 0 };
+    size_t m_CulledCommandCapacity{ 0 };
+    size_t m_DrawCountCapacity{ 0 };
+    size_t m_DrawRecordCapacity{ 0 };
+    size_t m_MaterialCapacity{ 0 };
+    size_t m_DrawIDCapacity{ 0 };
+    size_t m_DrawInstanceCapacity{ 0 };
+    size_t m_ModelCapacity{ 0 };
+    size_t m_InstanceCount{ 0 };
+
+    unsigned int m_ArenaGeneration{ 0 };
+
+    std::unique_ptr<Shader> m_CullShader;
+
+    std::vector<PendingDraw> m_Pending;
+    std::vector<DrawElementsIndirectCommand> m_Commands;
+    std::vector<GPUDrawRecord> m_DrawRecords;
+    std::vector<glm::mat4> m_Models;
+    std::vector<SetCopy> m_Sets;
+    std::vector<GPUMaterialRecord> m_MaterialRecords;
+    std::unordered_map<const Material*, GLuint> m_MaterialIndices;
+    std::vector<Batch> m_Batches;
+};
+
+#endif // !INDIRECT_DRAW_H
@@ -0,0 +1,229 @@
+#include "InstanceBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "Debugging.h"
+
+FrameInstanceBuffer::~FrameInstanceBuffer()
+{
+    clean();
+}
+
+void FrameInstanceBuffer::Begin()
+{
+    m_Matrices.clear();
+}
+
+GLuint FrameInstanceBuffer::Append(const glm::mat4& model)
+{
+    GLuint first = static_cast<GLuint>(m_Matrices.size());
+    m_Matrices.push_back(model);
+    return first;
+}
+
+GLuint FrameInstanceBuffer::Append(const std::vector<glm::mat4>& models)
+{
+    GLuint first = static_cast<GLuint>(m_Matrices.size());
+    m_Matrices.insert(m_Matrices.end(), models.begin(), models.end());
+    return first;
+}
+
+void FrameInstanceBuffer::Upload()
+{
+    if (m_Matrices.empty())
+        return;
+
+    if (m_Buffer == 0)
+        glGenBuffers(1, &m_Buffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+    // orphan the old storage (or grow it) and then fill the new one
+    m_Capacity = std::max(m_Capacity, m_Matrices.size());
+    glBufferData(GL_ARRAY_BUFFER, m_Capacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_Matrices.size() * sizeof(glm::mat4), m_Matrices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GL_CHECK();
+}
+
+void FrameInstanceBuffer::clean()
+{
+    if (m_Buffer != 0) {
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+    }
+    m_Capacity = 0;
+    m_Matrices.clear();
+}
+
+InstanceSet::InstanceSet(std::vector<glm::mat4> matrices, Usage usage) :
+    m_Usage{ usage },
+    m_Matrices{ std::move(matrices) }
+{
+    MarkDirty(0, m_Matrices.size());
+}
+
+InstanceSet::~InstanceSet()
+{
+    clean();
+}
+
+void InstanceSet::SetMatrices(std::vector<glm::mat4> matrices)
+{
+    if (matrices.size() != m_Matrices.size() || m_Usage == Usage::Static)
+        clean();
+    m_Matrices = std::move(matrices);
+    MarkDirty(0, m_Matrices.size());
+}
+
+void InstanceSet::SetMatrix(size_t index, const glm::mat4& model)
+{
+    if (index >= m_Matrices.size())
+        return;
+    if (m_Usage == Usage::Static) {
+        std::cerr << "InstanceSet: SetMatrix called on a static set, use SetMatrices" << std::endl;
+        return;
+    }
+    m_Matrices[index] = model;
+    MarkDirty(index, 1);
+}
+
+void InstanceSet::MarkDirty(size_t first, size_t count)
+{
+    size_t last = std::min(first + count, m_Matrices.size());
+    if (first >= last)
+        return;
+    ++m_Version;
+
+    // every region holds its own copy, so the range has to be written in all of them
+    for (auto& range : m_Dirty) {
+        if (range.IsEmpty())
+            range = DirtyRange{ first, last };
+        else
+            range = DirtyRange{ std::min(range.Begin, first), std::max(range.End, last) };
+    }
+}
+
+void InstanceSet::Sync(unsigned long long frameIndex)
+{
+    if (m_Matrices.empty() || frameIndex == m_LastFrame)
+        return;
+    m_LastFrame = frameIndex;
+
+    if (m_Buffer == 0)
+        CreateStorage();
+
+    if (m_Usage == Usage::Static)
+        return;
+
+    m_Region = (m_Region + 1) % INSTANCE_SET_REGIONS;
+    m_Fenced = false;
+
+    DirtyRange& range = m_Dirty[m_Region];
+    if (range.IsEmpty())
+        return;
+
+    WaitFence(m_Region);
+    const size_t offset = m_Region * m_Capacity + range.Begin;
+    const size_t bytes = (range.End - range.Begin) * sizeof(glm::mat4);
+    if (m_Mapped != nullptr)
+    {
+        // the mapping is coherent, a plain copy is visible to the next draws
+        std::memcpy(m_Mapped + offset, m_Matrices.data() + range.Begin, bytes);
+    }
+    else
+    {
+        // the map failed in CreateStorage, the storage is dynamic so the range is uploaded instead
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(glm::mat4), bytes, m_Matrices.data() + range.Begin);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    range = DirtyRange{};
+}
+
+void InstanceSet::Fence()
+{
+    if (m_Usage == Usage::Static || m_Buffer == 0 || m_Fenced)
+        return;
+
+    if (m_Fences[m_Region] != nullptr)
+        glDeleteSync(m_Fences[m_Region]);
+    m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_Fenced = true;
+}
+
+void InstanceSet::clean()
+{
+    for (auto& fence : m_Fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (m_Buffer != 0) {
+        if (m_Mapped != nullptr) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            m_Mapped = nullptr;
+        }
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+    }
+    m_Capacity = 0;
+    m_Region = 0;
+    m_LastFrame = ~0ull;
+    m_Fenced = true;
+    // the next storage starts empty
+    MarkDirty(0, m_Matrices.size());
+}
+
+void InstanceSet::CreateStorage()
+{
+    m_Capacity = m_Matrices.size();
+    glGenBuffers(1, &m_Buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+
+    if (m_Usage == Usage::Static)
+    {
+        // immutable and not mappable, the driver can keep it in video memory
+        glBufferStorage(GL_ARRAY_BUFFER, m_Capacity * sizeof(glm::mat4), m_Matrices.data(), 0);
+        m_Dirty.fill(DirtyRange{});
+    }
+    else
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr size = INSTANCE_SET_REGIONS * m_Capacity * sizeof(glm::mat4);
+        // dynamic storage too, so Sync can fall back to glBufferSubData without the mapping
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags | GL_DYNAMIC_STORAGE_BIT);
+        m_Mapped = static_cast<glm::mat4*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+        if (m_Mapped == nullptr)
+            std::cerr << "InstanceSet: unable to map the instance buffer, the updates use glBufferSubData" << std::endl;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GL_CHECK();
+}
+
+void InstanceSet::WaitFence(size_t region)
+{
+    GLsync& fence = m_Fences[region];
+    if (fence == nullptr)
+        return;
+
+    // one second at a time, the flush is needed only by the first wait
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(fence, flags, 1000000000);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            break;
+        if (result == GL_WAIT_FAILED) {
+            std::cerr << "InstanceSet: glClientWaitSync failed" << std::endl;
+            break;
+        }
+        flags = 0;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
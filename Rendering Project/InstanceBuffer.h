@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <array>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+/**
+    * @brief Per frame buffer of instance model matrices.
+    *
+    * @details The renderer appends the matrices of every instanced batch of the frame,
+    *          uploads them once and then each batch reads its own range through
+    *          BasicMesh::RenderInstanced(shader, buffer, firstInstance, count).
+    *          The storage is orphaned at every upload so the driver does not stall on
+    *          the draws of the previous frame that still read it.
+**/
+class FrameInstanceBuffer
+{
+public:
+    FrameInstanceBuffer() = default;
+    ~FrameInstanceBuffer();
+    FrameInstanceBuffer(const FrameInstanceBuffer&) = delete;
+    FrameInstanceBuffer& operator=(const FrameInstanceBuffer&) = delete;
+
+    void Begin();
+    // return the index of the first matrix appended
+    GLuint Append(const glm::mat4& model);
+    GLuint Append(const std::vector<glm::mat4>& models);
+    void Upload();
+    void clean();
+
+    GLuint GetBuffer() const { return m_Buffer; }
+    size_t GetCount() const { return m_Matrices.size(); }
+    const std::vector<glm::mat4>& GetMatrices() const { return m_Matrices; }
+
+private:
+    GLuint m_Buffer{ 0 };
+    size_t m_Capacity{ 0 };
+    std::vector<glm::mat4> m_Matrices;
+};
+
+/**
+    * @brief Model matrices of an InstancedMeshRenderer, kept on the GPU across the frames.
+    *
+    * @details A static set is stored in an immutable glBufferStorage buffer written once at the
+    *          first Sync() and never uploaded again (unless SetMatrices() replaces it).
+    *          A dynamic set is stored in INSTANCE_SET_REGIONS copies inside one persistently mapped
+    *          buffer: every frame Sync() moves to the next region, waits the fence of the frame that
+    *          used it last and writes only the matrices marked dirty since that region was written.
+    *          The draws read the region of the frame through GetFirstInstance(), then Fence()
+    *          protects it until the GPU is done with it.
+**/
+class InstanceSet
+{
+public:
+    static constexpr size_t INSTANCE_SET_REGIONS = 3;
+
+    enum class Usage
+    {
+        Static,
+        Dynamic
+    };
+
+    explicit InstanceSet(std::vector<glm::mat4> matrices, Usage usage = Usage::Static);
+    ~InstanceSet();
+    InstanceSet(const InstanceSet&) = delete;
+    InstanceSet& operator=(const InstanceSet&) = delete;
+
+    // replace all the matrices, the storage is reallocated if the count changes
+    void SetMatrices(std::vector<glm::mat4> matrices);
+    // dynamic sets only, the matrix is written in the following Sync() of every region
+    void SetMatrix(size_t index, const glm::mat4& model);
+    void MarkDirty(size_t first, size_t count);
+
+    // once per frame before drawing, frameIndex avoid to advance twice when the set is drawn by more passes
+    void Sync(unsigned long long frameIndex);
+    // after the last draw of the frame that reads the set
+    void Fence();
+    void clean();
+
+    const std::vector<glm::mat4>& GetMatrices() const { return m_Matrices; }
+    size_t GetCount() const { return m_Matrices.size(); }
+    bool IsStatic() const { return m_Usage == Usage::Static; }
+    GLuint GetBuffer() const { return m_Buffer; }
+    // index of the first matrix of the region of the current frame
+    GLuint GetFirstInstance() const { return static_cast<GLuint>(m_Region * m_Capacity); }
+    // incremented by every change of the matrices, the shadow cache use it to detect the moved static sets
+    unsigned int GetVersion() const { return m_Version; }
+
+private:
+    struct DirtyRange
+    {
+        size_t Begin{ 0 };
+        size_t End{ 0 };
+        bool IsEmpty() const { return End <= Begin; }
+    };
+
+    void CreateStorage();
+    void WaitFence(size_t region);
+
+    Usage m_Usage;
+    std::vector<glm::mat4> m_Matrices;
+
+    GLuint m_Buffer{ 0 };
+    glm::mat4* m_Mapped{ nullptr };
+    size_t m_Capacity{ 0 };
+    size_t m_Region{ 0 };
+    unsigned long long m_LastFrame{ ~0ull };
+    unsigned int m_Version{ 0 };
+    bool m_Fenced{ true };
+
+    std::array<DirtyRange, INSTANCE_SET_REGIONS> m_Dirty;
+    std::array<GLsync, INSTANCE_SET_REGIONS> m_Fences{};
+};
+
+#endif // !INSTANCE_BUFFER_H
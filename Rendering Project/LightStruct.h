@@ -12,6 +12,13 @@
 #include <atomic>
 #include "Component.h"
 
+// how the shadow of a point light is stored: 6 cube faces or 2 paraboloid hemispheres (cheaper, less precise)
+enum class PointShadowType
+{
+    Cube = 0,
+    DualParaboloid = 1
+};
+
 struct PointLight: public Component 
 {
     PointLight() :
@@ -52,6 +59,7 @@ struct PointLight: public Component
     float constant{ 1.0f };
     float linear{ 0.09f };
     float quadratic{ 0.032f };
+    PointShadowType shadowType{ PointShadowType::Cube };
 
 private:
 
@@ -62,6 +70,7 @@ private:
 // the view matrix always look at the position (that is suppose to be at the height of the terrein), 
 // the actual camera position will be computed from the position, direction and height 
 // in such a way that the projection will be parallel to the direction of the light 
+// the DeferredRenderer does not use Projection and View for the shadow: it fits its cascades to the camera (ShadowCascades.h)
 struct DirLight : public Component 
 {
     DirLight() :
@@ -1,24 +1,44 @@
 #include "Mesh.h"
+#include "CpuProfiler.h"
+#include <limits>
 
 BasicMesh::BasicMesh() :
+    m_FileFormat{ INVALID_FORMAT },
     m_VAO{ 0 },
-    m_Buffers{ 0 },
+    m_ArenaGeneration{ 0 },
+    m_BoundingSphere{ 0.0f },
     m_InstanceBuffer{ 0 },
-    m_FileFormat{ INVALID_FORMAT }
+    m_InstanceMatricesSize{ 0 },
+    m_InstanceFormatReady{ false },
+    m_CpuOnly{ false }
 {
 };
 
+BasicMesh::BasicMesh(CpuOnly) :
+    BasicMesh()
+{
+    m_CpuOnly = true;
+}
+
+unsigned int BasicMesh::GetIndexCount() const
+{
+    unsigned int count = 0;
+    for (const auto& entry : m_Meshes)
+        count += entry.NumIndices;
+    return count;
+}
+
 bool BasicMesh::LoadMesh(const std::string& Filename)
 {
+    PROFILE_SCOPE("BasicMesh::LoadMesh");
     // Release the previously loaded mesh (if it exists)
     Clear();
 
-    // Create the VAO
-    glGenVertexArrays(1, &m_VAO);
-    glBindVertexArray(m_VAO);
-
-    // Create the buffers for the vertices attributes
-    glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+    // Create the VAO, the vertices attributes are stored in the GeometryArena
+    if (!m_CpuOnly) {
+        glGenVertexArrays(1, &m_VAO);
+        GLState::BindVertexArray(m_VAO);
+    }
 
     // Determine file format from extension
     m_FileFormat = GetFormatFromFilename(Filename);
@@ -36,9 +56,11 @@ bool BasicMesh::LoadMesh(const std::string& Filename)
     else {
         std::cout << "Error parsing " << Filename.c_str() << ": " << Importer.GetErrorString() << "\n";
     }
+    if (m_CpuOnly)
+        return Ret;
 
     // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
     GL_CHECK();
 
     return Ret;
@@ -67,6 +89,8 @@ bool BasicMesh::InitFromScene(const aiScene* pScene, const std::string& Filename
     }
 
     PopulateBuffers();
+    if (m_CpuOnly)
+        return true;
     GL_CHECK();
     return GLCheckError();
 }
@@ -164,7 +188,9 @@ bool BasicMesh::InitMaterials(const aiScene* pScene, const std::string& Filename
     for (unsigned int i = 0; i < pScene->mNumMaterials; i++) {
         const aiMaterial* pMaterial = pScene->mMaterials[i];
 
-        LoadTextures(Dir, pMaterial, i);
+        // a CPU-only mesh keeps the colors only
+        if (!m_CpuOnly)
+            LoadTextures(Dir, pMaterial, i);
 
         // i load the color to in the case the object don't use the texture, 
         // i don't think that this case will ever occur in the final project but i writen this for the first testing could be usefull in some case 
@@ -297,36 +323,51 @@ void BasicMesh::LoadTextures(const std::string& Dir, const aiMaterial* pMaterial
     */
 }
 
-// use struct of array for populating the buffer 
+// the cpu side is a struct of array, the arena store the vertices interleaved
 void BasicMesh::PopulateBuffers()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(m_Positions[0]) * m_Positions.size(), &m_Positions[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(POSITION_LOCATION);
-    glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(m_TexCoords[0]) * m_TexCoords.size(), &m_TexCoords[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(TEX_COORD_LOCATION);
-    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(m_Normals[0]) * m_Normals.size(), &m_Normals[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(NORMAL_LOCATION);
-    glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[TANGENT_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(m_Tangents[0]) * m_Tangents.size(), &m_Tangents[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(TANGENT_LOCATION);
-    glVertexAttribPointer(TANGENT_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[BITANGENT_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(m_Bitangents[0]) * m_Bitangents.size(), &m_Bitangents[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(BITANGENT_LOCATION);
-    glVertexAttribPointer(BITANGENT_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(m_Indices[0]) * m_Indices.size(), &m_Indices[0], GL_STATIC_DRAW);
+    std::vector<ArenaVertex> vertices(m_Positions.size());
+    for (size_t i = 0; i < m_Positions.size(); i++) {
+        vertices[i].Position = m_Positions[i];
+        vertices[i].TexCoord = m_TexCoords[i];
+        vertices[i].Normal = m_Normals[i];
+        vertices[i].Tangent = m_Tangents[i];
+        vertices[i].Bitangent = m_Bitangents[i];
+    }
+
+    // bounding sphere around the center of the AABB, used for the culling
+    glm::vec3 minPos(std::numeric_limits<float>::max());
+    glm::vec3 maxPos(std::numeric_limits<float>::lowest());
+    for (const auto& pos : m_Positions) {
+        minPos = glm::min(minPos, pos);
+        maxPos = glm::max(maxPos, pos);
+    }
+    glm::vec3 center = m_Positions.empty() ? glm::vec3(0.0f) : (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& pos : m_Positions)
+        radius = std::max(radius, glm::length(pos - center));
+    m_BoundingSphere = glm::vec4(center, radius);
+    if (m_CpuOnly)
+        return;
+
+    GeometryArena& arena = GeometryArena::Get();
+    m_Allocation = arena.Allocate(vertices, m_Indices);
+
+    // the allocation could have grown the arena, read the generation only after it
+    arena.SetupVertexFormat(m_VAO);
+    m_ArenaGeneration = arena.GetGeneration();
+}
+
+void BasicMesh::BindVertexArray()
+{
+    GLState::BindVertexArray(m_VAO);
+
+    // the arena has been reallocated since the last draw, point the VAO to the new buffers
+    const GeometryArena& arena = GeometryArena::Get();
+    if (m_ArenaGeneration != arena.GetGeneration()) {
+        arena.AttachBuffers(m_VAO);
+        m_ArenaGeneration = arena.GetGeneration();
+    }
 }
 
 void BasicMesh::Clear()
@@ -336,10 +377,10 @@ void BasicMesh::Clear()
     m_Meshes.clear();
 
     // The rest of your cleanup is for VAO / VBOs
-    if (m_Buffers[0] != 0) {
-        glDeleteBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+    if (m_Allocation.IsValid()) {
+        GeometryArena::Get().Free(m_Allocation);
         // Make it idempotent
-        for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(m_Buffers); ++i) m_Buffers[i] = 0;
+        m_Allocation = ArenaAllocation{};
     }
 
     if (m_InstanceBuffer != 0) {
@@ -348,9 +389,11 @@ void BasicMesh::Clear()
     }
 
     if (m_VAO != 0) {
-        glDeleteVertexArrays(1, &m_VAO);
+        GLState::DeleteVertexArrays(1, &m_VAO);
         m_VAO = 0;
     }
+    m_InstanceMatricesSize = 0;
+    m_InstanceFormatReady = false;
 }
 void BasicMesh::ClearBuffer()
 {
@@ -374,105 +417,98 @@ void BasicMesh::Render(const std::shared_ptr<Shader> shader)
 
 void BasicMesh::Render(const Shader& shader)
 {
-    glBindVertexArray(m_VAO);
+    BindVertexArray();
 
     for (unsigned int i = 0; i < m_Meshes.size(); i++) {
         unsigned int MaterialIndex = m_Meshes[i].MaterialIndex;
 
-        if (m_Materials[MaterialIndex].pDiffuse != nullptr)
-        {
-            m_Materials[MaterialIndex].pDiffuse->Bind();
-            shader.setInt("material.diffuse", COLOR_TEXTURE_UNIT);
-        }
-
-        if (m_Materials[MaterialIndex].pSpecularExponent != nullptr)
-        {
-            m_Materials[MaterialIndex].pSpecularExponent->Bind();
-            shader.setInt("material.specular", SPECULAR_EXPONENT_UNIT);
-        }
-
-        if (m_Materials[MaterialIndex].pNormal != nullptr)
-        {
-            m_Materials[MaterialIndex].pNormal->Bind();
-            shader.setInt("material.normal", NORMAL_TEXTURE_UNIT);
-        }
-
-        if (m_Materials[MaterialIndex].pAlpha != nullptr)
-        {
-            m_Materials[MaterialIndex].pAlpha->Bind();
-            shader.setInt("material.alpha", ALPHA_TEXTURE_UNIT);
-        }
-
-        shader.setBool("hasDiffuseTexture", m_Materials[MaterialIndex].pDiffuse != nullptr);
-        shader.setBool("hasSpecularTexture", m_Materials[MaterialIndex].pSpecularExponent != nullptr);
-        shader.setBool("hasNormalTexture", m_Materials[MaterialIndex].pNormal != nullptr);
-        shader.setBool("hasAlphaTexture", m_Materials[MaterialIndex].pAlpha != nullptr);
-
-        shader.setVec3("material.diffuseColor", m_Materials[MaterialIndex].DiffuseColor);
-        shader.setVec3("material.ambientColor", m_Materials[MaterialIndex].AmbientColor);
-        shader.setVec3("material.specularColor", m_Materials[MaterialIndex].SpecularColor);
-        shader.setFloat("material.shininess", m_Materials[MaterialIndex].Shininess);
-
+        BindMaterial(shader, MaterialIndex);
 
+        GLState::CountDraw();
         glDrawElementsBaseVertex(GL_TRIANGLES,
             m_Meshes[i].NumIndices,
             GL_UNSIGNED_INT,
-            (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
-            m_Meshes[i].BaseVertex);
+            (void*)(sizeof(unsigned int) * (m_Allocation.FirstIndex + m_Meshes[i].BaseIndex)),
+            m_Allocation.BaseVertex + m_Meshes[i].BaseVertex);
+        // the textures stay bound, the next sub mesh with the same material skips the binds (see GLState)
+    }
 
-        if (m_Materials[MaterialIndex].pDiffuse != nullptr)
-            m_Materials[MaterialIndex].pDiffuse->Unbind();
+    // Make sure the VAO is not changed from the outside
+    GLState::BindVertexArray(0);
+}
 
-        if (m_Materials[MaterialIndex].pSpecularExponent != nullptr)
-            m_Materials[MaterialIndex].pSpecularExponent->Unbind();
+void BasicMesh::BindMaterial(const Shader& shader, unsigned int MaterialIndex)
+{
+    if (m_Materials[MaterialIndex].pDiffuse != nullptr)
+    {
+        m_Materials[MaterialIndex].pDiffuse->Bind();
+        shader.setInt("material.diffuse", COLOR_TEXTURE_UNIT);
+    }
 
-        if (m_Materials[MaterialIndex].pNormal != nullptr)
-            m_Materials[MaterialIndex].pNormal->Unbind();
+    if (m_Materials[MaterialIndex].pSpecularExponent != nullptr)
+    {
+        m_Materials[MaterialIndex].pSpecularExponent->Bind();
+        shader.setInt("material.specular", SPECULAR_EXPONENT_UNIT);
+    }
 
-        if (m_Materials[MaterialIndex].pAlpha != nullptr)
-            m_Materials[MaterialIndex].pAlpha->Unbind();
+    if (m_Materials[MaterialIndex].pNormal != nullptr)
+    {
+        m_Materials[MaterialIndex].pNormal->Bind();
+        shader.setInt("material.normal", NORMAL_TEXTURE_UNIT);
+    }
 
+    if (m_Materials[MaterialIndex].pAlpha != nullptr)
+    {
+        m_Materials[MaterialIndex].pAlpha->Bind();
+        shader.setInt("material.alpha", ALPHA_TEXTURE_UNIT);
     }
 
-    // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);
+    shader.setBool("hasDiffuseTexture", m_Materials[MaterialIndex].pDiffuse != nullptr);
+    shader.setBool("hasSpecularTexture", m_Materials[MaterialIndex].pSpecularExponent != nullptr);
+    shader.setBool("hasNormalTexture", m_Materials[MaterialIndex].pNormal != nullptr);
+    shader.setBool("hasAlphaTexture", m_Materials[MaterialIndex].pAlpha != nullptr);
+
+    shader.setVec3("material.diffuseColor", m_Materials[MaterialIndex].DiffuseColor);
+    shader.setVec3("material.ambientColor", m_Materials[MaterialIndex].AmbientColor);
+    shader.setVec3("material.specularColor", m_Materials[MaterialIndex].SpecularColor);
+    shader.setFloat("material.shininess", m_Materials[MaterialIndex].Shininess);
+}
+
+// the instance matrices are read from INSTANCE_MATRIX_BINDING, the format is specified once per VAO
+// and only the buffer bound to the binding point changes
+void BasicMesh::SetupInstanceFormat()
+{
+    if (m_InstanceFormatReady)
+        return;
+
+    GLState::BindVertexArray(m_VAO);
+    for (GLuint column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+        glVertexAttribFormat(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, column * sizeof(glm::vec4));
+        glVertexAttribBinding(INSTANCE_MATRIX_LOCATION + column, INSTANCE_MATRIX_BINDING);
+    }
+    // Set the attribute divisor (the magic of instancing)
+    glVertexBindingDivisor(INSTANCE_MATRIX_BINDING, 1);
+    GL_CHECK();
+
+    m_InstanceFormatReady = true;
 }
 
 void BasicMesh::SetupInstancedArrays(const std::vector<glm::mat4>& instanceMatrices) {
-    if (instanceMatrices.empty()) return;
+    if (instanceMatrices.empty() || m_CpuOnly) return;
 
     if (m_InstanceBuffer == 0) {
         glGenBuffers(1, &m_InstanceBuffer);
     }
 
-    glBindVertexArray(m_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
     glBufferData(GL_ARRAY_BUFFER, instanceMatrices.size() * sizeof(glm::mat4), instanceMatrices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_InstanceMatricesSize = static_cast<unsigned int>(instanceMatrices.size());
 
-    GLsizei vec4Size = sizeof(glm::vec4);
-
-    // Enable the vertex attributes
-    glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIB_LOCATION);
-    glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIB_LOCATION + 1);
-    glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIB_LOCATION + 2);
-    glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIB_LOCATION + 3);
-
-    // Set up the pointers
-    // Location 3
-    glVertexAttribPointer(INSTANCE_MATRIX_ATTRIB_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-    // Location 4
-    glVertexAttribPointer(INSTANCE_MATRIX_ATTRIB_LOCATION + 1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(1 * vec4Size));
-    // Location 5
-    glVertexAttribPointer(INSTANCE_MATRIX_ATTRIB_LOCATION + 2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * vec4Size));
-    // Location 6
-    glVertexAttribPointer(INSTANCE_MATRIX_ATTRIB_LOCATION + 3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * vec4Size));
-
-    // Set the attribute divisor (the magic of instancing)
-    glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIB_LOCATION, 1);
-    glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIB_LOCATION + 1, 1);
-    glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIB_LOCATION + 2, 1);
-    glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIB_LOCATION + 3, 1);
-
+    SetupInstanceFormat();
+    GLState::BindVertexArray(m_VAO);
+    glBindVertexBuffer(INSTANCE_MATRIX_BINDING, m_InstanceBuffer, 0, sizeof(glm::mat4));
 
     GL_CHECK();
 }
@@ -484,75 +520,74 @@ void BasicMesh::RenderInstanced( Shader& shader, unsigned int instanceCount) {
     if (instanceCount > m_InstanceMatricesSize) // avoid render object without a model matrix 
         instanceCount = m_InstanceMatricesSize;
 
-    glBindVertexArray(m_VAO);
-
-    for (unsigned int i = 0; i < m_Meshes.size(); i++) {
-        unsigned int MaterialIndex = m_Meshes[i].MaterialIndex;
+    BindVertexArray();
+    glBindVertexBuffer(INSTANCE_MATRIX_BINDING, m_InstanceBuffer, 0, sizeof(glm::mat4));
+    DrawInstancedSubMeshes(shader, instanceCount);
 
-        if (m_Materials[MaterialIndex].pDiffuse != nullptr) {
-            m_Materials[MaterialIndex].pDiffuse->Bind();
-            shader.setInt("material.diffuse", COLOR_TEXTURE_UNIT);
-        }
+    GLState::BindVertexArray(0);
+    GL_CHECK();
+}
 
-        if (m_Materials[MaterialIndex].pSpecularExponent != nullptr) {
-            m_Materials[MaterialIndex].pSpecularExponent->Bind();
-            shader.setInt("material.specular", SPECULAR_EXPONENT_UNIT);
-        }
+// Overload for shared_ptr<Shader>
+void BasicMesh::RenderInstanced( std::shared_ptr<Shader> shader, unsigned int instanceCount) {
+    RenderInstanced(*shader, instanceCount);
+}
 
-        if (m_Materials[MaterialIndex].pNormal)
-        {
-            m_Materials[MaterialIndex].pNormal->Bind();
-            shader.setInt("material.normal", NORMAL_TEXTURE_UNIT);
-        }
+void BasicMesh::RenderInstanced(const Shader& shader, GLuint instanceBuffer, unsigned int firstInstance, unsigned int instanceCount)
+{
+    if (instanceCount == 0)
+        return;
 
-        if (m_Materials[MaterialIndex].pAlpha)
-        {
-            m_Materials[MaterialIndex].pAlpha->Bind();
-            shader.setInt("material.alpha", ALPHA_TEXTURE_UNIT);
-        }
+    SetupInstanceFormat();
+    BindVertexArray();
+    // the offset select the first matrix, so the draw itself does not need a base instance
+    glBindVertexBuffer(INSTANCE_MATRIX_BINDING, instanceBuffer, firstInstance * sizeof(glm::mat4), sizeof(glm::mat4));
+    DrawInstancedSubMeshes(shader, instanceCount);
 
-        shader.setBool("hasDiffuseTexture", m_Materials[MaterialIndex].pDiffuse != nullptr);
-        shader.setBool("hasSpecularTexture", m_Materials[MaterialIndex].pSpecularExponent != nullptr);
-        shader.setBool("hasNormalTexture", m_Materials[MaterialIndex].pNormal != nullptr);
-        shader.setBool("hasAlphaTexture", m_Materials[MaterialIndex].pAlpha != nullptr);
+    GLState::BindVertexArray(0);
+    GL_CHECK();
+}
 
-        shader.setVec3("material.diffuseColor", m_Materials[MaterialIndex].DiffuseColor);
-        shader.setVec3("material.ambientColor", m_Materials[MaterialIndex].AmbientColor);
-        shader.setVec3("material.specularColor", m_Materials[MaterialIndex].SpecularColor);
-        shader.setFloat("material.shininess", m_Materials[MaterialIndex].Shininess);
+void BasicMesh::RenderInstancedDepth(unsigned int instanceCount)
+{
+    if (instanceCount == 0)
+        return;
 
-        // Instanced draw call
+    BindVertexArray();
+    for (unsigned int i = 0; i < m_Meshes.size(); i++) {
+        GLState::CountDraw();
         glDrawElementsInstancedBaseVertex(
             GL_TRIANGLES,
             m_Meshes[i].NumIndices,
             GL_UNSIGNED_INT,
-            (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
+            (void*)(sizeof(unsigned int) * (m_Allocation.FirstIndex + m_Meshes[i].BaseIndex)),
             instanceCount,
-            m_Meshes[i].BaseVertex
+            m_Allocation.BaseVertex + m_Meshes[i].BaseVertex
         );
-
-        // Unbind textures
-        if (m_Materials[MaterialIndex].pDiffuse != nullptr)
-            m_Materials[MaterialIndex].pDiffuse->Unbind();
-
-        if (m_Materials[MaterialIndex].pSpecularExponent != nullptr)
-            m_Materials[MaterialIndex].pSpecularExponent->Unbind();
-
-        if (m_Materials[MaterialIndex].pNormal != nullptr)
-            m_Materials[MaterialIndex].pNormal->Unbind();
-
-        if (m_Materials[MaterialIndex].pAlpha != nullptr)
-            m_Materials[MaterialIndex].pAlpha->Unbind();
-
     }
 
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
     GL_CHECK();
 }
 
-// Overload for shared_ptr<Shader>
-void BasicMesh::RenderInstanced( std::shared_ptr<Shader> shader, unsigned int instanceCount) {
-    RenderInstanced(*shader, instanceCount);
+void BasicMesh::DrawInstancedSubMeshes(const Shader& shader, unsigned int instanceCount)
+{
+    for (unsigned int i = 0; i < m_Meshes.size(); i++) {
+        unsigned int MaterialIndex = m_Meshes[i].MaterialIndex;
+
+        BindMaterial(shader, MaterialIndex);
+
+        // Instanced draw call
+        GLState::CountDraw();
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES,
+            m_Meshes[i].NumIndices,
+            GL_UNSIGNED_INT,
+            (void*)(sizeof(unsigned int) * (m_Allocation.FirstIndex + m_Meshes[i].BaseIndex)),
+            instanceCount,
+            m_Allocation.BaseVertex + m_Meshes[i].BaseVertex
+        );
+    }
 }
 
 bool BasicMesh::CreatePrimitive(Shape* shape)
@@ -560,12 +595,11 @@ bool BasicMesh::CreatePrimitive(Shape* shape)
     // Release the previously loaded mesh (if it exists)
     Clear();
 
-    // Create the VAO
-    glGenVertexArrays(1, &m_VAO);
-    glBindVertexArray(m_VAO);
-
-    // Create the buffers for the vertices attributes
-    glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+    // Create the VAO, the vertices attributes are stored in the GeometryArena
+    if (!m_CpuOnly) {
+        glGenVertexArrays(1, &m_VAO);
+        GLState::BindVertexArray(m_VAO);
+    }
 
     // Create a single mesh entry for our primitive
     m_Meshes.resize(1);
@@ -610,9 +644,11 @@ bool BasicMesh::CreatePrimitive(Shape* shape)
 
     // Load data to GPU
     PopulateBuffers();
+    if (m_CpuOnly)
+        return true;
 
     // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
     GL_CHECK();
 
     return true;
@@ -1191,6 +1227,8 @@ void BasicMesh::SetTextures(const std::string& diffusePath, const std::string& s
         m_Materials.resize(1);
         InitPrimitiveMaterial();
     }
+    if (m_CpuOnly)
+        return;
 
     // Set diffuse texture if provided
     if (!diffusePath.empty()) {
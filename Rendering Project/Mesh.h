@@ -13,6 +13,7 @@
 #include "Texture.h"
 #include "Utilities.h"
 #include "Shader.h"
+#include "GeometryArena.h"
 
 // use to keep sync with the shaders
 constexpr int POSITION_LOCATION = 0;
@@ -20,6 +21,12 @@ constexpr int TEX_COORD_LOCATION = 1;
 constexpr int NORMAL_LOCATION = 2;
 constexpr int TANGENT_LOCATION = 3;
 constexpr int BITANGENT_LOCATION = 4;
+// the instance matrix use 4 consecutive locations, after the draw id of the indirect path (5)
+constexpr int INSTANCE_MATRIX_LOCATION = 6;
+// vertex buffer binding points: 0 = GeometryArena, 1 = indirect draw id, 2 = instance matrices
+constexpr GLuint INSTANCE_MATRIX_BINDING = 2;
+// the layered shadow passes read the instance matrices as a storage buffer (0..4 are used by IndirectDraw.h)
+constexpr GLuint INSTANCE_MATRIX_SSBO_BINDING = 5;
 
 #define ASSIMP_LOAD_FLAGS aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_CalcTangentSpace
 
@@ -28,15 +35,50 @@ constexpr int BITANGENT_LOCATION = 4;
 class BasicMesh
 {
 public:
+    // tag of the CPU-only constructor
+    struct CpuOnly {};
+
     BasicMesh();
+    // CPU-only descriptor: CreatePrimitive and LoadMesh build the sub meshes, the geometry and the bounding
+    // sphere but never call GL (no VAO, no GeometryArena, no texture), for the renderers without a context
+    explicit BasicMesh(CpuOnly);
     ~BasicMesh();
 
+    struct BasicMeshEntry {
+        BasicMeshEntry()
+        {
+            NumIndices = 0;
+            BaseVertex = 0;
+            BaseIndex = 0;
+            MaterialIndex = INVALID_MATERIAL;
+        }
+
+        unsigned int NumIndices;
+        unsigned int BaseVertex;
+        unsigned int BaseIndex;
+        unsigned int MaterialIndex;
+    };
+
+    // used by the renderers that draw straight from the geometry arena (multi draw indirect)
+    const std::vector<BasicMeshEntry>& GetSubMeshes() const { return m_Meshes; }
+    const std::vector<Material>& GetMaterials() const { return m_Materials; }
+    const ArenaAllocation& GetArenaAllocation() const { return m_Allocation; }
+    // local space bounding sphere: xyz = center, w = radius
+    const glm::vec4& GetBoundingSphere() const { return m_BoundingSphere; }
+    bool IsCpuOnly() const { return m_CpuOnly; }
+    // indices of all the sub meshes, 3 per triangle
+    unsigned int GetIndexCount() const;
+
     bool LoadMesh(const std::string& Filename);
     void SetupInstancedArrays(const std::vector<glm::mat4>& instanceMatrices);
     void Render(const std::shared_ptr<Shader> shader);
     void Render(const Shader& shader);
     void RenderInstanced( Shader& shader, unsigned int instanceCount = 0);
     void RenderInstanced( std::shared_ptr<Shader> shader, unsigned int instanceCount = 0);
+    // draw instanceCount instances whose model matrices are stored (one mat4 each) in instanceBuffer from firstInstance
+    void RenderInstanced(const Shader& shader, GLuint instanceBuffer, unsigned int firstInstance, unsigned int instanceCount);
+    // depth only instanced draw without materials, the shader fetch its per instance data from gl_InstanceID
+    void RenderInstancedDepth(unsigned int instanceCount);
 
     class Shape
     {
@@ -142,6 +184,10 @@ private:
     bool CreateBSpline(BSpline bspline);
     void InitPrimitiveMaterial();
     void PopulateBuffers();
+    void BindVertexArray();
+    void SetupInstanceFormat();
+    void BindMaterial(const Shader& shader, unsigned int MaterialIndex);
+    void DrawInstancedSubMeshes(const Shader& shader, unsigned int instanceCount);
 
     enum FORMAT_TYPE {
         OBJ = 0,
@@ -168,38 +214,16 @@ private:
         return FORMAT_TYPE::INVALID_FORMAT;
     }
 
-    enum BUFFER_TYPE {
-        INDEX_BUFFER = 0,
-        POS_VB = 1,
-        TEXCOORD_VB = 2,
-        NORMAL_VB = 3,
-        TANGENT_VB = 4,
-        BITANGENT_VB = 5,
-        NUM_BUFFERS = 6
-    };
-
-    const GLuint INSTANCE_MATRIX_ATTRIB_LOCATION = 3;
-
-    struct BasicMeshEntry {
-        BasicMeshEntry()
-        {
-            NumIndices = 0;
-            BaseVertex = 0;
-            BaseIndex = 0;
-            MaterialIndex = INVALID_MATERIAL;
-        }
-
-        unsigned int NumIndices;
-        unsigned int BaseVertex;
-        unsigned int BaseIndex;
-        unsigned int MaterialIndex;
-    };
-
     FORMAT_TYPE m_FileFormat;
     GLuint m_VAO;
-    GLuint m_Buffers[NUM_BUFFERS];
+    // the vertices and the indices live in the shared GeometryArena
+    ArenaAllocation m_Allocation;
+    unsigned int m_ArenaGeneration;
+    glm::vec4 m_BoundingSphere;
     GLuint m_InstanceBuffer;
     unsigned int m_InstanceMatricesSize;
+    bool m_InstanceFormatReady;
+    bool m_CpuOnly;
 
 
     std::vector<BasicMeshEntry> m_Meshes;
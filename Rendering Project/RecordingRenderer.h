@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef RECORDING_RENDERER_H
+#define RECORDING_RENDERER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "EntityComponentSysetm.h"
+
+/**
+    * @brief IRenderer without GL: records what the Scene submits, to measure and test the CPU side
+    *        (collectRenderCommands, the animations, the culling) on a machine without a context.
+    *
+    * @details The commands, the instanced commands and the LightData of the frame go in per-frame arenas:
+    *          vectors cleared by beginFrame that keep their capacity, so after the first frames the
+    *          recording does not allocate. The scene must build its meshes with Scene::createMesh (CPU-only,
+    *          see BasicMesh::CpuOnly). The clock of the animations advances by a fixed step every
+    *          endFrame, so two runs of the same scene record the same frames.
+    *          With setHashing every frame gets an FNV-1a hash of the recorded data (the meshes by their
+    *          index count and bounding sphere, not by address) to check that two runs are identical.
+    *          With setViewProjection endFrame also culls the commands against the frustum, like the
+    *          CPU path of DeferredRenderer.
+**/
+class RecordingRenderer : public IRenderer
+{
+public:
+    struct FrameStats
+    {
+        uint64_t frame{ 0 };
+        size_t commands{ 0 };
+        size_t visibleCommands{ 0 };     // all the commands without a view projection
+        size_t instancedCommands{ 0 };
+        size_t instances{ 0 };
+        size_t pointLights{ 0 };
+        size_t spotLights{ 0 };
+        uint64_t triangles{ 0 };         // of the visible commands and of every instance
+        uint64_t hash{ 0 };              // 0 without hashing
+    };
+
+    explicit RecordingRenderer(float timeStep = 1.0f / 60.0f) : m_TimeStep(timeStep) {}
+
+    void initialize() override {}
+
+    void beginFrame() override
+    {
+        m_Commands.clear();
+        m_InstancedCommands.clear();
+        m_Lights.pointLights.clear();
+        m_Lights.spotLights.clear();
+        m_Hash = FNV_OFFSET;
+    }
+
+    void submitRenderCommand(const RenderCommand& command) override
+    {
+        m_Commands.push_back(command);
+        if (!m_Hashing)
+            return;
+        hashMesh(command.mesh.get());
+        hashValue(command.modelMatrix);
+        hashValue(static_cast<uint8_t>(command.castShadows | command.receiveShadows << 1 | command.isStatic << 2));
+    }
+
+    void submitInstancedRenderCommand(const InstancedRenderCommand& command) override
+    {
+        m_InstancedCommands.push_back(command);
+        if (!m_Hashing)
+            return;
+        hashMesh(command.mesh.get());
+        hashValue(static_cast<uint8_t>(command.castShadows));
+        for (const glm::mat4& model : command.instances->GetMatrices())
+            hashValue(model);
+    }
+
+    void setLightData(const LightData& lights) override
+    {
+        // assigned, not copied, so the vectors keep their storage
+        m_Lights.pointLights.assign(lights.pointLights.begin(), lights.pointLights.end());
+        m_Lights.spotLights.assign(lights.spotLights.begin(), lights.spotLights.end());
+        m_Lights.sunLight = lights.sunLight;
+        if (!m_Hashing)
+            return;
+        for (const PointLight& light : m_Lights.pointLights)
+        {
+            hashValue(light.Pos);
+            hashValue(light.Diffuse);
+        }
+        for (const SpotLight& light : m_Lights.spotLights)
+        {
+            hashValue(light.Pos);
+            hashValue(light.Dir);
+            hashValue(light.Diffuse);
+        }
+    }
+
+    void setSkybox(const std::string& /*path*/, const std::vector<std::string>& /*faces*/) override {}
+
+    void endFrame() override
+    {
+        PROFILE_SCOPE("RecordingRenderer::endFrame");
+        FrameStats stats;
+        stats.frame = m_Frame;
+        stats.commands = m_Commands.size();
+        stats.instancedCommands = m_InstancedCommands.size();
+        stats.pointLights = m_Lights.pointLights.size();
+        stats.spotLights = m_Lights.spotLights.size();
+        stats.hash = m_Hashing ? m_Hash : 0;
+
+        for (const RenderCommand& command : m_Commands)
+        {
+            if (!command.mesh)
+                continue;
+            if (m_Culling && !SphereInsidePlanes(m_Planes, TransformBoundingSphere(command.mesh->GetBoundingSphere(), command.modelMatrix)))
+                continue;
+            ++stats.visibleCommands;
+            stats.triangles += command.mesh->GetIndexCount() / 3;
+        }
+        for (const InstancedRenderCommand& command : m_InstancedCommands)
+        {
+            const size_t count = command.instances ? command.instances->GetCount() : 0;
+            stats.instances += count;
+            if (command.mesh)
+                stats.triangles += static_cast<uint64_t>(command.mesh->GetIndexCount() / 3) * count;
+        }
+
+        m_Stats = stats;
+        ++m_Frame;
+        m_Time += m_TimeStep;
+    }
+
+    void resize() override {}
+
+    WindowContext& getContext() override
+    {
+        throw std::logic_error("RecordingRenderer has no WindowContext");
+    }
+
+    float getTime() override { return m_Time; }
+    bool isCpuOnly() const override { return true; }
+
+    void setTime(float time) { m_Time = time; }
+    void setTimeStep(float timeStep) { m_TimeStep = timeStep; }
+    void setHashing(bool enable) { m_Hashing = enable; }
+    // cull the commands of the next frames against the frustum of viewProjection
+    void setViewProjection(const glm::mat4& viewProjection)
+    {
+        m_Planes = FrustumPlanes(viewProjection);
+        m_Culling = true;
+    }
+    void disableCulling() { m_Culling = false; }
+
+    // what the last frame recorded, valid until the next beginFrame
+    const std::vector<RenderCommand>& getCommands() const { return m_Commands; }
+    const std::vector<InstancedRenderCommand>& getInstancedCommands() const { return m_InstancedCommands; }
+    const LightData& getLightData() const { return m_Lights; }
+    const FrameStats& getFrameStats() const { return m_Stats; }
+
+private:
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+    static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    std::vector<RenderCommand> m_Commands;
+    std::vector<InstancedRenderCommand> m_InstancedCommands;
+    LightData m_Lights;
+    FrameStats m_Stats;
+
+    float m_Time{ 0.0f };
+    float m_TimeStep;
+    uint64_t m_Frame{ 0 };
+    bool m_Hashing{ false };
+    uint64_t m_Hash{ FNV_OFFSET };
+    bool m_Culling{ false };
+    CullPlanes m_Planes{};
+
+    void hashBytes(const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+            m_Hash = (m_Hash ^ bytes[i]) * FNV_PRIME;
+    }
+
+    template<typename T>
+    void hashValue(const T& value) { hashBytes(&value, sizeof(T)); }
+
+    void hashMesh(const BasicMesh* mesh)
+    {
+        if (!mesh)
+        {
+            hashValue(uint32_t{ 0 });
+            return;
+        }
+        hashValue(mesh->GetIndexCount());
+        hashValue(mesh->GetBoundingSphere());
+    }
+};
+
+#endif // !RECORDING_RENDERER_H
@@ -0,0 +1,320 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+
+#include "GLState.h"
+#include "Debugging.h"
+#include "GpuProfiler.h"
+
+RenderGraph::Handle RenderGraph::Builder::Create(const std::string& name, const TextureDesc& desc)
+{
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.bytes = static_cast<size_t>(desc.width) * static_cast<size_t>(desc.height) * BytesPerTexel(desc.internalFormat);
+    m_Graph.m_Resources.push_back(resource);
+    const Handle handle = static_cast<Handle>(m_Graph.m_Resources.size() - 1);
+    m_Graph.m_Passes[m_Pass].creates.push_back(handle);
+    return Write(handle);
+}
+
+RenderGraph::Handle RenderGraph::Builder::Read(Handle resource)
+{
+    m_Graph.m_Passes[m_Pass].reads.push_back(resource);
+    return resource;
+}
+
+RenderGraph::Handle RenderGraph::Builder::Write(Handle resource)
+{
+    m_Graph.m_Passes[m_Pass].writes.push_back(resource);
+    m_Graph.m_Resources[resource].writers.push_back(m_Pass);
+    return resource;
+}
+
+void RenderGraph::Builder::SideEffect()
+{
+    m_Graph.m_Passes[m_Pass].sideEffect = true;
+}
+
+RenderGraph::~RenderGraph()
+{
+    Clean();
+}
+
+void RenderGraph::Reset()
+{
+    m_Resources.clear();
+    m_Passes.clear();
+}
+
+RenderGraph::Handle RenderGraph::Import(const std::string& name, GLuint texture, size_t bytes)
+{
+    Resource resource;
+    resource.name = name;
+    resource.bytes = bytes;
+    resource.imported = true;
+    resource.texture = texture;
+    m_Resources.push_back(resource);
+    return static_cast<Handle>(m_Resources.size() - 1);
+}
+
+void RenderGraph::MarkOutput(Handle resource)
+{
+    m_Resources[resource].output = true;
+}
+
+void RenderGraph::AddPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    m_Passes.push_back(std::move(pass));
+    Builder builder(*this, m_Passes.size() - 1);
+    setup(builder);
+}
+
+void RenderGraph::Compile()
+{
+    ++m_Frame;
+    m_Stats = {};
+    m_Stats.passCount = m_Passes.size();
+
+    cullPasses();
+    allocateTransients();
+    evictPool();
+}
+
+void RenderGraph::Execute()
+{
+    for (const Pass& pass : m_Passes)
+    {
+        if (pass.culled)
+            continue;
+        GpuProfiler::Scope scope(pass.name.c_str());
+        pass.execute(*this);
+    }
+}
+
+GLuint RenderGraph::GetTexture(Handle resource) const
+{
+    return m_Resources[resource].texture;
+}
+
+std::vector<std::string> RenderGraph::GetCulledPasses() const
+{
+    std::vector<std::string> names;
+    for (const Pass& pass : m_Passes)
+    {
+        if (pass.culled)
+            names.push_back(pass.name);
+    }
+    return names;
+}
+
+void RenderGraph::Clean()
+{
+    for (PooledTexture& pooled : m_Pool)
+        GLState::DeleteTextures(1, &pooled.texture);
+    m_Pool.clear();
+}
+
+size_t RenderGraph::BytesPerTexel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_R8:
+        return 1;
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    case GL_RGB8:
+        return 3;
+    case GL_RGBA8:
+    case GL_RG16:
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_R11F_G11F_B10F:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        return 4;
+    case GL_RGB16F:
+        return 6;
+    case GL_RGBA16F:
+    case GL_RG32F:
+        return 8;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+// a pass is kept while one of the resources it writes is read by a kept pass (or is an output)
+void RenderGraph::cullPasses()
+{
+    for (Resource& resource : m_Resources)
+        resource.refCount = resource.output ? 1 : 0;
+    for (size_t p = 0; p < m_Passes.size(); ++p)
+    {
+        Pass& pass = m_Passes[p];
+        pass.refCount = pass.writes.size();
+        // a read-modify-write does not keep the pass alive by itself
+        for (Handle read : pass.reads)
+        {
+            if (std::find(pass.writes.begin(), pass.writes.end(), read) == pass.writes.end())
+                ++m_Resources[read].refCount;
+        }
+    }
+
+    std::vector<Handle> unused;
+    auto releaseReads = [&](Pass& pass)
+    {
+        for (Handle read : pass.reads)
+        {
+            Resource& resource = m_Resources[read];
+            if (resource.refCount > 0 && std::find(pass.writes.begin(), pass.writes.end(), read) == pass.writes.end() && --resource.refCount == 0)
+                unused.push_back(read);
+        }
+    };
+
+    // a resource is pushed once: here if nothing reads it, or by releaseReads when its count reaches 0
+    for (Handle h = 0; h < m_Resources.size(); ++h)
+    {
+        if (m_Resources[h].refCount == 0)
+            unused.push_back(h);
+    }
+    for (Pass& pass : m_Passes)
+    {
+        if (pass.refCount == 0 && !pass.sideEffect)
+        {
+            pass.culled = true;
+            releaseReads(pass);
+        }
+    }
+
+    while (!unused.empty())
+    {
+        const Handle h = unused.back();
+        unused.pop_back();
+        for (size_t writer : m_Resources[h].writers)
+        {
+            Pass& pass = m_Passes[writer];
+            if (pass.culled || pass.sideEffect || pass.refCount == 0)
+                continue;
+            if (--pass.refCount == 0)
+            {
+                pass.culled = true;
+                releaseReads(pass);
+            }
+        }
+    }
+}
+
+// the transient textures go back to the pool after their last pass, the next ones can take them
+void RenderGraph::allocateTransients()
+{
+    for (size_t p = 0; p < m_Passes.size(); ++p)
+    {
+        const Pass& pass = m_Passes[p];
+        const size_t bandwidth = [&]() {
+            size_t bytes = 0;
+            for (Handle h : pass.reads)
+                bytes += m_Resources[h].bytes;
+            for (Handle h : pass.writes)
+                bytes += m_Resources[h].bytes;
+            return bytes;
+        }();
+
+        if (pass.culled)
+        {
+            ++m_Stats.culledPasses;
+            m_Stats.culledBandwidthBytes += bandwidth;
+            for (Handle h : pass.creates)
+                m_Stats.culledBytes += m_Resources[h].bytes;
+            continue;
+        }
+        m_Stats.bandwidthBytes += bandwidth;
+        for (const auto* list : { &pass.reads, &pass.writes })
+        {
+            for (Handle h : *list)
+            {
+                Resource& resource = m_Resources[h];
+                resource.firstPass = std::min(resource.firstPass, p);
+                resource.lastPass = std::max(resource.lastPass, p);
+            }
+        }
+    }
+
+    for (PooledTexture& pooled : m_Pool)
+        pooled.busy = false;
+
+    for (size_t p = 0; p < m_Passes.size(); ++p)
+    {
+        const Pass& pass = m_Passes[p];
+        if (pass.culled)
+            continue;
+        for (Handle h : pass.creates)
+        {
+            Resource& resource = m_Resources[h];
+            resource.poolIndex = acquire(resource.desc);
+            resource.texture = m_Pool[resource.poolIndex].texture;
+            m_Stats.transientBytes += resource.bytes;
+        }
+        for (const auto* list : { &pass.reads, &pass.writes })
+        {
+            for (Handle h : *list)
+            {
+                const Resource& resource = m_Resources[h];
+                if (!resource.imported && resource.lastPass == p)
+                    m_Pool[resource.poolIndex].busy = false;
+            }
+        }
+    }
+
+    for (const PooledTexture& pooled : m_Pool)
+    {
+        if (pooled.lastFrame == m_Frame)
+            m_Stats.allocatedBytes += static_cast<size_t>(pooled.desc.width) * static_cast<size_t>(pooled.desc.height) * BytesPerTexel(pooled.desc.internalFormat);
+    }
+}
+
+size_t RenderGraph::acquire(const TextureDesc& desc)
+{
+    for (size_t i = 0; i < m_Pool.size(); ++i)
+    {
+        if (!m_Pool[i].busy && m_Pool[i].desc == desc)
+        {
+            m_Pool[i].busy = true;
+            m_Pool[i].lastFrame = m_Frame;
+            return i;
+        }
+    }
+
+    PooledTexture pooled;
+    pooled.desc = desc;
+    pooled.lastFrame = m_Frame;
+    pooled.busy = true;
+    glGenTextures(1, &pooled.texture);
+    GLState::BindTexture(GL_TEXTURE_2D, pooled.texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+    GLDebug::Label(GL_TEXTURE, pooled.texture, "RenderGraph pool " + std::to_string(m_Pool.size()));
+    m_Pool.push_back(pooled);
+    return m_Pool.size() - 1;
+}
+
+void RenderGraph::evictPool()
+{
+    auto stale = std::remove_if(m_Pool.begin(), m_Pool.end(), [this](PooledTexture& pooled) {
+        if (m_Frame - pooled.lastFrame <= POOL_FRAMES)
+            return false;
+        GLState::DeleteTextures(1, &pooled.texture);
+        return true;
+    });
+    m_Pool.erase(stale, m_Pool.end());
+}
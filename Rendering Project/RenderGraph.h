@@ -0,0 +1,149 @@
+#pragma once
+
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glad/gl.h>
+
+/**
+    * @brief Frame graph of the render passes: every pass declares the textures it reads and writes.
+    *
+    * @details The graph is declared again every frame (AddPass, then Compile and Execute). Compile culls
+    *          the passes whose results are never read, starting from the resources marked as output and
+    *          the passes with a side effect. Then every transient texture of the remaining passes gets a
+    *          physical texture from a pool kept between the frames: two transient textures with the same
+    *          description whose lifetimes (first to last pass that uses them) do not overlap alias the
+    *          same texture, so their content is undefined when the first pass writes them.
+    *          The imported resources are the textures that the FBO classes still own, the graph only
+    *          tracks who uses them for the culling and for the statistics.
+**/
+class RenderGraph
+{
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID = UINT32_MAX;
+    // a pool texture not used for this many frames is deleted (e.g. the old size after a resize)
+    static constexpr uint64_t POOL_FRAMES = 8;
+
+    struct TextureDesc
+    {
+        int width{ 0 };
+        int height{ 0 };
+        GLenum internalFormat{ GL_RGBA8 };
+
+        bool operator==(const TextureDesc&) const = default;
+    };
+
+    // estimated per frame, every read and write is counted as the whole resource
+    struct Stats
+    {
+        size_t passCount{ 0 };
+        size_t culledPasses{ 0 };
+        size_t transientBytes{ 0 };        // the transient textures of the live passes, one texture each
+        size_t allocatedBytes{ 0 };        // the pool textures really used after the aliasing
+        size_t culledBytes{ 0 };           // transient textures of the culled passes, never allocated
+        size_t bandwidthBytes{ 0 };        // reads and writes of the live passes
+        size_t culledBandwidthBytes{ 0 };  // reads and writes of the culled passes
+
+        bool operator==(const Stats&) const = default;
+    };
+
+    class Builder
+    {
+    public:
+        // transient texture, allocated by the graph only if the pass is not culled
+        Handle Create(const std::string& name, const TextureDesc& desc);
+        Handle Read(Handle resource);
+        Handle Write(Handle resource);
+        // the pass is never culled
+        void SideEffect();
+
+    private:
+        friend class RenderGraph;
+        Builder(RenderGraph& graph, size_t pass) : m_Graph(graph), m_Pass(pass) {}
+
+        RenderGraph& m_Graph;
+        size_t m_Pass;
+    };
+
+    using SetupFunction = std::function<void(Builder&)>;
+    using ExecuteFunction = std::function<void(const RenderGraph&)>;
+
+    RenderGraph() = default;
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+    ~RenderGraph();
+
+    // forget the passes and the resources of the previous frame, the pool is kept
+    void Reset();
+    // a texture owned outside the graph, bytes is its size for the statistics
+    Handle Import(const std::string& name, GLuint texture, size_t bytes);
+    // the passes that contribute to this resource are kept
+    void MarkOutput(Handle resource);
+    // setup runs now and declares the resources, execute runs in Execute() if the pass is not culled
+    void AddPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute);
+
+    void Compile();
+    void Execute();
+
+    GLuint GetTexture(Handle resource) const;
+    const Stats& GetStats() const { return m_Stats; }
+    std::vector<std::string> GetCulledPasses() const;
+    void Clean();
+
+    static size_t BytesPerTexel(GLenum internalFormat);
+
+private:
+    struct Resource
+    {
+        std::string name;
+        TextureDesc desc;
+        size_t bytes{ 0 };
+        bool imported{ false };
+        bool output{ false };
+        GLuint texture{ 0 };
+        size_t poolIndex{ SIZE_MAX };
+        std::vector<size_t> writers;
+        size_t refCount{ 0 };
+        size_t firstPass{ SIZE_MAX };
+        size_t lastPass{ 0 };
+    };
+
+    struct Pass
+    {
+        std::string name;
+        ExecuteFunction execute;
+        std::vector<Handle> creates;
+        std::vector<Handle> reads;
+        std::vector<Handle> writes;
+        bool sideEffect{ false };
+        bool culled{ false };
+        size_t refCount{ 0 };
+    };
+
+    struct PooledTexture
+    {
+        GLuint texture{ 0 };
+        TextureDesc desc;
+        uint64_t lastFrame{ 0 };
+        bool busy{ false };
+    };
+
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+    std::vector<PooledTexture> m_Pool;
+    uint64_t m_Frame{ 0 };
+    Stats m_Stats;
+
+    void cullPasses();
+    void allocateTransients();
+    size_t acquire(const TextureDesc& desc);
+    void evictPool();
+};
+
+#endif // !RENDER_GRAPH_H
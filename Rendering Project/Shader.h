@@ -4,6 +4,8 @@
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
+#include "GLState.h"
+#include "Debugging.h"
 
 
 #include <string>
@@ -28,7 +30,7 @@ public:
     {
         if (ID != 0)
         {
-            glDeleteProgram(ID);
+            GLState::DeleteProgram(ID);
             ID = 0;
         }
     }
@@ -38,6 +40,13 @@ public:
         load(vertexPath, fragmentPath, geometryPath);
     }
 
+    // lines added after the #version of every stage by the next load, e.g. "#define SHADOW_MASK_PASS\n",
+    // so one source file can build more variants of a program
+    void setDefines(const std::string& defines)
+    {
+        m_Defines = defines;
+    }
+
     // load function to load shaders from file paths
     // ------------------------------------------------------------------------
     void load(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
@@ -45,7 +54,7 @@ public:
         // If shader program already exists, delete it first
         if (ID != 0)
         {
-            glDeleteProgram(ID);
+            GLState::DeleteProgram(ID);
             ID = 0;
         }
 
@@ -74,8 +83,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = injectDefines(vShaderStream.str());
+            fragmentCode = injectDefines(fShaderStream.str());
 
             if (geometryPath != nullptr)
             {
@@ -83,7 +92,7 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = injectDefines(gShaderStream.str());
             }
 
         }
@@ -125,6 +134,7 @@ public:
             glAttachShader(ID, geometry);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM", "no path");
+        GLDebug::Label(GL_PROGRAM, ID, fragmentPath);
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -132,11 +142,51 @@ public:
             glDeleteShader(geometry);
     }
 
+    // load a compute only program
+    // ------------------------------------------------------------------------
+    void loadCompute(const char* computePath)
+    {
+        if (ID != 0)
+        {
+            GLState::DeleteProgram(ID);
+            ID = 0;
+        }
+
+        std::string computeCode;
+        std::ifstream cShaderFile;
+        cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            cShaderFile.open(computePath);
+            std::stringstream cShaderStream;
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = injectDefines(cShaderStream.str());
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+        const char* cShaderCode = computeCode.c_str();
+
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE", computePath);
+
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM", computePath);
+        GLDebug::Label(GL_PROGRAM, ID, computePath);
+        glDeleteShader(compute);
+    }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     {
-        glUseProgram(ID);
+        GLState::UseProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -182,6 +232,15 @@ public:
         glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
     }
     // ------------------------------------------------------------------------
+    void setIVec2(const std::string& name, const glm::ivec2& value) const
+    {
+        glUniform2iv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    void setIVec4(const std::string& name, const glm::ivec4& value) const
+    {
+        glUniform4iv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
         glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
@@ -196,8 +255,26 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat4Array(const std::string& name, const glm::mat4* mats, int count) const
+    {
+        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), count, GL_FALSE, &mats[0][0][0]);
+    }
 
 private:
+    std::string m_Defines;
+
+    // the #version must stay the first directive of the source
+    std::string injectDefines(const std::string& code) const
+    {
+        if (m_Defines.empty())
+            return code;
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return m_Defines + code;
+        return code.substr(0, lineEnd + 1) + m_Defines + code.substr(lineEnd + 1);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type, std::string path)
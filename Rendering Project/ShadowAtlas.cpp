@@ -0,0 +1,252 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Debugging.h"
+#include "GLState.h"
+#include "LightStruct.h"
+#include "Shader.h"
+
+namespace
+{
+    // keep the even bits of x, packed in the low half (inverse of the Morton interleave)
+    unsigned int CompactBits(unsigned int x)
+    {
+        x &= 0x55555555u;
+        x = (x ^ (x >> 1)) & 0x33333333u;
+        x = (x ^ (x >> 2)) & 0x0f0f0f0fu;
+        x = (x ^ (x >> 4)) & 0x00ff00ffu;
+        x = (x ^ (x >> 8)) & 0x0000ffffu;
+        return x;
+    }
+
+    unsigned int FloorPowerOfTwo(unsigned int x)
+    {
+        unsigned int result = 1;
+        while (result * 2 <= x)
+            result *= 2;
+        return result;
+    }
+
+    size_t TileTexels(unsigned int size, unsigned int tileCount)
+    {
+        return static_cast<size_t>(size) * size * tileCount;
+    }
+}
+
+ShadowAtlas::ShadowAtlas(unsigned int size) :
+    m_Size{ FloorPowerOfTwo(size) }
+{
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+    clean();
+}
+
+void ShadowAtlas::Init()
+{
+    glGenTextures(1, &m_Texture);
+    GLState::BindTexture(GL_TEXTURE_2D, m_Texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, m_Size, m_Size);
+
+    // linear filter + compare mode give a 2x2 PCF for free, the shaders clamp the samples inside the tile
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glGenFramebuffers(1, &m_FBO);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_Texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (Status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("FB error, status: 0x%x\n", Status);
+        throw 1;
+    }
+
+    // a never written tile must read as "lit"
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    GL_CHECK();
+}
+
+bool ShadowAtlas::Allocate(const std::vector<Request>& requests)
+{
+    std::vector<Tile> tiles(requests.size());
+    const size_t capacity = static_cast<size_t>(m_Size) * m_Size;
+    size_t total = 0;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        if (requests[i].tileCount == 0) continue;
+        tiles[i].tileCount = requests[i].tileCount;
+        tiles[i].size = std::clamp(FloorPowerOfTwo(requests[i].size), MIN_TILE_SIZE, m_Size);
+        total += TileTexels(tiles[i].size, tiles[i].tileCount);
+    }
+
+    while (total > capacity)
+    {
+        // the largest tiles go first, among them the least important light
+        size_t pick = requests.size();
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            if (tiles[i].size == 0) continue;
+            if (pick == requests.size() || tiles[i].size > tiles[pick].size ||
+                (tiles[i].size == tiles[pick].size && requests[i].priority < requests[pick].priority))
+                pick = i;
+        }
+
+        total -= TileTexels(tiles[pick].size, tiles[pick].tileCount);
+        // every light is already at the minimum size: the least important one is left without shadow
+        tiles[pick].size = tiles[pick].size > MIN_TILE_SIZE ? tiles[pick].size / 2 : 0;
+        total += TileTexels(tiles[pick].size, tiles[pick].tileCount);
+    }
+
+    std::vector<size_t> order(requests.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (tiles[a].size != tiles[b].size)
+            return tiles[a].size > tiles[b].size;
+        return requests[a].priority > requests[b].priority;
+    });
+
+    // position along the Morton curve in MIN_TILE_SIZE units
+    size_t offset = 0;
+    for (size_t i : order)
+    {
+        Tile& tile = tiles[i];
+        if (tile.size == 0) {
+            tile = Tile{};
+            continue;
+        }
+        const size_t area = static_cast<size_t>(tile.size / MIN_TILE_SIZE) * (tile.size / MIN_TILE_SIZE);
+        tile.firstTile = static_cast<unsigned int>(offset / area);
+        offset += area * tile.tileCount;
+    }
+
+    m_UsedTexels = total;
+    bool changed = tiles != m_Tiles;
+    m_Tiles = std::move(tiles);
+    return changed;
+}
+
+glm::ivec4 ShadowAtlas::GetTileRect(const Tile& tile, unsigned int offset) const
+{
+    unsigned int index = tile.firstTile + offset;
+    int size = static_cast<int>(tile.size);
+    return glm::ivec4(static_cast<int>(CompactBits(index)) * size, static_cast<int>(CompactBits(index >> 1)) * size, size, size);
+}
+
+glm::vec4 ShadowAtlas::GetTileUniform(const Tile& tile) const
+{
+    return glm::vec4(static_cast<float>(tile.firstTile), static_cast<float>(tile.size) / static_cast<float>(m_Size), 0.0f, 0.0f);
+}
+
+void ShadowAtlas::BindForWriting()
+{
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+}
+
+void ShadowAtlas::SetViewport(const Tile& tile, unsigned int offset) const
+{
+    glm::ivec4 rect = GetTileRect(tile, offset);
+    GLState::Viewport(rect.x, rect.y, rect.z, rect.w);
+}
+
+void ShadowAtlas::SetViewports(const Tile& tile) const
+{
+    for (unsigned int offset = 0; offset < tile.tileCount; ++offset)
+        SetViewport(offset, tile, offset);
+}
+
+void ShadowAtlas::SetViewport(GLuint index, const Tile& tile, unsigned int offset) const
+{
+    glm::vec4 rect = glm::vec4(GetTileRect(tile, offset));
+    GLState::ViewportIndexedf(index, rect.x, rect.y, rect.z, rect.w);
+}
+
+void ShadowAtlas::ClearTile(const Tile& tile, unsigned int offset) const
+{
+    glm::ivec4 rect = GetTileRect(tile, offset);
+    GLState::Enable(GL_SCISSOR_TEST);
+    glScissor(rect.x, rect.y, rect.z, rect.w);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    GLState::Disable(GL_SCISSOR_TEST);
+}
+
+void ShadowAtlas::CopyTileFrom(const ShadowAtlas& source, const Tile& tile, unsigned int offset) const
+{
+    glm::ivec4 rect = GetTileRect(tile, offset);
+    glCopyImageSubData(source.m_Texture, GL_TEXTURE_2D, 0, rect.x, rect.y, 0,
+        m_Texture, GL_TEXTURE_2D, 0, rect.x, rect.y, 0, rect.z, rect.w, 1);
+}
+
+void ShadowAtlas::BindForReading(GLint TextureUnit) const
+{
+    GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit);
+    GLState::BindTexture(GL_TEXTURE_2D, m_Texture);
+}
+
+void ShadowAtlas::clean()
+{
+    if (m_FBO != 0) {
+        GLState::DeleteFramebuffers(1, &m_FBO);
+        m_FBO = 0;
+    }
+    if (m_Texture != 0) {
+        GLState::DeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+    m_Tiles.clear();
+    m_UsedTexels = 0;
+}
+
+std::array<glm::mat4, 6> PointShadowFaceMatrices(const PointLight& light)
+{
+    glm::vec3 lightPos = light.Pos;
+    glm::mat4 shadowProj = light.Projection;
+    return {
+        shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(1.0f, 0.0f, 0.0f)), glm::vec3(0.0f, -1.0f, 0.0f)),
+        shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(-1.0f, 0.0f, 0.0f)), glm::vec3(0.0f, -1.0f, 0.0f)),
+        shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(0.0f, 0.0f, 1.0f)),
+        shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, -1.0f, 0.0f)), glm::vec3(0.0f, 0.0f, -1.0f)),
+        shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, 0.0f, 1.0f)), glm::vec3(0.0f, -1.0f, 0.0f)),
+        shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, 0.0f, -1.0f)), glm::vec3(0.0f, -1.0f, 0.0f))
+    };
+}
+
+void SetupPointShadowUniforms(const PointLight& light, const Shader& target)
+{
+    target.setVec3("lightPos", light.Pos);
+    target.setFloat("far_plane", light.far_plane);
+
+    std::array<glm::mat4, 6> shadowTransforms = PointShadowFaceMatrices(light);
+    for (unsigned int i = 0; i < 6; ++i)
+        target.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+}
+
+void SetupPointShadowFaceUniforms(const PointLight& light, int face, const Shader& target)
+{
+    target.setVec3("lightPos", light.Pos);
+    target.setFloat("far_plane", light.far_plane);
+    target.setMat4("faceMatrix", PointShadowFaceMatrices(light)[face]);
+}
+
+void SetupParaboloidShadowUniforms(const PointLight& light, int hemisphere, const Shader& target)
+{
+    target.setVec3("lightPos", light.Pos);
+    target.setFloat("far_plane", light.far_plane);
+    target.setFloat("hemisphere", hemisphere == 0 ? 1.0f : -1.0f);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include <array>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+struct PointLight;
+class Shader;
+
+/**
+    * @brief One depth texture shared by the shadows of every spot and point light.
+    *
+    * @details Every light asks for tileCount square tiles of a power of two size (1 for a spot light,
+    *          6 for a cube map, 2 for a dual paraboloid). Allocate() sorts the requests from the
+    *          largest tile to the smallest and places them along a Morton (Z order) curve: since every
+    *          tile is at least as small as the ones before it, its offset on the curve is always a
+    *          multiple of its own area and the tile is found back from its index with no table.
+    *          The shaders only need (first tile index, tile size) to rebuild the rect of every face.
+    *          When the requests do not fit, the largest tiles of the least important lights are halved
+    *          first, a light that does not fit even at MIN_TILE_SIZE gets no tile (size 0).
+**/
+class ShadowAtlas
+{
+public:
+    static constexpr unsigned int MIN_TILE_SIZE = 128;
+
+    struct Request
+    {
+        unsigned int tileCount; // all the tiles of a light have the same size
+        unsigned int size;      // wanted side in texels, power of two
+        float priority;         // the lowest priority is shrunk first
+    };
+
+    struct Tile
+    {
+        unsigned int firstTile{ 0 }; // Morton index of the first tile among the tiles of this size
+        unsigned int size{ 0 };      // 0 when the light did not fit
+        unsigned int tileCount{ 0 };
+
+        bool operator==(const Tile& other) const = default;
+    };
+
+    explicit ShadowAtlas(unsigned int size);
+    ~ShadowAtlas();
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    void Init();
+    // one tile per request, in the same order, return true if any tile changed since the last call
+    bool Allocate(const std::vector<Request>& requests);
+    const std::vector<Tile>& GetTiles() const { return m_Tiles; }
+
+    // x, y, width, height in texels of the tile offset of a light
+    glm::ivec4 GetTileRect(const Tile& tile, unsigned int offset) const;
+    // (first tile, tile size / atlas size) as read by AtlasTileRect() in Lighting_pass_test.frag
+    glm::vec4 GetTileUniform(const Tile& tile) const;
+    size_t GetUsedTexels() const { return m_UsedTexels; }
+
+    void BindForWriting();
+    void SetViewport(const Tile& tile, unsigned int offset) const;
+    // viewport i = tile offset i, for the shaders that select the tile with gl_ViewportIndex
+    void SetViewports(const Tile& tile) const;
+    void SetViewport(GLuint index, const Tile& tile, unsigned int offset) const;
+    void ClearTile(const Tile& tile, unsigned int offset) const;
+    // the atlas has the same size and format of source, so a plain image copy
+    void CopyTileFrom(const ShadowAtlas& source, const Tile& tile, unsigned int offset) const;
+    void BindForReading(GLint TextureUnit) const;
+    void clean();
+
+    GLuint GetTexture() const { return m_Texture; }
+    unsigned int GetSize() const { return m_Size; }
+
+private:
+    unsigned int m_Size{ 0 };
+    GLuint m_FBO{ 0 };
+    GLuint m_Texture{ 0 };
+    size_t m_UsedTexels{ 0 };
+    std::vector<Tile> m_Tiles;
+};
+
+// How the 6 cube tiles of a point light are rendered in the atlas
+// GeometryShader: one draw per light, the geometry shader copies every triangle in the 6 faces
+// PerFace: every face is drawn on its own, the empty faces are skipped
+enum class PointShadowMode
+{
+    GeometryShader,
+    PerFace
+};
+
+// view projection of the 6 faces in the cube map order (+X, -X, +Y, -Y, +Z, -Z)
+std::array<glm::mat4, 6> PointShadowFaceMatrices(const PointLight& light);
+// lightPos, far_plane and the 6 face matrices (shadowMapPoint*.vert + shadowMapPoint.geom)
+void SetupPointShadowUniforms(const PointLight& light, const Shader& target);
+// lightPos, far_plane and the faceMatrix of a single face (shadowMapPoint_face*.vert)
+void SetupPointShadowFaceUniforms(const PointLight& light, int face, const Shader& target);
+// lightPos, far_plane and hemisphere, 0 = front (+Z), 1 = back (-Z) (shadowMapParaboloid*.vert)
+void SetupParaboloidShadowUniforms(const PointLight& light, int hemisphere, const Shader& target);
+
+#endif // !SHADOW_ATLAS_H
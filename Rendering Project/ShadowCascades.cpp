@@ -0,0 +1,68 @@
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+void ShadowCascades::SetCount(size_t count)
+{
+    m_Count = std::clamp(count, size_t(1), MAX_CASCADES);
+}
+
+void ShadowCascades::Update(const glm::mat4& cameraView, const glm::mat4& cameraProjection, const glm::vec3& lightDirection,
+    float shadowDistance, float casterReach, unsigned int resolution)
+{
+    const float tanHalfY = 1.0f / cameraProjection[1][1];
+    const float tanHalfX = 1.0f / cameraProjection[0][0];
+    const float nearPlane = cameraProjection[3][2] / (cameraProjection[2][2] - 1.0f);
+    const float farPlane = std::max(shadowDistance, nearPlane * 2.0f);
+
+    // same up of DirLight::updateView, the light usually looks down
+    glm::vec3 direction = glm::normalize(lightDirection);
+    glm::vec3 up = glm::vec3(1.0f, 0.0f, 0.0f);
+    if (glm::abs(glm::dot(direction, up)) > 0.999f)
+        up = glm::vec3(0.0f, 0.0f, 1.0f);
+    // only the orientation of the light, the position of every cascade is in its orthographic box
+    const glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+    const glm::mat4 inverseView = glm::inverse(cameraView);
+
+    float sliceNear = nearPlane;
+    for (size_t c = 0; c < m_Count; ++c)
+    {
+        const float p = static_cast<float>(c + 1) / static_cast<float>(m_Count);
+        const float logSplit = nearPlane * std::pow(farPlane / nearPlane, p);
+        const float linearSplit = nearPlane + (farPlane - nearPlane) * p;
+        const float sliceFar = m_Lambda * logSplit + (1.0f - m_Lambda) * linearSplit;
+
+        // corners of the slice in view space, the sphere is computed there so it does not change with the camera rotation
+        std::array<glm::vec3, 8> corners;
+        for (int k = 0; k < 8; ++k)
+        {
+            const float z = (k & 4) ? sliceFar : sliceNear;
+            corners[k] = glm::vec3(((k & 1) ? 1.0f : -1.0f) * z * tanHalfX, ((k & 2) ? 1.0f : -1.0f) * z * tanHalfY, -z);
+        }
+        glm::vec3 center(0.0f);
+        for (const auto& corner : corners)
+            center += corner;
+        center /= 8.0f;
+        float radius = 0.0f;
+        for (const auto& corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+        // a radius that jitters in the last bits would change the texel size every frame
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // move the box by whole texels only
+        glm::vec3 lightCenter = glm::vec3(lightRotation * inverseView * glm::vec4(center, 1.0f));
+        const float texelSize = 2.0f * radius / static_cast<float>(resolution);
+        lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+        lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+        const glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+            lightCenter.y - radius, lightCenter.y + radius,
+            -lightCenter.z - radius - casterReach, -lightCenter.z + radius);
+
+        m_Matrices[c] = projection * lightRotation;
+        m_Splits[c] = sliceFar;
+        sliceNear = sliceFar;
+    }
+}
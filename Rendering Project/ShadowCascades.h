@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+
+#include <array>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/**
+    * @brief Light space matrices of the cascaded shadow maps of the directional light.
+    *
+    * @details The view frustum of the camera, cut at the shadow distance, is split in cascades with the
+    *          practical split scheme: a blend of the logarithmic and the linear splits weighted by lambda.
+    *          Every slice is enclosed in a sphere whose radius does not change when the camera rotates,
+    *          so the orthographic box of the cascade keeps the same size and its origin is snapped to
+    *          the shadow map texels: the shadow edges do not shimmer while the camera moves.
+    *          The box is extended towards the light by casterReach, so the casters outside the slice
+    *          still throw their shadow inside it.
+**/
+class ShadowCascades
+{
+public:
+    static constexpr size_t MAX_CASCADES = 4;
+
+    // cameraProjection is a standard glm::perspective, only its field of view, aspect and near plane are used
+    void Update(const glm::mat4& cameraView, const glm::mat4& cameraProjection, const glm::vec3& lightDirection,
+        float shadowDistance, float casterReach, unsigned int resolution);
+
+    void SetCount(size_t count);
+    // 0 = linear splits, 1 = logarithmic splits
+    void SetSplitLambda(float lambda) { m_Lambda = lambda; }
+
+    size_t GetCount() const { return m_Count; }
+    const glm::mat4& GetMatrix(size_t cascade) const { return m_Matrices[cascade]; }
+    // view depth where the cascade ends
+    float GetSplit(size_t cascade) const { return m_Splits[cascade]; }
+    const std::array<glm::mat4, MAX_CASCADES>& GetMatrices() const { return m_Matrices; }
+    const std::array<float, MAX_CASCADES>& GetSplits() const { return m_Splits; }
+
+private:
+    size_t m_Count{ MAX_CASCADES };
+    float m_Lambda{ 0.75f };
+    std::array<glm::mat4, MAX_CASCADES> m_Matrices{};
+    std::array<float, MAX_CASCADES> m_Splits{};
+};
+
+#endif // !SHADOW_CASCADES_H
@@ -0,0 +1,141 @@
+#include "ShadowMoments.h"
+
+#include <algorithm>
+
+#include "Debugging.h"
+#include "GLState.h"
+#include "PathConfig.h"
+
+namespace
+{
+    GLuint GroupCount(int texels)
+    {
+        return (static_cast<GLuint>(std::max(texels, 1)) + SHADOW_MOMENTS_WORKGROUP_SIZE - 1) / SHADOW_MOMENTS_WORKGROUP_SIZE;
+    }
+}
+
+ShadowMomentMap::ShadowMomentMap(unsigned int depthWidth, unsigned int depthHeight, unsigned int layers) :
+    m_Width{ std::max(1u, depthWidth / 2) },
+    m_Height{ std::max(1u, depthHeight / 2) },
+    m_Layers{ std::max(1u, layers) }
+{
+}
+
+ShadowMomentMap::~ShadowMomentMap()
+{
+    clean();
+}
+
+void ShadowMomentMap::Init()
+{
+    m_MomentShader = std::make_unique<Shader>();
+    m_MomentShader->loadCompute(getShaderFullPath("shadow_moments.comp").c_str());
+    m_BlurShader = std::make_unique<Shader>();
+    m_BlurShader->loadCompute(getShaderFullPath("shadow_blur.comp").c_str());
+
+    m_Levels = 1;
+    for (unsigned int size = std::min(m_Width, m_Height); size > 1; size /= 2)
+        m_Levels++;
+
+    glGenTextures(1, &m_Texture);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, m_Levels, GL_RGBA16F, m_Width, m_Height, m_Layers);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // the shadow maps have the compare mode on, a plain sampler must not inherit it
+    glGenSamplers(1, &m_DepthSampler);
+    glSamplerParameteri(m_DepthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glSamplerParameteri(m_DepthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(m_DepthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    GL_CHECK();
+}
+
+void ShadowMomentMap::Update(GLuint depthTexture, GLenum depthTarget, const std::vector<Region>& regions, GLuint scratch)
+{
+    if (regions.empty())
+        return;
+
+    const bool fromArray = depthTarget == GL_TEXTURE_2D_ARRAY;
+    const GLint depthUnit = fromArray ? 1 : 0;
+
+    // depth -> warped moments, 2x2 depth texels per moment texel
+    m_MomentShader->use();
+    GLState::ActiveTexture(GL_TEXTURE0 + depthUnit);
+    GLState::BindTexture(depthTarget, depthTexture);
+    glBindSampler(depthUnit, m_DepthSampler);
+    m_MomentShader->setInt("depthTexture", 0);
+    m_MomentShader->setInt("depthArray", 1);
+    m_MomentShader->setBool("fromArray", fromArray);
+    m_MomentShader->setVec2("exponents", GetExponents());
+    glBindImageTexture(0, m_Texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    for (const auto& region : regions)
+    {
+        const glm::ivec4 rect = region.depthRect / 2;
+        m_MomentShader->setInt("layer", region.layer);
+        m_MomentShader->setIVec4("srcRect", region.depthRect);
+        glDispatchCompute(GroupCount(rect.z), GroupCount(rect.w), 1);
+    }
+    glBindSampler(depthUnit, 0);
+
+    // separable gaussian clamped to the rect of every region, the horizontal blur lands in the scratch
+    // (layer i at x = i * width) and the vertical one goes back to level 0 of the moments
+    if (m_BlurRadius > 0 && scratch != 0)
+    {
+        m_BlurShader->use();
+        m_BlurShader->setInt("radius", m_BlurRadius);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            m_BlurShader->setIVec2("direction", pass == 0 ? glm::ivec2(1, 0) : glm::ivec2(0, 1));
+            for (const auto& region : regions)
+            {
+                // a single layer of the moments is bound as a 2D image
+                const glm::ivec4 rect = region.depthRect / 2;
+                const glm::ivec2 scratchOrigin = glm::ivec2(rect.x + region.layer * static_cast<int>(m_Width), rect.y);
+                if (pass == 0)
+                {
+                    glBindImageTexture(0, m_Texture, 0, GL_FALSE, region.layer, GL_READ_ONLY, GL_RGBA16F);
+                    glBindImageTexture(1, scratch, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+                    m_BlurShader->setIVec4("rect", rect);
+                    m_BlurShader->setIVec2("dstOrigin", scratchOrigin);
+                }
+                else
+                {
+                    glBindImageTexture(0, scratch, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+                    glBindImageTexture(1, m_Texture, 0, GL_FALSE, region.layer, GL_WRITE_ONLY, GL_RGBA16F);
+                    m_BlurShader->setIVec4("rect", glm::ivec4(scratchOrigin, rect.z, rect.w));
+                    m_BlurShader->setIVec2("dstOrigin", glm::ivec2(rect.x, rect.y));
+                }
+                glDispatchCompute(GroupCount(rect.z), GroupCount(rect.w), 1);
+            }
+        }
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    GL_CHECK();
+}
+
+void ShadowMomentMap::BindForReading(GLint TextureUnit) const
+{
+    GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+}
+
+void ShadowMomentMap::clean()
+{
+    if (m_Texture != 0) {
+        GLState::DeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+    if (m_DepthSampler != 0) {
+        glDeleteSamplers(1, &m_DepthSampler);
+        m_DepthSampler = 0;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef SHADOW_MOMENTS_H
+#define SHADOW_MOMENTS_H
+
+#include <memory>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+constexpr GLuint SHADOW_MOMENTS_WORKGROUP_SIZE = 8;
+
+// how the lighting pass filters the shadow of a light type
+enum class ShadowFilter
+{
+    PCF,  // many hardware compare taps on the depth map
+    EVSM  // one trilinear tap on the prefiltered exponential variance moments
+};
+
+/**
+    * @brief Exponential variance shadow maps built from depth shadow maps.
+    *
+    * @details The moments are a 2D array (one layer per cascade, or a single layer for the atlas) at half
+    *          the resolution of the depth: every moment texel averages the warped moments of 2x2 depth
+    *          texels, which is already a correct prefilter. Update() converts the given depth rects
+    *          (shadow_moments.comp), blurs them with a separable gaussian that never reads outside the
+    *          rect (shadow_blur.comp, through a scratch texture) and rebuilds the mip chain, so the
+    *          lighting pass needs a single filtered tap per light.
+    *          The scratch is only alive during Update(), so the caller provides it (a transient texture
+    *          of the RenderGraph): a 2D GL_RGBA16F texture of at least GetScratchSize() texels where
+    *          the layers are placed side by side.
+    *          The atlas tiles are aligned to their own size (ShadowAtlas), so the mip levels up to the
+    *          size of a tile never mix two lights.
+**/
+class ShadowMomentMap
+{
+public:
+    // layer of the depth texture and rect in depth texels (even sizes)
+    struct Region
+    {
+        int layer;
+        glm::ivec4 depthRect;
+    };
+
+    // sizes of the depth maps, the moments are half of them
+    ShadowMomentMap(unsigned int depthWidth, unsigned int depthHeight, unsigned int layers);
+    ~ShadowMomentMap();
+    ShadowMomentMap(const ShadowMomentMap&) = delete;
+    ShadowMomentMap& operator=(const ShadowMomentMap&) = delete;
+
+    void Init();
+    bool IsInitialized() const { return m_Texture != 0; }
+    // depthTarget is GL_TEXTURE_2D (region layer ignored) or GL_TEXTURE_2D_ARRAY, scratch can be 0 without blur
+    void Update(GLuint depthTexture, GLenum depthTarget, const std::vector<Region>& regions, GLuint scratch);
+    void BindForReading(GLint TextureUnit) const;
+    void clean();
+
+    // taps of the gaussian on each side of the texel, 0 disables the blur
+    void SetBlurRadius(int radius) { m_BlurRadius = radius; }
+    int GetBlurRadius() const { return m_BlurRadius; }
+    // smallest scratch for the blur, every layer side by side
+    glm::ivec2 GetScratchSize() const { return glm::ivec2(m_Width * m_Layers, m_Height); }
+    // the moments with their mip chain, for the statistics
+    size_t GetBytes() const { return static_cast<size_t>(m_Width) * m_Height * m_Layers * 8 * 4 / 3; }
+    // positive and negative warp exponents, 5.54 is the largest that keeps the squared moments in a half float
+    static glm::vec2 GetExponents() { return glm::vec2(5.54f, 5.54f); }
+    GLuint GetTexture() const { return m_Texture; }
+
+private:
+    unsigned int m_Width{ 0 }, m_Height{ 0 }, m_Layers{ 0 };
+    int m_Levels{ 1 };
+    int m_BlurRadius{ 2 };
+    GLuint m_Texture{ 0 };
+    GLuint m_DepthSampler{ 0 };
+    std::unique_ptr<Shader> m_MomentShader;
+    std::unique_ptr<Shader> m_BlurShader;
+};
+
+#endif // !SHADOW_MOMENTS_H
@@ -46,7 +46,7 @@ inline void  Skybox::clear()
 	textureCube.Delete();
 	shader.clean();
 	if (VBO != 0) glDeleteBuffers(1, &VBO);
-	if (VAO != 0) glDeleteVertexArrays(1, &VAO);
+	if (VAO != 0) GLState::DeleteVertexArrays(1, &VAO);
 }
 inline void Skybox::load(const char* const path, std::vector<std::string> faces, const char* const vert, const char* const frag)
 {
@@ -59,13 +59,13 @@ inline void Skybox::Render(glm::mat4  projection, glm::mat4 view)
 {
 	// --- STATE SETUP ---
 	   // 1. Change the depth function to LEQUAL so the shader's z=w trick works.
-	glDepthFunc(GL_LEQUAL);
+	GLState::DepthFunc(GL_LEQUAL);
 
 	// 2. Change face culling. We are inside the cube, so we want to render
 	//    the back faces and cull the front faces.
 	glCullFace(GL_BACK);
 
-	glDepthMask(GL_FALSE);
+	GLState::DepthMask(GL_FALSE);
 
 	// --- RENDERING ---
 	shader.use();
@@ -74,18 +74,19 @@ inline void Skybox::Render(glm::mat4  projection, glm::mat4 view)
 	glm::mat4 View = glm::mat4(glm::mat3(view));
 	shader.setMat4("view", View); // The shader handles the translation removal
 
-	glBindVertexArray(VAO);
+	GLState::BindVertexArray(VAO);
 	textureCube.Bind();
 
+	GLState::CountDraw();
 	glDrawArrays(GL_TRIANGLES, 0, 36);
 
 
 	// --- STATE RESTORATION ---
 	// IMPORTANT: Reset the state back to the defaults for the rest of your scene.
-	glBindVertexArray(0);
-	glDepthMask(GL_TRUE);
+	GLState::BindVertexArray(0);
+	GLState::DepthMask(GL_TRUE);
 	glCullFace(GL_BACK); // Set culling back to the default
-	glDepthFunc(GL_LESS); // Set depth function back to the default
+	GLState::DepthFunc(GL_LESS); // Set depth function back to the default
 
 }
 
@@ -139,14 +140,14 @@ inline void Skybox::initializeCubeData()
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 
-	glBindVertexArray(VAO);
+	GLState::BindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
 
 
@@ -0,0 +1,324 @@
+#pragma once
+
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "EntityComponentSysetm.h"
+
+/**
+    * @brief Size of a StressScene, from the command line ("entities=2000,meshes=8,points=16") or a file.
+    *
+    * @details The keys are the members below: entities, meshes, groups, group_size, points, spots,
+    *          animated (fraction of the entities that move), extent (half side of the area) and seed.
+    *          The file has one "key=value" per line, '#' starts a comment.
+**/
+struct StressSceneSpec
+{
+    int entities{ 1000 };           // N entities with a MeshRenderer
+    int meshes{ 6 };                // M distinct meshes shared by the entities and the groups
+    int instancedGroups{ 4 };       // K InstancedMeshRenderer
+    int groupSize{ 256 };           // S instances per group
+    int pointLights{ 8 };           // P
+    int spotLights{ 4 };            // Q
+    float animatedFraction{ 0.1f };
+    float extent{ 60.0f };
+    unsigned int seed{ 1 };
+
+    bool Set(const std::string& key, const std::string& value)
+    {
+        char* end = nullptr;
+        const double number = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || number < 0.0)
+            return false;
+
+        if (key == "entities")
+            entities = static_cast<int>(number);
+        else if (key == "meshes")
+            meshes = std::max(1, static_cast<int>(number));
+        else if (key == "groups")
+            instancedGroups = static_cast<int>(number);
+        else if (key == "group_size")
+            groupSize = static_cast<int>(number);
+        else if (key == "points")
+            pointLights = static_cast<int>(number);
+        else if (key == "spots")
+            spotLights = static_cast<int>(number);
+        else if (key == "animated")
+            animatedFraction = std::clamp(static_cast<float>(number), 0.0f, 1.0f);
+        else if (key == "extent")
+            extent = std::max(1.0f, static_cast<float>(number));
+        else if (key == "seed")
+            seed = static_cast<unsigned int>(number);
+        else
+            return false;
+        return true;
+    }
+
+    // "key=value,key=value"
+    bool Parse(const std::string& list)
+    {
+        std::istringstream entries(list);
+        std::string entry;
+        while (std::getline(entries, entry, ','))
+        {
+            if (!setEntry(entry))
+                return false;
+        }
+        return true;
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line.erase(std::remove_if(line.begin(), line.end(), [](char c) { return c == ' ' || c == '\t' || c == '\r'; }), line.end());
+            if (line.empty() || line[0] == '#')
+                continue;
+            if (!setEntry(line))
+                return false;
+        }
+        return true;
+    }
+
+    // JSON object, so the benchmark results say which scene they measured
+    void Write(std::ostream& out) const
+    {
+        out << "{ \"entities\": " << entities << ", \"meshes\": " << meshes
+            << ", \"groups\": " << instancedGroups << ", \"group_size\": " << groupSize
+            << ", \"points\": " << pointLights << ", \"spots\": " << spotLights
+            << ", \"animated\": " << animatedFraction << ", \"extent\": " << extent
+            << ", \"seed\": " << seed << " }";
+    }
+
+private:
+    bool setEntry(const std::string& entry)
+    {
+        const size_t equal = entry.find('=');
+        if (equal == std::string::npos)
+        {
+            std::cout << "StressScene: expected key=value, got " << entry << std::endl;
+            return false;
+        }
+        if (!Set(entry.substr(0, equal), entry.substr(equal + 1)))
+        {
+            std::cout << "StressScene: invalid entry " << entry << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+    * @brief Synthetic scene of a given size, built only from the primitives of BasicMesh (no asset).
+    *
+    * @details The M meshes cycle through Cube, Square and a closed BSpline ribbon of growing size. The N
+    *          entities use them in turn at random places of the area, an evenly spread animatedFraction
+    *          of them follows a B-spline loop (so they are dynamic shadow casters). The K instanced groups
+    *          are clusters of S instances, the P point and Q spot lights are spread over the area.
+    *          Everything comes from a std::mt19937 seeded with the spec, so a spec is always the same scene.
+    *          The deferred lighting shader shades at most 32 point and 16 spot lights, the forward+
+    *          renderer has no limit.
+**/
+class StressScene : public Scene {
+public:
+    StressScene(std::unique_ptr<IRenderer> renderer, const StressSceneSpec& spec = {})
+        : Scene(std::move(renderer)), m_Spec(spec), m_Generator(spec.seed) {}
+
+    const StressSceneSpec& getSpec() const { return m_Spec; }
+
+protected:
+    void loadScene() override {
+        createMeshes();
+        createGround();
+        createEntities();
+        createInstancedGroups();
+        createLights();
+    }
+
+private:
+    StressSceneSpec m_Spec;
+    std::mt19937 m_Generator;
+    std::vector<std::shared_ptr<BasicMesh>> m_Meshes;
+
+    float random(float min, float max) {
+        return std::uniform_real_distribution<float>(min, max)(m_Generator);
+    }
+
+    glm::vec3 randomPosition(float minHeight, float maxHeight) {
+        const float x = random(-m_Spec.extent, m_Spec.extent);
+        const float y = random(minHeight, maxHeight);
+        const float z = random(-m_Spec.extent, m_Spec.extent);
+        return glm::vec3(x, y, z);
+    }
+
+    glm::quat randomRotation() {
+        const float x = random(-1.0f, 1.0f);
+        const float y = random(0.1f, 1.0f);
+        const float z = random(-1.0f, 1.0f);
+        return glm::angleAxis(random(0.0f, glm::radians(360.0f)), glm::normalize(glm::vec3(x, y, z)));
+    }
+
+    void createMeshes() {
+        for (int i = 0; i < m_Spec.meshes; ++i) {
+            auto mesh = createMesh();
+            const int variant = i / 3;
+            switch (i % 3) {
+            case 0: {
+                BasicMesh::Cube cube{ 0.5 + 0.25 * variant };
+                mesh->CreatePrimitive(&cube);
+                break;
+            }
+            case 1: {
+                BasicMesh::Square square{ 1 + variant, 1 };
+                mesh->CreatePrimitive(&square);
+                break;
+            }
+            default: {
+                // a small closed ribbon, 8 control points on a wavy circle
+                std::vector<glm::vec3> points;
+                const float radius = 1.0f + 0.5f * static_cast<float>(variant);
+                for (int p = 0; p < 8; ++p) {
+                    const float angle = glm::radians(45.0f * static_cast<float>(p));
+                    points.push_back(glm::vec3(radius * cos(angle), (p % 2) * 0.3f * radius, radius * sin(angle)));
+                }
+                BasicMesh::BSpline bspline{ points, 0.3f, 1.0f, true };
+                mesh->CreatePrimitive(&bspline);
+                break;
+            }
+            }
+            m_Meshes.push_back(mesh);
+        }
+    }
+
+    void createGround() {
+        EntityID groundEntity = createEntity();
+
+        Transform groundTransform;
+        groundTransform.rotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+        addComponent(groundEntity, groundTransform);
+
+        auto groundMesh = createMesh();
+        BasicMesh::Square square{ static_cast<int>(m_Spec.extent * 2.5f), 50 };
+        groundMesh->CreatePrimitive(&square);
+        MeshRenderer groundRenderer;
+        groundRenderer.mesh = groundMesh;
+        groundRenderer.castShadows = false;
+        addComponent(groundEntity, groundRenderer);
+    }
+
+    void createEntities() {
+        const float maxHeight = std::max(1.0f, m_Spec.extent * 0.25f);
+        for (int i = 0; i < m_Spec.entities; ++i) {
+            EntityID entity = createEntity();
+
+            Transform transform;
+            transform.position = randomPosition(0.5f, maxHeight);
+            transform.rotation = randomRotation();
+            transform.scale = glm::vec3(random(0.5f, 1.5f));
+            addComponent(entity, transform);
+
+            MeshRenderer renderer;
+            renderer.mesh = m_Meshes[i % m_Meshes.size()];
+            addComponent(entity, renderer);
+
+            // entity i moves when the running count of animated entities steps up: evenly spread
+            const float fraction = m_Spec.animatedFraction;
+            if (static_cast<int>((i + 1) * fraction) > static_cast<int>(i * fraction))
+                addComponent(entity, createLoopAnimation());
+        }
+    }
+
+    Animation createLoopAnimation() {
+        // closed loop around the origin, collectRenderCommands adds the position of the Transform
+        std::vector<glm::vec3> points;
+        const float radius = random(1.0f, 4.0f);
+        for (int p = 0; p < 6; ++p) {
+            const float angle = glm::radians(60.0f * static_cast<float>(p));
+            points.push_back(glm::vec3(radius * cos(angle), random(-0.5f, 0.5f), radius * sin(angle)));
+        }
+        std::vector<float> timestamp(points.size() + 1, random(0.5f, 2.0f));
+
+        Animation animation;
+        animation.animation = std::make_unique<BSplineAnimation>(points, timestamp, true);
+        return animation;
+    }
+
+    void createInstancedGroups() {
+        const float spread = std::max(1.0f, m_Spec.extent * 0.25f);
+        for (int g = 0; g < m_Spec.instancedGroups; ++g) {
+            const glm::vec3 center = randomPosition(spread, 2.0f * spread);
+            std::vector<glm::mat4> instanceMatrices;
+            instanceMatrices.reserve(m_Spec.groupSize);
+            for (int i = 0; i < m_Spec.groupSize; ++i) {
+                const float x = random(-spread, spread);
+                const float y = random(-spread, spread);
+                const float z = random(-spread, spread);
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), center + glm::vec3(x, y, z));
+                model = model * glm::mat4_cast(randomRotation());
+                model = glm::scale(model, glm::vec3(random(0.5f, 1.5f)));
+                instanceMatrices.push_back(model);
+            }
+            if (instanceMatrices.empty())
+                continue;
+
+            EntityID groupEntity = createEntity();
+            InstancedMeshRenderer instancedRenderer;
+            instancedRenderer.mesh = m_Meshes[g % m_Meshes.size()];
+            instancedRenderer.instances = std::make_shared<InstanceSet>(instanceMatrices);
+            addComponent(groupEntity, std::move(instancedRenderer));
+        }
+    }
+
+    void createLights() {
+        // --- Create Sun Light ---
+        EntityID sun = createEntity();
+        DirLight sunLight = {
+            glm::vec3(0.0f, -1.0f, -1.0f), glm::vec3(0.0f, 10.f, 0.0f),
+            glm::vec3(0.5f), glm::vec3(0.5f), glm::vec3(0.3f),
+            0.1f, 100.f
+        };
+        addComponent(sun, sunLight);
+
+        // --- Create Point Lights ---
+        for (int i = 0; i < m_Spec.pointLights; ++i) {
+            EntityID lightEntity = createEntity();
+            const glm::vec3 color = colors[i % colors.size()];
+            PointLight pointLight(randomPosition(2.0f, 10.0f), 0.1f * color, 0.8f * color, glm::vec3(1.0f), 1.0f, 25.0f);
+            addComponent(lightEntity, pointLight);
+        }
+
+        // --- Create Spot Lights ---
+        const glm::vec2 cut = glm::vec2(glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(17.5f)));
+        const glm::vec3 attenuation = glm::vec3(1.0f, 0.09f, 0.032f);
+        for (int i = 0; i < m_Spec.spotLights; ++i) {
+            EntityID lightEntity = createEntity();
+            const glm::vec3 color = colors[i % colors.size()];
+            const glm::vec3 position = randomPosition(8.0f, 20.0f);
+            const float x = random(-0.3f, 0.3f);
+            const float z = random(-0.3f, 0.3f);
+            SpotLight spotLight(
+                position, glm::vec3(x, -1.0f, z),
+                color * 0.1f, color, color * 0.5f,
+                1.0f, 25.0f, cut, attenuation
+            );
+            addComponent(lightEntity, spotLight);
+        }
+    }
+};
+
+#endif // !STRESS_SCENE_H
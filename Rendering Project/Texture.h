@@ -7,6 +7,7 @@
 #include "stb_image.h"
 //#include "utilities.h"
 #include "Debugging.h"
+#include "CpuProfiler.h"
 #include <string>
 #include "Shader.h"
 
@@ -17,8 +18,10 @@
 #define NORMAL_TEXTURE_UNIT 2
 #define ALPHA_TEXTURE_UNIT 3
 #define SHADOW_MAP_DIR_UNIT 4
-#define SHADOW_MAP_CUBE_UNIT 5
-#define SHADOW_MAP_SPOT_UNIT 6
+#define SHADOW_ATLAS_UNIT 5
+#define SHADOW_MOMENTS_DIR_UNIT 6
+#define SHADOW_MOMENTS_ATLAS_UNIT 7
+#define SHADOW_MASK_UNIT 8 // and 9, see ShadowMaskFBO
 
 class Texture {
 private:
@@ -56,6 +59,7 @@ public:
         height{ 0 },
         nrComponents{ 0 }
     {
+        PROFILE_SCOPE("Texture::load");
         glGenTextures(1, &ID);
         GL_CHECK();
         // STB loading code
@@ -116,21 +120,21 @@ public:
     // Binds a texture
     void Bind()
     {
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(type, ID);
+        GLState::ActiveTexture(GL_TEXTURE0 + slot);
+        GLState::BindTexture(type, ID);
         GL_CHECK();
     }
     // Unbinds a texture
     void Unbind()
     {
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(type, 0);
+        GLState::ActiveTexture(GL_TEXTURE0 + slot);
+        GLState::BindTexture(type, 0);
         GL_CHECK();
     }
     // Deletes a texture
     void Delete()
     {
-        glDeleteTextures(1, &ID);
+        GLState::DeleteTextures(1, &ID);
     }
 };
 
@@ -145,11 +149,12 @@ public:
 
     // The load function now ONLY loads the texture data
     void load(const char* path, const std::vector<std::string>& faces, GLint texSlot = 0) {
+        PROFILE_SCOPE("Cubemap::load");
         if (faces.size() != 6) { /* error handling */ return; }
 
         slot = texSlot;
         glGenTextures(1, &ID);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
+        GLState::BindTexture(GL_TEXTURE_CUBE_MAP, ID);
 
         int width, height, nrChannels;
         std::string strpath = std::string(path);
@@ -186,22 +191,22 @@ public:
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0); // Unbind when done
+        GLState::BindTexture(GL_TEXTURE_CUBE_MAP, 0); // Unbind when done
     }
 
     void Bind() {
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
+        GLState::ActiveTexture(GL_TEXTURE0 + slot);
+        GLState::BindTexture(GL_TEXTURE_CUBE_MAP, ID);
     }
 
     void Unbind() {
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GLState::ActiveTexture(GL_TEXTURE0 + slot);
+        GLState::BindTexture(GL_TEXTURE_CUBE_MAP, 0);
     }
 
     void Delete() {
         if (ID != 0) {
-            glDeleteTextures(1, &ID);
+            GLState::DeleteTextures(1, &ID);
             ID = 0;
         }
     }
@@ -1,4 +1,6 @@
 #include "Utilities.h"
+#include "GLState.h"
+#include "CpuProfiler.h"
 
 
 GLuint loadTexture(const char* path);
@@ -203,6 +205,7 @@ MaterialPhong materialValues[] = {
 
 GLuint loadTexture(char const* path)
 {
+    PROFILE_SCOPE("loadTexture");
     GLuint textureID;
     glGenTextures(1, &textureID);
 
@@ -218,7 +221,7 @@ GLuint loadTexture(char const* path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -241,7 +244,7 @@ GLuint loadCubemap(char const* path, std::vector<std::string> faces)
 {
     GLuint textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     std::string strpath = std::string(path);
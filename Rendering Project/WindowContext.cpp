@@ -5,10 +5,17 @@
 
 #include "EntityComponentSysetm.h"
 
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 // to do delete the camera logic from all the code outside this one, and substitute it with this class  
 
 
-WindowContext::WindowContext(const int width, const  int height, const char* title):
+WindowContext::WindowContext(const int width, const  int height, const char* title, ContextMode mode):
+    m_mode(mode),
+    m_startTime(std::chrono::steady_clock::now()),
     m_width(width),
     m_height(height),
     m_camera(glm::vec3(0.0f, 0.0f, 3.0f)),
@@ -17,12 +24,24 @@ WindowContext::WindowContext(const int width, const  int height, const char* tit
 {
     snprintf(m_title, sizeof(m_title), "%s", title);
 
+    if (m_mode == ContextMode::Headless)
+        createHeadless();
+    else
+        createWindow();
+    setupState();
+}
+
+void WindowContext::createWindow()
+{
     if (!glfwInit()) {
         throw std::runtime_error("Failed to initialize GLFW");
     }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#if GL_DEBUG_LEVEL > 0
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -49,18 +68,106 @@ WindowContext::WindowContext(const int width, const  int height, const char* tit
     glfwSetCursorPosCallback(m_window, DispatchMouseCallback);
 
     glfwSetInputMode(m_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glViewport(0, 0, m_width, m_height);
+}
+
+void WindowContext::createHeadless()
+{
+#ifdef HEADLESS_EGL
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!getPlatformDisplay) {
+        throw std::runtime_error("EGL_EXT_platform_base is not supported");
+    }
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        throw std::runtime_error("Failed to initialize the surfaceless EGL display");
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(display);
+        throw std::runtime_error("EGL does not support desktop OpenGL");
+    }
+
+    // no config and no surface: the context only renders into framebuffer objects
+    const EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#if GL_DEBUG_LEVEL > 0
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        eglTerminate(display);
+        throw std::runtime_error("Failed to create a surfaceless OpenGL 4.5 context");
+    }
+    m_eglDisplay = display;
+    m_eglContext = context;
+
+    if (!gladLoadGL(reinterpret_cast<GLADloadfunc>(eglGetProcAddress))) {
+        throw std::runtime_error("Failed to initialize GLAD");
+    }
+    std::cout << "Headless context: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+
+    // the offscreen default framebuffer, every bind of 0 lands here
+    glCreateRenderbuffers(1, &m_offscreenColor);
+    glNamedRenderbufferStorage(m_offscreenColor, GL_RGBA8, m_width, m_height);
+    glCreateRenderbuffers(1, &m_offscreenDepth);
+    glNamedRenderbufferStorage(m_offscreenDepth, GL_DEPTH24_STENCIL8, m_width, m_height);
+    glCreateFramebuffers(1, &m_offscreenFbo);
+    glNamedFramebufferRenderbuffer(m_offscreenFbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_offscreenColor);
+    glNamedFramebufferRenderbuffer(m_offscreenFbo, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_offscreenDepth);
+    if (glCheckNamedFramebufferStatus(m_offscreenFbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("The offscreen framebuffer is not complete");
+    }
+    GLState::SetDefaultFramebuffer(m_offscreenFbo);
+#else
+    throw std::runtime_error("Headless mode not built, configure with -DHEADLESS=ON");
+#endif
+}
+
+void WindowContext::destroyHeadless()
+{
+#ifdef HEADLESS_EGL
+    if (!m_eglContext)
+        return;
+    GLState::SetDefaultFramebuffer(0);
+    GLState::DeleteFramebuffers(1, &m_offscreenFbo);
+    glDeleteRenderbuffers(1, &m_offscreenColor);
+    glDeleteRenderbuffers(1, &m_offscreenDepth);
+    m_offscreenFbo = m_offscreenColor = m_offscreenDepth = 0;
+
+    EGLDisplay display = static_cast<EGLDisplay>(m_eglDisplay);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, static_cast<EGLContext>(m_eglContext));
+    eglTerminate(display);
+    m_eglContext = nullptr;
+    m_eglDisplay = nullptr;
+#endif
+}
+
+void WindowContext::setupState()
+{
+    // a new context, nothing of the state is known
+    GLState::Invalidate();
+    GLState::QueryCaps();
+    GLDebug::Init();
+
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Viewport(0, 0, m_width, m_height);
 
     // Setup openGL variable 
-    glEnable(GL_BLEND);
+    GLState::Enable(GL_BLEND);
 
     // enable face culling
-    glEnable(GL_CULL_FACE);
+    GLState::Enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
     // set up GL_DEPTH_TEST
-    glEnable(GL_DEPTH_TEST);
+    GLState::Enable(GL_DEPTH_TEST);
 }
 
 WindowContext::~WindowContext()
@@ -70,15 +177,41 @@ WindowContext::~WindowContext()
 
 void WindowContext::close()
 {
-    if (m_window)
+    if (m_mode == ContextMode::Headless)
+        destroyHeadless();
+    else if (m_window)
     {
         glfwDestroyWindow(m_window);
         glfwTerminate();
+        m_window = nullptr;
     }
 }
+
+double WindowContext::now() const
+{
+    if (m_fixedStep > 0.0)
+        return m_simulatedTime;
+    if (m_mode == ContextMode::Headless)
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+    return glfwGetTime();
+}
+
+void WindowContext::requestClose()
+{
+    m_closeRequested = true;
+}
+
+void WindowContext::readPixels(std::vector<uint8_t>& rgba) const
+{
+    rgba.resize(static_cast<size_t>(m_width) * static_cast<size_t>(m_height) * 4);
+    GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+}
+
 void WindowContext::updateTitle()
 {
-    float currentFrame = static_cast<float>(glfwGetTime());
+    float currentFrame = static_cast<float>(now());
     m_deltaTime = currentFrame - m_lastFrame;
     m_lastFrame = currentFrame;
 
@@ -88,16 +221,19 @@ void WindowContext::updateTitle()
         m_fps = m_frameCount / (fps_deltatime);
         m_frameCount = 0; 
         m_fps_lastFrame = currentFrame;
-       
+        if (m_mode == ContextMode::Headless)
+            return;
 
-        // Update window title with FPS
-        char title[64];
+        // Update window title with FPS and the GL calls dropped by the state cache in the last frame
+        char title[128];
         // This creates a std::string
-        std::string formatted_str = std::format("{} | FPS: {:.1f}", m_title, m_fps);
+        const GLState::Stats& glCalls = GLState::GetFrameStats();
+        std::string formatted_str = std::format("{} | FPS: {:.1f} | GL state calls skipped: {}/{}", m_title, m_fps,
+            glCalls.skipped, glCalls.skipped + glCalls.issued);
 
         // Copy it to your C-style buffer
-        strncpy(title, formatted_str.c_str(), 64 - 1);
-        title[64 - 1] = '\0';
+        strncpy(title, formatted_str.c_str(), 128 - 1);
+        title[128 - 1] = '\0';
         glfwSetWindowTitle(m_window, title);
     }
 }
@@ -105,11 +241,15 @@ void WindowContext::updateTitle()
 
 bool WindowContext::shouldClose() const
 {
-    return glfwWindowShouldClose(m_window);
+    if (m_mode == ContextMode::Headless)
+        return m_closeRequested;
+    return m_closeRequested || glfwWindowShouldClose(m_window);
 }
 
 void WindowContext::processInput()
 {
+    if (m_mode == ContextMode::Headless)
+        return;
     if (glfwGetKey(m_window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(m_window, true);
 
@@ -123,8 +263,18 @@ void WindowContext::processInput()
 
 void WindowContext::swapBuffersAndPollEvents()
 {
-    glfwSwapBuffers(m_window);
-    glfwPollEvents();
+    if (m_mode == ContextMode::Headless)
+    {
+        // nothing to present, the wait stands in for the throttle of the swap
+        glFinish();
+    }
+    else
+    {
+        glfwSwapBuffers(m_window);
+        glfwPollEvents();
+    }
+    m_simulatedTime += m_fixedStep;
+    GLState::EndFrame();
 }
 
 Camera& WindowContext::getCamera()
@@ -134,13 +284,13 @@ Camera& WindowContext::getCamera()
 
 float WindowContext::getDeltaTime()
 {
-    float currentFrame = static_cast<float>(glfwGetTime());
+    float currentFrame = static_cast<float>(now());
     m_deltaTime = currentFrame - m_lastFrame;
     m_lastFrame = currentFrame;
     return m_deltaTime;
 }
 
-float WindowContext::getTotalTime() const { return  static_cast<float>(glfwGetTime()); }
+float WindowContext::getTotalTime() const { return  static_cast<float>(now()); }
 
 void WindowContext::linkScene(Scene* scene)
 {
@@ -155,7 +305,7 @@ void WindowContext::onResize(int width, int height)
     {
         m_width = width;
         m_height = height;
-        glViewport(0, 0, width, height);
+        GLState::Viewport(0, 0, width, height);
 
         // Se una scena  collegata, inoltra la chiamata di resize
         if (m_linkedScene)
@@ -7,14 +7,27 @@
 #include <GLFW/glfw3.h>
 #include "Camera.h"
 
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
 class Scene;  // avoid circular include #include "EntityComponentSysetm.h"
 
 
+// Window: GLFW window and context. Headless: surfaceless EGL context (Mesa llvmpipe works, no display
+// needed) that renders into an offscreen framebuffer bound in place of 0, the size never changes and
+// there is no input; only built with the CMake option HEADLESS (Linux).
+enum class ContextMode
+{
+    Window,
+    Headless
+};
+
 // this class has the of abstracting the handling of the 
 class WindowContext
 {
 public:
-    WindowContext(const int width, const int height, const char* title);
+    WindowContext(const int width, const int height, const char* title, ContextMode mode = ContextMode::Window);
     ~WindowContext();
 
     // disable copy clone
@@ -36,6 +49,14 @@ public:
     // Metodo per collegare la scena per le callback
     void linkScene(Scene* scene);
 
+    bool isHeadless() const { return m_mode == ContextMode::Headless; }
+    // a step > 0 replaces the real clock: the time advances by step at every swap (deterministic animations)
+    void setFixedTimeStep(double step) { m_fixedStep = step; }
+    // shouldClose returns true from the next check
+    void requestClose();
+    // RGBA8 of the default framebuffer (the offscreen one when headless), bottom row first
+    void readPixels(std::vector<uint8_t>& rgba) const;
+
     void close();
 
 private:
@@ -47,8 +68,25 @@ private:
     static void DispatchResizeCallback(GLFWwindow* window, int width, int height);
     static void DispatchMouseCallback(GLFWwindow* window, double xpos, double ypos);
 
+    void createWindow();
+    void createHeadless();
+    void destroyHeadless();
+    void setupState();
+    double now() const;
+
 private:
     GLFWwindow* m_window = nullptr;
+    ContextMode m_mode;
+    // headless context, EGLDisplay and EGLContext kept opaque to not include EGL everywhere
+    void* m_eglDisplay = nullptr;
+    void* m_eglContext = nullptr;
+    GLuint m_offscreenFbo = 0;
+    GLuint m_offscreenColor = 0;
+    GLuint m_offscreenDepth = 0;
+    bool m_closeRequested = false;
+    double m_fixedStep = 0.0;
+    double m_simulatedTime = 0.0;
+    std::chrono::steady_clock::time_point m_startTime;
     Scene* m_linkedScene = nullptr; // Puntatore alla scena per il resize
     Camera m_camera;
 
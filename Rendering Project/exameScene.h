@@ -258,7 +258,7 @@ private:
             smallSiland2MS->LoadMesh(getAssetFullPath("flying_island/scene.gltf").c_str());
             InstancedMeshRenderer instancedCubeRenderer;
             instancedCubeRenderer.mesh = smallSiland2MS;
-            instancedCubeRenderer.instanceMatrices = instanceMatrices;
+            instancedCubeRenderer.instances = std::make_shared<InstanceSet>(instanceMatrices);
             addComponent(smallSiland2ID, std::move(instancedCubeRenderer));
         }
 
@@ -297,7 +297,7 @@ private:
             smallSiland2MS->LoadMesh(getAssetFullPath("flying_island_2/scene.gltf").c_str());
             InstancedMeshRenderer instancedCubeRenderer;
             instancedCubeRenderer.mesh = smallSiland2MS;
-            instancedCubeRenderer.instanceMatrices = instanceMatrices;
+            instancedCubeRenderer.instances = std::make_shared<InstanceSet>(instanceMatrices);
             addComponent(smallSiland2ID, std::move(instancedCubeRenderer));
         }
 
@@ -338,7 +338,7 @@ private:
             //smallSiland2MS->LoadMesh(getAssetFullPath("the_last_stronghold_animated/scene.gltf").c_str());
             InstancedMeshRenderer instancedCubeRenderer;
             instancedCubeRenderer.mesh = smallSiland2MS;
-            instancedCubeRenderer.instanceMatrices = instanceMatrices;
+            instancedCubeRenderer.instances = std::make_shared<InstanceSet>(instanceMatrices);
             //addComponent(smallSiland2ID, std::move(instancedCubeRenderer));
         }
 
@@ -397,7 +397,7 @@ private:
         //    barrelMesh->SetupInstancedArrays(instanceMatrices);
         //    InstancedMeshRenderer instancedCubeRenderer;
         //    instancedCubeRenderer.mesh = barrelMesh;
-        //    instancedCubeRenderer.instanceMatrices = instanceMatrices;
+        //    instancedCubeRenderer.instances = std::make_shared<InstanceSet>(instanceMatrices);
         //    addComponent(instanceBarrelsID, std::move(instancedCubeRenderer));
         //}
     }
@@ -1,5 +1,7 @@
 #include "frameBufferObject.h"
 
+#include <algorithm>
+
 
 
 ShadowMapFBO::ShadowMapFBO(const unsigned int s_Width, const unsigned int s_Height) :
@@ -17,12 +19,12 @@ void ShadowMapFBO::clean()
 {
 	if (fbo != 0)
 	{
-		glDeleteFramebuffers(1, &fbo);
+		GLState::DeleteFramebuffers(1, &fbo);
 		fbo = 0;
 	}
 	if (depthbufferTexture != 0)
 	{
-		glDeleteTextures(1, &depthbufferTexture);
+		GLState::DeleteTextures(1, &depthbufferTexture);
 		depthbufferTexture = 0;
 	}
 }
@@ -35,7 +37,7 @@ void ShadowMapFBO::Init(std::shared_ptr<Shader> inShader)
 
 	// create  Depth texture
 	glGenTextures(1, &depthbufferTexture);
-	glBindTexture(GL_TEXTURE_2D, depthbufferTexture);
+	GLState::BindTexture(GL_TEXTURE_2D, depthbufferTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_Width, m_Height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
 	// Set texture parameters for shadow mapping
@@ -49,7 +51,7 @@ void ShadowMapFBO::Init(std::shared_ptr<Shader> inShader)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 
 	// attach to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthbufferTexture, 0);
 
 	// Disable read/writes to the color buffer
@@ -62,9 +64,9 @@ void ShadowMapFBO::Init(std::shared_ptr<Shader> inShader)
 		printf("FB error, status: 0x%x\n", Status);
 		throw 1;
 	}
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
 	GL_CHECK();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 	GL_CHECK();
 }
 
@@ -74,16 +76,16 @@ void ShadowMapFBO::resizeWindow(const unsigned int s_Width, const unsigned int s
 	m_Height = s_Height;
 
 	// Update the depth texture
-	glBindTexture(GL_TEXTURE_2D, depthbufferTexture);
+	GLState::BindTexture(GL_TEXTURE_2D, depthbufferTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, s_Width, s_Height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
 	// Verify framebuffer is still complete
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 	if (Status != GL_FRAMEBUFFER_COMPLETE) {
 		printf("FB error after resize, status: 0x%x\n", Status);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void ShadowMapFBO::BindForWriting()
@@ -94,25 +96,23 @@ void ShadowMapFBO::BindForWriting()
 		return;
 	}
 
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
 
-	glViewport(0, 0, m_Width, m_Height);
+	GLState::Viewport(0, 0, m_Width, m_Height);
 	GL_CHECK();
 }
 
 void ShadowMapFBO::BindForReading(GLint TextureUnit)
 {
 	// Validate texture unit to prevent invalid enum
-	GLint maxUnits;
-	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
-	if (TextureUnit < 0 || TextureUnit >= maxUnits) {
+	if (TextureUnit < 0 || TextureUnit >= GLState::GetCaps().maxCombinedTextureImageUnits) {
 		std::cerr << "Invalid texture unit: " << TextureUnit << std::endl;
 		return;
 	}
 
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit);
 
-	glBindTexture(GL_TEXTURE_2D, depthbufferTexture);
+	GLState::BindTexture(GL_TEXTURE_2D, depthbufferTexture);
 	GL_CHECK(); // Check after bind
 }
 
@@ -132,12 +132,12 @@ void ShadowMapArrayFBO::clean()
 {
 	if (fbo != 0)
 	{
-		glDeleteFramebuffers(1, &fbo);
+		GLState::DeleteFramebuffers(1, &fbo);
 		fbo = 0;
 	}
 	if (textureArray != 0)
 	{
-		glDeleteTextures(1, &textureArray);
+		GLState::DeleteTextures(1, &textureArray);
 		textureArray = 0;
 	}
 
@@ -159,7 +159,7 @@ void ShadowMapArrayFBO::Init(size_t Size, std::shared_ptr<Shader> inShader)
 
 	// create  Depth texture
 	glGenTextures(1, &textureArray);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
 
 	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, s_Width, s_Height, (GLsizei)size);
 
@@ -173,7 +173,7 @@ void ShadowMapArrayFBO::Init(size_t Size, std::shared_ptr<Shader> inShader)
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 
 	// attach to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureArray, 0, 0);
 
 	// Disable read/writes to the color buffer
@@ -186,9 +186,9 @@ void ShadowMapArrayFBO::Init(size_t Size, std::shared_ptr<Shader> inShader)
 		printf("FB error, status: 0x%x\n", Status);
 		throw 1;
 	}
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
 	GL_CHECK();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 	GL_CHECK();
 }
 
@@ -206,7 +206,7 @@ void ShadowMapArrayFBO::Init(size_t Size)
 
 	// create  Depth texture
 	glGenTextures(1, &textureArray);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
 
 	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, s_Width, s_Height, (GLsizei)size);
 
@@ -220,7 +220,7 @@ void ShadowMapArrayFBO::Init(size_t Size)
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 
 	// attach to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureArray, 0, 0);
 
 	// Disable read/writes to the color buffer
@@ -233,9 +233,9 @@ void ShadowMapArrayFBO::Init(size_t Size)
 		printf("FB error, status: 0x%x\n", Status);
 		throw 1;
 	}
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
 	GL_CHECK();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 	GL_CHECK();
 }
 
@@ -250,258 +250,48 @@ void ShadowMapArrayFBO::resizeWindow(const unsigned int WIDTH, const unsigned in
 	s_Height = HEIGHT;
 
 	// Update the depth texture
-	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
 	glTexImage2D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, s_Width, s_Height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
 	// Verify framebuffer is still complete
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 	if (Status != GL_FRAMEBUFFER_COMPLETE) {
 		printf("FB error after resize, status: 0x%x\n", Status);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void ShadowMapArrayFBO::BindLayerForWriting(int layerIndex)
 {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
 	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureArray, 0, layerIndex);
-	glViewport(0, 0, s_Width, s_Height);
+	GLState::Viewport(0, 0, s_Width, s_Height);
 	GL_CHECK();
 }
 
-void ShadowMapArrayFBO::BindForReading(GLint TextureUnit)
-{
-	// Validate texture unit to prevent invalid enum
-	GLint maxUnits;
-	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
-	if (TextureUnit < 0 || TextureUnit >= maxUnits) {
-		std::cerr << "Invalid texture unit: " << TextureUnit << std::endl;
-		return;
-	}
-
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
-
-	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
-	GL_CHECK(); // Check after bind
-}
-
-// ShadowMAP FBO for point light that means to use a cube texture instead a normal texture 
-// in addiction use the gemoetry shader for loat every thing in a single step
-
-ShadowMapCubeFBO::ShadowMapCubeFBO(const unsigned int SIZE) :
-	s_SIZE{ SIZE }
-{
-	;
-}
-ShadowMapCubeFBO::~ShadowMapCubeFBO()
-{
-	clean();
-}
-void ShadowMapCubeFBO::clean()
-{
-	if (fbo != 0)
-	{
-		glDeleteFramebuffers(1, &fbo);
-		fbo = 0;
-	}
-	if (depthCubemap != 0)
-	{
-		glDeleteTextures(1, &depthCubemap);
-		depthCubemap = 0;
-	}
-}
-
-void ShadowMapCubeFBO::resizeWindow(const unsigned int WIDTH, const unsigned int HEIGHT) {}
-
-void ShadowMapCubeFBO::Init(size_t MAX_LIGHTS, std::shared_ptr<Shader> inShader)
+void ShadowMapArrayFBO::BindAllLayersForWriting()
 {
-	//clean();
-	shader = std::move(inShader);
-
-	// Validate maxLights
-	if (maxLights == 0) {
-		printf("Error: Array size cannot be zero\n");
-		throw 1;
-	}
-	maxLights = MAX_LIGHTS;
-	// Generate FBO
-	glGenFramebuffers(1, &fbo);
-
-	// Generate the cubemap
-	glGenTextures(1, &depthCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depthCubemap);
-
-	// Allocate storage for all cube maps
-	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT,
-		s_SIZE, s_SIZE, maxLights * 6, 0,
-		GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-	// Set texture parameters
-	// Set texture parameters for shadow mapping 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	// Enable shadow comparison
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-
-	// Attach cubemap to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
-
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-
-
-	// Check completeness
-	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-	if (Status != GL_FRAMEBUFFER_COMPLETE) {
-		printf("FB error, status: 0x%x\n", Status);
-		throw 1;
-	}
-
-	// unbind buffer for avoid malicious use 
-	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
-	GL_CHECK();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureArray, 0);
+	GLState::Viewport(0, 0, s_Width, s_Height);
 	GL_CHECK();
-
 }
 
-void ShadowMapCubeFBO::SetupShader(std::shared_ptr<Shader> inShader)
-{
-	shader = std::move(inShader);
-}
-
-void ShadowMapCubeFBO::Init( size_t MAX_LIGHTS)
-{
-	//clean();
-	// Validate maxLights
-	if (MAX_LIGHTS == 0) {
-		printf("Error: maxLights size cannot be zero\n");
-		throw 1;
-	}
-	maxLights = MAX_LIGHTS;
-	// Generate FBO
-	glGenFramebuffers(1, &fbo);
-
-	// Generate the cubemap
-	glGenTextures(1, &depthCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depthCubemap);
-
-	// Allocate storage for all cube maps
-	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT,
-		s_SIZE, s_SIZE, maxLights * 6, 0,
-		GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-	// Set texture parameters
-	// Set texture parameters for shadow mapping 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	// Enable shadow comparison
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-
-	// Attach cubemap to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
-
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-
-
-	// Check completeness
-	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-	if (Status != GL_FRAMEBUFFER_COMPLETE) {
-		printf("FB error, status: 0x%x\n", Status);
-		throw 1;
-	}
-
-	// unbind buffer for avoid malicious use 
-	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
-	GL_CHECK();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	GL_CHECK();
-}
-void ShadowMapCubeFBO::BindForWriting(int lightIndex)
-{
-	// Additional validation checks
-	if (fbo == 0) {
-		std::cerr << "Error: Invalid framebuffer object in Writing" << std::endl;
-		return;
-	}
-
-	// This is the key change - we'll handle array indexing in geometry shader
-	currentLightIndex = lightIndex;
-
-	// bind framebuffer for drawing 
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
-	GL_CHECK();
-
-	// setup the size of the window
-	glViewport(0, 0, s_SIZE, s_SIZE);
-	GL_CHECK();
-}
-void ShadowMapCubeFBO::BindForReading(GLint TextureUnit)
+void ShadowMapArrayFBO::BindForReading(GLint TextureUnit)
 {
-	// Check if texture is valid
-	if (depthCubemap == 0) {
-		std::cerr << "depthCubemap is 0 (uninitialized)" << std::endl;
-		return;
-	}
-
-	if (!glIsTexture(depthCubemap)) {
-		std::cerr << "depthCubemap is not a valid texture object" << std::endl;
-		return;
-	}
-
-	// Your existing validation code...
-	GLint maxUnits;
-	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
-	if (TextureUnit < 0 || TextureUnit >= maxUnits) {
+	// Validate texture unit to prevent invalid enum
+	if (TextureUnit < 0 || TextureUnit >= GLState::GetCaps().maxCombinedTextureImageUnits) {
 		std::cerr << "Invalid texture unit: " << TextureUnit << std::endl;
 		return;
 	}
 
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depthCubemap);
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit);
 
-	// Check for errors after binding
-	GLenum error = glGetError();
-	if (error != GL_NO_ERROR) {
-		std::cerr << "glBindTexture error: " << error << std::endl;
-	}
-}
-
-void ShadowMapCubeFBO::setupUniformShader(const PointLight* light)
-{
-	glm::vec3 lightPos = light->Pos;
-	glm::mat4 shadowProj = light->Projection;
-	shader->setVec3("lightPos", lightPos);
-	shader->setFloat("far_plane", light->far_plane);
-
-
-	std::vector<glm::mat4> shadowTransforms;
-	shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(1.0f, 0.0f, 0.0f)), glm::vec3(0.0f, -1.0f, 0.0f)));
-	shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(-1.0f, 0.0f, 0.0f)), glm::vec3(0.0f, -1.0f, 0.0f)));
-	shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(0.0f, 0.0f, 1.0f)));
-	shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, -1.0f, 0.0f)), glm::vec3(0.0f, 0.0f, -1.0f)));
-	shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, 0.0f, 1.0f)), glm::vec3(0.0f, -1.0f, 0.0f)));
-	shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, (lightPos + glm::vec3(0.0f, 0.0f, -1.0f)), glm::vec3(0.0f, -1.0f, 0.0f)));
-
-	for (unsigned int i = 0; i < 6; ++i)
-		shader->setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	GL_CHECK(); // Check after bind
 }
 
-
 ShadowMapPointDirFBO::ShadowMapPointDirFBO(const unsigned int SIZE, const unsigned int WIDTH, const unsigned int HEIGHT) :
 	P_SIZE{ SIZE },
 	D_WIDTH{ WIDTH },
@@ -517,17 +307,17 @@ void ShadowMapPointDirFBO::clean()
 {
 	if (fbo != 0)
 	{
-		glDeleteFramebuffers(1, &fbo);
+		GLState::DeleteFramebuffers(1, &fbo);
 		fbo = 0;
 	}
 	if (depthPointMap != 0)
 	{
-		glDeleteTextures(1, &depthPointMap);
+		GLState::DeleteTextures(1, &depthPointMap);
 		depthPointMap = 0;
 	}
 	if (depthDirMap != 0)
 	{
-		glDeleteTextures(1, &depthDirMap);
+		GLState::DeleteTextures(1, &depthDirMap);
 		depthDirMap = 0;
 	}
 }
@@ -542,7 +332,7 @@ void ShadowMapPointDirFBO::Init(std::shared_ptr<Shader> inShader)
 
 	// Generate the cubemap
 	glGenTextures(1, &depthPointMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, depthPointMap);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, depthPointMap);
 
 	for (unsigned int i = 0; i < 6; ++i)
 	{
@@ -564,13 +354,13 @@ void ShadowMapPointDirFBO::Init(std::shared_ptr<Shader> inShader)
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
 	// Attach cubemap to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthPointMap, 0);
 
 
 	// create  Depth texture
 	glGenTextures(1, &depthDirMap);
-	glBindTexture(GL_TEXTURE_2D, depthDirMap);
+	GLState::BindTexture(GL_TEXTURE_2D, depthDirMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, D_WIDTH, D_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
 	// Set texture parameters for shadow mapping
@@ -584,7 +374,7 @@ void ShadowMapPointDirFBO::Init(std::shared_ptr<Shader> inShader)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 
 	// attach to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthDirMap, 0);
 
 	glDrawBuffer(GL_NONE);
@@ -599,11 +389,11 @@ void ShadowMapPointDirFBO::Init(std::shared_ptr<Shader> inShader)
 	}
 
 	// unbind buffer for avoid malicious use 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 	GL_CHECK();
 
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 	GL_CHECK();
 
 }
@@ -615,26 +405,24 @@ void ShadowMapPointDirFBO::BindForWriting()
 		return;
 	}
 	// bind framebuffer for drawing 
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
 	GL_CHECK();
 
 	// setup the size of the window
-	glViewport(0, 0, P_SIZE, P_SIZE);
+	GLState::Viewport(0, 0, P_SIZE, P_SIZE);
 	GL_CHECK();
 }
 void ShadowMapPointDirFBO::BindForReading(GLint TextureUnit)
 {
 	// Validate texture unit to prevent invalid enum
-	GLint maxUnits;
-	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
-	if (TextureUnit < 0 || TextureUnit >= maxUnits) {
+	if (TextureUnit < 0 || TextureUnit >= GLState::GetCaps().maxCombinedTextureImageUnits) {
 		std::cerr << "Invalid texture unit: " << TextureUnit << std::endl;
 		return;
 	}
 
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, depthPointMap);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, depthPointMap);
 	GL_CHECK(); // Check after bind
 }
 void ShadowMapPointDirFBO::setupUniformShader(Shader* shader, PointLight* light)
@@ -665,77 +453,75 @@ MultisampleFramebuffer::MultisampleFramebuffer(int s_Width, int s_Height, int sa
 
 MultisampleFramebuffer::~MultisampleFramebuffer()
 {
-	glDeleteTextures(1, &textureColorBufferMultiSampled);
-	glDeleteRenderbuffers(1, &rbo);
+	GLState::DeleteTextures(1, &textureColorBufferMultiSampled);
+	GLState::DeleteTextures(1, &depthBufferMultiSampled);
+	GLState::DeleteFramebuffers(1, &framebufferMSSA);
 }
 void MultisampleFramebuffer::init()
 {
 	
 	// Generate framebuffer
 	glGenFramebuffers(1, &framebufferMSSA);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebufferMSSA);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebufferMSSA);
+	GLDebug::Label(GL_FRAMEBUFFER, framebufferMSSA, "Multisample");
+
+	createAttachments();
 
+	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (Status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("FB error, status: 0x%x\n", Status);
+		throw 1;
+	}
+
+	// Unbind framebuffer
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void MultisampleFramebuffer::createAttachments()
+{
 	// Create multisampled color texture
 	glGenTextures(1, &textureColorBufferMultiSampled);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled);
+	GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled);
 	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGB, m_Width, m_Height, GL_TRUE);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled, 0);
 
-	// Create renderbuffer
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, m_Width, m_Height);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-
-	// Unbind framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Create multisampled depth texture, a texture and not a renderbuffer so the compute shaders can read it
+	glGenTextures(1, &depthBufferMultiSampled);
+	GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthBufferMultiSampled);
+	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_DEPTH24_STENCIL8, m_Width, m_Height, GL_TRUE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, depthBufferMultiSampled, 0);
+	GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 }
 
-
 void MultisampleFramebuffer::blit()
 {
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferMSSA);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, framebufferMSSA);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 	glBlitFramebuffer(0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 }
 void MultisampleFramebuffer::bind()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, framebufferMSSA);
-	glViewport(0, 0, m_Width, m_Height);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebufferMSSA);
+	GLState::Viewport(0, 0, m_Width, m_Height);
 }
 void MultisampleFramebuffer::resize(int s_Width, int s_Height)
 {
 	m_Width = s_Width;
 	m_Height = s_Height;
 	// Delete old resources
-	glDeleteTextures(1, &textureColorBufferMultiSampled);
-	glDeleteRenderbuffers(1, &rbo);
+	GLState::DeleteTextures(1, &textureColorBufferMultiSampled);
+	GLState::DeleteTextures(1, &depthBufferMultiSampled);
 
 	// Recreate with new dimensions
-	glBindFramebuffer(GL_FRAMEBUFFER, framebufferMSSA);
-
-	// Recreate multisampled color texture
-	glGenTextures(1, &textureColorBufferMultiSampled);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled);
-	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGB, m_Width, m_Height, GL_TRUE);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled, 0);
-
-	// Recreate renderbuffer
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, m_Width, m_Height);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebufferMSSA);
+	createAttachments();
 
 	// Verify framebuffer is still complete
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 		std::cout << "ERROR::FRAMEBUFFER:: MSAA Framebuffer resize failed!" << std::endl;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
@@ -752,9 +538,12 @@ void GBufferFBO::Init(int s_Width, int s_Height)
 //	clean();
 	m_Width = s_Width;
 	m_Height = s_Height;
+	m_RenderWidth = s_Width;
+	m_RenderHeight = s_Height;
 	// Generate FBO
 	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLDebug::Label(GL_FRAMEBUFFER, fbo, "GBuffer");
 
 	// Create all textures
 	createTextures();
@@ -773,37 +562,95 @@ void GBufferFBO::Init(int s_Width, int s_Height)
 	shaderGeom = std::make_shared<Shader>();
 	shaderLighting = std::make_shared<Shader>();
 	shaderInstanced = std::make_shared<Shader>();
+	shaderIndirect = std::make_shared<Shader>();
+	shaderShadowMask = std::make_shared<Shader>();
+	loadShaders();
+}
+
+void GBufferFBO::loadShaders()
+{
+	const std::string layout = m_Layout == GBufferLayout::Compact ? "#define GBUFFER_COMPACT\n" : "";
+	shaderGeom->setDefines(layout);
+	shaderInstanced->setDefines(layout);
+	shaderIndirect->setDefines(layout);
+	shaderLighting->setDefines(layout);
+	shaderShadowMask->setDefines(layout + "#define SHADOW_MASK_PASS\n");
 	// create shader object 
 	shaderGeom->load(getShaderFullPath("Geometry_pass.vert").c_str(), getShaderFullPath("Geometry_pass.frag").c_str() );
 	shaderInstanced->load(getShaderFullPath("Geometry_pass_instanced.vert").c_str(), getShaderFullPath("Geometry_pass.frag").c_str() );
+	shaderIndirect->load(getShaderFullPath("Geometry_pass_indirect.vert").c_str(), getShaderFullPath("Geometry_pass_indirect.frag").c_str() );
 	shaderLighting->load(getShaderFullPath("Lighting_pass_test.vert").c_str(), getShaderFullPath("Lighting_pass_test.frag").c_str() );
+	shaderShadowMask->load(getShaderFullPath("Lighting_pass_test.vert").c_str(), getShaderFullPath("Lighting_pass_test.frag").c_str() );
+}
 
+void GBufferFBO::SetLayout(GBufferLayout layout)
+{
+	if (layout == m_Layout)
+		return;
+	m_Layout = layout;
+	if (fbo == 0)
+		return;
+	Resize(m_Width, m_Height);
+	loadShaders();
 }
 
-void GBufferFBO::createTextures() {
-	// Position + linear depth color buffer 
-	glGenTextures(1, &gPosition);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, m_Width, m_Height, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
+size_t GBufferFBO::BytesPerPixel(GBufferLayout layout)
+{
+	// color targets + 24 bit depth (stored in 4 bytes)
+	if (layout == GBufferLayout::Compact)
+		return 1 + 4 + 4 + 4;
+	return 6 + 8 + 4 + 4;
+}
 
-	// Normal + shininess color buffer
-	glGenTextures(1, &gNormalShiness);
-	glBindTexture(GL_TEXTURE_2D, gNormalShiness);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, m_Width, m_Height, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormalShiness, 0);
+void GBufferFBO::createTextures() {
+	if (m_Layout == GBufferLayout::Compact)
+	{
+		// Shininess, log2 encoded in 8 bits (the position is reconstructed from the depth)
+		glGenTextures(1, &gShininess);
+		GLState::BindTexture(GL_TEXTURE_2D, gShininess);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_Width, m_Height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gShininess, 0);
+
+		// Octahedral normal color buffer
+		glGenTextures(1, &gNormalShiness);
+		GLState::BindTexture(GL_TEXTURE_2D, gNormalShiness);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, m_Width, m_Height, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormalShiness, 0);
+	}
+	else
+	{
+		// Position + linear depth color buffer 
+		glGenTextures(1, &gPosition);
+		GLState::BindTexture(GL_TEXTURE_2D, gPosition);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, m_Width, m_Height, 0, GL_RGB, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
+
+		// Normal + shininess color buffer
+		glGenTextures(1, &gNormalShiness);
+		GLState::BindTexture(GL_TEXTURE_2D, gNormalShiness);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, m_Width, m_Height, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormalShiness, 0);
+	}
 
 	// Color + specular color buffer
 	glGenTextures(1, &gColorSpec);
-	glBindTexture(GL_TEXTURE_2D, gColorSpec);
+	GLState::BindTexture(GL_TEXTURE_2D, gColorSpec);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -815,7 +662,7 @@ void GBufferFBO::createTextures() {
 void GBufferFBO::createDepthBuffer() {
 	// Create depth renderbuffer
 	glGenTextures(1, &depthBuffer);
-	glBindTexture(GL_TEXTURE_2D, depthBuffer);
+	GLState::BindTexture(GL_TEXTURE_2D, depthBuffer);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_Width, m_Height,
 		0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -825,48 +672,53 @@ void GBufferFBO::createDepthBuffer() {
 
 	// Attach as depth attachment
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthBuffer, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
 }
 
 
 void GBufferFBO::BindForWriting()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glViewport(0, 0, m_Width, m_Height);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::Viewport(0, 0, m_RenderWidth, m_RenderHeight);
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Keep it black so it doesn't leak into g-buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void GBufferFBO::UnBind()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 void GBufferFBO::BindForReading(GLint TextureUnit) {
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
+	// the compact layout has the shininess in the slot of the position
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit);
+	GLState::BindTexture(GL_TEXTURE_2D, m_Layout == GBufferLayout::Compact ? gShininess : gPosition);
 
-	glActiveTexture(GL_TEXTURE0 + TextureUnit + 1);
-	glBindTexture(GL_TEXTURE_2D, gNormalShiness);
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit + 1);
+	GLState::BindTexture(GL_TEXTURE_2D, gNormalShiness);
 
-	glActiveTexture(GL_TEXTURE0 + TextureUnit + 2);
-	glBindTexture(GL_TEXTURE_2D, gColorSpec);
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit + 2);
+	GLState::BindTexture(GL_TEXTURE_2D, gColorSpec);
 
-	glActiveTexture(GL_TEXTURE0 + TextureUnit + 3);
-	glBindTexture(GL_TEXTURE_2D, depthBuffer);
+	GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit + 3);
+	GLState::BindTexture(GL_TEXTURE_2D, depthBuffer);
 }
 
 void GBufferFBO::Resize(int s_Width, int s_Height) 
 {
 	m_Height = s_Height;
-	m_Width = m_Width;
+	m_Width = s_Width;
+	m_RenderWidth = std::min(m_RenderWidth, m_Width);
+	m_RenderHeight = std::min(m_RenderHeight, m_Height);
 	// Delete old textures and renderbuffer
-	glDeleteTextures(1, &gPosition);
-	glDeleteTextures(1, &gNormalShiness);
-	glDeleteTextures(1, &gColorSpec);
-	glDeleteTextures(1, &depthBuffer);
+	GLState::DeleteTextures(1, &gPosition);
+	GLState::DeleteTextures(1, &gShininess);
+	GLState::DeleteTextures(1, &gNormalShiness);
+	GLState::DeleteTextures(1, &gColorSpec);
+	GLState::DeleteTextures(1, &depthBuffer);
+	gPosition = gShininess = 0;
 
 	// Bind framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
 
 	// Recreate textures with new dimensions
 	createTextures();
@@ -883,14 +735,20 @@ void GBufferFBO::Resize(int s_Width, int s_Height)
 		std::cout << "ERROR::FRAMEBUFFER:: GBuffer framebuffer resize failed!" << std::endl;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
+void GBufferFBO::SetRenderSize(int renderWidth, int renderHeight)
+{
+	m_RenderWidth = std::clamp(renderWidth, 1, m_Width);
+	m_RenderHeight = std::clamp(renderHeight, 1, m_Height);
+}
+
 void GBufferFBO::setupVAOVBO()
 {
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 
-	glBindVertexArray(VAO);
+	GLState::BindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
 
@@ -902,16 +760,17 @@ void GBufferFBO::setupVAOVBO()
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(1);
 
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
 
 void GBufferFBO::Render()
 {
-	glDisable(GL_DEPTH_TEST);
-	glBindVertexArray(VAO);
+	GLState::Disable(GL_DEPTH_TEST);
+	GLState::BindVertexArray(VAO);
+	GLState::CountDraw();
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
-	glEnable(GL_DEPTH_TEST);
+	GLState::BindVertexArray(0);
+	GLState::Enable(GL_DEPTH_TEST);
 }
 
 GBufferFBO::~GBufferFBO()
@@ -923,11 +782,12 @@ GBufferFBO::~GBufferFBO()
 void GBufferFBO::clean()
 {
 
-	if (gPosition != 0 || gNormalShiness != 0 || gColorSpec != 0)
+	if (gPosition != 0 || gShininess != 0 || gNormalShiness != 0 || gColorSpec != 0)
 	{
-		GLuint textures[] = { gPosition, gNormalShiness, gColorSpec };
-		glDeleteTextures(3, textures);
+		GLuint textures[] = { gPosition, gShininess, gNormalShiness, gColorSpec };
+		GLState::DeleteTextures(4, textures);
 		gPosition = 0;
+		gShininess = 0;
 		gNormalShiness = 0;
 		gColorSpec = 0;
 	}
@@ -939,7 +799,7 @@ void GBufferFBO::clean()
 	}
 	if (fbo != 0)
 	{
-		glDeleteFramebuffers(1, &fbo);
+		GLState::DeleteFramebuffers(1, &fbo);
 		fbo = 0;
 	}
 
@@ -950,7 +810,7 @@ void GBufferFBO::clean()
 	}
 	if (VAO != 0)
 	{
-		glDeleteVertexArrays(1, &VAO);
+		GLState::DeleteVertexArrays(1, &VAO);
 		VAO = 0;
 	}
 
@@ -974,6 +834,8 @@ void FXAA::init(int s_Width, int s_Height)
 	//clean();
 	m_Width = s_Width;
 	m_Height = s_Height;
+	m_RenderWidth = s_Width;
+	m_RenderHeight = s_Height;
 	loadShaders();
 	createFramebuffer();
 	createScreenQuad();
@@ -982,92 +844,100 @@ void FXAA::init(int s_Width, int s_Height)
 void FXAA::resize(int s_Width, int s_Height) {
 	m_Width = s_Width;
 	m_Height = s_Height;
+	m_RenderWidth = std::min(m_RenderWidth, m_Width);
+	m_RenderHeight = std::min(m_RenderHeight, m_Height);
 	// Recreate framebuffer with new dimensions
 	deleteFramebuffer();
 	createFramebuffer();
 }
 
+void FXAA::setRenderSize(int renderWidth, int renderHeight) {
+	m_RenderWidth = std::clamp(renderWidth, 1, m_Width);
+	m_RenderHeight = std::clamp(renderHeight, 1, m_Height);
+}
+
+void FXAA::setDepthAttachment(GLuint depthTexture) {
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if (depthTexture == depthAttachment)
+		return;
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	depthAttachment = depthTexture;
+}
+
 void FXAA::bind() {
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-	glViewport(0, 0, m_Width, m_Height);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GLState::Viewport(0, 0, m_RenderWidth, m_RenderHeight);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void FXAA::unbind() {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void FXAA::render() {
 	// Bind default framebuffer for final output
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, m_Width, m_Height);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::Viewport(0, 0, m_Width, m_Height);
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	// Disable depth testing for post-processing
-	glDisable(GL_DEPTH_TEST);
+	GLState::Disable(GL_DEPTH_TEST);
 
 	// Use FXAA shader
 	fxaaShader.use();
 
 	// Set uniforms
 	fxaaShader.setVec2("rcpFrame", 1.0f / m_Width, 1.0f / m_Height);
+	fxaaShader.setVec2("uvScale", static_cast<float>(m_RenderWidth) / m_Width, static_cast<float>(m_RenderHeight) / m_Height);
+	fxaaShader.setVec2("uvMax", (m_RenderWidth - 0.5f) / m_Width, (m_RenderHeight - 0.5f) / m_Height);
 
 	// Bind the color texture from our framebuffer
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	GLState::ActiveTexture(GL_TEXTURE0);
+	GLState::BindTexture(GL_TEXTURE_2D, colorTexture);
 	fxaaShader.setInt("screenTexture", 0);
 
 	// Render the screen quad
-	glBindVertexArray(VAO);
+	GLState::BindVertexArray(VAO);
+	GLState::CountDraw();
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 
 	// Re-enable depth testing
-	glEnable(GL_DEPTH_TEST);
+	GLState::Enable(GL_DEPTH_TEST);
 }
 
 void FXAA::createFramebuffer() {
 	// Generate framebuffer
 	glGenFramebuffers(1, &framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GLDebug::Label(GL_FRAMEBUFFER, framebuffer, "FXAA");
 	
 	// Create color texture
 	glGenTextures(1, &colorTexture);
-	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	GLState::BindTexture(GL_TEXTURE_2D, colorTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, m_Width, m_Height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
-
-	// Create depth texture
-	glGenTextures(1, &depthTexture);
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_Width, m_Height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	depthAttachment = 0;
 
 	// Check framebuffer completeness
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 		std::cout << "ERROR::FXAA::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void FXAA::deleteFramebuffer() {
 	if (colorTexture != 0) {
-		glDeleteTextures(1, &colorTexture);
+		GLState::DeleteTextures(1, &colorTexture);
 		colorTexture = 0;
 	}
-	if (depthTexture != 0) {
-		glDeleteTextures(1, &depthTexture);
-		depthTexture = 0;
-	}
 	if (framebuffer != 0) {
-		glDeleteFramebuffers(1, &framebuffer);
+		GLState::DeleteFramebuffers(1, &framebuffer);
 		framebuffer = 0;
 	}
 }
@@ -1085,7 +955,7 @@ void FXAA::createScreenQuad() {
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 
-	glBindVertexArray(VAO);
+	GLState::BindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
 
@@ -1097,12 +967,12 @@ void FXAA::createScreenQuad() {
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
 
 void FXAA::deleteScreenQuad() {
 	if (VAO != 0) {
-		glDeleteVertexArrays(1, &VAO);
+		GLState::DeleteVertexArrays(1, &VAO);
 		VAO = 0;
 	}
 	if (VBO != 0) {
@@ -1115,3 +985,88 @@ void FXAA::loadShaders() {
 	// You'll need to create these shader files
 	fxaaShader.load(getShaderFullPath("fxaa.vert").c_str(), getShaderFullPath("fxaa.frag").c_str() );
 }
+
+// ShadowMaskFBO, half resolution visibility of the sun and of the most important shadowed lights
+
+ShadowMaskFBO::~ShadowMaskFBO()
+{
+	clean();
+}
+
+void ShadowMaskFBO::Init(int s_Width, int s_Height)
+{
+	m_Width = std::max(1, (s_Width + 1) / 2);
+	m_Height = std::max(1, (s_Height + 1) / 2);
+	m_RenderWidth = m_Width;
+	m_RenderHeight = m_Height;
+
+	// the targets are attached by SetTargets before every use
+	glGenFramebuffers(1, &fbo);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLDebug::Label(GL_FRAMEBUFFER, fbo, "ShadowMask");
+	unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, attachments);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GL_CHECK();
+}
+
+void ShadowMaskFBO::SetTargets(GLuint mask0, GLuint mask1)
+{
+	// attached every frame, a deleted pool texture can give its name to a new one
+	maskTextures = { mask0, mask1 };
+
+	// the upsample weights every texel by itself, the graph textures are already nearest and clamped
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	for (int i = 0; i < 2; i++)
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, maskTextures[i], 0);
+	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (Status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("FB error, status: 0x%x\n", Status);
+		throw 1;
+	}
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMaskFBO::Resize(int s_Width, int s_Height)
+{
+	m_Width = std::max(1, (s_Width + 1) / 2);
+	m_Height = std::max(1, (s_Height + 1) / 2);
+	m_RenderWidth = std::min(m_RenderWidth, m_Width);
+	m_RenderHeight = std::min(m_RenderHeight, m_Height);
+	// the next SetTargets brings the textures of the new size
+}
+
+void ShadowMaskFBO::SetRenderSize(int renderWidth, int renderHeight)
+{
+	m_RenderWidth = std::clamp((renderWidth + 1) / 2, 1, m_Width);
+	m_RenderHeight = std::clamp((renderHeight + 1) / 2, 1, m_Height);
+}
+
+void ShadowMaskFBO::BindForWriting()
+{
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::Viewport(0, 0, m_RenderWidth, m_RenderHeight);
+	// everything is lit until the mask pass writes it
+	const GLfloat lit[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glClearBufferfv(GL_COLOR, 0, lit);
+	glClearBufferfv(GL_COLOR, 1, lit);
+}
+
+void ShadowMaskFBO::BindForReading(GLint TextureUnit)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		GLState::ActiveTexture(GL_TEXTURE0 + TextureUnit + i);
+		GLState::BindTexture(GL_TEXTURE_2D, maskTextures[i]);
+	}
+}
+
+void ShadowMaskFBO::clean()
+{
+	maskTextures = {};
+	if (fbo != 0)
+	{
+		GLState::DeleteFramebuffers(1, &fbo);
+		fbo = 0;
+	}
+}
@@ -8,6 +8,7 @@
 #define GLFW_INCLUDE_NONE    
 #include <GLFW/glfw3.h>
 
+#include <array>
 #include <memory>
 
 #include <glm/glm.hpp>
@@ -38,6 +39,7 @@ public:
 	void BindForWriting();
 	void BindForReading(GLint TextureUnit);
 	void clean();
+	GLuint GetTexture() const { return depthbufferTexture; }
 
 	unsigned int m_Width{ 0 }, m_Height{ 0 };
 	std::shared_ptr<Shader> shader;
@@ -63,8 +65,12 @@ public:
 	void Init(size_t Size); // to be use in combo with SetupShader to have a fully working object 
 	void SetupShader(std::shared_ptr<Shader> inShader); 
 	void BindLayerForWriting(int layerIndex);
+	// attach the whole array, the layer is then selected by the shaders through gl_Layer
+	void BindAllLayersForWriting();
 	void BindForReading(GLint TextureUnit);
 	void clean();
+	size_t GetLayerCount() const { return size; }
+	GLuint GetTexture() const { return textureArray; }
 
 	unsigned int s_Width{ 0 }, s_Height{ 0 };
 
@@ -75,34 +81,6 @@ private:
 	size_t size{ 0 };
 };
 
-class ShadowMapCubeFBO
-{
-public:
-	ShadowMapCubeFBO() = delete;
-	ShadowMapCubeFBO& operator=(const ShadowMapCubeFBO&) = delete;
-	ShadowMapCubeFBO(const unsigned int size);
-	~ShadowMapCubeFBO();
-
-	void resizeWindow(const unsigned int WIDTH, const unsigned int HEIGHT);
-	void setupUniformShader(const PointLight* light);
-	void Init(size_t MAX_LIGHTS, std::shared_ptr<Shader> inShader);
-	void Init(size_t MAX_LIGHTS); // to be use in combo with SetupShader to have a fully working object 
-	void SetupShader(std::shared_ptr<Shader> inShader);
-	void BindForWriting(int lightIndex);
-	void BindForReading(GLint TextureUnit);
-	void clean();
-
-	unsigned int s_SIZE{ 0 };
-	unsigned int maxLights{ 0 };
-
-	std::shared_ptr<Shader> shader;
-
-private:
-	GLuint fbo{ 0 };
-	GLuint depthCubemap{ 0 };
-	int currentLightIndex = 0;
-};
-
 class ShadowMapPointDirFBO
 {
 public:
@@ -136,16 +114,24 @@ public:
 	~MultisampleFramebuffer();
 
 	void init();
+	// resolve the color on the default framebuffer
 	void blit();
 	void resize(int s_Width, int s_Height);
 	void bind();
 
+	GLuint getFramebuffer() const { return framebufferMSSA; }
+	// multisampled depth texture, sampler2DMS (e.g. the light culling of the ForwardPlusRenderer)
+	GLuint getDepthTexture() const { return depthBufferMultiSampled; }
+	int getSamples() const { return samples; }
+
 private:
 	GLuint framebufferMSSA{ 0 };
 	GLuint textureColorBufferMultiSampled{ 0 };
-	GLuint rbo{ 0 };
+	GLuint depthBufferMultiSampled{ 0 };
 	int samples;
 	int m_Width, m_Height;
+
+	void createAttachments();
 };
 
 class FXAA {
@@ -162,6 +148,12 @@ public:
 
 	// Getters for the framebuffer texture
 	GLuint getColorTexture() const { return colorTexture; }
+	// the target has no depth of its own, the forward pass attaches the G-buffer depth (0 = detach)
+	void setDepthAttachment(GLuint depthTexture);
+
+	// dynamic resolution: the lighting renders in the bottom left renderWidth x renderHeight texels and
+	// render() upscales them to the window, the texture keeps its size
+	void setRenderSize(int renderWidth, int renderHeight);
 
 	// FXAA quality settings
 	void setQualitySubpix(float value) { qualitySubpix = value; }
@@ -174,8 +166,9 @@ public:
 private:
 
 	GLuint colorTexture{ 0 };
-	GLuint depthTexture{ 0 };
+	GLuint depthAttachment{ 0 };
 	int m_Width{ 0 }, m_Height{ 0 };
+	int m_RenderWidth{ 0 }, m_RenderHeight{ 0 };
 
 	// Screen quad for post-processing
 	GLuint VAO{ 0 };
@@ -197,6 +190,11 @@ private:
 	void loadShaders();
 };
 
+// Standard: world position RGB16F, normal + shininess RGBA16F, color + specular RGBA8 and depth (22 bytes per pixel)
+// Compact: shininess R8, octahedral normal RG16, color + specular RGBA8 and depth (13 bytes per pixel),
+// the lighting pass reconstructs the position from the depth and the inverse view projection
+enum class GBufferLayout { Standard, Compact };
+
 class GBufferFBO
 {
 public:
@@ -209,19 +207,32 @@ public:
 	void UnBind();
 	void BindForReading(GLint TextureUnit);
 	void Resize(int s_Width, int s_Height);
+	// dynamic resolution: the geometry pass renders in the bottom left renderWidth x renderHeight texels
+	void SetRenderSize(int renderWidth, int renderHeight);
 	void Render();
 	void clean();
+	// recreates the targets and the shaders of the geometry and lighting passes
+	void SetLayout(GBufferLayout layout);
+	GBufferLayout GetLayout() const { return m_Layout; }
+	// every byte is written by the geometry pass and read back by the lighting pass
+	static size_t BytesPerPixel(GBufferLayout layout);
 
 	GLuint fbo{ 0 };
 	GLuint depthBuffer{ 0 };
 	std::shared_ptr<Shader> shaderGeom;
 	std::shared_ptr<Shader> shaderLighting;
 	std::shared_ptr<Shader> shaderInstanced;
+	std::shared_ptr<Shader> shaderIndirect;
+	// Lighting_pass_test.frag built with SHADOW_MASK_PASS, writes the visibilities of ShadowMaskFBO
+	std::shared_ptr<Shader> shaderShadowMask;
 
 private:
 	GLuint gPosition{ 0 }, gNormalShiness{ 0 }, gColorSpec{ 0 };
+	GLuint gShininess{ 0 }; // compact layout, in place of gPosition
 	GLuint VAO{ 0 }, VBO{ 0 };
 	int m_Height{ 0 }, m_Width{ 0 };
+	int m_RenderHeight{ 0 }, m_RenderWidth{ 0 };
+	GBufferLayout m_Layout{ GBufferLayout::Standard };
 	inline const static float quadVertices[20] = {
 		// Positions   // Texture coords
 		-1.0f, -1.0f,  0.0f,  0.0f, 0.0f,  // Bottom-left
@@ -233,6 +244,39 @@ private:
 	void createTextures();
 	void createDepthBuffer();
 	void setupVAOVBO();
+	void loadShaders();
 
 };
+// half resolution visibility of the sun (channel 0) and of up to MAX_MASKED_LIGHTS shadowed lights
+// (channels 1..7) in two RGBA8 targets, the lighting pass reads it back with a depth and normal aware upsample
+class ShadowMaskFBO
+{
+public:
+	static constexpr int MAX_MASKED_LIGHTS = 7;
+
+	ShadowMaskFBO() = default;
+	ShadowMaskFBO& operator=(const ShadowMaskFBO&) = delete;
+	~ShadowMaskFBO();
+
+	// size of the full resolution target, the mask is half of it
+	void Init(int s_Width, int s_Height);
+	// the two GL_RGBA8 targets of GetWidth() x GetHeight() are transient textures of the RenderGraph
+	void SetTargets(GLuint mask0, GLuint mask1);
+	void Resize(int s_Width, int s_Height);
+	// full resolution size of the rendered part of the targets, see GBufferFBO::SetRenderSize
+	void SetRenderSize(int renderWidth, int renderHeight);
+	void BindForWriting();
+	// the two targets on TextureUnit and TextureUnit + 1
+	void BindForReading(GLint TextureUnit);
+	void clean();
+
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+
+private:
+	GLuint fbo{ 0 };
+	std::array<GLuint, 2> maskTextures{}; // not owned
+	int m_Width{ 0 }, m_Height{ 0 };
+	int m_RenderWidth{ 0 }, m_RenderHeight{ 0 };
+};
 #endif // !FRAME_BUFFER_OBJECT_H
\ No newline at end of file
@@ -10,27 +10,98 @@
 #include "DemoScene.h"
 #include "exameScene.h"
 #include "EntityComponentSysetm.h"
+#include "ForwardPlusRenderer.h"
+#include "CameraPath.h"
+#include "FramePipeline.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 
 
-int main()
+
+int main(int argc, char** argv)
 {
-    const int WIDTH{ 1600 };
-    const int HEIGHT{ 1000 };
+    int WIDTH{ 1600 };
+    int HEIGHT{ 1000 };
     const char* WindowName{ "finestra" };
 
-    WindowContext context{ WIDTH ,HEIGHT ,WindowName };
+    // the CMake option RENDERER picks the default of the deployment
+#ifdef RENDERER_FORWARD_PLUS
+    bool forwardPlus{ true };
+#else
+    bool forwardPlus{ false };
+#endif
+    std::string gpuProfilePath;
+    std::string cpuProfilePath;
+    ContextMode mode{ ContextMode::Window };
+    // 0 runs until the window is closed
+    long maxFrames{ 0 };
+    // the camera of every frame, played back by RenderingProjectBenchmark --camera-path
+    std::string recordCameraPath;
+    CameraPath recordedCamera;
+    // 0: the scene and the GL submission on this thread, N: the scene on a simulation thread, N frames in flight
+    int framesInFlight{ 0 };
+    // deferred renderer: print the passes, memory and bandwidth of the render graph when they change
+    bool renderGraphReport{ false };
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--forward-plus") == 0)
+            forwardPlus = true;
+        else if (std::strcmp(argv[i], "--deferred") == 0)
+            forwardPlus = false;
+        // the GPU time of the passes, written when the window closes (.json, otherwise csv)
+        else if (std::strcmp(argv[i], "--gpu-profile") == 0 && i + 1 < argc)
+            gpuProfilePath = argv[++i];
+        // Chrome trace of the CPU zones, written when the window closes (about:tracing, ui.perfetto.dev)
+        else if (std::strcmp(argv[i], "--cpu-profile") == 0 && i + 1 < argc)
+            cpuProfilePath = argv[++i];
+        // no window: offscreen rendering at a fixed --resolution, stopped by --frames
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            mode = ContextMode::Headless;
+        else if (std::strcmp(argv[i], "--resolution") == 0 && i + 1 < argc)
+            std::sscanf(argv[++i], "%dx%d", &WIDTH, &HEIGHT);
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            maxFrames = std::strtol(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc)
+            recordCameraPath = argv[++i];
+        else if (std::strcmp(argv[i], "--pipelined") == 0 && i + 1 < argc)
+            framesInFlight = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--render-graph-report") == 0)
+            renderGraphReport = true;
+    }
+
+    WindowContext context{ WIDTH ,HEIGHT ,WindowName, mode };
     // --- ECS Application Setup ---
     { // Scope of the renderer
         // 1. Create the renderer
-        auto renderer = std::make_unique<DeferredRenderer>(context);
+        std::unique_ptr<IRenderer> renderer;
+        if (forwardPlus)
+            renderer = std::make_unique<ForwardPlusRenderer>(context);
+        else
+        {
+            auto deferred = std::make_unique<DeferredRenderer>(context);
+            deferred->setRenderGraphReport(renderGraphReport);
+            renderer = std::move(deferred);
+        }
+
+        // pipelined: the scene writes frame packets, the pipeline draws them with the renderer on this thread
+        std::unique_ptr<FramePipeline> pipeline;
+        if (framesInFlight > 0)
+        {
+            pipeline = std::make_unique<FramePipeline>(std::move(renderer), framesInFlight);
+            renderer = pipeline->createSceneRenderer();
+        }
 
         // 2. Create the scene
         auto scene = std::make_unique<ExameScene>(std::move(renderer));
 
         // 3. Initialize the scene  
         scene->initialize();  
+        if (pipeline)
+            pipeline->start(*scene);
 
         double lastTime{ 0.0 };
         int frameCount{ 0 };
@@ -50,15 +121,46 @@ int main()
 
             glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glEnable(GL_DEPTH_TEST);
+            GLState::Enable(GL_DEPTH_TEST);
 
-            scene->render();
+            if (pipeline)
+                pipeline->renderFrame();
+            else
+                scene->render();
+            if (!recordCameraPath.empty())
+                recordedCamera.Add(context.getTotalTime(), context.getCamera());
 
             // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
             // -------------------------------------------------------------------------------
             context.swapBuffersAndPollEvents();
+
+            if (maxFrames > 0 && --maxFrames == 0)
+                context.requestClose();
+        }
+
+        if (pipeline)
+        {
+            pipeline->stop();
+            const FramePipeline::Stats stats = pipeline->getStats();
+            std::cout << "Pipeline: " << stats.frames << " frames, " << pipeline->getFramesInFlight() << " in flight, waits render "
+                << stats.renderWaitMs << " ms simulation " << stats.simulationWaitMs << " ms, max latency "
+                << stats.maxLatencyFrames << " frames" << std::endl;
+        }
+        if (!gpuProfilePath.empty())
+        {
+            if (gpuProfilePath.ends_with(".json"))
+                GpuProfiler::Get().ExportJSON(gpuProfilePath);
+            else
+                GpuProfiler::Get().ExportCSV(gpuProfilePath);
         }
+        if (!cpuProfilePath.empty())
+            CpuProfiler::Get().DumpChromeTrace(cpuProfilePath);
+        if (!recordCameraPath.empty())
+            recordedCamera.Save(recordCameraPath);
     } 
+    // the meshes are gone, release the shared geometry while the context is still alive
+    GeometryArena::Get().clean();
+    GpuProfiler::Get().clean();
 
     return 0;
 }
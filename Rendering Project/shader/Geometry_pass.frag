@@ -7,11 +7,27 @@ in vec3 Normal;
 in vec3 FragPos;
 in mat3 TBN;
 
-// G-buffer outputs
+// G-buffer outputs (GBufferLayout)
+#ifdef GBUFFER_COMPACT
+layout (location = 0) out float gShininess;     // log2(shininess) / 11, 1..2048 in 8 bits
+layout (location = 1) out vec2 gNormalShiness;  // Octahedral world space normal, the position comes from the depth
+#else
 layout (location = 0) out vec3 gPosition;       // World space position 
 layout (location = 1) out vec4 gNormalShiness;  // World space normal + shininess
+#endif
 layout (location = 2) out vec4 gColorSpec;      // Diffuse color (RGB) + specular intensity (A)
 
+#ifdef GBUFFER_COMPACT
+// the unit octahedron unfolded on the square, the lower hemisphere folded over the diagonals
+vec2 EncodeOctahedral(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 f = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+    return f * 0.5 + 0.5;
+}
+#endif
+
 
 // Material properties
 struct Material {
@@ -74,11 +90,16 @@ void main()
     }
     
     // Fill G-buffer
+#ifdef GBUFFER_COMPACT
+    gShininess = log2(max(material.shininess, 1.0)) / 11.0;
+    gNormalShiness = EncodeOctahedral(finalNormal);
+#else
     // Position buffer: world space position + linear depth (for later use)
     gPosition = FragPos;
     
     // Normal buffer: world space normal + shininess
     gNormalShiness = vec4(finalNormal, material.shininess);
+#endif
     
     // Color + Specular buffer: diffuse color (RGB) + specular intensity (A)
     gColorSpec = vec4(diffuseColor, specularIntensity);
@@ -0,0 +1,83 @@
+// Geometry Pass Fragment Shader for the multi draw indirect path
+#version 430 core
+
+// Input from vertex shader
+in vec2 TexCoord;
+in vec3 Normal;
+in vec3 FragPos;
+in mat3 TBN;
+flat in uint MaterialID;
+
+// G-buffer outputs (GBufferLayout)
+#ifdef GBUFFER_COMPACT
+layout (location = 0) out float gShininess;     // log2(shininess) / 11, 1..2048 in 8 bits
+layout (location = 1) out vec2 gNormalShiness;  // Octahedral world space normal, the position comes from the depth
+#else
+layout (location = 0) out vec3 gPosition;       // World space position 
+layout (location = 1) out vec4 gNormalShiness;  // World space normal + shininess
+#endif
+layout (location = 2) out vec4 gColorSpec;      // Diffuse color (RGB) + specular intensity (A)
+
+#ifdef GBUFFER_COMPACT
+// the unit octahedron unfolded on the square, the lower hemisphere folded over the diagonals
+vec2 EncodeOctahedral(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 f = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+    return f * 0.5 + 0.5;
+}
+#endif
+
+struct MaterialRecord {
+    vec4 diffuseColor;
+    vec4 ambientColor;
+    vec4 specularColor;     // w = shininess
+    uvec4 textureFlags;     // x = diffuse, y = specular, z = normal, w = alpha
+};
+
+layout (std430, binding = 1) readonly buffer MaterialRecords {
+    MaterialRecord materials[];
+};
+
+// the textures of the current batch, all the draws of a multi draw share the same material
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D alphaTexture;
+
+void main()
+{
+    MaterialRecord material = materials[MaterialID];
+
+    if (material.textureFlags.w != 0u) {
+        if (texture(alphaTexture, TexCoord).r < 0.1)
+            discard;
+    }
+
+    vec3 finalNormal;
+    if (material.textureFlags.z != 0u) {
+        vec3 normalMap = texture(normalTexture, TexCoord).rgb * 2.0 - 1.0;
+        finalNormal = normalize(TBN * normalMap);
+    } else {
+        finalNormal = normalize(Normal);
+    }
+
+    vec3 diffuseColor = material.textureFlags.x != 0u ? texture(diffuseTexture, TexCoord).rgb : material.diffuseColor.rgb;
+
+    float specularIntensity;
+    if (material.textureFlags.y != 0u) {
+        specularIntensity = texture(specularTexture, TexCoord).r;
+    } else {
+        specularIntensity = (material.specularColor.r + material.specularColor.g + material.specularColor.b) / 3.0;
+    }
+
+#ifdef GBUFFER_COMPACT
+    gShininess = log2(max(material.specularColor.w, 1.0)) / 11.0;
+    gNormalShiness = EncodeOctahedral(finalNormal);
+#else
+    gPosition = FragPos;
+    gNormalShiness = vec4(finalNormal, material.specularColor.w);
+#endif
+    gColorSpec = vec4(diffuseColor, specularIntensity);
+}
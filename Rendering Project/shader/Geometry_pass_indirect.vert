@@ -0,0 +1,53 @@
+// Geometry Pass Vertex Shader for the multi draw indirect path
+#version 430 core
+
+// Input vertex attributes (interleaved in the GeometryArena)
+layout (location = 0) in vec3 aPos;       // Position attribute
+layout (location = 1) in vec2 aTexCoord;  // Texture coordinate
+layout (location = 2) in vec3 aNormal;    // Normal attribute
+layout (location = 3) in vec3 aTangent;   // Tangent attribute
+layout (location = 4) in vec3 aBitangent; // Bitangent attribute
+layout (location = 5) in uint aDrawID;    // per instance, offset by the baseInstance of the command
+
+struct DrawRecord {
+    vec4 boundingSphere;
+    uvec4 info;     // x = material index
+};
+
+layout (std430, binding = 0) readonly buffer DrawRecords {
+    DrawRecord draws[];
+};
+// the slot of the instance and the models, filled by cull_draws.comp and IndirectDrawBuilder::Upload
+layout (std430, binding = 6) readonly buffer DrawInstances { uvec2 drawInstances[]; }; // x = model, y = command
+layout (std430, binding = 7) readonly buffer Models { mat4 models[]; };
+
+// Output data to fragment shader
+out vec2 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+out mat3 TBN;
+flat out uint MaterialID;
+
+uniform mat4 view;          // View matrix
+uniform mat4 projection;    // Projection matrix
+
+void main()
+{
+    uvec2 drawInstance = drawInstances[aDrawID];
+    mat4 model = models[drawInstance.x];
+    MaterialID = draws[drawInstance.y].info.x;
+
+    // Calculate world space position
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    TexCoord = aTexCoord;
+
+    // Transform tangent space vectors to world space
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    vec3 T = normalize(normalMatrix * aTangent);
+    vec3 B = normalize(normalMatrix * aBitangent);
+    vec3 N = normalize(normalMatrix * aNormal);
+    TBN = mat3(T, B, N);
+
+    Normal = normalMatrix * aNormal;
+}
@@ -2,7 +2,9 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
 layout (location = 2) in vec3 aNormal;
-layout (location = 3) in mat4 instanceModel; 
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+layout (location = 6) in mat4 instanceModel; // INSTANCE_MATRIX_LOCATION in Mesh.h, uses the locations 6 to 9
 
 // Output data to fragment shader
 out vec2 TexCoord;
@@ -22,13 +24,12 @@ void main()
 
     // Calculate TBN for normal mapping
     mat3 normalMatrix = transpose(inverse(mat3(instanceModel)));
-    vec3 T = normalize(normalMatrix * vec3(1.0, 0.0, 0.0)); // Tangent
-    vec3 N = normalize(normalMatrix * aNormal);             // Normal
-    T = normalize(T - dot(T, N) * N);                       // Re-orthogonalize
-    vec3 B = cross(N, T);                                   // Bitangent
+    vec3 T = normalize(normalMatrix * aTangent);
+    vec3 B = normalize(normalMatrix * aBitangent);
+    vec3 N = normalize(normalMatrix * aNormal);
     TBN = mat3(T, B, N);
     
     Normal = N;
     
     gl_Position = projection * view * worldPos;
-}
\ No newline at end of file
+}
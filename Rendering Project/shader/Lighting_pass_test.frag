@@ -3,24 +3,55 @@
 // Input data from Vertex 
 in vec2 TexCoord;
 
-// G-buffer textures
+// G-buffer textures (GBufferLayout)
+#ifdef GBUFFER_COMPACT
+uniform sampler2D gShininess;       // log2 encoded
+uniform sampler2D gNormalShininess; // octahedral normal only
+uniform mat4 invViewProjection;     // the position comes from the depth
+#else
 uniform sampler2D gPosition;
 uniform sampler2D gNormalShininess;
+#endif
 uniform sampler2D gColorSpec;
 uniform sampler2D gDepth;
+// rendered part of the G-buffer, smaller than its textures with dynamic resolution
+uniform ivec2 renderSize;
 
 // Shadow map samplers
-uniform samplerCubeArrayShadow shadowCubeArray;   // For Point Lights
-uniform sampler2D shadowDir;                // For Directional Lights
-uniform sampler2DArrayShadow  shadowSpotArray;     // For Spot Lights
+uniform sampler2DArrayShadow shadowCascades; // For Directional Lights, one layer per cascade
+uniform sampler2DShadow shadowAtlas;        // For Point and Spot Lights, one or more tiles per light (see ShadowAtlas.h)
+
+// Prefiltered EVSM moments of the same maps at half resolution, see ShadowMoments.h
+uniform sampler2DArray cascadeMoments;
+uniform sampler2DArray atlasMoments;        // one layer, same tiles of shadowAtlas
+uniform vec2 evsmExponents;
+// 0 = PCF, 1 = EVSM (ShadowFilter)
+uniform int dirShadowFilter;
+uniform int spotShadowFilter;
+uniform int pointShadowFilter;
 
 
 // Camera position for specular calculations
 uniform vec3 viewPos;
 
+#ifdef SHADOW_MASK_PASS
+// Visibility of the sun and of the masked lights at half resolution, see ShadowMaskFBO
+#define MAX_MASKED_LIGHTS 7
+layout (location = 0) out vec4 MaskSunLights; // r = sun, gba = masked lights 0..2
+layout (location = 1) out vec4 MaskLights;    // masked lights 3..6
+uniform int numMaskedLights;
+uniform int maskedLightType[MAX_MASKED_LIGHTS];  // 0 = point, 1 = spot
+uniform int maskedLightIndex[MAX_MASKED_LIGHTS];
+#else
 // Output 
 out vec4 FragColor;
 
+// Shadow mask written by the SHADOW_MASK_PASS build of this shader
+uniform bool useShadowMask;
+uniform sampler2D shadowMask0;
+uniform sampler2D shadowMask1;
+#endif
+
 // Light structures
 struct Light {
     vec3 ambient;
@@ -43,7 +74,9 @@ struct PointLight {
     
     Light light;
     float far_plane;
-    int shadowID;
+    vec4 shadowTile; // (first tile, tile size / atlas size), 6 tiles for a cube and 2 for a dual paraboloid
+    int shadowType; // 0 = cube, 1 = dual paraboloid
+    int maskChannel; // masked light index in the shadow mask, -1 = shadow computed here
 };
 
 struct SpotLight {
@@ -57,7 +90,8 @@ struct SpotLight {
     float quadratic;
     mat4 SpaceMatrices;
     Light light;    
-    int shadowID;
+    vec4 shadowTile; // (first tile, tile size / atlas size), size 0 = no tile in the atlas
+    int maskChannel; // masked light index in the shadow mask, -1 = shadow computed here
 };
 
 // Light uniforms
@@ -73,8 +107,12 @@ uniform DirLight dirLight;
 uniform PointLight pointLights[MAX_POINT_LIGHTS];
 uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
 
-// Light space matrices for shadows
-uniform mat4 dirLightSpaceMatrice;
+// Cascades of the directional light, see ShadowCascades.h
+#define MAX_CASCADES 4
+uniform int cascadeCount;
+uniform mat4 cascadeMatrices[MAX_CASCADES];
+uniform float cascadeSplits[MAX_CASCADES]; // view depth where every cascade ends
+uniform vec3 cameraForward;
 
 
 
@@ -84,13 +122,32 @@ vec3 CalcPointLight(PointLight light);
 vec3 CalcSpotLight(SpotLight light);
 
 float CalcPointLightShadow(vec3 fragPos, PointLight light);
+float CalcPointLightShadowParaboloid(vec3 fragPos, PointLight light);
 float CalcDirLightShadow(vec3 fragPos, DirLight light);
 float CalcSpotLightShadow(vec3 fragPos, SpotLight light);
 
+vec4 AtlasTileRect(vec4 shadowTile, int offset);
+float SampleAtlas(vec4 tileRect, vec2 uv, float depth);
+vec2 CubeFaceUV(vec3 dir, out int face);
+float EvsmVisibility(vec4 moments, float depth);
+float SampleAtlasMoments(vec4 shadowTile, int offset, vec2 uv, float footprint, float depth);
+float MomentLod(float footprint, float texels);
+
 vec3 ReinhardToneMapping(vec3 color);
 
 vec3 DebugShadowVisualizationPOINT();
 vec3 DebugShadowVisualizationDIR();
+int SelectCascade(vec3 fragPos);
+
+vec3 ReadPosition(ivec2 texel);
+vec4 ReadNormalShininess(ivec2 texel);
+
+#ifdef SHADOW_MASK_PASS
+void WriteShadowMask();
+#else
+void UpsampleShadowMask(out vec4 mask0, out vec4 mask1);
+float MaskVisibility(vec4 mask0, vec4 mask1, int maskChannel);
+#endif
 
 float LinearizeDepth(float depth, float near, float far)
 {
@@ -107,20 +164,41 @@ float shininess;
 vec3 viewDir;
 float specularIntensity;
 float depth;
+// world size of the pixel, the mip level of the moments comes from it (the shadow functions are
+// called in non uniform control flow where the implicit derivatives are undefined)
+vec3 dPdx;
+vec3 dPdy;
 
 void main()
 {
+#ifdef SHADOW_MASK_PASS
+    // every mask texel takes the top left texel of its 2x2 block, the upsample compares against the same one
+    ivec2 gTexel = ivec2(gl_FragCoord.xy) * 2;
+    FragPos = ReadPosition(gTexel);
+    dPdx = dFdx(FragPos);
+    dPdy = dFdy(FragPos);
+    Normal = ReadNormalShininess(gTexel).rgb;
+    if (length(Normal) < 0.1) {
+        MaskSunLights = vec4(1.0);
+        MaskLights = vec4(1.0);
+        return;
+    }
+    WriteShadowMask();
+#else
     // Sample G-buffer data
-    FragPos = texture(gPosition, TexCoord).rgb;
-    vec4 normalShininess = texture(gNormalShininess, TexCoord);
+    ivec2 gTexel = ivec2(gl_FragCoord.xy);
+    FragPos = ReadPosition(gTexel);
+    dPdx = dFdx(FragPos);
+    dPdy = dFdy(FragPos);
+    vec4 normalShininess = ReadNormalShininess(gTexel);
     Normal = normalShininess.rgb;
     shininess = normalShininess.a;
     
-    vec4 colorSpec = texture(gColorSpec, TexCoord);
+    vec4 colorSpec = texelFetch(gColorSpec, gTexel, 0);
     diffuseColor = colorSpec.rgb;
     specularIntensity = colorSpec.a;
 
-     depth = texture(gDepth, TexCoord).r;
+     depth = texelFetch(gDepth, gTexel, 0).r;
     
     // If no geometry was rendered to this pixel, discard
     if (length(Normal) < 0.1) {
@@ -132,10 +210,15 @@ void main()
     
     // Initialize result color
     vec3 result = vec3(0.0);
+
+    vec4 mask0 = vec4(1.0);
+    vec4 mask1 = vec4(1.0);
+    if (useShadowMask)
+        UpsampleShadowMask(mask0, mask1);
     
     // Calculate directional light (sunlight)
     {
-       float visibility = CalcDirLightShadow(FragPos, dirLight);
+       float visibility = useShadowMask ? mask0.r : CalcDirLightShadow(FragPos, dirLight);
        result += CalcDirLight(dirLight) * visibility; 
     }
     
@@ -147,21 +230,23 @@ void main()
         {
             continue; // Go to the next light
         }
-        float visibility = CalcPointLightShadow(FragPos, pointLights[i]);
+        float visibility = useShadowMask && pointLights[i].maskChannel >= 0 ?
+            MaskVisibility(mask0, mask1, pointLights[i].maskChannel) : CalcPointLightShadow(FragPos, pointLights[i]);
         result += CalcPointLight(pointLights[i]) * visibility;  
     }
     
     // Calculate spot lights
     for(int i = 0; i < numSpotLights && i < MAX_SPOT_LIGHTS; ++i) 
     {
-       float visibility = CalcSpotLightShadow(FragPos, spotLights[i]);
+       float visibility = useShadowMask && spotLights[i].maskChannel >= 0 ?
+           MaskVisibility(mask0, mask1, spotLights[i].maskChannel) : CalcSpotLightShadow(FragPos, spotLights[i]);
        result += CalcSpotLight(spotLights[i]) * visibility;
     }
     
     
     FragColor = vec4( result ,1.0);
    // FragColor =  vec4(DebugShadowVisualizationDIR(),1.0);
-    
+#endif
 
 
 }
@@ -271,6 +356,9 @@ vec2 poissonDisk[16] = vec2[](
 
 float CalcPointLightShadow(vec3 fragPos, PointLight light) 
 {
+    if (light.shadowType == 1)
+        return CalcPointLightShadowParaboloid(fragPos, light);
+
     vec3 lightToFrag = fragPos - light.position;
     
     // 1. Current depth from light's perspective, normalized to [0, 1]
@@ -280,8 +368,18 @@ float CalcPointLightShadow(vec3 fragPos, PointLight light)
     vec3 lightDir = normalize(lightToFrag);
     float bias = max(0.01 * (1.0 - dot(Normal, lightDir)), 0.001);
     
-    // 3. Sample with hardware shadow comparison - NOW RETURNS 0.0 (shadow) or 1.0 (lit)
-    float shadowResult = texture(shadowCubeArray, vec4(lightToFrag, light.shadowID), currentDepth - bias);
+    // the light did not fit in the atlas
+    if (light.shadowTile.y <= 0.0)
+        return 1.0;
+
+    if (pointShadowFilter == 1)
+    {
+        int face;
+        vec2 uv = CubeFaceUV(lightToFrag, face);
+        // a 90 degree face maps a world step s at distance r to about 0.5 * s / r in uv
+        float footprint = 0.5 * max(length(dPdx), length(dPdy)) / length(lightToFrag);
+        return SampleAtlasMoments(light.shadowTile, face, uv, footprint, currentDepth - bias * 0.1);
+    }
     
     // This determines how wide we spread our samples.
     float viewDistance = length(viewPos - fragPos);
@@ -294,8 +392,10 @@ float CalcPointLightShadow(vec3 fragPos, PointLight light)
     
     for(int i = 0; i < samples; ++i)
     {
-        // Sample with hardware shadow comparison at offset positions
-        float pcfResult = texture(shadowCubeArray, vec4(lightToFrag + gridSamplingDisk[i] * diskRadius, light.shadowID), currentDepth - bias);
+        // every sample select its own face, the kernel can cross the edge of a face
+        int face;
+        vec2 uv = CubeFaceUV(lightToFrag + gridSamplingDisk[i] * diskRadius, face);
+        float pcfResult = SampleAtlas(AtlasTileRect(light.shadowTile, face), uv, currentDepth - bias);
         shadow += pcfResult; // Add the lit contribution (1.0 = lit, 0.0 = shadow)
     }
     
@@ -306,10 +406,60 @@ float CalcPointLightShadow(vec3 fragPos, PointLight light)
     return  shadow;
 }
 
+// same projection of shadowMapParaboloid.vert, 3x3 PCF on top of the hardware 2x2 (9 fetch against the 20 of the cube)
+float CalcPointLightShadowParaboloid(vec3 fragPos, PointLight light)
+{
+    vec3 lightToFrag = fragPos - light.position;
+    float currentDepth = length(lightToFrag) / light.far_plane;
+
+    vec3 lightDir = normalize(lightToFrag);
+    float bias = max(0.01 * (1.0 - dot(Normal, lightDir)), 0.001);
+
+    float hemisphere = lightDir.z >= 0.0 ? 1.0 : -1.0;
+    vec3 n = vec3(lightDir.x * hemisphere, lightDir.y, lightDir.z * hemisphere);
+    vec2 uv = vec2(-n.x, n.y) / (1.0 + n.z) * 0.5 + 0.5;
+    if (light.shadowTile.y <= 0.0)
+        return 1.0;
+    if (pointShadowFilter == 1)
+    {
+        // the paraboloid is at most as dense as a cube face (0.25 at the center, 0.5 on the rim)
+        float footprint = 0.5 * max(length(dPdx), length(dPdy)) / length(lightToFrag);
+        return SampleAtlasMoments(light.shadowTile, hemisphere > 0.0 ? 0 : 1, uv, footprint, currentDepth - bias * 0.1);
+    }
+    vec4 tileRect = AtlasTileRect(light.shadowTile, hemisphere > 0.0 ? 0 : 1);
+
+    vec2 texelSize = 1.0 / (light.shadowTile.y * vec2(textureSize(shadowAtlas, 0).xy));
+    float shadow = 0.0;
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            shadow += SampleAtlas(tileRect, uv + vec2(x, y) * texelSize, currentDepth - bias);
+        }
+    }
+    return shadow / 9.0;
+}
+
+// first cascade that reaches the view depth of the fragment, -1 beyond the shadow distance
+int SelectCascade(vec3 fragPos)
+{
+    float viewDepth = dot(fragPos - viewPos, cameraForward);
+    for (int i = 0; i < cascadeCount && i < MAX_CASCADES; ++i)
+    {
+        if (viewDepth <= cascadeSplits[i])
+            return i;
+    }
+    return -1;
+}
+
 float CalcDirLightShadow(vec3 fragPos, DirLight light)
 {
+    int cascade = SelectCascade(fragPos);
+    if (cascade < 0)
+        return 1.0;
+
     // Transform fragment position to light space
-    vec4 fragPosLightSpace = dirLightSpaceMatrice * vec4(fragPos, 1.0);
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
     
     // Perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
@@ -328,13 +478,20 @@ float CalcDirLightShadow(vec3 fragPos, DirLight light)
     if(projCoords.z > 1.0)
         return  1.0;
 
-    // PCF - Percentage-Closer Filtering
+    if (dirShadowFilter == 1)
+    {
+        mat4 m = cascadeMatrices[cascade];
+        float footprint = 0.5 * max(length((m * vec4(dPdx, 0.0)).xy), length((m * vec4(dPdy, 0.0)).xy));
+        float lod = MomentLod(footprint, float(textureSize(cascadeMoments, 0).x));
+        return EvsmVisibility(textureLod(cascadeMoments, vec3(projCoords.xy, float(cascade)), lod), currentDepth);
+    }
+
+    // PCF - Percentage-Closer Filtering, the hardware compare adds a 2x2 bilinear filter to every tap
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowDir, 0).xy;
-    
-    float viewDistance = length(viewPos - fragPos);
+    vec2 texelSize = 1.0 / textureSize(shadowCascades, 0).xy;
     
-    float radius = 0.5 + 2.0 * (1.0 - exp(-viewDistance * 0.3 ));
+    // the cascades already grow the texels with the distance, a fixed kernel is enough
+    float radius = 1.5;
 
     for(int i = 0; i < 16; i++)
     {
@@ -342,16 +499,11 @@ float CalcDirLightShadow(vec3 fragPos, DirLight light)
         float r = sqrt(float(i) + 0.5) / 4.0; // V  tribution
     
         vec2 offset = vec2(cos(angle), sin(angle)) * r * radius * texelSize;
-        float pcfDepth = texture(shadowDir, projCoords.xy + offset).r;
-    
-        if(currentDepth - bias > pcfDepth)
-            shadow += 1.0;
+        shadow += texture(shadowCascades, vec4(projCoords.xy + offset, float(cascade), currentDepth - bias));
     }
     shadow /= 16.0;
     
-    
-        
-    return 1.0 - shadow;
+    return shadow;
 }
 
 
@@ -369,24 +521,33 @@ float CalcSpotLightShadow(vec3 fragPos, SpotLight light)
     // 4. Get depth to compare
     float currentDepth = projCoords.z;
 
-    // 5. If outside the light's frustum, skip shadow
-    if (projCoords.z > 1.0)
+    // 5. If outside the light's frustum or without a tile in the atlas, skip shadow
+    if (projCoords.z > 1.0 || light.shadowTile.y <= 0.0)
         return 1.0;
 
     // 6. Compute bias (tune this!)
     vec3 lightDir = normalize(light.position - fragPos);
     float bias = max(0.005 * (1.0 - dot(Normal, lightDir)), 0.001);
 
+    if (spotShadowFilter == 1)
+    {
+        vec4 dx = light.SpaceMatrices * vec4(fragPos + dPdx, 1.0);
+        vec4 dy = light.SpaceMatrices * vec4(fragPos + dPdy, 1.0);
+        float footprint = max(length(dx.xy / dx.w * 0.5 + 0.5 - projCoords.xy), length(dy.xy / dy.w * 0.5 + 0.5 - projCoords.xy));
+        return SampleAtlasMoments(light.shadowTile, 0, projCoords.xy, footprint, currentDepth - bias * 0.1);
+    }
+
     // 7. PCF sampling using hardware comparison
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowSpotArray, 0).xy;
+    vec4 tileRect = AtlasTileRect(light.shadowTile, 0);
+    vec2 texelSize = 1.0 / (light.shadowTile.y * vec2(textureSize(shadowAtlas, 0).xy));
 
     for (int x = -1; x <= 1; ++x)
     {
         for (int y = -1; y <= 1; ++y)
         {
             vec2 offset = vec2(x, y) * texelSize;
-            shadow += texture(shadowSpotArray, vec4(projCoords.xy + offset, light.shadowID, currentDepth - bias));
+            shadow += SampleAtlas(tileRect, projCoords.xy + offset, currentDepth - bias);
             }
     }
 
@@ -395,6 +556,232 @@ float CalcSpotLightShadow(vec3 fragPos, SpotLight light)
     return shadow;
 }
 
+// inverse of the Morton interleave, same as CompactBits() in ShadowAtlas.cpp
+uint CompactBits(uint x)
+{
+    x &= 0x55555555u;
+    x = (x ^ (x >> 1)) & 0x33333333u;
+    x = (x ^ (x >> 2)) & 0x0f0f0f0fu;
+    x = (x ^ (x >> 4)) & 0x00ff00ffu;
+    x = (x ^ (x >> 8)) & 0x0000ffffu;
+    return x;
+}
+
+// (x, y, width, height) in atlas uv of the tile offset of a light, as ShadowAtlas::GetTileRect()
+vec4 AtlasTileRect(vec4 shadowTile, int offset)
+{
+    uint index = uint(shadowTile.x) + uint(offset);
+    vec2 cell = vec2(float(CompactBits(index)), float(CompactBits(index >> 1)));
+    return vec4(cell * shadowTile.y, shadowTile.yy);
+}
+
+// uv in [0, 1] inside the tile, clamped half a texel from the border so the bilinear compare never reads a neighbour tile
+float SampleAtlas(vec4 tileRect, vec2 uv, float depth)
+{
+    vec2 halfTexel = 0.5 / vec2(textureSize(shadowAtlas, 0).xy);
+    vec2 atlasUV = clamp(tileRect.xy + uv * tileRect.zw, tileRect.xy + halfTexel, tileRect.xy + tileRect.zw - halfTexel);
+    return texture(shadowAtlas, vec3(atlasUV, depth));
+}
+
+// Chebyshev upper bound of the probability that depth is lit, for one pair of moments
+float ChebyshevUpperBound(vec2 moments, float depth, float minVariance)
+{
+    if (depth <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    return variance / (variance + d * d);
+}
+
+// exponential variance shadow test, same warp of shadow_moments.comp
+float EvsmVisibility(vec4 moments, float depth)
+{
+    depth = depth * 2.0 - 1.0;
+    float pos = exp(evsmExponents.x * depth);
+    float neg = -exp(-evsmExponents.y * depth);
+
+    // the minimum variance is scaled in the warped space of each moment
+    float posVariance = 0.0001 * evsmExponents.x * pos;
+    float negVariance = 0.0001 * evsmExponents.y * neg;
+    float visibility = min(ChebyshevUpperBound(moments.xy, pos, posVariance * posVariance),
+                           ChebyshevUpperBound(moments.zw, neg, negVariance * negVariance));
+
+    // cut the tail of the bound to reduce the light bleeding
+    const float bleedReduction = 0.2;
+    return clamp((visibility - bleedReduction) / (1.0 - bleedReduction), 0.0, 1.0);
+}
+
+// mip level where a texel covers footprint (in uv of a map of the given texels)
+float MomentLod(float footprint, float texels)
+{
+    return max(log2(max(footprint * texels, 1e-6)), 0.0);
+}
+
+// one trilinear tap in a tile of the atlas moments, footprint is the pixel size in uv of the tile,
+// the mip level stops before the tile shrinks to one texel and the uv keeps half a texel of that
+// level from the border so no other light is read
+float SampleAtlasMoments(vec4 shadowTile, int offset, vec2 uv, float footprint, float depth)
+{
+    vec4 tileRect = AtlasTileRect(shadowTile, offset);
+    vec2 atlasSize = vec2(textureSize(atlasMoments, 0).xy);
+    float tileTexels = shadowTile.y * atlasSize.x;
+    float lod = min(MomentLod(footprint, tileTexels), max(log2(tileTexels) - 1.0, 0.0));
+
+    vec2 atlasUV = tileRect.xy + clamp(uv, 0.0, 1.0) * tileRect.zw;
+    vec2 halfTexel = 0.5 * exp2(lod) / atlasSize;
+    atlasUV = clamp(atlasUV, tileRect.xy + halfTexel, tileRect.xy + tileRect.zw - halfTexel);
+
+    return EvsmVisibility(textureLod(atlasMoments, vec3(atlasUV, 0.0), lod), depth);
+}
+
+// face (+X, -X, +Y, -Y, +Z, -Z) and uv of the projection of PointShadowFaceMatrices() that sees dir
+vec2 CubeFaceUV(vec3 dir, out int face)
+{
+    vec3 a = abs(dir);
+    vec3 forward;
+    vec3 up;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = dir.x > 0.0 ? 0 : 1;
+        forward = vec3(sign(dir.x), 0.0, 0.0);
+        up = vec3(0.0, -1.0, 0.0);
+    }
+    else if (a.y >= a.z) {
+        face = dir.y > 0.0 ? 2 : 3;
+        forward = vec3(0.0, sign(dir.y), 0.0);
+        up = vec3(0.0, 0.0, sign(dir.y));
+    }
+    else {
+        face = dir.z > 0.0 ? 4 : 5;
+        forward = vec3(0.0, 0.0, sign(dir.z));
+        up = vec3(0.0, -1.0, 0.0);
+    }
+    // camera basis of glm::lookAt, the 90 degree perspective divide by the distance along forward
+    vec3 s = normalize(cross(forward, up));
+    vec3 u = cross(s, forward);
+    float z = dot(forward, dir);
+    return vec2(dot(s, dir), dot(u, dir)) / z * 0.5 + 0.5;
+}
+
+#ifdef SHADOW_MASK_PASS
+void WriteShadowMask()
+{
+    float visibility[MAX_MASKED_LIGHTS + 1];
+    visibility[0] = CalcDirLightShadow(FragPos, dirLight);
+    for (int k = 0; k < MAX_MASKED_LIGHTS; ++k)
+    {
+        visibility[k + 1] = 1.0;
+        if (k >= numMaskedLights)
+            continue;
+
+        int index = maskedLightIndex[k];
+        if (maskedLightType[k] == 0)
+        {
+            if (length(pointLights[index].position - FragPos) <= pointLights[index].far_plane)
+                visibility[k + 1] = CalcPointLightShadow(FragPos, pointLights[index]);
+        }
+        else
+            visibility[k + 1] = CalcSpotLightShadow(FragPos, spotLights[index]);
+    }
+    MaskSunLights = vec4(visibility[0], visibility[1], visibility[2], visibility[3]);
+    MaskLights = vec4(visibility[4], visibility[5], visibility[6], visibility[7]);
+}
+#else
+// Joint bilateral upsample: the 4 mask texels around the pixel are weighted by their bilinear weight,
+// by how much their normal agrees and by their distance from the plane of the pixel, so the shadow
+// of a foreground object does not bleed on the background behind it
+void UpsampleShadowMask(out vec4 mask0, out vec4 mask1)
+{
+    ivec2 maskSize = (renderSize + 1) / 2;
+    // the mask texel m was computed at the full resolution texel 2m, i.e. at m + 0.25 in mask texels
+    vec2 coord = gl_FragCoord.xy * 0.5 - 0.25;
+    ivec2 base = ivec2(floor(coord));
+    vec2 f = coord - vec2(base);
+    float planeTolerance = 0.01 * length(viewPos - FragPos);
+
+    mask0 = vec4(0.0);
+    mask1 = vec4(0.0);
+    float totalWeight = 0.0;
+    ivec2 nearest = clamp(base + ivec2(round(f)), ivec2(0), maskSize - 1);
+    float nearestDistance = 1e20;
+    for (int k = 0; k < 4; ++k)
+    {
+        ivec2 offset = ivec2(k & 1, k >> 1);
+        ivec2 m = clamp(base + offset, ivec2(0), maskSize - 1);
+        vec3 samplePos = ReadPosition(m * 2);
+        vec3 sampleNormal = ReadNormalShininess(m * 2).rgb;
+        if (length(sampleNormal) < 0.1)
+            continue;
+
+        float planeDistance = abs(dot(Normal, samplePos - FragPos));
+        if (planeDistance < nearestDistance) {
+            nearestDistance = planeDistance;
+            nearest = m;
+        }
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y
+            * pow(max(dot(Normal, sampleNormal), 0.0), 8.0)
+            * exp(-planeDistance / planeTolerance);
+        mask0 += texelFetch(shadowMask0, m, 0) * weight;
+        mask1 += texelFetch(shadowMask1, m, 0) * weight;
+        totalWeight += weight;
+    }
+
+    if (totalWeight < 1e-4) {
+        // no neighbour lies on this surface (thin geometry): the closest one is the best guess
+        mask0 = texelFetch(shadowMask0, nearest, 0);
+        mask1 = texelFetch(shadowMask1, nearest, 0);
+        return;
+    }
+    mask0 /= totalWeight;
+    mask1 /= totalWeight;
+}
+
+float MaskVisibility(vec4 mask0, vec4 mask1, int maskChannel)
+{
+    int channel = maskChannel + 1; // channel 0 is the sun
+    return channel < 4 ? mask0[channel] : mask1[channel - 4];
+}
+#endif
+
+#ifdef GBUFFER_COMPACT
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    // the lower hemisphere was folded over the diagonals
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
+
+vec3 ReadPosition(ivec2 texel)
+{
+#ifdef GBUFFER_COMPACT
+    float d = texelFetch(gDepth, texel, 0).r;
+    vec2 ndc = (vec2(texel) + 0.5) / vec2(renderSize) * 2.0 - 1.0;
+    vec4 world = invViewProjection * vec4(ndc, d * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+#else
+    return texelFetch(gPosition, texel, 0).rgb;
+#endif
+}
+
+// normal in rgb, shininess in a, all zero where no geometry was rendered
+vec4 ReadNormalShininess(ivec2 texel)
+{
+#ifdef GBUFFER_COMPACT
+    // every octahedral code is a valid normal, the cleared pixels are found from the depth
+    if (texelFetch(gDepth, texel, 0).r >= 1.0)
+        return vec4(0.0);
+    vec3 normal = DecodeOctahedral(texelFetch(gNormalShininess, texel, 0).rg);
+    return vec4(normal, exp2(texelFetch(gShininess, texel, 0).r * 11.0));
+#else
+    return texelFetch(gNormalShininess, texel, 0);
+#endif
+}
+
 vec3 ReinhardToneMapping(vec3 color)
 {
         // Add an exposure control
@@ -428,7 +815,9 @@ vec3 DebugShadowVisualizationPOINT()
     float currentDepth = length(lightToFrag) / light.far_plane;
     
     // The depth stored in the shadow map (closest occluder), already normalized
-    float closestDepth =  texture(shadowCubeArray, vec4(gridSamplingDisk[0] , light.shadowID), currentDepth );
+    int face;
+    vec2 uv = CubeFaceUV(lightToFrag, face);
+    float closestDepth = SampleAtlas(AtlasTileRect(light.shadowTile, face), uv, currentDepth);
 
 
     // --- DEBUG MODES ---
@@ -470,26 +859,26 @@ vec3 DebugShadowVisualizationDIR()
     // Use the first point light for debugging
     DirLight light = dirLight;
     
-    vec3 lightToFrag = FragPos - light.position;
-    
-    // The fragment's distance from the light, normalized to [0, 1]
-    vec4 fragPosLightSpace = dirLightSpaceMatrice * vec4(FragPos, 1.0);
+    // the cascade that shades the fragment, black beyond the shadow distance
+    int cascade = SelectCascade(FragPos);
+    if (cascade < 0)
+        return vec3(0.0);
+
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(FragPos, 1.0);
     
     // Perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
 
-    // The depth stored in the shadow map (closest occluder), already normalized
-    float closestDepth = texture(shadowDir,projCoords.xy).r;
+    // lit (1) or shadowed (0) without PCF
+    float closestDepth = texture(shadowCascades, vec4(projCoords.xy, float(cascade), projCoords.z));
 
 
     // --- DEBUG MODES ---
 
-    // 1. Visualize the Shadow Map itself.
-    // This is the MOST IMPORTANT test. You should see a grayscale representation of your
-    // scene from the light's point of view. If this is all white or all black,
-    // your depth map generation pass is broken.
-    return vec3(closestDepth);
+    // 1. Visualize the cascades: red, green, blue, yellow, darker in the shadow.
+    vec3 cascadeColors[MAX_CASCADES] = vec3[](vec3(1.0, 0.2, 0.2), vec3(0.2, 1.0, 0.2), vec3(0.2, 0.2, 1.0), vec3(1.0, 1.0, 0.2));
+    return cascadeColors[cascade] * (0.3 + 0.7 * closestDepth);
 
     // 2. Visualize the fragment's calculated depth from the light.
     // This should look like a smooth gradient centered on the light.
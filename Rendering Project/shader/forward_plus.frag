@@ -0,0 +1,254 @@
+// Forward shading of the ForwardPlusRenderer: the material of Geometry_pass.frag and the lights of
+// Lighting_pass_test.frag, but only the lights that the culling pass kept for the tile of the fragment.
+// The sun and spot shadows are the PCF of Lighting_pass_test.frag
+#version 430 core
+#define TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 255 // keep in sync with forward_plus_cull.comp
+
+in vec2 TexCoord;
+in vec3 Normal;
+in vec3 FragPos;
+in mat3 TBN;
+
+out vec4 FragColor;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    sampler2D normal;
+    sampler2D alpha;
+    vec3 diffuseColor;
+    vec3 ambientColor;
+    vec3 specularColor;
+    float shininess;
+};
+
+uniform Material material;
+uniform bool hasDiffuseTexture;
+uniform bool hasSpecularTexture;
+uniform bool hasNormalTexture;
+uniform bool hasAlphaTexture;
+
+struct Light {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct DirLight {
+    vec3 position;
+    vec3 direction;
+    Light light;
+};
+
+// same layout of forward_plus_cull.comp
+struct ForwardLight {
+    vec4 positionType;      // xyz world position, w 0 = point / 1 = spot
+    vec4 directionCutOff;   // xyz spot direction, w cos of the inner cone
+    vec4 ambientOuterCutOff;// xyz ambient, w cos of the outer cone
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation;       // constant, linear, quadratic, range (the light is cut past it)
+    vec4 boundingSphere;
+    mat4 shadowMatrix;      // spot lights: projection * view of the light
+    vec4 shadowTile;        // x = first tile, y = tile size / atlas size (0 = no tile), see ShadowAtlas.h
+};
+
+layout (std430, binding = 0) readonly buffer Lights {
+    ForwardLight lights[];
+};
+layout (std430, binding = 1) readonly buffer TileLights {
+    uint tileLights[];
+};
+
+uniform DirLight dirLight;
+uniform vec3 viewPos;
+uniform int tilesX;
+
+uniform sampler2DArrayShadow shadowCascades; // one layer per cascade
+uniform sampler2DShadow shadowAtlas;         // one tile per spot light
+
+// Cascades of the directional light, see ShadowCascades.h
+#define MAX_CASCADES 4
+uniform int cascadeCount;
+uniform mat4 cascadeMatrices[MAX_CASCADES];
+uniform float cascadeSplits[MAX_CASCADES]; // view depth where every cascade ends
+uniform vec3 cameraForward;
+
+// Global variables
+vec3 FragNormal;
+vec3 viewDir;
+vec3 diffuseColor;
+float specularIntensity;
+float shininess;
+
+vec3 CalcDirLight(DirLight light);
+vec3 CalcLight(ForwardLight light);
+float CalcDirLightShadow(vec3 fragPos, DirLight light);
+float CalcSpotLightShadow(vec3 fragPos, ForwardLight light);
+
+void main()
+{
+    if (hasAlphaTexture && texture(material.alpha, TexCoord).r < 0.1)
+        discard;
+
+    if (hasNormalTexture) {
+        vec3 normalMap = texture(material.normal, TexCoord).rgb * 2.0 - 1.0;
+        FragNormal = normalize(TBN * normalMap);
+    } else {
+        FragNormal = normalize(Normal);
+    }
+
+    diffuseColor = hasDiffuseTexture ? texture(material.diffuse, TexCoord).rgb : material.diffuseColor;
+    if (hasSpecularTexture)
+        specularIntensity = texture(material.specular, TexCoord).r;
+    else
+        specularIntensity = (material.specularColor.r + material.specularColor.g + material.specularColor.b) / 3.0;
+    shininess = material.shininess;
+
+    viewDir = normalize(viewPos - FragPos);
+
+    vec3 result = CalcDirLight(dirLight) * CalcDirLightShadow(FragPos, dirLight);
+
+    ivec2 tile = ivec2(gl_FragCoord.xy) / TILE_SIZE;
+    uint base = uint(tile.y * tilesX + tile.x) * uint(MAX_LIGHTS_PER_TILE + 1);
+    uint count = tileLights[base];
+    for (uint k = 0u; k < count; ++k)
+    {
+        ForwardLight light = lights[tileLights[base + 1u + k]];
+        float visibility = light.positionType.w > 0.5 ? CalcSpotLightShadow(FragPos, light) : 1.0;
+        result += CalcLight(light) * visibility;
+    }
+
+    FragColor = vec4(result, 1.0);
+}
+
+// Calculates the color when using a directional light
+vec3 CalcDirLight(DirLight light)
+{
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(FragNormal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, FragNormal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    vec3 ambient = light.light.ambient * diffuseColor;
+    vec3 diffuse = light.light.diffuse * diff * diffuseColor;
+    vec3 specular = light.light.specular * spec * specularIntensity;
+    return (ambient + diffuse + specular);
+}
+
+// CalcPointLight and CalcSpotLight of the lighting pass, the spot cone is 1 for the point lights
+vec3 CalcLight(ForwardLight light)
+{
+    vec3 toLight = light.positionType.xyz - FragPos;
+    float distance = length(toLight);
+    if (distance > light.attenuation.w)
+        return vec3(0.0);
+    vec3 lightDir = toLight / max(distance, 1e-5);
+
+    float diff = max(dot(FragNormal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, FragNormal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * (distance * distance));
+    if (light.positionType.w > 0.5)
+    {
+        float theta = dot(lightDir, normalize(-light.directionCutOff.xyz));
+        float epsilon = light.directionCutOff.w - light.ambientOuterCutOff.w;
+        attenuation *= clamp((theta - light.ambientOuterCutOff.w) / epsilon, 0.0, 1.0);
+    }
+
+    vec3 ambient = light.ambientOuterCutOff.xyz * diffuseColor;
+    vec3 diffuse = light.diffuse.xyz * diff * diffuseColor;
+    vec3 specular = light.specular.xyz * spec * specularIntensity;
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+// first cascade that reaches the view depth of the fragment, -1 beyond the shadow distance
+int SelectCascade(vec3 fragPos)
+{
+    float viewDepth = dot(fragPos - viewPos, cameraForward);
+    for (int i = 0; i < cascadeCount && i < MAX_CASCADES; ++i)
+    {
+        if (viewDepth <= cascadeSplits[i])
+            return i;
+    }
+    return -1;
+}
+
+float CalcDirLightShadow(vec3 fragPos, DirLight light)
+{
+    int cascade = SelectCascade(fragPos);
+    if (cascade < 0)
+        return 1.0;
+
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
+    if (projCoords.z > 1.0)
+        return 1.0;
+
+    vec3 lightDir = normalize(-light.direction);
+    float bias = max(0.001 * (1.0 - dot(FragNormal, lightDir)), 0.001);
+
+    // 16 taps on a golden angle spiral, the hardware compare adds a 2x2 bilinear filter to every tap
+    float shadow = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadowCascades, 0).xy;
+    float radius = 1.5;
+    for (int i = 0; i < 16; i++)
+    {
+        float angle = 2.399963 * float(i);
+        float r = sqrt(float(i) + 0.5) / 4.0;
+        vec2 offset = vec2(cos(angle), sin(angle)) * r * radius * texelSize;
+        shadow += texture(shadowCascades, vec4(projCoords.xy + offset, float(cascade), projCoords.z - bias));
+    }
+    return shadow / 16.0;
+}
+
+// inverse of the Morton interleave, same as CompactBits() in ShadowAtlas.cpp
+uint CompactBits(uint x)
+{
+    x &= 0x55555555u;
+    x = (x ^ (x >> 1)) & 0x33333333u;
+    x = (x ^ (x >> 2)) & 0x0f0f0f0fu;
+    x = (x ^ (x >> 4)) & 0x00ff00ffu;
+    x = (x ^ (x >> 8)) & 0x0000ffffu;
+    return x;
+}
+
+// uv of the tile in the atlas, x, y, width, height
+vec4 AtlasTileRect(vec4 shadowTile)
+{
+    uint index = uint(shadowTile.x);
+    vec2 cell = vec2(float(CompactBits(index)), float(CompactBits(index >> 1)));
+    return vec4(cell * shadowTile.y, shadowTile.yy);
+}
+
+// clamped half a texel from the border so the bilinear compare never reads a neighbour tile
+float SampleAtlas(vec4 tileRect, vec2 uv, float depth)
+{
+    vec2 halfTexel = 0.5 / vec2(textureSize(shadowAtlas, 0).xy);
+    vec2 atlasUV = clamp(tileRect.xy + uv * tileRect.zw, tileRect.xy + halfTexel, tileRect.xy + tileRect.zw - halfTexel);
+    return texture(shadowAtlas, vec3(atlasUV, depth));
+}
+
+float CalcSpotLightShadow(vec3 fragPos, ForwardLight light)
+{
+    vec4 fragPosLightSpace = light.shadowMatrix * vec4(fragPos, 1.0);
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
+    if (projCoords.z > 1.0 || light.shadowTile.y <= 0.0)
+        return 1.0;
+
+    vec3 lightDir = normalize(light.positionType.xyz - fragPos);
+    float bias = max(0.005 * (1.0 - dot(FragNormal, lightDir)), 0.001);
+
+    // 3x3 PCF
+    float shadow = 0.0;
+    vec4 tileRect = AtlasTileRect(light.shadowTile);
+    vec2 texelSize = 1.0 / (light.shadowTile.y * vec2(textureSize(shadowAtlas, 0).xy));
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+            shadow += SampleAtlas(tileRect, projCoords.xy + vec2(x, y) * texelSize, projCoords.z - bias);
+    }
+    return shadow / 9.0;
+}
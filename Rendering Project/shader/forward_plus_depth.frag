@@ -0,0 +1,17 @@
+// Depth pre-pass of the ForwardPlusRenderer, only the alpha test of Geometry_pass.frag
+#version 330 core
+
+in vec2 TexCoord;
+
+struct Material {
+    sampler2D alpha;
+};
+
+uniform Material material;
+uniform bool hasAlphaTexture;
+
+void main()
+{
+    if (hasAlphaTexture && texture(material.alpha, TexCoord).r < 0.1)
+        discard;
+}
@@ -5,6 +5,9 @@ out vec4 FragColor;
 
 uniform sampler2D screenTexture;
 uniform vec2 rcpFrame; // Reciprocal of the frame size: (1.0/width, 1.0/height)
+// dynamic resolution: the scene fills only the bottom left part of the texture
+uniform vec2 uvScale;  // render size / texture size
+uniform vec2 uvMax;    // center of the last rendered texel, the texels past it are stale
 
 // FXAA Quality Settings
 #define FXAA_QUALITY_PRESET 12
@@ -16,6 +19,10 @@ uniform vec2 rcpFrame; // Reciprocal of the frame size: (1.0/width, 1.0/height)
 #define FXAA_SUBPIX_TRIM_SCALE   (1.0 - FXAA_SUBPIX_TRIM)
 #define FXAA_SUBPIX_CAP          (3.0/4.0)      // NVIDA FXAA_WhitePaper default ammount
 
+vec4 FxaaTexture(sampler2D tex, vec2 pos) {
+    return texture(tex, min(pos, uvMax));
+}
+
 float FxaaLuma(vec3 rgb) {
     return rgb.y * (0.587/0.299) + rgb.x;
 }
@@ -23,11 +30,11 @@ float FxaaLuma(vec3 rgb) {
 vec3 FxaaPixelShader(vec2 pos, sampler2D tex, vec2 rcpFrame) {
 
     // compute the neighbors pixel
-    vec3 rgbN = texture(tex, pos + vec2(0.0, -rcpFrame.y)).rgb;
-    vec3 rgbW = texture(tex, pos + vec2(-rcpFrame.x, 0.0)).rgb;
-    vec3 rgbE = texture(tex, pos + vec2(rcpFrame.x, 0.0)).rgb;
-    vec3 rgbS = texture(tex, pos + vec2(0.0, rcpFrame.y)).rgb;
-    vec3 rgbM = texture(tex, pos).rgb;
+    vec3 rgbN = FxaaTexture(tex, pos + vec2(0.0, -rcpFrame.y)).rgb;
+    vec3 rgbW = FxaaTexture(tex, pos + vec2(-rcpFrame.x, 0.0)).rgb;
+    vec3 rgbE = FxaaTexture(tex, pos + vec2(rcpFrame.x, 0.0)).rgb;
+    vec3 rgbS = FxaaTexture(tex, pos + vec2(0.0, rcpFrame.y)).rgb;
+    vec3 rgbM = FxaaTexture(tex, pos).rgb;
 
     // compute the luminance of the pixel
     float lumaN = FxaaLuma(rgbN);
@@ -45,10 +52,10 @@ vec3 FxaaPixelShader(vec2 pos, sampler2D tex, vec2 rcpFrame) {
     if(range < max(FXAA_EDGE_THRESHOLD_MIN, rangeMax * FXAA_EDGE_THRESHOLD))  return rgbM;
 
     // Diagonal samples
-    vec3 rgbNW = texture(tex, pos + vec2(-rcpFrame.x, -rcpFrame.y)).rgb;
-    vec3 rgbNE = texture(tex, pos + vec2(rcpFrame.x, -rcpFrame.y)).rgb;
-    vec3 rgbSW = texture(tex, pos + vec2(-rcpFrame.x, rcpFrame.y)).rgb;
-    vec3 rgbSE = texture(tex, pos + vec2(rcpFrame.x, rcpFrame.y)).rgb;
+    vec3 rgbNW = FxaaTexture(tex, pos + vec2(-rcpFrame.x, -rcpFrame.y)).rgb;
+    vec3 rgbNE = FxaaTexture(tex, pos + vec2(rcpFrame.x, -rcpFrame.y)).rgb;
+    vec3 rgbSW = FxaaTexture(tex, pos + vec2(-rcpFrame.x, rcpFrame.y)).rgb;
+    vec3 rgbSE = FxaaTexture(tex, pos + vec2(rcpFrame.x, rcpFrame.y)).rgb;
     
     // compute the avarege color of the square around at the pixel
     vec3 rgbL = (rgbNW + rgbNE + rgbSW + rgbSE + rgbN + rgbW + rgbM + rgbE + rgbS);
@@ -118,10 +125,10 @@ vec3 FxaaPixelShader(vec2 pos, sampler2D tex, vec2 rcpFrame) {
     for(int i = 0; i < FXAA_SEARCH_STEPS; i++) {
         // If the search in a direction isn't done, sample the luminance at the current position
         if(!doneN) {
-            lumaEndN = FxaaLuma(texture(tex, posN).rgb);
+            lumaEndN = FxaaLuma(FxaaTexture(tex, posN).rgb);
         }
         if(!doneP) {
-            lumaEndP = FxaaLuma(texture(tex, posP).rgb);
+            lumaEndP = FxaaLuma(FxaaTexture(tex, posP).rgb);
         }
         // If the luminance difference exceeds gradientN, the edge endpoint is found
         doneN = doneN || (abs(lumaEndN - lumaN) >= gradientN);
@@ -153,7 +160,7 @@ vec3 FxaaPixelShader(vec2 pos, sampler2D tex, vec2 rcpFrame) {
     float subPixelOffset = (0.5 + (dstN * (-1.0/spanLength))) * lengthSign;
     
     // Fech the color for the blending aka far rgb 
-    vec3 rgbF = texture(tex, vec2(
+    vec3 rgbF = FxaaTexture(tex, vec2(
         pos.x + (horzSpan ? 0.0 : subPixelOffset),
         pos.y + (horzSpan ? subPixelOffset : 0.0))).rgb;
 
@@ -167,6 +174,7 @@ vec3 FxaaPixelShader(vec2 pos, sampler2D tex, vec2 rcpFrame) {
 }
 
 void main() {
-    vec3 color = FxaaPixelShader(TexCoord, screenTexture, rcpFrame);
+    // the upscale to the window size is the bilinear filter of the texture
+    vec3 color = FxaaPixelShader(TexCoord * uvScale, screenTexture, rcpFrame);
     FragColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 6) in mat4 instanceModel;
+
+uniform vec3 lightPos;
+uniform float far_plane;
+uniform float hemisphere; // 1 = front (+Z), -1 = back (-Z)
+
+out vec4 FragPos; // world position, used by shadowMapPoint.frag for the linear depth
+
+// the back hemisphere is the front one rotated by 180 degree around Y (keep the winding of the triangles),
+// x is flipped to look along +Z like a normal camera looks along -Z
+vec4 ParaboloidProject(vec3 worldPos)
+{
+    vec3 d = worldPos - lightPos;
+    d = vec3(d.x * hemisphere, d.y, d.z * hemisphere);
+    float dist = length(d);
+    vec3 n = d / max(dist, 0.0001);
+
+    // drop what is behind the hemisphere (a small margin avoid holes on the seam)
+    gl_ClipDistance[0] = n.z + 0.1;
+    return vec4(vec2(-n.x, n.y) / (1.0 + n.z), dist / far_plane * 2.0 - 1.0, 1.0);
+}
+
+void main()
+{
+    FragPos = instanceModel * vec4(aPos, 1.0);
+    gl_Position = ParaboloidProject(FragPos.xyz);
+}
@@ -0,0 +1,18 @@
+#version 430 core
+// single cube face version of shadowMapPoint_indirect, no geometry shader: the face is selected by the attached layer
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in uint aDrawID;
+
+// the slot of the instance and the models, filled by cull_draws.comp and IndirectDrawBuilder::Upload
+layout (std430, binding = 6) readonly buffer DrawInstances { uvec2 drawInstances[]; }; // x = model, y = command
+layout (std430, binding = 7) readonly buffer Models { mat4 models[]; };
+
+uniform mat4 faceMatrix;
+
+out vec4 FragPos; // world position, used by shadowMapPoint.frag for the linear depth
+
+void main()
+{
+    FragPos = models[drawInstances[aDrawID].x] * vec4(aPos, 1.0);
+    gl_Position = faceMatrix * FragPos;
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// single cube face version of shadowMapPoint, no geometry shader: the face is selected by the attached layer
+layout (location = 0) in vec3 aPos;
+layout (location = 6) in mat4 instanceModel;
+
+uniform mat4 faceMatrix;
+
+out vec4 FragPos; // world position, used by shadowMapPoint.frag for the linear depth
+
+void main()
+{
+    FragPos = instanceModel * vec4(aPos, 1.0);
+    gl_Position = faceMatrix * FragPos;
+}
@@ -0,0 +1,12 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in uint aDrawID;
+
+// the slot of the instance and the models, filled by cull_draws.comp and IndirectDrawBuilder::Upload
+layout (std430, binding = 6) readonly buffer DrawInstances { uvec2 drawInstances[]; }; // x = model, y = command
+layout (std430, binding = 7) readonly buffer Models { mat4 models[]; };
+
+void main()
+{
+    gl_Position = models[drawInstances[aDrawID].x] * vec4(aPos, 1.0);
+}
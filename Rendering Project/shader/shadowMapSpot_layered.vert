@@ -0,0 +1,20 @@
+#version 430 core
+#extension GL_ARB_shader_viewport_layer_array : require
+// every caster instance is drawn viewportCount times, once per spot light tile of the atlas
+#define MAX_LAYERED_SPOT_LIGHTS 16
+layout (location = 0) in vec3 aPos;
+
+layout (std430, binding = 5) readonly buffer InstanceMatrices { mat4 instanceModels[]; }; // INSTANCE_MATRIX_SSBO_BINDING
+
+uniform int firstInstance;
+uniform int viewportCount;
+uniform mat4 lightSpaceMatrices[MAX_LAYERED_SPOT_LIGHTS];
+
+void main()
+{
+    int caster = gl_InstanceID / viewportCount;
+    int tile = gl_InstanceID % viewportCount;
+
+    gl_ViewportIndex = tile;
+    gl_Position = lightSpaceMatrices[tile] * instanceModels[firstInstance + caster] * vec4(aPos, 1.0);
+}
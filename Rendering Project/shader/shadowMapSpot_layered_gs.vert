@@ -0,0 +1,17 @@
+#version 430 core
+// fallback of shadowMapSpot_layered.vert when gl_ViewportIndex can not be written by the vertex shader
+layout (location = 0) in vec3 aPos;
+
+layout (std430, binding = 5) readonly buffer InstanceMatrices { mat4 instanceModels[]; }; // INSTANCE_MATRIX_SSBO_BINDING
+
+uniform int firstInstance;
+uniform int viewportCount;
+
+flat out int vLayer;
+
+void main()
+{
+    int caster = gl_InstanceID / viewportCount;
+    vLayer = gl_InstanceID % viewportCount;
+    gl_Position = instanceModels[firstInstance + caster] * vec4(aPos, 1.0);
+}